@@ -63,6 +63,18 @@
  *
  * Only CLEAN and CLEAN2 blocks are eligible to be evicted from the cache. We evict entries
  * either when they timeout or the cache is full and we need to add a new entry to it.
+ *
+ * If a "hot file" is configured, we count accesses to each cached block and on shutdown
+ * save the most frequently accessed block numbers (and their counts) to that file. On the
+ * next startup, worker threads prefetch those blocks in the background, hottest first.
+ * This is done by at most a quarter of the worker threads, only when no read requests from
+ * the upper layer are pending, and only into free cache space (we never evict to warm up).
+ *
+ * If de-duplication is enabled (in-memory cache only), then whenever a block becomes CLEAN
+ * we look up its content in a second hashtable keyed by a fast content hash. If an identical
+ * buffer is already there, we free ours and share that one instead. Shared buffers are
+ * reference counted and are only ever referenced by CLEAN entries; before a shared block
+ * can be modified (moving to DIRTY), it gets its own private copy again.
  */
 
 /* Cache entry states */
@@ -102,12 +114,17 @@
  * to wrap after about two years; the effect would be mis-timed writes and evictions.
  *
  * In state CLEAN2 only, the MD5 to verify immediately follows the structure.
+ *
+ * In state CLEAN only, 'shared' may be set, in which case u.data points to a
+ * 'struct dedup_buf' instead of directly to the data.
  */
 struct cache_entry {
     s3b_block_t                     block_num;      // block number - MUST BE FIRST
     u_int                           dirty:1;        // indicates state DIRTY or WRITING2
     u_int                           verify:1;       // data should be verified first
     uint32_t                        timeout:30;     // when to evict (CLEAN[2]) or write (DIRTY)
+    u_int                           shared:1;       // u.data points to a shared dedup_buf
+    u_int                           hits:31;        // number of accesses by the upper layer
     TAILQ_ENTRY(cache_entry)        link;           // next in list (cleans or dirties)
     union {
         void                        *data;          // data buffer in memory
@@ -133,6 +150,30 @@ struct cache_entry {
 /* Special timeout value for entries in state READING and READING2 */
 #define READING_TIMEOUT             ((uint32_t)0x3fffffff)
 
+/* Hot file format */
+#define HOT_FILE_SIGNATURE          "s3backer-hot-blocks"
+#define HOT_FILE_VERSION            1
+
+/* With de-duplication, the cache can hold up to this many blocks per data buffer */
+#define DEDUP_ENTRY_FACTOR          4
+
+/* Increment an entry's access count without wrapping */
+#define MAX_HITS                    ((u_int)0x7fffffff)
+#define ENTRY_HIT(entry)            do { if ((entry)->hits != MAX_HITS) (entry)->hits++; } while (0)
+
+/* A data buffer shared by one or more CLEAN entries having identical content */
+struct dedup_buf {
+    s3b_block_t                     key;            // content hash - MUST BE FIRST
+    u_int                           refs;           // number of entries referencing this buffer
+    void                            *data;          // the shared data
+};
+
+/* One block in the hot list */
+struct hot_block {
+    s3b_block_t                     block_num;      // block number
+    u_int                           hits;           // access count as of last shutdown
+};
+
 /* Private data */
 struct block_cache_private {
     struct block_cache_conf         *config;        // configuration
@@ -142,6 +183,9 @@ struct block_cache_private {
     TAILQ_HEAD(, cache_entry)       dirties;        // list of dirty blocks (write order)
     struct s3b_hash                 *hashtable;     // hashtable of all cached blocks
     struct s3b_dcache               *dcache;        // on-disk persistent cache
+    struct s3b_hash                 *dedup;         // hashtable of shared data buffers (if dedup)
+    u_int                           num_shared;     // # of entries referencing a dedup_buf
+    u_int                           max_entries;    // max # of entries (more than cache_size if dedup)
     u_int                           num_cleans;     // length of the 'cleans' list
     u_int                           num_dirties;    // # blocks that are DIRTY, WRITING, or WRITING2
     u_int64_t                       start_time;     // when we started
@@ -151,6 +195,12 @@ struct block_cache_private {
     s3b_block_t                     seq_last;       // last block read in sequence by upper layer
     u_int                           seq_count;      // # of blocks read in sequence by upper layer
     u_int                           ra_count;       // # of blocks of read-ahead initiated
+    u_int                           demand_reads;   // # of reads in progress from upper layer
+    struct hot_block                *hot_list;      // hot blocks to prefetch (hottest first)
+    u_int                           hot_count;      // length of 'hot_list'
+    u_int                           hot_next;       // next 'hot_list' index to prefetch
+    u_int                           hot_active;     // # of hot block prefetches in progress
+    u_int                           max_hot_active; // limit on 'hot_active'
     u_int                           thread_id;      // next thread id
     u_int                           num_threads;    // number of alive worker threads
     int                             stopping;       // signals worker threads to exit
@@ -168,6 +218,12 @@ struct cbinfo {
     void                        *arg;
 };
 
+/* Hot block collection info */
+struct hot_collect {
+    struct hot_block            *list;
+    u_int                       count;
+};
+
 /* s3backer_store functions */
 static int block_cache_meta_data(struct s3backer_store *s3b, off_t *file_sizep, u_int *block_sizep);
 static int block_cache_set_mounted(struct s3backer_store *s3b, int *old_valuep, int new_value);
@@ -183,6 +239,17 @@ static void block_cache_destroy(struct s3backer_store *s3b);
 
 /* Other functions */
 static s3b_dcache_visit_t block_cache_dcache_load;
+static void block_cache_hot_load(struct block_cache_private *priv);
+static void block_cache_hot_save(struct block_cache_private *priv);
+static void block_cache_hot_collect(void *arg, void *value);
+static int block_cache_hot_cmp(const void *ptr1, const void *ptr2);
+static int block_cache_hot_prefetch(struct block_cache_private *priv);
+static void block_cache_dedup(struct block_cache_private *priv, struct cache_entry *entry);
+static int block_cache_unshare(struct block_cache_private *priv, struct cache_entry *entry);
+static void block_cache_dedup_release(struct block_cache_private *priv, struct cache_entry *entry);
+static s3b_block_t block_cache_content_hash(const void *data, u_int len);
+static u_int block_cache_num_buffers(struct block_cache_private *priv);
+static int block_cache_full(struct block_cache_private *priv);
 static int block_cache_read(struct block_cache_private *priv, s3b_block_t block_num, u_int off, u_int len, void *dest);
 static int block_cache_do_read(struct block_cache_private *priv, s3b_block_t block_num, u_int off, u_int len, void *dest, int stats);
 static int block_cache_write(struct block_cache_private *priv, s3b_block_t block_num, u_int off, u_int len, const void *src);
@@ -266,8 +333,11 @@ block_cache_create(struct block_cache_conf *config, struct s3backer_store *inner
         goto fail7;
     TAILQ_INIT(&priv->cleans);
     TAILQ_INIT(&priv->dirties);
-    if ((r = s3b_hash_create(&priv->hashtable, config->cache_size)) != 0)
+    priv->max_entries = config->dedup ? config->cache_size * DEDUP_ENTRY_FACTOR : config->cache_size;
+    if ((r = s3b_hash_create(&priv->hashtable, priv->max_entries)) != 0)
         goto fail8;
+    if (config->dedup && (r = s3b_hash_create(&priv->dedup, config->cache_size)) != 0)
+        goto fail9;
     s3b->data = priv;
 
     /* Compute dirty ratio at which we will be writing immediately */
@@ -279,10 +349,16 @@ block_cache_create(struct block_cache_conf *config, struct s3backer_store *inner
     if (config->cache_file != NULL) {
         if ((r = s3b_dcache_open(&priv->dcache, config->log, config->cache_file, config->block_size,
           config->cache_size, block_cache_dcache_load, priv)) != 0)
-            goto fail9;
+            goto fail10;
         priv->stats.initial_size = priv->num_cleans;
     }
 
+    /* Read in hot blocks from previous run; use at most a quarter of the worker threads to prefetch them */
+    if (config->hot_file != NULL) {
+        block_cache_hot_load(priv);
+        priv->max_hot_active = (config->num_threads + 3) / 4;
+    }
+
     /* Grab lock */
     pthread_mutex_lock(&priv->mutex);
     S3BCACHE_CHECK_INVARIANTS(priv);
@@ -290,14 +366,14 @@ block_cache_create(struct block_cache_conf *config, struct s3backer_store *inner
     /* Create threads */
     for (priv->num_threads = 0; priv->num_threads < config->num_threads; priv->num_threads++) {
         if ((r = pthread_create(&thread, NULL, block_cache_worker_main, priv)) != 0)
-            goto fail10;
+            goto fail11;
     }
 
     /* Done */
     pthread_mutex_unlock(&priv->mutex);
     return s3b;
 
-fail10:
+fail11:
     priv->stopping = 1;
     while (priv->num_threads > 0) {
         pthread_cond_broadcast(&priv->worker_work);
@@ -310,6 +386,10 @@ fail10:
         }
         s3b_dcache_close(priv->dcache);
     }
+    free(priv->hot_list);
+fail10:
+    if (config->dedup)
+        s3b_hash_destroy(priv->dedup);
 fail9:
     s3b_hash_destroy(priv->hashtable);
 fail8:
@@ -376,6 +456,192 @@ block_cache_dcache_load(void *arg, s3b_block_t dslot, s3b_block_t block_num, con
     return 0;
 }
 
+/*
+ * Read in the list of hot blocks saved by the previous run, if any.
+ *
+ * Problems with the hot file are not fatal; we just start with a cold cache.
+ */
+static void
+block_cache_hot_load(struct block_cache_private *priv)
+{
+    struct block_cache_conf *const config = priv->config;
+    uintmax_t block_num;
+    u_int max_blocks;
+    u_int block_size;
+    u_int version;
+    char line[128];
+    u_int hits;
+    FILE *fp;
+
+    /* Open file */
+    if ((fp = fopen(config->hot_file, "r")) == NULL) {
+        if (errno != ENOENT)
+            (*config->log)(LOG_ERR, "can't open hot file `%s': %s", config->hot_file, strerror(errno));
+        return;
+    }
+
+    /* Check header */
+    if (fgets(line, sizeof(line), fp) == NULL
+      || sscanf(line, HOT_FILE_SIGNATURE " %u %u", &version, &block_size) != 2
+      || version != HOT_FILE_VERSION) {
+        (*config->log)(LOG_ERR, "ignoring invalid hot file `%s'", config->hot_file);
+        goto done;
+    }
+    if (block_size != config->block_size) {
+        (*config->log)(LOG_NOTICE, "ignoring hot file `%s' created with a different block size (%u != %u)",
+          config->hot_file, block_size, config->block_size);
+        goto done;
+    }
+
+    /* Allocate list; there's no point in prefetching more blocks than will fit in the cache */
+    max_blocks = config->hot_blocks != 0 && config->hot_blocks < config->cache_size ? config->hot_blocks : config->cache_size;
+    if ((priv->hot_list = calloc(max_blocks, sizeof(*priv->hot_list))) == NULL) {
+        (*config->log)(LOG_ERR, "can't allocate hot block list: %s", strerror(errno));
+        priv->stats.out_of_memory_errors++;
+        goto done;
+    }
+
+    /* Read block numbers and access counts, hottest first */
+    while (priv->hot_count < max_blocks && fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "%jx %u", &block_num, &hits) != 2 || block_num != (s3b_block_t)block_num) {
+            (*config->log)(LOG_ERR, "hot file `%s' is corrupted; ignoring remainder", config->hot_file);
+            break;
+        }
+        priv->hot_list[priv->hot_count].block_num = (s3b_block_t)block_num;
+        priv->hot_list[priv->hot_count].hits = hits;
+        priv->hot_count++;
+    }
+    (*config->log)(LOG_INFO, "loaded %u hot blocks from `%s'", priv->hot_count, config->hot_file);
+
+done:
+    fclose(fp);
+}
+
+/*
+ * Save the most frequently accessed cached blocks to the hot file.
+ *
+ * This assumes the mutex is held and all worker threads have exited.
+ */
+static void
+block_cache_hot_save(struct block_cache_private *priv)
+{
+    struct block_cache_conf *const config = priv->config;
+    struct hot_collect collect;
+    char temp[PATH_MAX];
+    u_int max_blocks;
+    FILE *fp;
+    u_int i;
+    int r;
+
+    /* Gather all cached blocks that have been accessed */
+    memset(&collect, 0, sizeof(collect));
+    if ((collect.list = calloc(s3b_hash_size(priv->hashtable) + 1, sizeof(*collect.list))) == NULL) {
+        (*config->log)(LOG_ERR, "can't allocate hot block list: %s", strerror(errno));
+        return;
+    }
+    s3b_hash_foreach(priv->hashtable, block_cache_hot_collect, &collect);
+
+    /* Don't clobber the previous hot file if nothing was accessed */
+    if (collect.count == 0)
+        goto done;
+
+    /* Sort hottest first and trim */
+    qsort(collect.list, collect.count, sizeof(*collect.list), block_cache_hot_cmp);
+    max_blocks = config->hot_blocks != 0 && config->hot_blocks < config->cache_size ? config->hot_blocks : config->cache_size;
+    if (collect.count > max_blocks)
+        collect.count = max_blocks;
+
+    /* Write into temporary file */
+    snprintf(temp, sizeof(temp), "%s.new", config->hot_file);
+    if ((fp = fopen(temp, "w")) == NULL) {
+        (*config->log)(LOG_ERR, "can't create hot file `%s': %s", temp, strerror(errno));
+        goto done;
+    }
+    fprintf(fp, "%s %u %u\n", HOT_FILE_SIGNATURE, HOT_FILE_VERSION, config->block_size);
+    for (i = 0; i < collect.count; i++)
+        fprintf(fp, "%0*jx %u\n", S3B_BLOCK_NUM_DIGITS, (uintmax_t)collect.list[i].block_num, collect.list[i].hits);
+    r = ferror(fp) ? EIO : 0;
+    if (fclose(fp) != 0 && r == 0)
+        r = errno;
+
+    /* Atomically replace previous hot file */
+    if (r == 0 && rename(temp, config->hot_file) == -1)
+        r = errno;
+    if (r != 0) {
+        (*config->log)(LOG_ERR, "can't write hot file `%s': %s", config->hot_file, strerror(r));
+        (void)unlink(temp);
+        goto done;
+    }
+    (*config->log)(LOG_INFO, "saved %u hot blocks to `%s'", collect.count, config->hot_file);
+
+done:
+    free(collect.list);
+}
+
+static void
+block_cache_hot_collect(void *arg, void *value)
+{
+    struct hot_collect *const collect = arg;
+    struct cache_entry *const entry = value;
+
+    if (entry->hits == 0)
+        return;
+    collect->list[collect->count].block_num = entry->block_num;
+    collect->list[collect->count].hits = entry->hits;
+    collect->count++;
+}
+
+/*
+ * Sort hot blocks by decreasing access count, then by block number.
+ */
+static int
+block_cache_hot_cmp(const void *ptr1, const void *ptr2)
+{
+    const struct hot_block *const hot1 = ptr1;
+    const struct hot_block *const hot2 = ptr2;
+
+    if (hot1->hits != hot2->hits)
+        return hot1->hits > hot2->hits ? -1 : 1;
+    return hot1->block_num < hot2->block_num ? -1 : hot1->block_num > hot2->block_num ? 1 : 0;
+}
+
+/*
+ * Prefetch the next hot block from the previous run.
+ *
+ * This assumes the mutex is held.
+ */
+static int
+block_cache_hot_prefetch(struct block_cache_private *priv)
+{
+    struct cache_entry *entry;
+    struct hot_block *hot;
+    int r;
+
+    /* Stop warming up once the cache is full; we never evict anything to make room for a hot block */
+    if (block_cache_full(priv)) {
+        priv->hot_next = priv->hot_count;
+        return 0;
+    }
+
+    /* Claim the next hot block */
+    hot = &priv->hot_list[priv->hot_next++];
+
+    /* Read the block into the cache, unless it's already there */
+    if (s3b_hash_get(priv->hashtable, hot->block_num) == NULL) {
+        priv->hot_active++;
+        r = block_cache_do_read(priv, hot->block_num, 0, 0, NULL, 0);
+        priv->hot_active--;
+        if (r != 0)
+            return r;
+        priv->stats.hot_prefetched++;
+    }
+
+    /* Carry over half of the block's previous access count so it stays hot if used again */
+    if ((entry = s3b_hash_get(priv->hashtable, hot->block_num)) != NULL && entry->hits < hot->hits / 2)
+        entry->hits = hot->hits / 2;
+    return 0;
+}
+
 static int
 block_cache_meta_data(struct s3backer_store *s3b, off_t *file_sizep, u_int *block_sizep)
 {
@@ -430,14 +696,23 @@ block_cache_destroy(struct s3backer_store *const s3b)
         pthread_cond_wait(&priv->worker_exit, &priv->mutex);
     }
 
+    /* Save hot blocks for next time */
+    if (config->hot_file != NULL)
+        block_cache_hot_save(priv);
+
     /* Destroy inner store */
     (*priv->inner->destroy)(priv->inner);
 
     /* Free structures */
     if (config->cache_file != NULL)
         s3b_dcache_close(priv->dcache);
+    free(priv->hot_list);
     s3b_hash_foreach(priv->hashtable, block_cache_free_one, priv);
     s3b_hash_destroy(priv->hashtable);
+    if (config->dedup) {
+        assert(s3b_hash_size(priv->dedup) == 0);
+        s3b_hash_destroy(priv->dedup);
+    }
     pthread_cond_destroy(&priv->write_complete);
     pthread_cond_destroy(&priv->worker_exit);
     pthread_cond_destroy(&priv->worker_work);
@@ -452,11 +727,14 @@ void
 block_cache_get_stats(struct s3backer_store *s3b, struct block_cache_stats *stats)
 {
     struct block_cache_private *const priv = s3b->data;
+    struct block_cache_conf *const config = priv->config;
 
     pthread_mutex_lock(&priv->mutex);
     memcpy(stats, &priv->stats, sizeof(*stats));
     stats->current_size = s3b_hash_size(priv->hashtable);
     stats->dirty_ratio = block_cache_dirty_ratio(priv);
+    if (config->dedup)
+        stats->dedup_saved = priv->num_shared - s3b_hash_size(priv->dedup);
     pthread_mutex_unlock(&priv->mutex);
 }
 
@@ -526,8 +804,13 @@ block_cache_read(struct block_cache_private *const priv, s3b_block_t block_num,
         pthread_cond_signal(&priv->worker_work);
 
     /* Peform the read */
+    priv->demand_reads++;
     r = block_cache_do_read(priv, block_num, off, len, dest, 1);
 
+    /* Let hot block prefetching resume if there are no more reads pending */
+    if (--priv->demand_reads == 0 && priv->hot_next < priv->hot_count)
+        pthread_cond_broadcast(&priv->worker_work);
+
     /* Release lock */
     pthread_mutex_unlock(&priv->mutex);
     return r;
@@ -571,8 +854,10 @@ again:
                     (*config->log)(LOG_ERR, "can't allocate block cache buffer: %s", strerror(r));
                     return r;
                 }
-            } else
+            } else {
+                assert(!entry->shared);
                 data = entry->u.data;
+            }
 
             /* Change from CLEAN2 to READING2 */
             if (config->cache_file != NULL) {
@@ -603,8 +888,10 @@ again:
             assert(0);
             break;
         }
-        if (stats)
+        if (stats) {
             priv->stats.read_hits++;
+            ENTRY_HIT(entry);
+        }
         return 0;
     }
 
@@ -618,6 +905,7 @@ again:
     entry->block_num = block_num;
     entry->dirty = 0;
     entry->verify = 0;
+    entry->hits = 0;
     entry->timeout = READING_TIMEOUT;
     ENTRY_RESET_LINK(entry);
     s3b_hash_put_new(priv->hashtable, entry);
@@ -691,8 +979,14 @@ read:
     entry->timeout = block_cache_get_time(priv) + priv->clean_timeout;
     TAILQ_INSERT_TAIL(&priv->cleans, entry, link);
     priv->num_cleans++;
+    if (stats && !verified_but_not_read)
+        ENTRY_HIT(entry);
     assert(ENTRY_GET_STATE(entry) == CLEAN);
 
+    /* Share data buffer with any identical block */
+    if (config->dedup)
+        block_cache_dedup(priv, entry);
+
     /* If data was only verified, we have to actually go read it now */
     if (verified_but_not_read)
         goto again;
@@ -772,6 +1066,10 @@ again:
                 goto again;
             }
 
+            /* Get a private copy of the data if it's shared with other blocks */
+            if (entry->shared && (r = block_cache_unshare(priv, entry)) != 0)
+                goto fail;
+
             /* Invalidate disk cache entry */
             if (config->cache_file != NULL) {
                 if ((r = s3b_dcache_erase_block(priv->dcache, entry->u.dslot)) != 0)
@@ -792,6 +1090,7 @@ again:
             if ((r = block_cache_write_data(priv, entry, src, off, len)) != 0)
                 (*config->log)(LOG_ERR, "error updating dirty block! %s", strerror(r));
             entry->dirty = 1;
+            ENTRY_HIT(entry);
             priv->stats.write_hits++;
             break;
         default:
@@ -837,6 +1136,7 @@ again:
     entry->block_num = block_num;
     entry->timeout = block_cache_get_time(priv) + priv->dirty_timeout;
     entry->dirty = 1;
+    entry->hits = 1;
     assert(off == 0 && len == config->block_size);
     s3b_hash_put_new(priv->hashtable, entry);
     TAILQ_INSERT_TAIL(&priv->dirties, entry, link);
@@ -905,9 +1205,10 @@ again:
      * and the data separately in hopes that the malloc() implementation will
      * put the data into its own page of virtual memory.
      *
-     * If the cache is full, try to evict a clean entry.
+     * If the cache is full, try to evict a clean entry. With de-duplication, evicting
+     * an entry that shares its data buffer doesn't make room, so we may evict several.
      */
-    if (s3b_hash_size(priv->hashtable) < config->cache_size) {
+    if (!block_cache_full(priv)) {
         if ((entry = calloc(1, sizeof(*entry))) == NULL) {
             r = errno;
             (*config->log)(LOG_ERR, "can't allocate block cache entry: %s", strerror(r));
@@ -973,7 +1274,9 @@ block_cache_free_entry(struct block_cache_private *priv, struct cache_entry **en
             (*config->log)(LOG_ERR, "can't erase cached block! %s", strerror(r));
         if ((r = s3b_dcache_free_block(priv->dcache, entry->u.dslot)) != 0)
             (*config->log)(LOG_ERR, "can't free cached block! %s", strerror(r));
-    } else
+    } else if (entry->shared)
+        block_cache_dedup_release(priv, entry);
+    else
         free(entry->u.data);
 
     /* Remove entry from the clean list */
@@ -985,6 +1288,191 @@ block_cache_free_entry(struct block_cache_private *priv, struct cache_entry **en
     free(entry);
 }
 
+/*
+ * Share a newly CLEAN entry's data buffer with any other CLEAN entry having identical content.
+ * If there is none, the entry's buffer becomes available for sharing by subsequent entries.
+ *
+ * Failure to de-duplicate is harmless; the entry just keeps its private buffer.
+ *
+ * This assumes the mutex is held.
+ */
+static void
+block_cache_dedup(struct block_cache_private *priv, struct cache_entry *entry)
+{
+    struct block_cache_conf *const config = priv->config;
+    struct dedup_buf *dbuf;
+    s3b_block_t key;
+
+    /* Sanity check */
+    assert(config->dedup);
+    assert(config->cache_file == NULL);
+    assert(ENTRY_GET_STATE(entry) == CLEAN);
+    assert(!entry->shared);
+
+    /* Look for an existing buffer with the same content */
+    key = block_cache_content_hash(entry->u.data, config->block_size);
+    if ((dbuf = s3b_hash_get(priv->dedup, key)) != NULL) {
+
+        /* Hash collision with different content? */
+        if (memcmp(dbuf->data, entry->u.data, config->block_size) != 0)
+            return;
+
+        /* Share existing buffer and free ours */
+        free(entry->u.data);
+        dbuf->refs++;
+        entry->u.data = dbuf;
+        entry->shared = 1;
+        priv->num_shared++;
+        return;
+    }
+
+    /* Make our buffer available for sharing */
+    if ((dbuf = malloc(sizeof(*dbuf))) == NULL) {
+        priv->stats.out_of_memory_errors++;
+        return;
+    }
+    dbuf->key = key;
+    dbuf->refs = 1;
+    dbuf->data = entry->u.data;
+    s3b_hash_put_new(priv->dedup, dbuf);
+    entry->u.data = dbuf;
+    entry->shared = 1;
+    priv->num_shared++;
+}
+
+/*
+ * Give a CLEAN entry that is about to be modified its own private data buffer.
+ *
+ * This assumes the mutex is held.
+ */
+static int
+block_cache_unshare(struct block_cache_private *priv, struct cache_entry *entry)
+{
+    struct block_cache_conf *const config = priv->config;
+    struct dedup_buf *const dbuf = entry->u.data;
+    struct cache_entry *victim;
+    void *data;
+    int r;
+
+    /* Sanity check */
+    assert(entry->shared);
+    assert(ENTRY_GET_STATE(entry) == CLEAN);
+
+    /*
+     * A private copy needs a buffer of its own, so make room first by evicting other clean entries.
+     * There is always one: the other entries sharing this buffer are clean. Evicting those instead
+     * leaves us the last reference, in which case we take the buffer without copying anything.
+     */
+    while (dbuf->refs > 1 && block_cache_num_buffers(priv) >= config->cache_size) {
+        if ((victim = TAILQ_FIRST(&priv->cleans)) == entry)
+            victim = TAILQ_NEXT(victim, link);
+        assert(victim != NULL);
+        block_cache_free_entry(priv, &victim);
+    }
+
+    /* If we are the only reference, just take back the buffer */
+    if (dbuf->refs == 1) {
+        s3b_hash_remove(priv->dedup, dbuf->key);
+        entry->u.data = dbuf->data;
+        free(dbuf);
+        goto done;
+    }
+
+    /* Copy the shared data */
+    if ((data = malloc(config->block_size)) == NULL) {
+        r = errno;
+        (*config->log)(LOG_ERR, "can't allocate block cache buffer: %s", strerror(r));
+        priv->stats.out_of_memory_errors++;
+        return r;
+    }
+    memcpy(data, dbuf->data, config->block_size);
+    dbuf->refs--;
+    entry->u.data = data;
+
+done:
+    entry->shared = 0;
+    priv->num_shared--;
+    return 0;
+}
+
+/*
+ * Drop an entry's reference to a shared data buffer, freeing the buffer if it was the last one.
+ *
+ * This assumes the mutex is held.
+ */
+static void
+block_cache_dedup_release(struct block_cache_private *priv, struct cache_entry *entry)
+{
+    struct dedup_buf *const dbuf = entry->u.data;
+
+    /* Sanity check */
+    assert(entry->shared);
+    assert(dbuf->refs > 0);
+
+    /* Drop reference */
+    entry->u.data = NULL;
+    entry->shared = 0;
+    priv->num_shared--;
+    if (--dbuf->refs > 0)
+        return;
+
+    /* Free buffer */
+    s3b_hash_remove(priv->dedup, dbuf->key);
+    free(dbuf->data);
+    free(dbuf);
+}
+
+/*
+ * Count the data buffers in use, i.e., the number of entries minus those saved by sharing.
+ *
+ * This assumes the mutex is held.
+ */
+static u_int
+block_cache_num_buffers(struct block_cache_private *priv)
+{
+    u_int num_buffers = s3b_hash_size(priv->hashtable);
+
+    if (priv->config->dedup)
+        num_buffers -= priv->num_shared - s3b_hash_size(priv->dedup);
+    return num_buffers;
+}
+
+/*
+ * Determine whether a new entry (which needs its own data buffer, at least until it is de-duplicated)
+ * would exceed the configured cache size.
+ *
+ * This assumes the mutex is held.
+ */
+static int
+block_cache_full(struct block_cache_private *priv)
+{
+    return s3b_hash_size(priv->hashtable) >= priv->max_entries || block_cache_num_buffers(priv) >= priv->config->cache_size;
+}
+
+/*
+ * Compute a fast, non-cryptographic hash of a block's content. Because matches are always
+ * confirmed by comparing the actual data, collisions only cost a missed sharing opportunity.
+ */
+static s3b_block_t
+block_cache_content_hash(const void *data, u_int len)
+{
+    const uint64_t *const words = data;
+    const u_char *const bytes = data;
+    uint64_t value = 0x9e3779b97f4a7c15ULL;
+    u_int i;
+
+    for (i = 0; i < len / sizeof(*words); i++) {
+        value ^= words[i];
+        value *= 0xff51afd7ed558ccdULL;
+        value ^= value >> 32;
+    }
+    for (i *= sizeof(*words); i < len; i++) {
+        value ^= bytes[i];
+        value *= 0xff51afd7ed558ccdULL;
+    }
+    return (s3b_block_t)(value ^ (value >> 32));
+}
+
 /*
  * Worker thread main entry point.
  */
@@ -1087,6 +1575,8 @@ block_cache_worker_main(void *arg)
                 entry->timeout = block_cache_get_time(priv) + priv->clean_timeout;
                 priv->num_cleans++;
                 assert(ENTRY_GET_STATE(entry) == CLEAN);
+                if (config->dedup)
+                    block_cache_dedup(priv, entry);
                 pthread_cond_signal(&priv->space_avail);
                 pthread_cond_broadcast(&priv->write_complete);
                 continue;
@@ -1121,6 +1611,12 @@ block_cache_worker_main(void *arg)
             continue;
         }
 
+        /* See if there is a hot block from the previous run that needs to be prefetched */
+        if (priv->hot_next < priv->hot_count && priv->hot_active < priv->max_hot_active && priv->demand_reads == 0) {
+            (void)block_cache_hot_prefetch(priv);
+            continue;
+        }
+
         /* There is nothing to do at this time; sleep until there is something to do */
         if (entry == NULL || (clean_entry != NULL && clean_entry->timeout < entry->timeout))
             entry = clean_entry;
@@ -1221,7 +1717,9 @@ block_cache_free_one(void *arg, void *value)
     struct block_cache_conf *const config = priv->config;
     struct cache_entry *const entry = value;
 
-    if (config->cache_file == NULL)
+    if (entry->shared)
+        block_cache_dedup_release(priv, entry);
+    else if (config->cache_file == NULL)
         free(entry->u.data);
     free(entry);
 }
@@ -1269,6 +1767,12 @@ block_cache_read_data(struct block_cache_private *priv, struct cache_entry *entr
     assert(len <= config->block_size);
     assert(off + len <= config->block_size);
 
+    /* Handle shared in-memory case */
+    if (entry->shared) {
+        memcpy(dest, (char *)((struct dedup_buf *)entry->u.data)->data + off, len);
+        return 0;
+    }
+
     /* Handle easy in-memory case */
     if (config->cache_file == NULL) {
         memcpy(dest, (char *)entry->u.data + off, len);
@@ -1291,6 +1795,7 @@ block_cache_write_data(struct block_cache_private *priv, struct cache_entry *ent
     assert(off <= config->block_size);
     assert(len <= config->block_size);
     assert(off + len <= config->block_size);
+    assert(!entry->shared);
 
     /* Handle easy in-memory case */
     if (config->cache_file == NULL) {
@@ -1349,6 +1854,7 @@ struct check_info {
     u_int   num_reading;
     u_int   num_writing;
     u_int   num_writing2;
+    u_int   num_shared;
 };
 
 static void
@@ -1375,8 +1881,9 @@ block_cache_check_invariants(struct block_cache_private *priv)
         dirty_len++;
     }
 
-    /* Check hash table size */
-    assert(s3b_hash_size(priv->hashtable) <= config->cache_size);
+    /* Check hash table size and number of data buffers */
+    assert(s3b_hash_size(priv->hashtable) <= priv->max_entries);
+    assert(block_cache_num_buffers(priv) <= config->cache_size);
 
     /* Check hash table entries */
     memset(&info, 0, sizeof(info));
@@ -1389,8 +1896,17 @@ block_cache_check_invariants(struct block_cache_private *priv)
       == s3b_hash_size(priv->hashtable));
     assert(priv->num_dirties == info.num_dirty + info.num_writing + info.num_writing2);
 
+    /* Check de-duplication */
+    assert(priv->num_shared == info.num_shared);
+    assert(config->dedup || priv->num_shared == 0);
+    assert(!config->dedup || s3b_hash_size(priv->dedup) <= priv->num_shared);
+
     /* Check read-ahead */
     assert(priv->ra_count <= config->read_ahead);
+
+    /* Check hot block prefetch */
+    assert(priv->hot_next <= priv->hot_count);
+    assert(priv->hot_active <= priv->max_hot_active);
 }
 
 static void
@@ -1400,6 +1916,11 @@ block_cache_check_one(void *arg, void *value)
     struct check_info *const info = arg;
 
     assert(entry != NULL);
+    assert(!entry->shared || ENTRY_GET_STATE(entry) == CLEAN);
+    if (entry->shared) {
+        assert(((struct dedup_buf *)entry->u.data)->refs > 0);
+        info->num_shared++;
+    }
     switch (ENTRY_GET_STATE(entry)) {
     case CLEAN:
     case CLEAN2:
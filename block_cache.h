@@ -34,7 +34,10 @@ struct block_cache_conf {
     u_int               read_ahead;
     u_int               read_ahead_trigger;
     u_int               no_verify;
+    u_int               dedup;
     const char          *cache_file;
+    const char          *hot_file;
+    u_int               hot_blocks;
     log_func_t          *log;
 };
 
@@ -49,6 +52,8 @@ struct block_cache_stats {
     u_int               write_misses;
     u_int               verified;
     u_int               mismatch;
+    u_int               hot_prefetched;
+    u_int               dedup_saved;
     u_int               out_of_memory_errors;
 };
 
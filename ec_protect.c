@@ -497,8 +497,21 @@ ec_protect_read_block_part(struct s3backer_store *s3b, s3b_block_t block_num, u_
 {
     struct ec_protect_private *const priv = s3b->data;
     struct ec_protect_conf *const config = priv->config;
+    struct block_info *binfo;
+
+    /* Find info for this block */
+    pthread_mutex_lock(&priv->mutex);
+    EC_PROTECT_CHECK_INVARIANTS(priv);
+    ec_protect_scrub_expired_writtens(priv, ec_protect_get_time());
+    binfo = s3b_hash_get(priv->hashtable, block_num);
+    pthread_mutex_unlock(&priv->mutex);
+
+    /* Recently written blocks need MD5 verification, which requires reading the whole block */
+    if (binfo != NULL)
+        return block_part_read_block_part(s3b, block_num, config->block_size, off, len, dest);
 
-    return block_part_read_block_part(s3b, block_num, config->block_size, off, len, dest);
+    /* Otherwise let the lower layer read just the part we need */
+    return (*priv->inner->read_block_part)(priv->inner, block_num, off, len, dest);
 }
 
 static int
@@ -32,7 +32,7 @@
 #include "erase.h"
 
 #define BLOCKS_PER_DOT          0x100
-#define MAX_QUEUE_LENGTH        1000
+#define MAX_QUEUE_LENGTH        (4 * DELETE_BATCH_MAX)
 #define NUM_ERASURE_THREADS     25
 
 /* Erasure state */
@@ -41,6 +41,8 @@ struct erase_state {
     s3b_block_t                 queue[MAX_QUEUE_LENGTH];
     u_int                       qlen;
     pthread_t                   threads[NUM_ERASURE_THREADS];
+    u_int                       batch;          // max blocks to delete at once
+    u_int                       pack_factor;
     int                         quiet;
     int                         stopping;
     uintmax_t                   count;
@@ -81,6 +83,8 @@ s3backer_erase(struct s3b_config *config)
     /* Initialize state */
     memset(priv, 0, sizeof(*priv));
     priv->quiet = config->quiet;
+    priv->pack_factor = config->http_io.pack_factor;
+    priv->batch = !config->test && config->http_io.delete_batch > 1 ? config->http_io.delete_batch : 1;
     if ((r = pthread_mutex_init(&priv->mutex, NULL)) != 0) {
         warnx("pthread_mutex_init: %s", strerror(r));
         goto fail0;
@@ -158,6 +162,10 @@ erase_list_callback(void *arg, s3b_block_t block_num)
 {
     struct erase_state *const priv = arg;
 
+    /* With packed objects deleted in batches, only the first block in each object has a key */
+    if (priv->batch > 1 && block_num % priv->pack_factor != 0)
+        return;
+
     pthread_mutex_lock(&priv->mutex);
     while (priv->qlen == MAX_QUEUE_LENGTH)
         pthread_cond_wait(&priv->queue_not_full, &priv->mutex);
@@ -170,8 +178,10 @@ static void *
 erase_thread_main(void *arg)
 {
     struct erase_state *const priv = arg;
-    s3b_block_t block_num;
-    int r;
+    s3b_block_t blocks[DELETE_BATCH_MAX];
+    int results[DELETE_BATCH_MAX];
+    u_int num;
+    u_int i;
 
     /* Acquire lock */
     pthread_mutex_lock(&priv->mutex);
@@ -179,29 +189,36 @@ erase_thread_main(void *arg)
     /* Erase blocks until there are no more */
     while (1) {
 
-        /* Is there a block to erase? */
-        if (priv->qlen > 0) {
+        /* Is there a full batch of blocks to erase, or any blocks left at the end? */
+        if (priv->qlen >= priv->batch || (priv->qlen > 0 && priv->stopping)) {
 
-            /* Grab next bock */
+            /* Grab next blocks */
             if (priv->qlen == MAX_QUEUE_LENGTH)
                 pthread_cond_signal(&priv->queue_not_full);
-            block_num = priv->queue[--priv->qlen];
+            for (num = 0; num < priv->batch && priv->qlen > 0; num++)
+                blocks[num] = priv->queue[--priv->qlen];
 
             /* Do block deletion */
             pthread_mutex_unlock(&priv->mutex);
-            r = (*priv->s3b->write_block)(priv->s3b, block_num, NULL, NULL, NULL, NULL);
+            if (priv->batch > 1)
+                http_io_delete_blocks(priv->s3b, blocks, num, results);
+            else
+                results[0] = (*priv->s3b->write_block)(priv->s3b, blocks[0], NULL, NULL, NULL, NULL);
             pthread_mutex_lock(&priv->mutex);
 
-            /* Check for error */
-            if (r != 0) {
-                warnx("can't delete block %0*jx: %s", S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num, strerror(r));
-                continue;
-            }
+            for (i = 0; i < num; i++) {
+
+                /* Check for error */
+                if (results[i] != 0) {
+                    warnx("can't delete block %0*jx: %s", S3B_BLOCK_NUM_DIGITS, (uintmax_t)blocks[i], strerror(results[i]));
+                    continue;
+                }
 
-            /* Update count and output a dot */
-            if ((++priv->count % BLOCKS_PER_DOT) == 0 && !priv->quiet) {
-                fprintf(stderr, ".");
-                fflush(stderr);
+                /* Update count and output a dot */
+                if ((++priv->count % BLOCKS_PER_DOT) == 0 && !priv->quiet) {
+                    fprintf(stderr, ".");
+                    fflush(stderr);
+                }
             }
 
             /* Spin again */
@@ -25,44 +25,83 @@
 #include "s3backer.h"
 #include "block_part.h"
 #include "http_io.h"
+#include "hash.h"
 
 /* HTTP definitions */
 #define HTTP_GET                    "GET"
 #define HTTP_PUT                    "PUT"
 #define HTTP_DELETE                 "DELETE"
+#define HTTP_POST                   "POST"
 #define HTTP_HEAD                   "HEAD"
 #define HTTP_NOT_MODIFIED           304
+#define HTTP_BAD_REQUEST            400
 #define HTTP_UNAUTHORIZED           401
 #define HTTP_FORBIDDEN              403
 #define HTTP_NOT_FOUND              404
+#define HTTP_METHOD_NOT_ALLOWED     405
 #define HTTP_PRECONDITION_FAILED    412
+#define HTTP_RANGE_NOT_SATISFIABLE  416
+#define HTTP_NOT_IMPLEMENTED        501
+#define HTTP_SERVICE_UNAVAILABLE    503
 #define AUTH_HEADER                 "Authorization"
 #define CTYPE_HEADER                "Content-Type"
 #define CONTENT_ENCODING_HEADER     "Content-Encoding"
 #define ETAG_HEADER                 "ETag"
-#define CONTENT_ENCODING_DEFLATE    "deflate"
+#define CONTENT_ENCODING_DEFLATE    COMPRESS_DEFLATE
+#define CONTENT_ENCODING_ZSTD       COMPRESS_ZSTD
+#define CONTENT_ENCODING_LZ4        COMPRESS_LZ4
 #define CONTENT_ENCODING_ENCRYPT    "encrypt"
+#define CONTENT_ENCODING_AEAD       "aead"
 #define MD5_HEADER                  "Content-MD5"
 #define ACL_HEADER                  "x-amz-acl"
 #define CONTENT_SHA256_HEADER       "x-amz-content-sha256"
+#define UNSIGNED_PAYLOAD            "UNSIGNED-PAYLOAD"
 #define STORAGE_CLASS_HEADER        "x-amz-storage-class"
 #define SCLASS_STANDARD             "STANDARD"
 #define SCLASS_REDUCED_REDUNDANCY   "REDUCED_REDUNDANCY"
 #define FILE_SIZE_HEADER            "x-amz-meta-s3backer-filesize"
 #define BLOCK_SIZE_HEADER           "x-amz-meta-s3backer-blocksize"
 #define HMAC_HEADER                 "x-amz-meta-s3backer-hmac"
+#define PACK_FACTOR_HEADER          "x-amz-meta-s3backer-packfactor"
+#define RANGE_HEADER                "Range"
+#define CONTENT_RANGE_HEADER        "Content-Range"
 #define IF_MATCH_HEADER             "If-Match"
 #define IF_NONE_MATCH_HEADER        "If-None-Match"
+#define COPY_SOURCE_HEADER          "x-amz-copy-source"
+#define METADATA_DIRECTIVE_HEADER   "x-amz-metadata-directive"
 
 /* MIME type for blocks */
 #define CONTENT_TYPE                "application/x-s3backer-block"
 
+/* MIME type for content references (content addressed layout) */
+#define CAS_REF_CONTENT_TYPE        "application/x-s3backer-ref"
+
+/* MIME type for multi-object delete and multipart upload requests */
+#define XML_CONTENT_TYPE            "application/xml"
+
 /* MIME type for mounted flag */
 #define MOUNTED_FLAG_CONTENT_TYPE   "text/plain"
 
 /* Mounted file object name */
 #define MOUNTED_FLAG                "s3backer-mounted"
 
+/* Unfinished key migration marker object name (see `--migrateKeys') */
+#define MIGRATING_FLAG              "s3backer-migrating"
+
+/* Hashed key layout marker object name (see `--hashPrefix') */
+#define HASHED_FLAG                 "s3backer-hashed"
+
+/* Packed layout marker object; its metadata records the pack factor */
+#define PACKED_FLAG                 "s3backer-packed"
+
+/* Saved non-zero block bitmap object name, MIME type, and format */
+#define NONZERO_BITMAP              "s3backer-nonzero"
+#define NONZERO_BITMAP_CONTENT_TYPE "application/x-s3backer-nonzero"
+#define NONZERO_BITMAP_MAGIC        "s3backer-nonzero"
+#define NONZERO_MAGIC_LENGTH        16
+#define NONZERO_BITMAP_VERSION      1
+#define NONZERO_HEADER_SIZE         72                  // magic, version, encoding, block size, pad, blocks, gen, count, MD5
+
 /* HTTP `Date' and `x-amz-date' header formats */
 #define HTTP_DATE_HEADER            "Date"
 #define AWS_DATE_HEADER             "x-amz-date"
@@ -72,7 +111,38 @@
 
 /* Size required for URL buffer */
 #define URL_BUF_SIZE(config)        (strlen((config)->baseURL) + strlen((config)->bucket) \
-                                      + strlen((config)->prefix) + S3B_BLOCK_NUM_DIGITS + 2)
+                                      + strlen((config)->prefix) + (config)->hash_prefix + S3B_BLOCK_NUM_DIGITS + 2)
+
+/* Multi-object delete API constants */
+#define DELETE_SUBRESOURCE          "delete"
+#define DELETE_ELEM_RESULT          "<DeleteResult"
+#define DELETE_ELEM_ERROR           "<Error>"
+#define DELETE_ELEM_ERROR_END       "</Error>"
+#define DELETE_ELEM_KEY             "Key"
+#define DELETE_ELEM_CODE            "Code"
+#define DELETE_LINGER_MS            10                  // max time a batch waits for more deletions to join
+#define DELETE_RESPONSE_MIN         1024                // response space for the result element itself
+#define DELETE_RESPONSE_PER_ERROR   512                 // response space allowed for each key that failed
+
+/* Multipart upload API constants */
+#define MULTIPART_UPLOADS           "uploads"
+#define MULTIPART_PART_NUMBER       "partNumber"
+#define MULTIPART_UPLOAD_ID         "uploadId"
+#define MULTIPART_ELEM_UPLOAD_ID    "UploadId"
+#define MULTIPART_ELEM_COMPLETE     "<CompleteMultipartUploadResult"
+#define MULTIPART_UPLOAD_ID_MAX     1024
+#define MULTIPART_QUERY_MAX         (3 * MULTIPART_UPLOAD_ID_MAX + 64)  // room for sub-resources appended to a block URL
+#define MULTIPART_RESPONSE_MAX      4096
+
+/* Server-side copy (used when migrating blocks to the hashed key layout) */
+#define COPY_RESULT_ELEM            "<CopyObjectResult"
+#define COPY_RESPONSE_MAX           1024
+
+/* Content addressed layout: block objects contain a reference to a content object named by its SHA-256 hash */
+#define CAS_KEY_INFIX               "cas-"
+#define CAS_REF_SIGNATURE           "s3backer-ref sha256 "
+#define CAS_REF_LENGTH              (sizeof(CAS_REF_SIGNATURE) - 1 + SHA256_DIGEST_LENGTH * 2 + 1)
+#define CAS_URL_BUF_SIZE(config)    (URL_BUF_SIZE(config) + sizeof(CAS_KEY_INFIX) + SHA256_DIGEST_LENGTH * 2)
 
 /* Bucket listing API constants */
 #define LIST_PARAM_MARKER           "marker"
@@ -89,7 +159,42 @@
                                       + sizeof(LIST_ELEM_KEY) + 1)
 
 /* How many blocks to list at a time */
-#define LIST_BLOCKS_CHUNK           0x100
+#define LIST_BLOCKS_CHUNK           1000                // S3 maximum keys per listing page
+
+/* Longest key we need to remember while listing (block or content object) */
+#define LIST_MAX_KEY(config)        (strlen((config)->prefix) + sizeof(CAS_KEY_INFIX) + SHA256_DIGEST_LENGTH * 2 + 10)
+
+/* Upper bound on the compressed size of `len' bytes for all supported codecs */
+#define COMPRESS_BOUND(len)         ((len) + (len) / 128 + 128)
+
+/* Incompressible block detection */
+#define COMPRESS_PROBE_CHUNKS       8                   // number of chunks sampled by the probe
+#define COMPRESS_PROBE_CHUNK_SIZE   512                 // size of each sampled chunk
+#define COMPRESS_PROBE_SIZE         (COMPRESS_PROBE_CHUNKS * COMPRESS_PROBE_CHUNK_SIZE)
+#define COMPRESS_PROBE_MIN_BLOCK    (4 * COMPRESS_PROBE_SIZE)   // smaller blocks are compressed without probing
+#define COMPRESS_PROBE_PERCENT      97                  // sample must compress to less than this percent
+#define COMPRESS_REGION_BLOCKS      256                 // consecutive blocks sharing one remembered outcome
+#define COMPRESS_REGION_SKIP        8                   // skip compression when a region's score reaches this
+#define COMPRESS_REGION_PENALTY     4                   // score added for each incompressible block
+#define COMPRESS_REGION_MAX         16                  // maximum region score
+
+/* Compression levels used when `--compress' is given without a level */
+#define ZSTD_DEFAULT_LEVEL          3
+#define LZ4_DEFAULT_LEVEL           9
+
+/* AES-GCM encoding is a random nonce, the ciphertext, then the authentication tag */
+#define GCM_NONCE_LENGTH            12
+#define GCM_TAG_LENGTH              16
+
+/* Salt for deriving the AES-GCM key from the bulk data key, so the two modes never share a key */
+#define GCM_KEY_SALT                "s3backer-aead-key"
+
+/* Maximum growth of data due to encryption */
+#define ENCRYPT_OVERHEAD            (GCM_NONCE_LENGTH + GCM_TAG_LENGTH > EVP_MAX_IV_LENGTH ? \
+                                      GCM_NONCE_LENGTH + GCM_TAG_LENGTH : EVP_MAX_IV_LENGTH)
+
+/* Outgoing data is digested in chunks of this size, so each chunk stays in cache while all digests are updated */
+#define DIGEST_CHUNK_SIZE           16384
 
 /* PBKDF2 key generation iterations */
 #define PBKDF2_ITERATIONS           5000
@@ -106,6 +211,9 @@
 #define S3_SERVICE_NAME             "s3"
 #define SIGNATURE_TERMINATOR        "aws4_request"
 #define SECURITY_TOKEN_HEADER       "x-amz-security-token"
+#define AUTH4_MAX_HEADERS           32                  // max number of signed headers
+#define AUTH4_HEADER_NAMES_SIZE     512                 // max length of signed header name list
+#define AUTH4_SCOPE_SIZE            128                 // max length of credential scope
 
 /* EC2 IAM info URL */
 #define EC2_IAM_META_DATA_URLBASE   "http://169.254.169.254/latest/meta-data/iam/security-credentials/"
@@ -113,6 +221,47 @@
 #define EC2_IAM_META_DATA_ACCESSKEY "SecretAccessKey"
 #define EC2_IAM_META_DATA_TOKEN     "Token"
 
+/* Adaptive request rate governor (AIMD token bucket per request class) */
+#define GOV_GET                     0                   // GET and HEAD requests
+#define GOV_PUT                     1
+#define GOV_DELETE                  2
+#define GOV_NUM_CLASSES             3
+#define GOV_MEASURE_INTERVAL        1.0                 // interval over which the unlimited request rate is measured (seconds)
+#define GOV_MIN_RATE                1.0                 // never throttle below this (requests/sec)
+#define GOV_INCREASE                10.0                // additive increase (requests/sec, per second at full rate)
+#define GOV_DECREASE                0.5                 // multiplicative decrease factor
+#define GOV_DECREASE_INTERVAL       0.5                 // min seconds between decreases, so a burst of 503's counts once
+#define GOV_BURST                   0.1                 // bucket holds this many seconds worth of tokens
+
+/* Hedged block reads */
+#define HEDGE_SAMPLES               256                 // number of recent time-to-first-byte samples kept
+#define HEDGE_MIN_SAMPLES           32                  // don't hedge until we have this many samples
+#define HEDGE_RECOMPUTE             16                  // recompute threshold after this many new samples
+#define HEDGE_MIN_DELAY             0.005               // never hedge sooner than this (seconds)
+#define HEDGE_MAX_TOKENS            10.0                // max number of hedges that can be saved up
+#define HEDGE_POLL_MS               1000                // max time to wait for network activity (milliseconds)
+
+/* I/O buffer pool */
+#define IO_BUF_SLOTS                64                  // max free buffers kept; any more are freed
+#define IO_BUF_POOL_BYTES           (64 * 1024 * 1024)  // max total size of free buffers kept
+
+/* Credentials */
+#define CREDS_HAZARDS               128                 // threads that can sign requests at once without locking
+
+/* Multiple endpoints */
+#define ENDPOINT_EWMA_WEIGHT        0.2                 // weight of each new time-to-first-byte sample
+#define ENDPOINT_EJECT_FAILURES     2                   // eject an endpoint after this many transport failures in a row
+#define ENDPOINT_EJECT_MIN          5.0                 // length of an endpoint's first ejection (seconds)
+#define ENDPOINT_EJECT_MAX          300.0               // ejections in a row double in length up to this (seconds)
+
+/* Lock-free updates to the non-zero block bitmap and to stats counters not otherwise protected by the mutex */
+#define ATOMIC_LOAD(ptr)            __atomic_load_n((ptr), __ATOMIC_RELAXED)
+#define ATOMIC_OR(ptr, val)         ((void)__atomic_fetch_or((ptr), (val), __ATOMIC_RELAXED))
+#define ATOMIC_ADD(ptr, val)        ((void)__atomic_fetch_add((ptr), (val), __ATOMIC_RELAXED))
+#define ATOMIC_SUB(ptr, val)        ((void)__atomic_fetch_sub((ptr), (val), __ATOMIC_RELAXED))
+#define STATS_INC(priv, field)      ATOMIC_ADD(&(priv)->stats.field, 1)
+#define STATS_ADD(priv, field, val) ATOMIC_ADD(&(priv)->stats.field, (val))
+
 /* Misc */
 #define WHITESPACE                  " \t\v\f\r\n"
 
@@ -128,21 +277,232 @@ struct curl_holder {
     LIST_ENTRY(curl_holder)     link;
 };
 
+struct multi_holder {
+    CURLM                       *multi;
+    LIST_ENTRY(multi_holder)    link;
+};
+
+#if HAVE_OPENSSL_GCM
+/* Authenticated encryption ciphers, each paired with the CBC cipher having the same key length */
+struct aead_cipher {
+    const char                  *name;          // as given to `--encrypt' and used in the Content-Encoding
+    int                         cbc_nid;        // the CBC cipher used by older encrypted blocks
+    const EVP_CIPHER            *(*cipher)(void);
+};
+
+static const struct aead_cipher aead_ciphers[] = {
+    { "AES-128-GCM",    NID_aes_128_cbc,    EVP_aes_128_gcm },
+    { "AES-256-GCM",    NID_aes_256_cbc,    EVP_aes_256_gcm },
+};
+#endif
+
+#if HAVE_LIBZSTD
+/* A cached pair of zstd compression and decompression contexts */
+struct zstd_ctx {
+    ZSTD_CCtx                   *cctx;
+    ZSTD_DCtx                   *dctx;
+    LIST_ENTRY(zstd_ctx)        link;
+};
+#endif
+
+/* A round of block writes to one packed object; later writers join until its PUT begins */
+struct pack_write {
+    s3b_block_t                 base;           // first block in the object
+    u_int                       num_blocks;     // number of blocks in the object
+    u_char                      *data;          // new object content
+    u_char                      *dirty;         // which blocks have been written this round
+    u_int                       num_dirty;      // number of blocks written this round
+    u_int                       refs;           // number of writers waiting on this round
+    int                         sending;        // read-fill or PUT has started; no more joiners
+    int                         done;           // round is complete
+    int                         result;         // result of the round
+    pthread_cond_t              cond;           // signaled when round is complete
+    LIST_ENTRY(pack_write)      link;
+};
+
+/* MD5 of a packed object this process wrote recently, so reading it back can't return older content */
+struct pack_md5 {
+    s3b_block_t                 base;           // first block in the object (must be first)
+    u_char                      md5[MD5_DIGEST_LENGTH]; // MD5 of the object, or zero if it was deleted
+    double                      timestamp;      // when it was written
+    TAILQ_ENTRY(pack_md5)       link;
+};
+
+/* A batch of block deletions sent as one multi-object delete; later deleters join until it is sent */
+struct delete_batch {
+    s3b_block_t                 *blocks;        // blocks to delete
+    int                         *results;       // result for each block (EAGAIN = delete it individually)
+    u_int                       num_blocks;     // number of blocks in the batch
+    u_int                       refs;           // number of deleters waiting on this batch
+    int                         done;           // batch is complete
+    pthread_cond_t              cond;           // signaled when batch is complete
+};
+
+/* A block being transferred in parts by several threads at once */
+struct multipart {
+    struct http_io_private      *priv;
+    struct http_io              *io;            // the block's I/O info
+    const char                  *url;           // the block's URL
+    const char                  *upload_id;     // multipart upload ID (when uploading)
+    const u_char                *src;           // object content (when uploading)
+    u_char                      *dest;          // object content (when reading)
+    u_int                       size;           // object size
+    u_int                       part_size;      // size of each part except the last
+    u_int                       num_parts;      // number of parts
+    u_int                       next_part;      // next part to transfer (protected by priv->mutex)
+    u_char                      (*md5s)[MD5_DIGEST_LENGTH];     // MD5 of each part (when uploading)
+    int                         (*xfer)(struct multipart *mp, u_int part);
+    int                         r;              // first error (protected by priv->mutex)
+};
+
+/* A transfer handed to the HTTP/2 multiplexing thread */
+struct multi_xfer {
+    CURL                        *curl;
+    CURLcode                    result;
+    int                         done;
+    pthread_cond_t              cond;           // signaled when transfer is done
+    TAILQ_ENTRY(multi_xfer)     link;
+};
+
+/* Rate governor for one class of requests */
+struct rate_gov {
+    double                      rate;           // current limit (requests/sec), or zero if not limited
+    double                      max_rate;       // the limit is lifted once it climbs back to this rate
+    double                      tokens;         // available tokens; negative when requests are waiting
+    double                      last_refill;    // time tokens were last added
+    double                      last_decrease;  // time rate was last decreased
+    double                      measured;       // request rate over the last measurement interval (requests/sec)
+    double                      interval_start; // start of the current measurement interval
+    u_int                       count;          // requests so far in the current measurement interval
+};
+
+/* An address requests may be sent to instead of wherever the base URL's host resolves to */
+struct endpoint {
+    struct http_io_endpoint_stats stats;        // name and stats
+    struct curl_slist           *connect_to;    // CURLOPT_CONNECT_TO setting that routes requests here
+    double                      ewma;           // average time to first byte (seconds, zero = not known yet)
+    u_int                       failures;       // transport failures in a row
+    double                      ejected_until;  // not used again until this time (if ejected)
+    double                      eject_time;     // length of the most recent ejection (seconds)
+};
+
+/* State shared by threads listing ranges of blocks concurrently */
+struct list_state {
+    struct http_io_private      *priv;
+    block_list_func_t           *callback;
+    void                        *arg;
+    pthread_mutex_t             mutex;          // serializes callbacks
+};
+
+/* One range of blocks being listed by its own thread */
+struct list_range {
+    struct list_state           *state;
+    pthread_t                   thread;
+    uintmax_t                   min;            // first block (or hash prefix) in range
+    uintmax_t                   max;            // first block (or hash prefix) after range, or zero to list to the end
+    int                         r;              // result
+};
+
+/* Cached AWS version 4 signing key */
+struct auth4_sigkey {
+    char                        scope[AUTH4_SCOPE_SIZE];        // credential scope, starting with the date
+    u_char                      key[EVP_MAX_MD_SIZE];           // derived signing key
+    u_int                       key_len;                        // zero if nothing cached yet
+};
+
+/*
+ * Immutable credentials snapshot. Signers protect the snapshot they use with a hazard pointer, without locking
+ * (see http_io_creds_acquire()); changes are made by publishing a new snapshot, and the old one is freed once
+ * no hazard pointer or reference refers to it.
+ */
+struct credentials {
+    u_int                       refs;                           // users without a hazard pointer (protected by mutex)
+    struct credentials          *next;                          // next in priv->creds_retired
+    const char                  *access_id;
+    const char                  *access_key;                    // secret key (points into access_key4)
+    const char                  *access_key4;                   // secret key with ACCESS_KEY_PREFIX prepended
+    const char                  *iam_token;                     // EC2 IAM session token, or NULL
+    struct auth4_sigkey         sigkey;                         // cached aws4 signing key for these credentials
+};
+
 /* Internal state */
 struct http_io_private {
     struct http_io_conf         *config;
     struct http_io_stats        stats;
     LIST_HEAD(, curl_holder)    curls;
+    LIST_HEAD(, multi_holder)   multis;         // idle multi handles for hedged reads
+    void                        *io_bufs[IO_BUF_SLOTS]; // free I/O buffers, NULL if empty (accessed atomically)
+    u_int                       io_buf_slots;   // how many of io_bufs[] are used, to bound their total size
+    size_t                      io_buf_size;    // size of each I/O buffer
+    int                         multipart;      // blocks may be larger than config->multipart_size
+    CURLSH                      *share;         // DNS and TLS session caches shared by all handles
+    pthread_mutex_t             share_locks[CURL_LOCK_DATA_LAST];
     pthread_mutex_t             mutex;
     u_int                       *non_zero;      // config->nonzero_bitmap is moved to here
+    LIST_HEAD(, pack_write)     pack_writes;    // packed object write rounds in progress
+    struct s3b_hash             *pack_md5s;     // recently written packed object MD5s, keyed by base block
+    TAILQ_HEAD(, pack_md5)      pack_md5_list;  // recently written packed object MD5s, oldest first
+    struct delete_batch         *delete_batch;  // batch of deletions still accepting joiners, if any
+    u_int                       deletes_active; // deletions (individual or batched) in progress
+    u_int                       deletes_done;   // count of deletions completed, for noticing progress
+    pthread_cond_t              delete_wakeup;  // signaled when a deletion completes or a batch fills up
+    int                         no_delete_multi;// server doesn't support multi-object deletes
     pthread_t                   iam_thread;     // IAM credentials refresh thread
     u_char                      shutting_down;
 
+    /* HTTP/2 multiplexing info */
+    CURLM                       *multi;         // multi handle shared by all transfers (if config->http2)
+    pthread_t                   multi_thread;   // thread driving all transfers on the multi handle
+    int                         multi_pipe[2];  // used to wake up the multi thread
+    TAILQ_HEAD(, multi_xfer)    multi_queue;    // transfers waiting to be added to the multi handle
+    u_int                       multi_active;   // number of transfers on the multi handle
+
+    /* Cipher context pool info */
+    struct cipher_ctx           *cipher_ctxs;   // contexts for threads encoding and decoding blocks
+    u_int                       num_cipher_ctxs;
+    SLIST_HEAD(, cipher_ctx)    cipher_idle;    // contexts not in use
+    pthread_mutex_t             cipher_mutex;   // protects cipher_idle and the crypto_* stats
+    pthread_cond_t              cipher_wakeup;  // signaled when a context becomes idle
+
     /* Encryption info */
-    const EVP_CIPHER            *cipher;
+    const EVP_CIPHER            *cipher;                        // CBC cipher
+    const EVP_CIPHER            *aead_cipher;                   // paired AES-GCM cipher, if any
+    const char                  *aead_name;                     // name of aead_cipher
+    int                         use_aead;                       // encrypt new blocks using aead_cipher
     u_int                       keylen;                         // length of key and ivkey
     u_char                      key[EVP_MAX_KEY_LENGTH];        // key used to encrypt data
     u_char                      ivkey[EVP_MAX_KEY_LENGTH];      // key used to encrypt block number to get IV for data
+    u_char                      aead_key[EVP_MAX_KEY_LENGTH];   // key used for aead_cipher, derived from key
+
+    /* Authentication info */
+    struct credentials          *creds;                         // current credentials, or NULL (atomically swapped)
+    struct credentials          *creds_hazards[CREDS_HAZARDS];  // snapshots in use by signers (accessed atomically)
+    struct credentials          *creds_retired;                 // replaced snapshots that may still be in use (mutex)
+
+    /* Request rate governor info */
+    struct rate_gov             govs[GOV_NUM_CLASSES];          // one per request class (if config->rate_governor)
+    pthread_mutex_t             gov_mutex;                      // protects govs and hedged read info
+
+    /* Hedged read info */
+    double                      hedge_samples[HEDGE_SAMPLES];   // recent GET times to first byte
+    u_int                       hedge_num_samples;              // total number of samples taken
+    double                      hedge_threshold;                // hedge GETs slower than this (zero = not known yet)
+    double                      hedge_tokens;                   // hedges allowed by config->hedge_budget
+
+    /* Endpoint info */
+    struct endpoint             *endpoints;                     // endpoints requests are spread across, if any
+    u_int                       num_endpoints;
+    u_int                       endpoint_next;                  // where to start the next search for the best endpoint
+    pthread_mutex_t             endpoint_mutex;                 // protects endpoint state and endpoint_next
+
+    /* Compression info */
+    const char                  *codec;         // compression codec, which is also its content encoding
+    u_char                      *compress_scores;   // per-region incompressibility scores (accessed atomically)
+#if HAVE_LIBZSTD
+    LIST_HEAD(, zstd_ctx)       zstd_ctxs;      // idle zstd contexts
+    ZSTD_CDict                  *zstd_cdict;    // zstd compression dictionary (if any)
+    ZSTD_DDict                  *zstd_ddict;    // zstd decompression dictionary (if any)
+#endif
 };
 
 /* I/O buffers */
@@ -169,7 +529,10 @@ struct http_io {
     int                 xml_text_len;           // # chars in 'xml_text' buffer
     int                 xml_text_max;           // max chars in 'xml_text' buffer
     int                 list_truncated;         // returned list was truncated
-    s3b_block_t         last_block;             // last dirty block listed
+    char                *last_key;              // last key listed
+    const char          *list_start;            // ignore keys before this key (if not NULL)
+    const char          *list_end;              // stop listing at this key (if not NULL)
+    int                 list_stop;              // reached list_end
     block_list_func_t   *callback_func;         // callback func for listing blocks
     void                *callback_arg;          // callback arg for listing blocks
     struct http_io_conf *config;                // configuration
@@ -182,23 +545,82 @@ struct http_io {
     const void          *src;                   // Block data (when writing)
     s3b_block_t         block_num;              // The block we're reading/writing
     u_int               buf_size;               // Size of data buffer
+    u_int               dest_size;              // Size of response buffer (when also sending data)
     u_int               *content_lengthp;       // Returned Content-Length
     uintmax_t           file_size;              // file size from "x-amz-meta-s3backer-filesize"
     u_int               block_size;             // block size from "x-amz-meta-s3backer-blocksize"
+    u_int               pack_factor;            // pack factor from "x-amz-meta-s3backer-packfactor"
+    uintmax_t           object_size;            // total object size from "Content-Range"
     u_int               expect_304;             // a verify request; expect a 304 response
     u_char              md5[MD5_DIGEST_LENGTH]; // parsed ETag header
     u_char              hmac[SHA_DIGEST_LENGTH];// parsed "x-amz-meta-s3backer-hmac" header
     char                content_encoding[32];   // received content encoding
     check_cancel_t      *check_cancel;          // write check-for-cancel callback
     void                *check_cancel_arg;      // write check-for-cancel callback argument
+    const char          *payload_sha256;        // precomputed payload hash for authentication, if any
+    struct http_io_evst *evst;                  // where to count a successful request, if not by its method
+    char                etag[64];               // raw ETag header, including quotes
+    int                 hedge;                  // a block GET that may be duplicated if slow
+    struct endpoint     *endpoint;              // where the current attempt was sent (if using endpoints)
+    int                 no_retry;               // give up after the first failed attempt
+    long                http_code;              // HTTP response code from the last attempt, or -1 if none
+    int                 cas_followed;           // block data was read via a content reference
+    u_char              cas_hash[SHA256_DIGEST_LENGTH];// SHA-256 the content must have, if cas_followed
 };
 
 /* CURL prepper function type */
 typedef void http_io_curl_prepper_t(CURL *curl, struct http_io *io);
 
+/*
+ * A set of pre-keyed cipher and HMAC contexts, so each block doesn't pay for key setup.
+ * A thread needing to encode or decode a block borrows one from the pool and does the work itself.
+ */
+struct cipher_ctx {
+    struct http_io_private      *priv;
+    SLIST_ENTRY(cipher_ctx)     link;           // link in priv->cipher_idle
+    int                         keyed;          // the contexts below are initialized
+    EVP_CIPHER_CTX              iv_ctx;         // keyed with ivkey, for deriving IVs
+    EVP_CIPHER_CTX              enc_ctx;        // keyed with key, for encrypting
+    EVP_CIPHER_CTX              dec_ctx;        // keyed with key, for decrypting
+    HMAC_CTX                    hmac_ctx;       // keyed with key, for signing
+    EVP_CIPHER_CTX              aead_ctx;       // keyed with aead_key, for AES-GCM (if any)
+};
+
+/* Cipher context pool function type */
+typedef int http_io_cipher_t(struct cipher_ctx *cctx, void *arg);
+
+/* Block encoding job */
+struct encode_job {
+    s3b_block_t         block_num;
+    const void          *src;                   // data to encode; replaced by the encoded data
+    u_int               len;                    // length of src
+    int                 raw;                    // don't compress or encrypt, just checksum
+    int                 check_zero;             // raw data is a whole block; check if it's all zeroes
+    int                 zero;                   // the data was all zeroes (if check_zero)
+    void                *buf;                   // I/O buffer holding the encoded data (if any)
+    int                 compressed;
+    int                 encrypted;
+    int                 aead;                   // encrypted with AES-GCM, so there's no separate hmac
+    u_char              hmac[SHA_DIGEST_LENGTH];
+    u_char              md5[MD5_DIGEST_LENGTH];
+    char                sha256[SHA256_DIGEST_LENGTH * 2 + 1];   // hex payload hash (if needed for auth)
+};
+
+/* Block decoding job */
+struct decode_job {
+    struct http_io      *io;                    // the completed read
+    void                *dest;                  // where to put the decoded block
+    u_int               did_read;               // length of data read; replaced by the decoded length
+    int                 encrypted;
+};
+
 /* s3backer_store functions */
 static int http_io_meta_data(struct s3backer_store *s3b, off_t *file_sizep, u_int *block_sizep);
 static int http_io_set_mounted(struct s3backer_store *s3b, int *old_valuep, int new_value);
+static int http_io_save_nonzero(struct http_io_private *priv, int save);
+static size_t http_io_put_varint(u_char *buf, size_t len, size_t max, uint64_t value);
+static void http_io_put_uint(u_char *buf, uint64_t value, int nbytes);
+static uint64_t http_io_get_uint(const u_char *buf, int nbytes);
 static int http_io_read_block(struct s3backer_store *s3b, s3b_block_t block_num, void *dest,
   u_char *actual_md5, const u_char *expect_md5, int strict);
 static int http_io_write_block(struct s3backer_store *s3b, s3b_block_t block_num, const void *src, u_char *md5,
@@ -206,6 +628,10 @@ static int http_io_write_block(struct s3backer_store *s3b, s3b_block_t block_num
 static int http_io_read_block_part(struct s3backer_store *s3b, s3b_block_t block_num, u_int off, u_int len, void *dest);
 static int http_io_write_block_part(struct s3backer_store *s3b, s3b_block_t block_num, u_int off, u_int len, const void *src);
 static int http_io_list_blocks(struct s3backer_store *s3b, block_list_func_t *callback, void *arg);
+static int http_io_list_range(struct http_io_private *priv, block_list_func_t *callback, void *arg,
+  uintmax_t min, uintmax_t max);
+static void *http_io_list_range_main(void *arg);
+static void http_io_list_range_callback(void *arg, s3b_block_t block_num);
 static int http_io_flush(struct s3backer_store *s3b);
 static void http_io_destroy(struct s3backer_store *s3b);
 
@@ -215,13 +641,51 @@ static http_io_curl_prepper_t http_io_read_prepper;
 static http_io_curl_prepper_t http_io_write_prepper;
 static http_io_curl_prepper_t http_io_list_prepper;
 static http_io_curl_prepper_t http_io_iamcreds_prepper;
+static http_io_curl_prepper_t http_io_copy_prepper;
+static http_io_curl_prepper_t http_io_post_prepper;
 
 /* S3 REST API functions */
 static void http_io_get_block_url(char *buf, size_t bufsiz, struct http_io_conf *config, s3b_block_t block_num);
+static void http_io_get_plain_block_url(char *buf, size_t bufsiz, struct http_io_conf *config, s3b_block_t block_num);
+static uintmax_t http_io_block_hash(struct http_io_conf *config, s3b_block_t block_num);
 static void http_io_get_mounted_flag_url(char *buf, size_t bufsiz, struct http_io_conf *config);
+static void http_io_get_nonzero_url(char *buf, size_t bufsiz, struct http_io_conf *config);
+static void http_io_get_migrating_flag_url(char *buf, size_t bufsiz, struct http_io_conf *config);
+static void http_io_get_hashed_flag_url(char *buf, size_t bufsiz, struct http_io_conf *config);
+static int http_io_set_flag(struct http_io_private *priv, const char *url, int *old_valuep, int new_value);
+static void http_io_get_packed_flag_url(char *buf, size_t bufsiz, struct http_io_conf *config);
+static int http_io_object_exists(struct http_io_private *priv, const char *url, int *existsp);
+static int http_io_head_etag(struct http_io_private *priv, const char *url, u_char *md5, char *etag, size_t etag_size);
+static void http_io_get_cas_url(char *buf, size_t bufsiz, struct http_io_conf *config, const char *hash);
 static int http_io_add_auth(struct http_io_private *priv, struct http_io *io, time_t now, const void *payload, size_t plen);
-static int http_io_add_auth2(struct http_io_private *priv, struct http_io *io, time_t now, const void *payload, size_t plen);
-static int http_io_add_auth4(struct http_io_private *priv, struct http_io *io, time_t now, const void *payload, size_t plen);
+static int http_io_add_auth2(struct http_io_private *priv, const struct credentials *creds, struct http_io *io,
+  time_t now, const void *payload, size_t plen);
+static int http_io_add_auth4(struct http_io_private *priv, struct credentials *creds, struct http_io *io,
+  time_t now, const void *payload, size_t plen);
+static void http_io_auth4_sigkey(struct http_io_private *priv, struct credentials *creds, const char *datebuf,
+  u_char *sigkey, u_int *sigkey_lenp, char *scope);
+
+/* Credentials snapshots */
+static struct credentials *http_io_creds_new(const char *access_id, const char *access_key, const char *iam_token,
+  const struct auth4_sigkey *sigkey);
+static struct credentials *http_io_creds_acquire(struct http_io_private *priv, int *slotp);
+static void http_io_creds_release(struct http_io_private *priv, struct credentials *creds, int slot);
+static int http_io_creds_publish(struct http_io_private *priv, struct credentials *expect, struct credentials *creds);
+static void http_io_creds_reclaim(struct http_io_private *priv);
+
+/* HTTP/2 multiplexing thread */
+#if HAVE_CURL_HTTP2
+static void *http_io_multi_main(void *arg);
+#endif
+static CURLcode http_io_perform_curl(struct http_io_private *priv, CURL *curl);
+static void http_io_net_start(struct http_io_private *priv);
+
+/* Cipher context pool */
+static int http_io_cipher_run(struct http_io_private *priv, http_io_cipher_t *func, void *arg);
+static int http_io_encode_block(struct cipher_ctx *cctx, void *arg);
+static int http_io_decode_block(struct cipher_ctx *cctx, void *arg);
+static void http_io_key_ctx(struct cipher_ctx *cctx);
+static void http_io_unkey_ctx(struct cipher_ctx *cctx);
 
 /* EC2 IAM thread */
 static void *update_iam_credentials_main(void *arg);
@@ -236,6 +700,10 @@ static void http_io_list_text(void *arg, const XML_Char *s, int len);
 
 /* HTTP and curl functions */
 static int http_io_perform_io(struct http_io_private *priv, struct http_io *io, http_io_curl_prepper_t *prepper);
+#if HAVE_CURL_MULTI_WAIT
+static CURLcode http_io_perform_hedged(struct http_io_private *priv, struct http_io *io,
+  http_io_curl_prepper_t *prepper, CURL **curlp);
+#endif
 static size_t http_io_curl_reader(const void *ptr, size_t size, size_t nmemb, void *stream);
 static size_t http_io_curl_writer(void *ptr, size_t size, size_t nmemb, void *stream);
 static size_t http_io_curl_header(void *ptr, size_t size, size_t nmemb, void *stream);
@@ -244,25 +712,104 @@ static struct curl_slist *http_io_add_header(struct curl_slist *headers, const c
 static void http_io_add_date(struct http_io_private *priv, struct http_io *const io, time_t now);
 static CURL *http_io_acquire_curl(struct http_io_private *priv, struct http_io *io);
 static void http_io_release_curl(struct http_io_private *priv, CURL **curlp, int may_cache);
+#if HAVE_CURL_MULTI_WAIT
+static CURLM *http_io_acquire_multi(struct http_io_private *priv);
+static void http_io_release_multi(struct http_io_private *priv, CURLM *multi);
+#endif
+static void http_io_share_lock(CURL *curl, curl_lock_data data, curl_lock_access access, void *arg);
+static void http_io_share_unlock(CURL *curl, curl_lock_data data, void *arg);
 
 /* Misc */
 static void http_io_openssl_locker(int mode, int i, const char *file, int line);
 static u_long http_io_openssl_ider(void);
 static void http_io_base64_encode(char *buf, size_t bufsiz, const void *data, size_t len);
-static u_int http_io_crypt(struct http_io_private *priv, s3b_block_t block_num, int enc, const u_char *src, u_int len, u_char *dst);
-static void http_io_authsig(struct http_io_private *priv, s3b_block_t block_num, const u_char *src, u_int len, u_char *hmac);
+static u_int http_io_crypt(struct cipher_ctx *cctx, s3b_block_t block_num, int enc, const u_char *src, u_int len, u_char *dst);
+static void http_io_authsig(struct cipher_ctx *cctx, s3b_block_t block_num, const u_char *src, u_int len, u_char *hmac);
+#if HAVE_OPENSSL_GCM
+static int http_io_aead_crypt(struct cipher_ctx *cctx, s3b_block_t block_num, int enc,
+  const u_char *src, u_int len, u_char *dest, u_int *lenp);
+#endif
 static void update_hmac_from_header(HMAC_CTX *ctx, struct http_io *io,
   const char *name, int value_only, char *sigbuf, size_t sigbuflen);
 static int http_io_is_zero_block(const void *data, u_int block_size);
+static int http_io_digest(struct http_io_private *priv, const void *data, u_int len, int check_zero,
+  u_char *md5, char *sha256buf);
+static const char *http_io_payload_hash(struct http_io_private *priv, const char *sha256buf);
+static void *http_io_get_buf(struct http_io_private *priv);
+static void http_io_put_buf(struct http_io_private *priv, void *buf);
+static int http_io_compress(struct http_io_private *priv, s3b_block_t block_num,
+  const void *src, u_int len, void **bufp, u_int *lenp);
+static int http_io_compress_probe(struct http_io_private *priv, s3b_block_t block_num, const void *src, u_int len);
+static void http_io_compress_outcome(struct http_io_private *priv, s3b_block_t block_num, int compressible);
+static int http_io_decompress(struct http_io_private *priv, s3b_block_t block_num, const char *codec,
+  const void *src, u_int len, void *dest, u_int *lenp);
+#if HAVE_LIBZSTD
+static int http_io_zstd_load_dict(struct http_io_private *priv);
+static struct zstd_ctx *http_io_get_zstd(struct http_io_private *priv);
+static void http_io_put_zstd(struct http_io_private *priv, struct zstd_ctx *ctx);
+#endif
+static int http_io_cas_store(struct http_io_private *priv, s3b_block_t block_num, const void *src, char *refbuf, size_t refbufsiz);
+static int http_io_cas_follow(struct http_io_private *priv, struct http_io *io, u_int *did_readp);
+static int http_io_read_packed(struct http_io_private *priv, s3b_block_t block_num, void *dest,
+  u_char *actual_md5, const u_char *expect_md5, int strict);
+static int http_io_write_packed(struct http_io_private *priv, s3b_block_t block_num, const void *src, u_char *caller_md5);
+static int http_io_get_range(struct http_io_private *priv, s3b_block_t block_num, size_t obj_size,
+  size_t off, size_t len, void *dest, const u_char *expect_md5);
+static u_int http_io_pack_blocks(struct http_io_conf *config, s3b_block_t base);
+static int http_io_pack_put(struct http_io_private *priv, s3b_block_t base, u_int num_blocks, const void *src, u_char *md5);
+static void http_io_pack_release(struct pack_write *pw);
+static struct pack_md5 *http_io_pack_md5_get(struct http_io_private *priv, s3b_block_t base);
+static void http_io_pack_md5_put(struct http_io_private *priv, s3b_block_t base, const u_char *md5);
+static void http_io_pack_md5_free(struct http_io_private *priv);
+static int http_io_set_packed(struct http_io_private *priv);
+static int http_io_delete_batched(struct http_io_private *priv, s3b_block_t block_num);
+static int http_io_delete_object(struct http_io_private *priv, s3b_block_t block_num);
+static int http_io_delete_multi(struct http_io_private *priv, const s3b_block_t *blocks, u_int num_blocks, int *results);
+static void http_io_delete_release(struct delete_batch *db);
+static size_t http_io_xml_escape(char *buf, const char *s);
+static size_t http_io_url_escape(char *buf, const char *s, const char *keep);
+static int http_io_xml_field(const char *xml, const char *end, const char *name, char *buf, size_t bufsiz);
+static int http_io_is_subresource(const char *query);
+static int http_io_put_multipart(struct http_io_private *priv, struct http_io *io, time_t now, u_char *md5);
+static int http_io_get_multipart(struct http_io_private *priv, struct http_io *io, u_int *did_readp);
+static int http_io_multipart_run(struct multipart *mp);
+static void *http_io_multipart_main(void *arg);
+static int http_io_put_part(struct multipart *mp, u_int part);
+static int http_io_get_part(struct multipart *mp, u_int part);
+static void http_io_abort_multipart(struct multipart *mp, const char *upload_id);
 static int http_io_parse_hex(const char *str, u_char *buf, u_int nbytes);
 static void http_io_prhex(char *buf, const u_char *data, size_t len);
+static int http_io_nonzero_test(struct http_io_private *priv, s3b_block_t block_num);
+static void http_io_nonzero_set(struct http_io_private *priv, s3b_block_t block_num);
+static void http_io_count_evst(struct http_io_evst *evst, double secs);
+static struct rate_gov *http_io_get_gov(struct http_io_private *priv, struct http_io *io);
+static void http_io_gov_acquire(struct http_io_private *priv, struct rate_gov *gov);
+static void http_io_gov_feedback(struct http_io_private *priv, struct rate_gov *gov, int ok);
+#if HAVE_CURL_MULTI_WAIT
+static double http_io_hedge_threshold(struct http_io_private *priv);
+static int http_io_hedge_permit(struct http_io_private *priv);
+static void http_io_hedge_sample(struct http_io_private *priv, double ttfb);
+#endif
+static int http_io_init_endpoints(struct http_io_private *priv);
+static int http_io_add_endpoint(struct http_io_private *priv, const char *basehost, const char *name);
+static struct endpoint *http_io_endpoint_pick(struct http_io_private *priv, struct http_io *io, CURL *curl);
+static void http_io_endpoint_done(struct http_io_private *priv, struct endpoint *ep, CURL *curl, CURLcode curl_code);
+static int http_io_endpoint_failed(CURLcode curl_code);
+static double http_io_now(void);
 static int http_io_strcasecmp_ptr(const void *ptr1, const void *ptr2);
+#if HAVE_CURL_MULTI_WAIT
+static int http_io_double_cmp(const void *ptr1, const void *ptr2);
+#endif
 
 /* Internal variables */
 static pthread_mutex_t *openssl_locks;
 static int num_openssl_locks;
 static u_char zero_md5[MD5_DIGEST_LENGTH];
 static u_char zero_hmac[SHA_DIGEST_LENGTH];
+static u_int io_buf_threads;                            // threads that have used an I/O buffer pool
+static __thread u_int io_buf_hint = UINT_MAX;           // I/O buffer pool slot this thread last used
+static u_int creds_threads;                             // threads that have signed a request
+static __thread u_int creds_hint = UINT_MAX;            // credentials hazard pointer slot this thread last used
 
 /*
  * Constructor
@@ -275,7 +822,10 @@ http_io_create(struct http_io_conf *config)
     struct s3backer_store *s3b;
     struct http_io_private *priv;
     struct curl_holder *holder;
+    int nshare_locks = 0;
+    long nctx;
     int nlocks;
+    u_int i;
     int r;
 
     /* Sanity check: we can really only handle one instance */
@@ -306,9 +856,45 @@ http_io_create(struct http_io_conf *config)
     priv->config = config;
     if ((r = pthread_mutex_init(&priv->mutex, NULL)) != 0)
         goto fail2;
+    if ((r = pthread_mutex_init(&priv->gov_mutex, NULL)) != 0) {
+        pthread_mutex_destroy(&priv->mutex);
+        goto fail2;
+    }
+    if ((r = pthread_mutex_init(&priv->endpoint_mutex, NULL)) != 0) {
+        pthread_mutex_destroy(&priv->gov_mutex);
+        pthread_mutex_destroy(&priv->mutex);
+        goto fail2;
+    }
+    if ((r = pthread_cond_init(&priv->delete_wakeup, NULL)) != 0) {
+        pthread_mutex_destroy(&priv->endpoint_mutex);
+        pthread_mutex_destroy(&priv->gov_mutex);
+        pthread_mutex_destroy(&priv->mutex);
+        goto fail2;
+    }
     LIST_INIT(&priv->curls);
+    LIST_INIT(&priv->multis);
+    LIST_INIT(&priv->pack_writes);
+    TAILQ_INIT(&priv->pack_md5_list);
     s3b->data = priv;
 
+    /* I/O buffers are big enough for the worst case of compressed and/or encrypted data */
+    priv->io_buf_size = COMPRESS_BOUND(config->block_size) + ENCRYPT_OVERHEAD;
+
+    /* Keep as many free I/O buffers as fit within the pool's size limit, but at least one */
+    priv->io_buf_slots = IO_BUF_POOL_BYTES / priv->io_buf_size;
+    if (priv->io_buf_slots > IO_BUF_SLOTS)
+        priv->io_buf_slots = IO_BUF_SLOTS;
+    else if (priv->io_buf_slots == 0)
+        priv->io_buf_slots = 1;
+
+    /* Transfer blocks in parts if they can be large enough; content references and packed objects are always sent whole */
+    priv->multipart = config->multipart_size > 0 && !config->cas && config->pack_factor == 1
+      && priv->io_buf_size > config->multipart_size;
+
+    /* Rate governors don't limit anything until S3 first throttles us (S3's limits are per prefix, not per bucket) */
+    for (i = 0; i < GOV_NUM_CLASSES; i++)
+        priv->govs[i].interval_start = http_io_now();
+
     /* Initialize openssl */
     num_openssl_locks = CRYPTO_num_locks();
     if ((openssl_locks = malloc(num_openssl_locks * sizeof(*openssl_locks))) == NULL) {
@@ -331,13 +917,31 @@ http_io_create(struct http_io_conf *config)
         assert(config->password != NULL);
         assert(config->block_size % EVP_MAX_IV_LENGTH == 0);
 
-        /* Find encryption algorithm */
+        /* Find encryption algorithm; AES-GCM ciphers are paired with the CBC cipher used by older blocks */
         OpenSSL_add_all_ciphers();
-        if ((priv->cipher = EVP_get_cipherbyname(config->encryption)) == NULL) {
+#if HAVE_OPENSSL_GCM
+        for (i = 0; i < sizeof(aead_ciphers) / sizeof(*aead_ciphers); i++) {
+            if (strcasecmp(config->encryption, aead_ciphers[i].name) == 0) {
+                priv->cipher = EVP_get_cipherbynid(aead_ciphers[i].cbc_nid);
+                priv->use_aead = 1;
+                break;
+            }
+        }
+#endif
+        if (priv->cipher == NULL && (priv->cipher = EVP_get_cipherbyname(config->encryption)) == NULL) {
             (*config->log)(LOG_ERR, "unknown encryption cipher `%s'", config->encryption);
             r = EINVAL;
             goto fail4;
         }
+#if HAVE_OPENSSL_GCM
+        for (i = 0; i < sizeof(aead_ciphers) / sizeof(*aead_ciphers); i++) {
+            if (EVP_CIPHER_nid(priv->cipher) == aead_ciphers[i].cbc_nid) {
+                priv->aead_cipher = (*aead_ciphers[i].cipher)();
+                priv->aead_name = aead_ciphers[i].name;
+                break;
+            }
+        }
+#endif
         if (EVP_CIPHER_block_size(priv->cipher) != EVP_CIPHER_iv_length(priv->cipher)) {
             (*config->log)(LOG_ERR, "invalid encryption cipher `%s': block size %d != IV length %d",
               config->encryption, EVP_CIPHER_block_size(priv->cipher), EVP_CIPHER_iv_length(priv->cipher));
@@ -369,6 +973,18 @@ http_io_create(struct http_io_conf *config)
             goto fail4;
         }
 
+        /*
+         * Hash the bulk encryption key with a distinct salt to get the AES-GCM key. CBC blocks keep using the
+         * bulk key for both encryption and their HMAC, as they always have, so existing blocks stay readable.
+         */
+        if (priv->aead_cipher != NULL && (r = PKCS5_PBKDF2_HMAC_SHA1((char *)priv->key, priv->keylen,
+          (const u_char *)GCM_KEY_SALT, strlen(GCM_KEY_SALT), PBKDF2_ITERATIONS,
+          EVP_CIPHER_key_length(priv->aead_cipher), priv->aead_key)) != 1) {
+            (*config->log)(LOG_ERR, "failed to create encryption key");
+            r = EINVAL;
+            goto fail4;
+        }
+
         /* Encryption debug */
 #if DEBUG_ENCRYPTION
     {
@@ -381,15 +997,116 @@ http_io_create(struct http_io_conf *config)
 #endif
     }
 
+    /* Initialize compression */
+    priv->codec = config->compress_codec != NULL ? config->compress_codec : COMPRESS_DEFLATE;
+    if (config->compress != Z_NO_COMPRESSION
+      && (priv->compress_scores = calloc((config->num_blocks + COMPRESS_REGION_BLOCKS - 1) / COMPRESS_REGION_BLOCKS, 1)) == NULL) {
+        r = errno;
+        goto fail4;
+    }
+#if HAVE_LIBZSTD
+    LIST_INIT(&priv->zstd_ctxs);
+    if (config->compress_dict != NULL && (r = http_io_zstd_load_dict(priv)) != 0)
+        goto fail4;
+#endif
+
+    /* Initialize endpoints */
+    if ((r = http_io_init_endpoints(priv)) != 0)
+        goto fail4;
+
     /* Initialize cURL */
     curl_global_init(CURL_GLOBAL_ALL);
 
+    /*
+     * Share DNS and TLS session caches between handles. Not the connection cache: each pooled handle already
+     * keeps its own connection alive, and a shared cache would serialize every request on one lock.
+     */
+    for (nshare_locks = 0; nshare_locks < CURL_LOCK_DATA_LAST; nshare_locks++) {
+        if ((r = pthread_mutex_init(&priv->share_locks[nshare_locks], NULL)) != 0)
+            goto fail5;
+    }
+    if ((priv->share = curl_share_init()) == NULL) {
+        (*config->log)(LOG_ERR, "curl_share_init() failed");
+        r = ENOMEM;
+        goto fail5;
+    }
+    curl_share_setopt(priv->share, CURLSHOPT_LOCKFUNC, http_io_share_lock);
+    curl_share_setopt(priv->share, CURLSHOPT_UNLOCKFUNC, http_io_share_unlock);
+    curl_share_setopt(priv->share, CURLSHOPT_USERDATA, priv);
+    curl_share_setopt(priv->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(priv->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+    /* Start HTTP/2 multiplexing thread */
+    TAILQ_INIT(&priv->multi_queue);
+    if (config->http2 > 0) {
+#if HAVE_CURL_HTTP2
+        if ((priv->multi = curl_multi_init()) == NULL) {
+            (*config->log)(LOG_ERR, "curl_multi_init() failed");
+            r = EIO;
+            goto fail6;
+        }
+        curl_multi_setopt(priv->multi, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+        curl_multi_setopt(priv->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)config->http2);
+        if (pipe(priv->multi_pipe) == -1) {
+            r = errno;
+            (*config->log)(LOG_ERR, "pipe: %s", strerror(r));
+            goto fail7;
+        }
+        (void)fcntl(priv->multi_pipe[0], F_SETFL, fcntl(priv->multi_pipe[0], F_GETFL) | O_NONBLOCK);
+        (void)fcntl(priv->multi_pipe[1], F_SETFL, fcntl(priv->multi_pipe[1], F_GETFL) | O_NONBLOCK);
+        if ((r = pthread_create(&priv->multi_thread, NULL, http_io_multi_main, priv)) != 0)
+            goto fail8;
+#else
+        (*config->log)(LOG_ERR, "HTTP/2 is not supported by this version of cURL");
+        r = ENOTSUP;
+        goto fail6;
+#endif
+    }
+
+    /* Set up cipher context pool, with one context per core unless configured otherwise */
+    SLIST_INIT(&priv->cipher_idle);
+    if ((r = pthread_mutex_init(&priv->cipher_mutex, NULL)) != 0)
+        goto fail9;
+    if ((r = pthread_cond_init(&priv->cipher_wakeup, NULL)) != 0) {
+        pthread_mutex_destroy(&priv->cipher_mutex);
+        goto fail9;
+    }
+    nctx = config->crypto_contexts > 0 ? config->crypto_contexts : sysconf(_SC_NPROCESSORS_ONLN);
+    if (nctx < 1)
+        nctx = 1;
+    if ((priv->cipher_ctxs = calloc(nctx, sizeof(*priv->cipher_ctxs))) == NULL) {
+        r = errno;
+        goto fail10;
+    }
+    for (priv->num_cipher_ctxs = 0; priv->num_cipher_ctxs < nctx; priv->num_cipher_ctxs++) {
+        struct cipher_ctx *const cctx = &priv->cipher_ctxs[priv->num_cipher_ctxs];
+
+        cctx->priv = priv;
+        if (config->encryption != NULL)
+            http_io_key_ctx(cctx);
+        SLIST_INSERT_HEAD(&priv->cipher_idle, cctx, link);
+    }
+
+    /* Remember the MD5s of packed objects we write for as long as the MD5 cache protects blocks */
+    if (config->pack_factor > 1 && config->md5_cache_size > 0 && config->md5_cache_time > 0) {
+        if ((r = s3b_hash_create(&priv->pack_md5s, config->md5_cache_size)) != 0)
+            goto fail11;
+    }
+
+    /* Publish configured credentials, if any */
+    if (config->accessId != NULL) {
+        if ((priv->creds = http_io_creds_new(config->accessId, config->accessKey, NULL, NULL)) == NULL) {
+            r = errno;
+            goto fail11;
+        }
+    }
+
     /* Initialize IAM credentials and start updater thread */
     if (config->ec2iam_role != NULL) {
         if ((r = update_iam_credentials(priv)) != 0)
-            goto fail5;
+            goto fail11;
         if ((r = pthread_create(&priv->iam_thread, NULL, update_iam_credentials_main, priv)) != 0)
-            goto fail5;
+            goto fail11;
     }
 
     /* Take ownership of non-zero block bitmap */
@@ -399,14 +1116,52 @@ http_io_create(struct http_io_conf *config)
     /* Done */
     return s3b;
 
-fail5:
+fail11:
+    http_io_pack_md5_free(priv);
+    while (priv->num_cipher_ctxs > 0)
+        http_io_unkey_ctx(&priv->cipher_ctxs[--priv->num_cipher_ctxs]);
+    free(priv->cipher_ctxs);
+fail10:
+    pthread_cond_destroy(&priv->cipher_wakeup);
+    pthread_mutex_destroy(&priv->cipher_mutex);
+fail9:
+    if (priv->multi != NULL) {
+        pthread_mutex_lock(&priv->mutex);
+        priv->shutting_down = 1;
+        pthread_mutex_unlock(&priv->mutex);
+        (void)write(priv->multi_pipe[1], "", 1);
+        pthread_join(priv->multi_thread, NULL);
+    }
+#if HAVE_CURL_HTTP2
+fail8:
+    if (priv->multi != NULL) {
+        close(priv->multi_pipe[0]);
+        close(priv->multi_pipe[1]);
+    }
+fail7:
+    if (priv->multi != NULL)
+        curl_multi_cleanup(priv->multi);
+#endif
+fail6:
     while ((holder = LIST_FIRST(&priv->curls)) != NULL) {
         curl_easy_cleanup(holder->curl);
         LIST_REMOVE(holder, link);
         free(holder);
     }
+    curl_share_cleanup(priv->share);
+fail5:
+    while (nshare_locks > 0)
+        pthread_mutex_destroy(&priv->share_locks[--nshare_locks]);
     curl_global_cleanup();
 fail4:
+    while (priv->num_endpoints > 0)
+        curl_slist_free_all(priv->endpoints[--priv->num_endpoints].connect_to);
+    free(priv->endpoints);
+#if HAVE_LIBZSTD
+    ZSTD_freeCDict(priv->zstd_cdict);
+    ZSTD_freeDDict(priv->zstd_ddict);
+#endif
+    free(priv->compress_scores);
     CRYPTO_set_locking_callback(NULL);
     CRYPTO_set_id_callback(NULL);
     while (nlocks > 0)
@@ -415,6 +1170,10 @@ fail4:
     openssl_locks = NULL;
     num_openssl_locks = 0;
 fail3:
+    free(priv->creds);
+    pthread_cond_destroy(&priv->delete_wakeup);
+    pthread_mutex_destroy(&priv->endpoint_mutex);
+    pthread_mutex_destroy(&priv->gov_mutex);
     pthread_mutex_destroy(&priv->mutex);
 fail2:
     free(priv);
@@ -434,7 +1193,12 @@ http_io_destroy(struct s3backer_store *const s3b)
 {
     struct http_io_private *const priv = s3b->data;
     struct http_io_conf *const config = priv->config;
+    struct multi_holder *mholder;
     struct curl_holder *holder;
+#if HAVE_LIBZSTD
+    struct zstd_ctx *zctx;
+#endif
+    int i;
     int r;
 
     /* Shut down IAM thread */
@@ -449,6 +1213,13 @@ http_io_destroy(struct s3backer_store *const s3b)
             (*config->log)(LOG_DEBUG, "EC2 IAM thread successfully shutdown");
     }
 
+    /* Free cipher context pool */
+    for (i = 0; i < priv->num_cipher_ctxs; i++)
+        http_io_unkey_ctx(&priv->cipher_ctxs[i]);
+    pthread_cond_destroy(&priv->cipher_wakeup);
+    pthread_mutex_destroy(&priv->cipher_mutex);
+    free(priv->cipher_ctxs);
+
     /* Clean up openssl */
     while (num_openssl_locks > 0)
         pthread_mutex_destroy(&openssl_locks[--num_openssl_locks]);
@@ -457,15 +1228,69 @@ http_io_destroy(struct s3backer_store *const s3b)
     CRYPTO_set_locking_callback(NULL);
     CRYPTO_set_id_callback(NULL);
 
+    /* Shut down HTTP/2 multiplexing thread */
+    if (priv->multi != NULL) {
+        pthread_mutex_lock(&priv->mutex);
+        assert(TAILQ_EMPTY(&priv->multi_queue));
+        assert(priv->multi_active == 0);
+        pthread_mutex_unlock(&priv->mutex);
+        (void)write(priv->multi_pipe[1], "", 1);
+        if ((r = pthread_join(priv->multi_thread, NULL)) != 0)
+            (*config->log)(LOG_ERR, "pthread_join: %s", strerror(r));
+        close(priv->multi_pipe[0]);
+        close(priv->multi_pipe[1]);
+    }
+
     /* Clean up cURL */
     while ((holder = LIST_FIRST(&priv->curls)) != NULL) {
         curl_easy_cleanup(holder->curl);
         LIST_REMOVE(holder, link);
         free(holder);
     }
+    while ((mholder = LIST_FIRST(&priv->multis)) != NULL) {
+        curl_multi_cleanup(mholder->multi);
+        LIST_REMOVE(mholder, link);
+        free(mholder);
+    }
+    if (priv->multi != NULL)
+        curl_multi_cleanup(priv->multi);
+    curl_share_cleanup(priv->share);
+    for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+        pthread_mutex_destroy(&priv->share_locks[i]);
     curl_global_cleanup();
 
+    /* Free I/O buffers */
+    for (i = 0; i < IO_BUF_SLOTS; i++)
+        free(priv->io_bufs[i]);
+
+    /* Free compression state */
+#if HAVE_LIBZSTD
+    while ((zctx = LIST_FIRST(&priv->zstd_ctxs)) != NULL) {
+        LIST_REMOVE(zctx, link);
+        ZSTD_freeCCtx(zctx->cctx);
+        ZSTD_freeDCtx(zctx->dctx);
+        free(zctx);
+    }
+    ZSTD_freeCDict(priv->zstd_cdict);
+    ZSTD_freeDDict(priv->zstd_ddict);
+#endif
+    free(priv->compress_scores);
+
+    /* Free endpoints */
+    while (priv->num_endpoints > 0)
+        curl_slist_free_all(priv->endpoints[--priv->num_endpoints].connect_to);
+    free(priv->endpoints);
+
     /* Free structures */
+    free(priv->creds);
+    http_io_creds_reclaim(priv);
+    assert(priv->creds_retired == NULL);
+    assert(LIST_EMPTY(&priv->pack_writes));
+    http_io_pack_md5_free(priv);
+    assert(priv->delete_batch == NULL);
+    pthread_cond_destroy(&priv->delete_wakeup);
+    pthread_mutex_destroy(&priv->endpoint_mutex);
+    pthread_mutex_destroy(&priv->gov_mutex);
     pthread_mutex_destroy(&priv->mutex);
     free(priv->non_zero);
     free(priv);
@@ -482,10 +1307,40 @@ void
 http_io_get_stats(struct s3backer_store *s3b, struct http_io_stats *stats)
 {
     struct http_io_private *const priv = s3b->data;
+    const double now = http_io_now();
+    u_int i;
 
+    /* Counters updated atomically may keep changing while we copy; that's OK for statistics */
     pthread_mutex_lock(&priv->mutex);
     memcpy(stats, &priv->stats, sizeof(*stats));
     pthread_mutex_unlock(&priv->mutex);
+
+    /* Get cipher context pool stats */
+    pthread_mutex_lock(&priv->cipher_mutex);
+    stats->crypto_jobs = priv->stats.crypto_jobs;
+    stats->crypto_queue_depth = priv->stats.crypto_queue_depth;
+    stats->crypto_max_queue_depth = priv->stats.crypto_max_queue_depth;
+    pthread_mutex_unlock(&priv->cipher_mutex);
+
+    /* Get current request rate limits and hedging threshold */
+    pthread_mutex_lock(&priv->gov_mutex);
+    stats->gov_get_rate = (u_int)priv->govs[GOV_GET].rate;
+    stats->gov_put_rate = (u_int)priv->govs[GOV_PUT].rate;
+    stats->gov_delete_rate = (u_int)priv->govs[GOV_DELETE].rate;
+    stats->hedge_threshold = (u_int)(priv->hedge_threshold * 1000.0);
+    pthread_mutex_unlock(&priv->gov_mutex);
+
+    /* Get endpoint stats */
+    pthread_mutex_lock(&priv->endpoint_mutex);
+    stats->num_endpoints = priv->num_endpoints;
+    for (i = 0; i < priv->num_endpoints; i++) {
+        const struct endpoint *const ep = &priv->endpoints[i];
+
+        stats->endpoints[i] = ep->stats;
+        stats->endpoints[i].latency = (u_int)(ep->ewma * 1000.0);
+        stats->endpoints[i].ejected = ep->ejected_until > now;
+    }
+    pthread_mutex_unlock(&priv->endpoint_mutex);
 }
 
 static int
@@ -493,8 +1348,104 @@ http_io_list_blocks(struct s3backer_store *s3b, block_list_func_t *callback, voi
 {
     struct http_io_private *const priv = s3b->data;
     struct http_io_conf *const config = priv->config;
-    char marker[sizeof("&marker=") + strlen(config->prefix) + S3B_BLOCK_NUM_DIGITS + 1];
+    struct list_state state;
+    struct list_range *ranges;
+    uintmax_t keyspace;
+    u_int num_ranges;
+    u_int num_started;
+    u_int i;
+    int r;
+
+    /*
+     * Split the keyspace into ranges, one per thread, each worth at least one listing page. Keys sort
+     * by block number, or with hashed keys by hash prefix, so that's what we split.
+     */
+    keyspace = config->hash_prefix > 0 ? (uintmax_t)1 << (config->hash_prefix * 4) : (uintmax_t)config->num_blocks;
+    num_ranges = config->list_threads;
+    if (num_ranges > (config->num_blocks + LIST_BLOCKS_CHUNK - 1) / LIST_BLOCKS_CHUNK)
+        num_ranges = (config->num_blocks + LIST_BLOCKS_CHUNK - 1) / LIST_BLOCKS_CHUNK;
+    if (num_ranges > keyspace)
+        num_ranges = keyspace;
+    if (num_ranges <= 1)
+        return http_io_list_range(priv, callback, arg, 0, 0);
+
+    /* Initialize shared state */
+    memset(&state, 0, sizeof(state));
+    state.priv = priv;
+    state.callback = callback;
+    state.arg = arg;
+    if ((r = pthread_mutex_init(&state.mutex, NULL)) != 0)
+        return r;
+    if ((ranges = calloc(num_ranges, sizeof(*ranges))) == NULL) {
+        r = errno;
+        pthread_mutex_destroy(&state.mutex);
+        return r;
+    }
+
+    /* List each range in its own thread; the last range runs to the end of the bucket */
+    for (num_started = 0; num_started < num_ranges; num_started++) {
+        struct list_range *const range = &ranges[num_started];
+
+        range->state = &state;
+        range->min = (keyspace * num_started) / num_ranges;
+        range->max = num_started < num_ranges - 1 ? (keyspace * (num_started + 1)) / num_ranges : 0;
+        if ((r = pthread_create(&range->thread, NULL, http_io_list_range_main, range)) != 0) {
+            (*config->log)(LOG_ERR, "pthread_create: %s", strerror(r));
+            break;
+        }
+    }
+
+    /* Wait for threads to finish and collect the first error (if any) */
+    for (i = 0; i < num_started; i++) {
+        pthread_join(ranges[i].thread, NULL);
+        if (r == 0)
+            r = ranges[i].r;
+    }
+
+    /* Done */
+    free(ranges);
+    pthread_mutex_destroy(&state.mutex);
+    return r;
+}
+
+static void *
+http_io_list_range_main(void *arg)
+{
+    struct list_range *const range = arg;
+    struct list_state *const state = range->state;
+
+    range->r = http_io_list_range(state->priv, http_io_list_range_callback, state, range->min, range->max);
+    return NULL;
+}
+
+/*
+ * Callback used by concurrent range listings; callers expect callbacks to happen one at a time.
+ */
+static void
+http_io_list_range_callback(void *arg, s3b_block_t block_num)
+{
+    struct list_state *const state = arg;
+
+    pthread_mutex_lock(&state->mutex);
+    (*state->callback)(state->arg, block_num);
+    pthread_mutex_unlock(&state->mutex);
+}
+
+/*
+ * List the blocks starting at block `min' up to but not including block `max' (if non-zero), using
+ * our own marker and XML parser so multiple ranges can be listed concurrently.
+ *
+ * With hashed keys, `min' and `max' are hash prefixes instead of block numbers.
+ */
+static int
+http_io_list_range(struct http_io_private *priv, block_list_func_t *callback, void *arg, uintmax_t min, uintmax_t max)
+{
+    struct http_io_conf *const config = priv->config;
+    char marker[sizeof("&marker=") + LIST_MAX_KEY(config) + 1];
     char urlbuf[URL_BUF_SIZE(config) + sizeof(marker) + 32];
+    char start_key[LIST_MAX_KEY(config) + 1];
+    char end_key[LIST_MAX_KEY(config) + 1];
+    const int key_digits = config->hash_prefix > 0 ? (int)config->hash_prefix : S3B_BLOCK_NUM_DIGITS;
     struct http_io io;
     int r;
 
@@ -514,16 +1465,40 @@ http_io_list_blocks(struct s3backer_store *s3b, block_list_func_t *callback, voi
     }
 
     /* Allocate buffers for XML path and tag text content */
-    io.xml_text_max = strlen(config->prefix) + S3B_BLOCK_NUM_DIGITS + 10;
+    io.xml_text_max = LIST_MAX_KEY(config);
     if ((io.xml_text = malloc(io.xml_text_max + 1)) == NULL) {
         (*config->log)(LOG_ERR, "malloc: %s", strerror(errno));
         goto oom;
     }
+    if ((io.last_key = calloc(1, io.xml_text_max + 1)) == NULL) {
+        (*config->log)(LOG_ERR, "calloc: %s", strerror(errno));
+        goto oom;
+    }
     if ((io.xml_path = calloc(1, 1)) == NULL) {
         (*config->log)(LOG_ERR, "calloc: %s", strerror(errno));
         goto oom;
     }
 
+    /*
+     * List keys from the key for `min' up to but not including the key for `max', which is where the
+     * next range starts, so every key belongs to exactly one range. Hashed keys are longer than their
+     * hash prefix, so the prefix itself sorts just before the first key having it and can serve as the
+     * marker; otherwise the marker is the key for block `min - 1', and any keys that sort after it but
+     * before the key for `min' (which the previous range lists) are skipped.
+     */
+    if (min > 0) {
+        snprintf(start_key, sizeof(start_key), "%s%0*jx", config->prefix, key_digits, min);
+        io.list_start = start_key;
+        if (config->hash_prefix > 0)
+            snprintf(io.last_key, io.xml_text_max + 1, "%s", start_key);
+        else
+            snprintf(io.last_key, io.xml_text_max + 1, "%s%0*jx", config->prefix, key_digits, min - 1);
+    }
+    if (max > 0) {
+        snprintf(end_key, sizeof(end_key), "%s%0*jx", config->prefix, key_digits, max);
+        io.list_end = end_key;
+    }
+
     /* List blocks */
     do {
         const time_t now = time(NULL);
@@ -538,10 +1513,8 @@ http_io_list_blocks(struct s3backer_store *s3b, block_list_func_t *callback, voi
         snprintf(urlbuf, sizeof(urlbuf), "%s%s?", config->baseURL, config->vhost ? "" : config->bucket);
 
         /* Add URL parameters (note: must be in "canonical query string" format for proper authentication) */
-        if (io.list_truncated) {
-            snprintf(urlbuf + strlen(urlbuf), sizeof(urlbuf) - strlen(urlbuf), "%s=%s%0*jx&",
-              LIST_PARAM_MARKER, config->prefix, S3B_BLOCK_NUM_DIGITS, (uintmax_t)io.last_block);
-        }
+        if (*io.last_key != '\0')
+            snprintf(urlbuf + strlen(urlbuf), sizeof(urlbuf) - strlen(urlbuf), "%s=%s&", LIST_PARAM_MARKER, io.last_key);
         snprintf(urlbuf + strlen(urlbuf), sizeof(urlbuf) - strlen(urlbuf), "%s=%u", LIST_PARAM_MAX_KEYS, LIST_BLOCKS_CHUNK);
         snprintf(urlbuf + strlen(urlbuf), sizeof(urlbuf) - strlen(urlbuf), "&%s=%s", LIST_PARAM_PREFIX, config->prefix);
 
@@ -577,12 +1550,13 @@ http_io_list_blocks(struct s3backer_store *s3b, block_list_func_t *callback, voi
             r = EIO;
             goto fail;
         }
-    } while (io.list_truncated);
+    } while (io.list_truncated && !io.list_stop);
 
     /* Done */
     XML_ParserFree(io.xml);
     free(io.xml_path);
     free(io.xml_text);
+    free(io.last_key);
     return 0;
 
 oom:
@@ -598,6 +1572,7 @@ fail:
         XML_ParserFree(io.xml);
     free(io.xml_path);
     free(io.xml_text);
+    free(io.last_key);
     return r;
 }
 
@@ -654,16 +1629,26 @@ http_io_list_elem_end(void *arg, const XML_Char *name)
 {
     struct http_io *const io = (struct http_io *)arg;
     s3b_block_t block_num;
+    u_int i;
 
     /* Handle <Truncated> tag */
     if (strcmp(io->xml_path, "/" LIST_ELEM_LIST_BUCKET_RESLT "/" LIST_ELEM_IS_TRUNCATED) == 0)
         io->list_truncated = strcmp(io->xml_text, LIST_TRUE) == 0;
 
-    /* Handle <Key> tag */
+    /* Handle <Key> tag; stop if we've reached the end of our range (if any) */
     else if (strcmp(io->xml_path, "/" LIST_ELEM_LIST_BUCKET_RESLT "/" LIST_ELEM_CONTENTS "/" LIST_ELEM_KEY) == 0) {
-        if (http_io_parse_block(io->config, io->xml_text, &block_num) == 0) {
-            (*io->callback_func)(io->callback_arg, block_num);
-            io->last_block = block_num;
+        if (io->list_end != NULL && strcmp(io->xml_text, io->list_end) >= 0)
+            io->list_stop = 1;
+        if (!io->list_stop) {
+            if ((io->list_start == NULL || strcmp(io->xml_text, io->list_start) >= 0)
+              && http_io_parse_block(io->config, io->xml_text, &block_num) == 0
+              && block_num % io->config->pack_factor == 0) {
+                for (i = 0; i < io->config->pack_factor && block_num + i < io->config->num_blocks; i++)
+                    (*io->callback_func)(io->callback_arg, block_num + i);
+            }
+
+            /* Remember every key (not just blocks) so the next marker always makes progress */
+            memcpy(io->last_key, io->xml_text, io->xml_text_len + 1);
         }
     }
 
@@ -693,12 +1678,15 @@ http_io_list_text(void *arg, const XML_Char *s, int len)
 
 /*
  * Parse a block's item name (including prefix) and set the corresponding bit in the bitmap.
+ *
+ * Only names in the configured key layout (hashed or not) are recognized.
  */
 int
 http_io_parse_block(struct http_io_conf *config, const char *name, s3b_block_t *block_nump)
 {
     const size_t plen = strlen(config->prefix);
     s3b_block_t block_num = 0;
+    uintmax_t hash = 0;
     int i;
 
     /* Check prefix */
@@ -706,6 +1694,17 @@ http_io_parse_block(struct http_io_conf *config, const char *name, s3b_block_t *
         return -1;
     name += plen;
 
+    /* Parse hash prefix (if any) */
+    for (i = 0; i < (int)config->hash_prefix; i++) {
+        char ch = name[i];
+
+        if (!isxdigit(ch))
+            return -1;
+        hash <<= 4;
+        hash |= ch <= '9' ? ch - '0' : tolower(ch) - 'a' + 10;
+    }
+    name += config->hash_prefix;
+
     /* Parse block number */
     for (i = 0; i < S3B_BLOCK_NUM_DIGITS; i++) {
         char ch = name[i];
@@ -720,6 +1719,10 @@ http_io_parse_block(struct http_io_conf *config, const char *name, s3b_block_t *
     if (i != S3B_BLOCK_NUM_DIGITS || name[i] != '\0' || block_num >= config->num_blocks)
         return -1;
 
+    /* Verify hash prefix */
+    if (config->hash_prefix > 0 && hash != http_io_block_hash(config, block_num))
+        return -1;
+
     /* Done */
     *block_nump = block_num;
     return 0;
@@ -730,7 +1733,7 @@ http_io_meta_data(struct s3backer_store *s3b, off_t *file_sizep, u_int *block_si
 {
     struct http_io_private *const priv = s3b->data;
     struct http_io_conf *const config = priv->config;
-    char urlbuf[URL_BUF_SIZE(config)];
+    char urlbuf[URL_BUF_SIZE(config) + sizeof(PACKED_FLAG)];
     const time_t now = time(NULL);
     struct http_io io;
     int r;
@@ -740,6 +1743,32 @@ http_io_meta_data(struct s3backer_store *s3b, off_t *file_sizep, u_int *block_si
     io.url = urlbuf;
     io.method = HTTP_HEAD;
 
+    /* Check the packed layout marker first, because the first block's object is deleted when it's all zeroes */
+    http_io_get_packed_flag_url(urlbuf, sizeof(urlbuf), config);
+    http_io_add_date(priv, &io, now);
+    if ((r = http_io_add_auth(priv, &io, now, NULL, 0)) != 0)
+        goto done;
+    switch ((r = http_io_perform_io(priv, &io, http_io_head_prepper))) {
+    case 0:
+        if (io.pack_factor != config->pack_factor) {
+            (*config->log)(LOG_ERR, "data store has pack factor %u but pack factor %u is configured",
+              io.pack_factor, config->pack_factor);
+            r = EINVAL;
+            goto done;
+        }
+        break;
+    case ENOENT:
+        break;
+    default:
+        goto done;
+    }
+
+    /* Reset I/O info */
+    curl_slist_free_all(io.headers);
+    memset(&io, 0, sizeof(io));
+    io.url = urlbuf;
+    io.method = HTTP_HEAD;
+
     /* Construct URL for the first block */
     http_io_get_block_url(urlbuf, sizeof(urlbuf), config, 0);
 
@@ -751,7 +1780,22 @@ http_io_meta_data(struct s3backer_store *s3b, off_t *file_sizep, u_int *block_si
         goto done;
 
     /* Perform operation */
-    if ((r = http_io_perform_io(priv, &io, http_io_head_prepper)) != 0)
+    r = http_io_perform_io(priv, &io, http_io_head_prepper);
+
+    /* With hashed keys, also look for the first block under its plain key, so we can auto-detect before migrating */
+    if (r == ENOENT && config->hash_prefix > 0) {
+        curl_slist_free_all(io.headers);
+        io.headers = NULL;
+        http_io_get_plain_block_url(urlbuf, sizeof(urlbuf), config, 0);
+        http_io_add_date(priv, &io, now);
+        if ((r = http_io_add_auth(priv, &io, now, NULL, 0)) != 0)
+            goto done;
+        if ((r = http_io_perform_io(priv, &io, http_io_head_prepper)) == 0) {
+            (*config->log)(LOG_WARNING, "block zero is stored under its plain key;"
+              " use `--migrateKeys' to move blocks to the hashed key layout");
+        }
+    }
+    if (r != 0)
         goto done;
 
     /* Extract filesystem sizing information */
@@ -762,6 +1806,16 @@ http_io_meta_data(struct s3backer_store *s3b, off_t *file_sizep, u_int *block_si
     *file_sizep = (off_t)io.file_size;
     *block_sizep = io.block_size;
 
+    /* Check the object layout matches (objects written before packing existed have no pack factor) */
+    if (io.pack_factor == 0)
+        io.pack_factor = 1;
+    if (io.pack_factor != config->pack_factor) {
+        (*config->log)(LOG_ERR, "data store has pack factor %u but pack factor %u is configured",
+          io.pack_factor, config->pack_factor);
+        r = EINVAL;
+        goto done;
+    }
+
 done:
     /*  Clean up */
     curl_slist_free_all(io.headers);
@@ -822,6 +1876,24 @@ http_io_set_mounted(struct s3backer_store *s3b, int *old_valuep, int new_value)
         }
     }
 
+    /*
+     * Save the non-zero block bitmap on a clean unmount; otherwise, delete any saved copy. A mount that
+     * can't invalidate the saved copy must fail, because it would not reflect blocks written by this mount.
+     */
+    if (new_value != -1 && (r = http_io_save_nonzero(priv, !new_value && priv->non_zero != NULL)) != 0) {
+        (*config->log)(LOG_ERR, "failed to %s non-zero block bitmap: %s",
+          !new_value && priv->non_zero != NULL ? "save" : "delete", strerror(r));
+        if (new_value)
+            goto done;
+        r = 0;
+    }
+
+    /* Record the packed layout in an object that, unlike the first block's, is never deleted */
+    if (new_value == 1 && config->pack_factor > 1 && (r = http_io_set_packed(priv)) != 0) {
+        (*config->log)(LOG_ERR, "failed to write packed layout marker: %s", strerror(r));
+        goto done;
+    }
+
     /* Set new value */
     if (new_value != -1) {
         char content[_POSIX_HOST_NAME_MAX + DATE_BUF_SIZE + 32];
@@ -882,20 +1954,353 @@ done:
     return r;
 }
 
-static int
-update_iam_credentials(struct http_io_private *const priv)
+/*
+ * Load the non-zero block bitmap saved by the last clean unmount, if any.
+ *
+ * Returns ENOENT if there is no usable saved bitmap, in which case the caller should list the bucket instead.
+ */
+int
+http_io_load_nonzero_bitmap(struct s3backer_store *s3b, u_int **bitmapp, uintmax_t *countp)
 {
+    struct http_io_private *const priv = s3b->data;
     struct http_io_conf *const config = priv->config;
-    char urlbuf[sizeof(EC2_IAM_META_DATA_URLBASE) + 128];
+    const int bits_per_word = sizeof(**bitmapp) * 8;
+    const size_t nwords = (config->num_blocks + bits_per_word - 1) / bits_per_word;
+    const size_t max_size = NONZERO_HEADER_SIZE + (config->num_blocks + 7) / 8;
+    char urlbuf[URL_BUF_SIZE(config) + sizeof(NONZERO_BITMAP)];
+    const time_t now = time(NULL);
+    u_char md5[MD5_DIGEST_LENGTH];
+    u_char *buf = NULL;
+    u_int *bitmap = NULL;
     struct http_io io;
-    char buf[2048] = { '\0' };
-    char *access_id = NULL;
-    char *access_key = NULL;
-    char *iam_token = NULL;
-    size_t buflen;
+    uint64_t generation;
+    uint64_t count;
+    u_int encoding;
+    size_t len;
+    int mounted;
     int r;
 
-    /* Build URL */
+    /* If the mounted flag is set, the last shutdown was not clean and any saved bitmap can't be trusted */
+    if ((r = http_io_set_mounted(s3b, &mounted, -1)) != 0)
+        return r;
+    if (mounted) {
+        (*config->log)(LOG_INFO, "mounted flag is set; ignoring any saved non-zero block bitmap");
+        return ENOENT;
+    }
+
+    /* Allocate buffers (an encoded bitmap is never larger than the raw bitmap) */
+    if ((buf = malloc(max_size)) == NULL) {
+        r = errno;
+        goto fail;
+    }
+    if ((bitmap = calloc(nwords, sizeof(*bitmap))) == NULL) {
+        r = errno;
+        goto fail;
+    }
+
+    /* Initialize I/O info */
+    memset(&io, 0, sizeof(io));
+    io.url = urlbuf;
+    io.method = HTTP_GET;
+    io.dest = buf;
+    io.buf_size = max_size;
+    http_io_get_nonzero_url(urlbuf, sizeof(urlbuf), config);
+
+    /* Add Date header */
+    http_io_add_date(priv, &io, now);
+
+    /* Add Authorization header */
+    if ((r = http_io_add_auth(priv, &io, now, NULL, 0)) != 0)
+        goto fail;
+
+    /* Fetch saved bitmap */
+    r = http_io_perform_io(priv, &io, http_io_read_prepper);
+    curl_slist_free_all(io.headers);
+    if (r != 0)
+        goto fail;
+    len = io.buf_size - io.bufs.rdremain;
+
+    /* Check header */
+    r = ENOENT;
+    if (len < NONZERO_HEADER_SIZE || memcmp(buf, NONZERO_BITMAP_MAGIC, NONZERO_MAGIC_LENGTH) != 0
+      || http_io_get_uint(buf + 16, 4) != NONZERO_BITMAP_VERSION) {
+        (*config->log)(LOG_WARNING, "saved non-zero block bitmap is invalid; ignoring it");
+        goto fail;
+    }
+    encoding = http_io_get_uint(buf + 20, 4);
+    if (http_io_get_uint(buf + 24, 4) != config->block_size || http_io_get_uint(buf + 32, 8) != config->num_blocks) {
+        (*config->log)(LOG_WARNING, "saved non-zero block bitmap is for a different block size or count; ignoring it");
+        goto fail;
+    }
+    generation = http_io_get_uint(buf + 40, 8);
+    count = http_io_get_uint(buf + 48, 8);
+    MD5(buf + NONZERO_HEADER_SIZE, len - NONZERO_HEADER_SIZE, md5);
+    if (memcmp(md5, buf + 56, MD5_DIGEST_LENGTH) != 0) {
+        (*config->log)(LOG_WARNING, "saved non-zero block bitmap has the wrong checksum; ignoring it");
+        goto fail;
+    }
+
+    /* Decode bitmap */
+    if (http_io_decode_nonzero(config, encoding, buf + NONZERO_HEADER_SIZE, len - NONZERO_HEADER_SIZE, bitmap) != count) {
+        (*config->log)(LOG_WARNING, "saved non-zero block bitmap is corrupted; ignoring it");
+        goto fail;
+    }
+
+    /* Done */
+    (*config->log)(LOG_INFO, "loaded saved non-zero block bitmap generation %ju (%ju blocks)",
+      (uintmax_t)generation, (uintmax_t)count);
+    config->nonzero_generation = generation;
+    free(buf);
+    *bitmapp = bitmap;
+    *countp = count;
+    return 0;
+
+fail:
+    free(bitmap);
+    free(buf);
+    return r;
+}
+
+/*
+ * Save the non-zero block bitmap to its companion object, or delete that object if we have no bitmap.
+ *
+ * The bitmap is run-length encoded unless that would make it bigger. Since blocks written by a mount that's
+ * not tracking them would not appear in the bitmap, we delete the saved copy whenever the filesystem is mounted.
+ */
+static int
+http_io_save_nonzero(struct http_io_private *priv, int save)
+{
+    struct http_io_conf *const config = priv->config;
+    const size_t raw_size = (config->num_blocks + 7) / 8;
+    char urlbuf[URL_BUF_SIZE(config) + sizeof(NONZERO_BITMAP)];
+    char md5buf[(MD5_DIGEST_LENGTH * 4) / 3 + 4];
+    const time_t now = time(NULL);
+    u_char md5[MD5_DIGEST_LENGTH];
+    u_char *buf = NULL;
+    struct http_io io;
+    uint64_t count = 0;
+    u_int encoding;
+    size_t len = 0;
+    int r;
+
+    /* Initialize I/O info */
+    memset(&io, 0, sizeof(io));
+    io.url = urlbuf;
+    io.method = save ? HTTP_PUT : HTTP_DELETE;
+    http_io_get_nonzero_url(urlbuf, sizeof(urlbuf), config);
+
+    /* Encode bitmap */
+    if (save) {
+        if ((buf = malloc(NONZERO_HEADER_SIZE + raw_size)) == NULL)
+            return errno;
+        count = http_io_encode_nonzero(config, priv->non_zero, buf + NONZERO_HEADER_SIZE, raw_size, &len, &encoding);
+        MD5(buf + NONZERO_HEADER_SIZE, len, md5);
+        memcpy(buf, NONZERO_BITMAP_MAGIC, NONZERO_MAGIC_LENGTH);
+        http_io_put_uint(buf + 16, NONZERO_BITMAP_VERSION, 4);
+        http_io_put_uint(buf + 20, encoding, 4);
+        http_io_put_uint(buf + 24, config->block_size, 4);
+        http_io_put_uint(buf + 28, 0, 4);
+        http_io_put_uint(buf + 32, config->num_blocks, 8);
+        http_io_put_uint(buf + 40, config->nonzero_generation + 1, 8);
+        http_io_put_uint(buf + 48, count, 8);
+        memcpy(buf + 56, md5, MD5_DIGEST_LENGTH);
+        io.src = buf;
+        io.buf_size = NONZERO_HEADER_SIZE + len;
+
+        /* Add Content-Type, Content-MD5 and ACL headers */
+        MD5(buf, io.buf_size, md5);
+        http_io_base64_encode(md5buf, sizeof(md5buf), md5, MD5_DIGEST_LENGTH);
+        io.headers = http_io_add_header(io.headers, "%s: %s", CTYPE_HEADER, NONZERO_BITMAP_CONTENT_TYPE);
+        io.headers = http_io_add_header(io.headers, "%s: %s", MD5_HEADER, md5buf);
+        io.headers = http_io_add_header(io.headers, "%s: %s", ACL_HEADER, config->accessType);
+    }
+
+    /* Add Date header */
+    http_io_add_date(priv, &io, now);
+
+    /* Add Authorization header */
+    if ((r = http_io_add_auth(priv, &io, now, io.src, io.buf_size)) != 0)
+        goto done;
+
+    /* Perform operation */
+    r = http_io_perform_io(priv, &io, http_io_write_prepper);
+    if (r == ENOENT && !save)
+        r = 0;
+    if (r == 0 && save) {
+        config->nonzero_generation++;
+        (*config->log)(LOG_INFO, "saved non-zero block bitmap generation %ju (%ju blocks, %u bytes)",
+          (uintmax_t)config->nonzero_generation, (uintmax_t)count, (u_int)io.buf_size);
+    }
+
+done:
+    /* Clean up */
+    curl_slist_free_all(io.headers);
+    free(buf);
+    return r;
+}
+
+/*
+ * Encode the non-zero block bitmap into `buf', run-length encoded if that fits within `raw_size' bytes,
+ * otherwise as raw bits. Returns the number of bits set, and sets *encodingp to the encoding used.
+ *
+ * Runs alternate between zero and non-zero blocks, starting with zero blocks, and each run's length
+ * is encoded as a base 128 varint. The bitmap is read atomically, so no lock is needed.
+ */
+uint64_t
+http_io_encode_nonzero(struct http_io_conf *config, const u_int *bitmap, u_char *buf, size_t raw_size,
+  size_t *lenp, u_int *encodingp)
+{
+    const int bits_per_word = sizeof(*bitmap) * 8;
+    uint64_t count = 0;
+    uint64_t run = 0;
+    size_t len = 0;
+    int value = 0;
+    off_t i;
+
+    /* Run-length encode, bailing out if that gets too big */
+    for (i = 0; i < config->num_blocks; ) {
+        const u_int word = ATOMIC_LOAD(&bitmap[i / bits_per_word]);
+
+        /* Skip whole words that continue the current run */
+        if (i % bits_per_word == 0 && i + bits_per_word <= config->num_blocks && word == (value ? ~0U : 0)) {
+            run += bits_per_word;
+            i += bits_per_word;
+            continue;
+        }
+
+        /* Check the next bit */
+        if (((word >> (i % bits_per_word)) & 1) != value) {
+            if ((len = http_io_put_varint(buf, len, raw_size, run)) == 0)
+                goto raw;
+            if (value)
+                count += run;
+            value = !value;
+            run = 0;
+        }
+        run++;
+        i++;
+    }
+    if ((len = http_io_put_varint(buf, len, raw_size, run)) == 0)
+        goto raw;
+    if (value)
+        count += run;
+    if (len < raw_size) {
+        *lenp = len;
+        *encodingp = NONZERO_ENCODING_RLE;
+        return count;
+    }
+
+raw:
+    /* Store raw bits */
+    memset(buf, 0, raw_size);
+    for (count = 0, i = 0; i < config->num_blocks; i++) {
+        if ((ATOMIC_LOAD(&bitmap[i / bits_per_word]) & (1 << (i % bits_per_word))) != 0) {
+            buf[i / 8] |= 1 << (i % 8);
+            count++;
+        }
+    }
+    *lenp = raw_size;
+    *encodingp = NONZERO_ENCODING_RAW;
+    return count;
+}
+
+/*
+ * Decode a saved non-zero block bitmap. Returns the number of bits set, or (uint64_t)-1 if the encoding is invalid.
+ */
+uint64_t
+http_io_decode_nonzero(struct http_io_conf *config, u_int encoding, const u_char *buf, size_t len, u_int *bitmap)
+{
+    const int bits_per_word = sizeof(*bitmap) * 8;
+    uint64_t count = 0;
+    uint64_t run;
+    size_t pos = 0;
+    int value = 0;
+    off_t i;
+
+    switch (encoding) {
+    case NONZERO_ENCODING_RAW:
+        if (len != (config->num_blocks + 7) / 8)
+            return (uint64_t)-1;
+        for (i = 0; i < config->num_blocks; i++) {
+            if ((buf[i / 8] & (1 << (i % 8))) != 0) {
+                bitmap[i / bits_per_word] |= 1 << (i % bits_per_word);
+                count++;
+            }
+        }
+        return count;
+    case NONZERO_ENCODING_RLE:
+        for (i = 0; pos < len; value = !value) {
+            for (run = 0; pos < len; pos++) {
+                run = (run << 7) | (buf[pos] & 0x7f);
+                if ((buf[pos] & 0x80) == 0)
+                    break;
+            }
+            if (pos++ == len || run > (uint64_t)(config->num_blocks - i))
+                return (uint64_t)-1;
+            if (value) {
+                for (count += run; run > 0; run--, i++)
+                    bitmap[i / bits_per_word] |= 1 << (i % bits_per_word);
+            } else
+                i += run;
+        }
+        return i == config->num_blocks ? count : (uint64_t)-1;
+    default:
+        return (uint64_t)-1;
+    }
+}
+
+/*
+ * Append a varint (most significant group first) to `buf'. Returns the new length, or zero if it won't fit.
+ */
+static size_t
+http_io_put_varint(u_char *buf, size_t len, size_t max, uint64_t value)
+{
+    int shift;
+
+    for (shift = 63; shift > 0 && (value >> shift) == 0; shift -= 7)
+        ;
+    for (; shift >= 0; shift -= 7) {
+        if (len == max)
+            return 0;
+        buf[len++] = ((value >> shift) & 0x7f) | (shift > 0 ? 0x80 : 0);
+    }
+    return len;
+}
+
+static void
+http_io_put_uint(u_char *buf, uint64_t value, int nbytes)
+{
+    while (nbytes-- > 0) {
+        buf[nbytes] = (u_char)value;
+        value >>= 8;
+    }
+}
+
+static uint64_t
+http_io_get_uint(const u_char *buf, int nbytes)
+{
+    uint64_t value = 0;
+
+    while (nbytes-- > 0)
+        value = (value << 8) | *buf++;
+    return value;
+}
+
+static int
+update_iam_credentials(struct http_io_private *const priv)
+{
+    struct http_io_conf *const config = priv->config;
+    char urlbuf[sizeof(EC2_IAM_META_DATA_URLBASE) + 128];
+    struct http_io io;
+    char buf[2048] = { '\0' };
+    char *access_id = NULL;
+    char *access_key = NULL;
+    char *iam_token = NULL;
+    struct credentials *creds;
+    size_t buflen;
+    int r;
+
+    /* Build URL */
     snprintf(urlbuf, sizeof(urlbuf), "%s%s", EC2_IAM_META_DATA_URLBASE, config->ec2iam_role);
 
     /* Initialize I/O info */
@@ -928,15 +2333,19 @@ update_iam_credentials(struct http_io_private *const priv)
         return EINVAL;
     }
 
-    /* Update credentials */
-    pthread_mutex_lock(&priv->mutex);
-    free(config->accessId);
-    free(config->accessKey);
-    free(config->iam_token);
-    config->accessId = access_id;
-    config->accessKey = access_key;
-    config->iam_token = iam_token;
-    pthread_mutex_unlock(&priv->mutex);
+    /* Build new credentials snapshot */
+    creds = http_io_creds_new(access_id, access_key, iam_token, NULL);
+    r = errno;
+    free(access_id);
+    free(access_key);
+    free(iam_token);
+    if (creds == NULL) {
+        (*config->log)(LOG_ERR, "failed to update EC2 IAM credentials: %s", strerror(r));
+        return r;
+    }
+
+    /* Publish it; signers still using the previous snapshot keep it alive until they're done */
+    http_io_creds_publish(priv, NULL, creds);
     (*config->log)(LOG_INFO, "successfully updated EC2 IAM credentials from %s", io.url);
 
     /* Done */
@@ -1028,7 +2437,7 @@ http_io_read_block(struct s3backer_store *const s3b, s3b_block_t block_num, void
     int encrypted = 0;
     struct http_io io;
     u_int did_read;
-    char *layer;
+    int multipart;
     int r;
 
     /* Sanity check */
@@ -1036,38 +2445,31 @@ http_io_read_block(struct s3backer_store *const s3b, s3b_block_t block_num, void
         return EINVAL;
 
     /* Read zero blocks when bitmap indicates empty until non-zero content is written */
-    if (priv->non_zero != NULL) {
-        const int bits_per_word = sizeof(*priv->non_zero) * 8;
-        const int word = block_num / bits_per_word;
-        const int bit = 1 << (block_num % bits_per_word);
-
-        pthread_mutex_lock(&priv->mutex);
-        if ((priv->non_zero[word] & bit) == 0) {
-            priv->stats.empty_blocks_read++;
-            pthread_mutex_unlock(&priv->mutex);
-            memset(dest, 0, config->block_size);
-            if (actual_md5 != NULL)
-                memset(actual_md5, 0, MD5_DIGEST_LENGTH);
-            return 0;
-        }
-        pthread_mutex_unlock(&priv->mutex);
+    if (priv->non_zero != NULL && !http_io_nonzero_test(priv, block_num)) {
+        STATS_INC(priv, empty_blocks_read);
+        memset(dest, 0, config->block_size);
+        if (actual_md5 != NULL)
+            memset(actual_md5, 0, MD5_DIGEST_LENGTH);
+        return 0;
     }
 
+    /* Packed blocks are read individually from within their object */
+    if (config->pack_factor > 1)
+        return http_io_read_packed(priv, block_num, dest, actual_md5, expect_md5, strict);
+
     /* Initialize I/O info */
     memset(&io, 0, sizeof(io));
     io.url = urlbuf;
     io.method = HTTP_GET;
     io.block_num = block_num;
 
-    /* Allocate a buffer in case compressed and/or encrypted data is larger */
-    io.buf_size = compressBound(config->block_size) + EVP_MAX_IV_LENGTH;
-    if ((io.dest = malloc(io.buf_size)) == NULL) {
-        (*config->log)(LOG_ERR, "malloc: %s", strerror(errno));
-        pthread_mutex_lock(&priv->mutex);
-        priv->stats.out_of_memory_errors++;
-        pthread_mutex_unlock(&priv->mutex);
+    /* Duplicate slow reads, unless multiplexing (the duplicate would likely share the slow request's connection) */
+    io.hedge = config->hedge_percentile > 0 && priv->multi == NULL;
+
+    /* Get a buffer in case compressed and/or encrypted data is larger */
+    io.buf_size = priv->io_buf_size;
+    if ((io.dest = http_io_get_buf(priv)) == NULL)
         return ENOMEM;
-    }
 
     /* Construct URL for this block */
     http_io_get_block_url(urlbuf, sizeof(urlbuf), config, block_num);
@@ -1075,175 +2477,122 @@ http_io_read_block(struct s3backer_store *const s3b, s3b_block_t block_num, void
     /* Add Date header */
     http_io_add_date(priv, &io, now);
 
+    /* Large blocks are read in parts, starting here with the first */
+    multipart = priv->multipart;
+    if (multipart) {
+        io.buf_size = config->multipart_size;
+        io.headers = http_io_add_header(io.headers, "%s: bytes=0-%u", RANGE_HEADER, config->multipart_size - 1);
+    }
+
     /* Add If-Match or If-None-Match header as required */
+    r = 0;
     if (expect_md5 != NULL && memcmp(expect_md5, zero_md5, MD5_DIGEST_LENGTH) != 0) {
         char md5buf[MD5_DIGEST_LENGTH * 2 + 1];
+        char etag[sizeof(io.etag)];
         const char *header;
 
-        if (strict)
+        /*
+         * A multipart upload's ETag is the MD5 of its parts' MD5s plus a "-N" suffix, which we can't predict,
+         * so for large blocks HEAD the object to get its raw ETag first. That settles the matter without any
+         * download if it's stale or unchanged; otherwise, we read it on condition that it still has that ETag.
+         */
+        if (multipart) {
+            if ((r = http_io_head_etag(priv, urlbuf, io.md5, etag, sizeof(etag))) == 0) {
+                const int match = memcmp(io.md5, expect_md5, MD5_DIGEST_LENGTH) == 0;
+
+                if (strict && !match) {
+                    (*config->log)(LOG_ERR, "rec'd stale content: %s %s", HTTP_HEAD, io.url);
+                    STATS_INC(priv, http_stale);
+                    r = EIO;
+                } else if (!strict && match)
+                    r = EEXIST;
+            }
             header = IF_MATCH_HEADER;
-        else {
-            header = IF_NONE_MATCH_HEADER;
-            io.expect_304 = 1;
+        } else {
+            http_io_prhex(md5buf, expect_md5, MD5_DIGEST_LENGTH);
+            snprintf(etag, sizeof(etag), "\"%s\"", md5buf);
+            if (strict)
+                header = IF_MATCH_HEADER;
+            else {
+                header = IF_NONE_MATCH_HEADER;
+                io.expect_304 = 1;
+            }
         }
-        http_io_prhex(md5buf, expect_md5, MD5_DIGEST_LENGTH);
-        io.headers = http_io_add_header(io.headers, "%s: \"%s\"", header, md5buf);
+        if (r == 0 && *etag != '\0')
+            io.headers = http_io_add_header(io.headers, "%s: %s", header, etag);
     }
 
-    /* Add Authorization header */
-    if ((r = http_io_add_auth(priv, &io, now, NULL, 0)) != 0)
-        goto fail;
-
-    /* Perform operation */
-    r = http_io_perform_io(priv, &io, http_io_read_prepper);
+    /* Add Authorization header and perform operation */
+    if (r == 0) {
+        if ((r = http_io_add_auth(priv, &io, now, NULL, 0)) != 0)
+            goto fail;
+        r = http_io_perform_io(priv, &io, http_io_read_prepper);
+    }
 
     /* Determine how many bytes we read */
     did_read = io.buf_size - io.bufs.rdremain;
 
-    /* Check Content-Encoding and decode if necessary */
-    for ( ; r == 0 && *io.content_encoding != '\0'; *layer = '\0') {
-
-        /* Find next encoding layer */
-        if ((layer = strrchr(io.content_encoding, ',')) != NULL)
-            *layer++ = '\0';
-        else
-            layer = io.content_encoding;
-
-        /* Sanity check */
-        if (io.dest == NULL)
-            goto bad_encoding;
-
-        /* Check for encryption (which must have been applied after compression) */
-        if (strncasecmp(layer, CONTENT_ENCODING_ENCRYPT "-", sizeof(CONTENT_ENCODING_ENCRYPT)) == 0) {
-            const char *const block_cipher = layer + sizeof(CONTENT_ENCODING_ENCRYPT);
-            u_char hmac[SHA_DIGEST_LENGTH];
-            u_char *buf;
+    /* Read the rest of a large block */
+    if (r == 0 && multipart)
+        r = http_io_get_multipart(priv, &io, &did_read);
 
-            /* Encryption must be enabled */
-            if (config->encryption == NULL) {
-                (*config->log)(LOG_ERR, "block %0*jx is encrypted with `%s' but `--encrypt' was not specified",
-                  S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num, block_cipher);
-                r = EIO;
-                break;
-            }
+    /* If we read a content reference, go get the content */
+    if (r == 0)
+        r = http_io_cas_follow(priv, &io, &did_read);
 
-            /* Verify encryption type */
-            if (strcasecmp(block_cipher, EVP_CIPHER_name(priv->cipher)) != 0) {
-                (*config->log)(LOG_ERR, "block %0*jx was encrypted using `%s' but `%s' encryption is configured",
-                  S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num, block_cipher, EVP_CIPHER_name(priv->cipher));
-                r = EIO;
-                break;
-            }
+    /* Check Content-Encoding and decode if necessary */
+    if (r == 0 && *io.content_encoding != '\0') {
+        struct decode_job job;
+
+        memset(&job, 0, sizeof(job));
+        job.io = &io;
+        job.dest = dest;
+        job.did_read = did_read;
+        r = http_io_cipher_run(priv, http_io_decode_block, &job);
+        did_read = job.did_read;
+        encrypted = job.encrypted;
+    }
 
-            /* Verify block's signature */
-            if (memcmp(io.hmac, zero_hmac, sizeof(io.hmac)) == 0) {
-                (*config->log)(LOG_ERR, "block %0*jx is encrypted, but no signature was found",
-                  S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num);
-                r = EIO;
-                break;
-            }
-            http_io_authsig(priv, block_num, io.dest, did_read, hmac);
-            if (memcmp(io.hmac, hmac, sizeof(hmac)) != 0) {
-                (*config->log)(LOG_ERR, "block %0*jx has an incorrect signature (did you provide the right password?)",
-                  S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num);
-                r = EIO;
-                break;
-            }
+    /* Check for required encryption */
+    if (r == 0 && config->encryption != NULL && !encrypted) {
+        (*config->log)(LOG_ERR, "block %0*jx was supposed to be encrypted but wasn't", S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num);
+        r = EIO;
+    }
 
-            /* Allocate buffer for the decrypted data */
-            if ((buf = malloc(did_read + EVP_MAX_IV_LENGTH)) == NULL) {
-                (*config->log)(LOG_ERR, "malloc: %s", strerror(errno));
-                pthread_mutex_lock(&priv->mutex);
-                priv->stats.out_of_memory_errors++;
-                pthread_mutex_unlock(&priv->mutex);
-                r = ENOMEM;
-                break;
-            }
+    /* Check for wrong length read */
+    if (r == 0 && did_read != config->block_size) {
+        (*config->log)(LOG_ERR, "read of block %0*jx returned %lu != %lu bytes",
+          S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num, (u_long)did_read, (u_long)config->block_size);
+        r = EIO;
+    }
 
-            /* Decrypt the block */
-            did_read = http_io_crypt(priv, block_num, 0, io.dest, did_read, buf);
-            memcpy(io.dest, buf, did_read);
-            free(buf);
+    /* Verify content read via a reference actually has the hash named by that reference */
+    if (r == 0 && io.cas_followed) {
+        u_char hash[SHA256_DIGEST_LENGTH];
 
-            /* Proceed */
-            encrypted = 1;
-            continue;
+        SHA256(io.dest != NULL ? io.dest : dest, config->block_size, hash);
+        if (memcmp(hash, io.cas_hash, SHA256_DIGEST_LENGTH) != 0) {
+            (*config->log)(LOG_ERR, "block %0*jx content does not match its content reference",
+              S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num);
+            r = EIO;
         }
+    }
 
-        /* Check for compression */
-        if (strcasecmp(layer, CONTENT_ENCODING_DEFLATE) == 0) {
-            u_long uclen = config->block_size;
-
-            switch (uncompress(dest, &uclen, io.dest, did_read)) {
-            case Z_OK:
-                did_read = uclen;
-                free(io.dest);
-                io.dest = NULL;         /* compression should have been first */
-                r = 0;
-                break;
-            case Z_MEM_ERROR:
-                (*config->log)(LOG_ERR, "zlib uncompress: %s", strerror(ENOMEM));
-                pthread_mutex_lock(&priv->mutex);
-                priv->stats.out_of_memory_errors++;
-                pthread_mutex_unlock(&priv->mutex);
-                r = ENOMEM;
-                break;
-            case Z_BUF_ERROR:
-                (*config->log)(LOG_ERR, "zlib uncompress: %s", "decompressed block is oversize");
-                r = EIO;
-                break;
-            case Z_DATA_ERROR:
-                (*config->log)(LOG_ERR, "zlib uncompress: %s", "data is corrupted or truncated");
-                r = EIO;
-                break;
-            default:
-                (*config->log)(LOG_ERR, "unknown zlib compress2() error %d", r);
-                r = EIO;
-                break;
-            }
-
-            /* Proceed */
-            continue;
-        }
-
-bad_encoding:
-        /* It was something we don't recognize */
-        (*config->log)(LOG_ERR, "read of block %0*jx returned unexpected encoding \"%s\"",
-          S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num, layer);
-        r = EIO;
-        break;
-    }
-
-    /* Check for required encryption */
-    if (r == 0 && config->encryption != NULL && !encrypted) {
-        (*config->log)(LOG_ERR, "block %0*jx was supposed to be encrypted but wasn't", S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num);
-        r = EIO;
-    }
-
-    /* Check for wrong length read */
-    if (r == 0 && did_read != config->block_size) {
-        (*config->log)(LOG_ERR, "read of block %0*jx returned %lu != %lu bytes",
-          S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num, (u_long)did_read, (u_long)config->block_size);
-        r = EIO;
-    }
-
-    /* Copy the data to the desination buffer (if we haven't already) */
-    if (r == 0 && io.dest != NULL)
-        memcpy(dest, io.dest, config->block_size);
+    /* Copy the data to the desination buffer (if we haven't already) */
+    if (r == 0 && io.dest != NULL)
+        memcpy(dest, io.dest, config->block_size);
 
     /* Update stats */
-    pthread_mutex_lock(&priv->mutex);
     switch (r) {
     case 0:
-        priv->stats.normal_blocks_read++;
+        STATS_INC(priv, normal_blocks_read);
         break;
     case ENOENT:
-        priv->stats.zero_blocks_read++;
+        STATS_INC(priv, zero_blocks_read);
         break;
     default:
         break;
     }
-    pthread_mutex_unlock(&priv->mutex);
 
     /* Check expected MD5 */
     if (expect_md5 != NULL) {
@@ -1267,14 +2616,10 @@ bad_encoding:
         if (!strict) {
             switch (r) {
             case 0:
-                pthread_mutex_lock(&priv->mutex);
-                priv->stats.http_mismatch++;
-                pthread_mutex_unlock(&priv->mutex);
+                STATS_INC(priv, http_mismatch);
                 break;
             case EEXIST:
-                pthread_mutex_lock(&priv->mutex);
-                priv->stats.http_verified++;
-                pthread_mutex_unlock(&priv->mutex);
+                STATS_INC(priv, http_verified);
                 break;
             default:
                 break;
@@ -1294,12 +2639,192 @@ bad_encoding:
 
 fail:
     /*  Clean up */
-    if (io.dest != NULL)
-        free(io.dest);
+    http_io_put_buf(priv, io.dest);
     curl_slist_free_all(io.headers);
     return r;
 }
 
+/*
+ * Decode (i.e., verify, decrypt and decompress) a block that was read with some Content-Encoding.
+ * This runs with a context borrowed from the cipher context pool.
+ */
+static int
+http_io_decode_block(struct cipher_ctx *cctx, void *arg)
+{
+    struct http_io_private *const priv = cctx->priv;
+    struct http_io_conf *const config = priv->config;
+    struct decode_job *const job = arg;
+    struct http_io *const io = job->io;
+    const s3b_block_t block_num = io->block_num;
+    char *layer;
+    int r = 0;
+
+    for ( ; r == 0 && *io->content_encoding != '\0'; *layer = '\0') {
+
+        /* Find next encoding layer */
+        if ((layer = strrchr(io->content_encoding, ',')) != NULL)
+            *layer++ = '\0';
+        else
+            layer = io->content_encoding;
+
+        /* Sanity check */
+        if (io->dest == NULL)
+            goto bad_encoding;
+
+#if HAVE_OPENSSL_GCM
+        /* Check for AES-GCM encryption (which must have been applied after compression) */
+        if (strncasecmp(layer, CONTENT_ENCODING_AEAD "-", sizeof(CONTENT_ENCODING_AEAD)) == 0) {
+            const char *const block_cipher = layer + sizeof(CONTENT_ENCODING_AEAD);
+            u_char *buf;
+
+            /* Encryption must be enabled with a compatible cipher */
+            if (config->encryption == NULL) {
+                (*config->log)(LOG_ERR, "block %0*jx is encrypted with `%s' but `--encrypt' was not specified",
+                  S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num, block_cipher);
+                r = EIO;
+                break;
+            }
+            if (priv->aead_cipher == NULL || strcasecmp(block_cipher, priv->aead_name) != 0) {
+                (*config->log)(LOG_ERR, "block %0*jx was encrypted using `%s' but `%s' encryption is configured",
+                  S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num, block_cipher, config->encryption);
+                r = EIO;
+                break;
+            }
+
+            /* Get buffer for the decrypted data */
+            if ((buf = http_io_get_buf(priv)) == NULL) {
+                r = ENOMEM;
+                break;
+            }
+
+            /* Authenticate and decrypt the block */
+            if (http_io_aead_crypt(cctx, block_num, 0, io->dest, job->did_read, buf, &job->did_read) != 0) {
+                (*config->log)(LOG_ERR, "block %0*jx failed authentication (did you provide the right password?)",
+                  S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num);
+                http_io_put_buf(priv, buf);
+                r = EIO;
+                break;
+            }
+            memcpy(io->dest, buf, job->did_read);
+            http_io_put_buf(priv, buf);
+
+            /* Proceed */
+            job->encrypted = 1;
+            continue;
+        }
+#endif
+
+        /* Check for encryption (which must have been applied after compression) */
+        if (strncasecmp(layer, CONTENT_ENCODING_ENCRYPT "-", sizeof(CONTENT_ENCODING_ENCRYPT)) == 0) {
+            const char *const block_cipher = layer + sizeof(CONTENT_ENCODING_ENCRYPT);
+            u_char hmac[SHA_DIGEST_LENGTH];
+            u_char *buf;
+
+            /* Encryption must be enabled */
+            if (config->encryption == NULL) {
+                (*config->log)(LOG_ERR, "block %0*jx is encrypted with `%s' but `--encrypt' was not specified",
+                  S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num, block_cipher);
+                r = EIO;
+                break;
+            }
+
+            /* Verify encryption type */
+            if (strcasecmp(block_cipher, EVP_CIPHER_name(priv->cipher)) != 0) {
+                (*config->log)(LOG_ERR, "block %0*jx was encrypted using `%s' but `%s' encryption is configured",
+                  S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num, block_cipher, EVP_CIPHER_name(priv->cipher));
+                r = EIO;
+                break;
+            }
+
+            /* Verify block's signature */
+            if (memcmp(io->hmac, zero_hmac, sizeof(io->hmac)) == 0) {
+                (*config->log)(LOG_ERR, "block %0*jx is encrypted, but no signature was found",
+                  S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num);
+                r = EIO;
+                break;
+            }
+            http_io_authsig(cctx, block_num, io->dest, job->did_read, hmac);
+            if (memcmp(io->hmac, hmac, sizeof(hmac)) != 0) {
+                (*config->log)(LOG_ERR, "block %0*jx has an incorrect signature (did you provide the right password?)",
+                  S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num);
+                r = EIO;
+                break;
+            }
+
+            /* Get buffer for the decrypted data */
+            assert(job->did_read + ENCRYPT_OVERHEAD <= priv->io_buf_size);
+            if ((buf = http_io_get_buf(priv)) == NULL) {
+                r = ENOMEM;
+                break;
+            }
+
+            /* Decrypt the block */
+            job->did_read = http_io_crypt(cctx, block_num, 0, io->dest, job->did_read, buf);
+            memcpy(io->dest, buf, job->did_read);
+            http_io_put_buf(priv, buf);
+
+            /* Proceed */
+            job->encrypted = 1;
+            continue;
+        }
+
+        /* Check for compression */
+        if (strcasecmp(layer, CONTENT_ENCODING_DEFLATE) == 0) {
+            u_long uclen = config->block_size;
+
+            switch (uncompress(job->dest, &uclen, io->dest, job->did_read)) {
+            case Z_OK:
+                job->did_read = uclen;
+                http_io_put_buf(priv, io->dest);
+                io->dest = NULL;         /* compression should have been first */
+                r = 0;
+                break;
+            case Z_MEM_ERROR:
+                (*config->log)(LOG_ERR, "zlib uncompress: %s", strerror(ENOMEM));
+                pthread_mutex_lock(&priv->mutex);
+                priv->stats.out_of_memory_errors++;
+                pthread_mutex_unlock(&priv->mutex);
+                r = ENOMEM;
+                break;
+            case Z_BUF_ERROR:
+                (*config->log)(LOG_ERR, "zlib uncompress: %s", "decompressed block is oversize");
+                r = EIO;
+                break;
+            case Z_DATA_ERROR:
+                (*config->log)(LOG_ERR, "zlib uncompress: %s", "data is corrupted or truncated");
+                r = EIO;
+                break;
+            default:
+                (*config->log)(LOG_ERR, "unknown zlib compress2() error %d", r);
+                r = EIO;
+                break;
+            }
+
+            /* Proceed */
+            continue;
+        }
+
+        /* Check for compression using one of the other codecs */
+        if (strcasecmp(layer, CONTENT_ENCODING_ZSTD) == 0 || strcasecmp(layer, CONTENT_ENCODING_LZ4) == 0) {
+            if ((r = http_io_decompress(priv, block_num, layer, io->dest, job->did_read, job->dest, &job->did_read)) == 0) {
+                http_io_put_buf(priv, io->dest);
+                io->dest = NULL;         /* compression should have been first */
+            }
+            continue;
+        }
+
+bad_encoding:
+        /* It was something we don't recognize */
+        (*config->log)(LOG_ERR, "read of block %0*jx returned unexpected encoding \"%s\"",
+          S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num, layer);
+        r = EIO;
+        break;
+    }
+
+    /* Done */
+    return r;
+}
+
 static void
 http_io_read_prepper(CURL *curl, struct http_io *io)
 {
@@ -1328,41 +2853,63 @@ http_io_write_block(struct s3backer_store *const s3b, s3b_block_t block_num, con
     char urlbuf[URL_BUF_SIZE(config)];
     char md5buf[(MD5_DIGEST_LENGTH * 4) / 3 + 4];
     char hmacbuf[SHA_DIGEST_LENGTH * 2 + 1];
-    u_char hmac[SHA_DIGEST_LENGTH];
-    u_char md5[MD5_DIGEST_LENGTH];
+    char refbuf[CAS_REF_LENGTH + 1];
     const time_t now = time(NULL);
     void *encoded_buf = NULL;
+    const int plain = config->compress == Z_NO_COMPRESSION && config->encryption == NULL
+      && !config->cas && config->pack_factor == 1;
+    struct encode_job job;
     struct http_io io;
-    int compressed = 0;
-    int encrypted = 0;
+    int multipart;
+    int cas_ref = 0;
     int r;
 
     /* Sanity check */
     if (config->block_size == 0 || block_num >= config->num_blocks)
         return EINVAL;
 
-    /* Detect zero blocks (if not done already by upper layer) */
+    /* Detect zero blocks (if not done already by upper layer). If the block will be sent as-is,
+       compute its digests in the same pass with a pooled cipher context, while the data is in cache. */
+    memset(&job, 0, sizeof(job));
     if (src != NULL) {
-        if (http_io_is_zero_block(src, config->block_size))
+        if (plain) {
+            job.block_num = block_num;
+            job.src = src;
+            job.len = config->block_size;
+            job.raw = 1;
+            job.check_zero = 1;
+            if ((r = http_io_cipher_run(priv, http_io_encode_block, &job)) != 0)
+                return r;
+            if (job.zero) {
+                memset(&job, 0, sizeof(job));
+                src = NULL;
+            }
+        } else if (http_io_is_zero_block(src, config->block_size))
             src = NULL;
     }
 
     /* Don't write zero blocks when bitmap indicates empty until non-zero content is written */
     if (priv->non_zero != NULL) {
-        const int bits_per_word = sizeof(*priv->non_zero) * 8;
-        const int word = block_num / bits_per_word;
-        const int bit = 1 << (block_num % bits_per_word);
-
-        pthread_mutex_lock(&priv->mutex);
         if (src == NULL) {
-            if ((priv->non_zero[word] & bit) == 0) {
-                priv->stats.empty_blocks_written++;
-                pthread_mutex_unlock(&priv->mutex);
+            if (!http_io_nonzero_test(priv, block_num)) {
+                STATS_INC(priv, empty_blocks_written);
                 return 0;
             }
         } else
-            priv->non_zero[word] |= bit;
-        pthread_mutex_unlock(&priv->mutex);
+            http_io_nonzero_set(priv, block_num);
+    }
+
+    /* Packed blocks are written by rewriting their object */
+    if (config->pack_factor > 1)
+        return http_io_write_packed(priv, block_num, src, caller_md5);
+
+    /* Zero blocks are deleted, together with any other blocks being deleted at the same time */
+    if (src == NULL && config->delete_batch > 1 && !__atomic_load_n(&priv->no_delete_multi, __ATOMIC_RELAXED)) {
+        if (caller_md5 != NULL)
+            memset(caller_md5, 0, MD5_DIGEST_LENGTH);
+        if ((r = http_io_delete_batched(priv, block_num)) == 0)
+            STATS_INC(priv, zero_blocks_written);
+        return r;
     }
 
     /* Initialize I/O info */
@@ -1375,98 +2922,49 @@ http_io_write_block(struct s3backer_store *const s3b, s3b_block_t block_num, con
     io.check_cancel = check_cancel;
     io.check_cancel_arg = check_cancel_arg;
 
-    /* Compress block if desired */
-    if (src != NULL && config->compress != Z_NO_COMPRESSION) {
-        u_long compress_len;
-
-        /* Allocate buffer */
-        compress_len = compressBound(io.buf_size);
-        if ((encoded_buf = malloc(compress_len)) == NULL) {
-            (*config->log)(LOG_ERR, "malloc: %s", strerror(errno));
-            pthread_mutex_lock(&priv->mutex);
-            priv->stats.out_of_memory_errors++;
-            pthread_mutex_unlock(&priv->mutex);
-            r = ENOMEM;
-            goto fail;
-        }
-
-        /* Compress data */
-        r = compress2(encoded_buf, &compress_len, io.src, io.buf_size, config->compress);
-        switch (r) {
-        case Z_OK:
-            break;
-        case Z_MEM_ERROR:
-            (*config->log)(LOG_ERR, "zlib compress: %s", strerror(ENOMEM));
-            pthread_mutex_lock(&priv->mutex);
-            priv->stats.out_of_memory_errors++;
-            pthread_mutex_unlock(&priv->mutex);
-            r = ENOMEM;
-            goto fail;
-        default:
-            (*config->log)(LOG_ERR, "unknown zlib compress2() error %d", r);
-            r = EIO;
+    /* With content addressed layout, store the content separately and write a reference to it instead */
+    if (src != NULL && config->cas) {
+        if ((r = http_io_cas_store(priv, block_num, src, refbuf, sizeof(refbuf))) != 0)
             goto fail;
-        }
-
-        /* Update POST data */
-        io.src = encoded_buf;
-        io.buf_size = compress_len;
-        compressed = 1;
+        io.src = refbuf;
+        io.buf_size = strlen(refbuf);
+        cas_ref = 1;
     }
 
-    /* Encrypt data if desired */
-    if (src != NULL && config->encryption != NULL) {
-        void *encrypt_buf;
-        u_int encrypt_len;
-
-        /* Allocate buffer */
-        if ((encrypt_buf = malloc(io.buf_size + EVP_MAX_IV_LENGTH)) == NULL) {
-            (*config->log)(LOG_ERR, "malloc: %s", strerror(errno));
-            pthread_mutex_lock(&priv->mutex);
-            priv->stats.out_of_memory_errors++;
-            pthread_mutex_unlock(&priv->mutex);
-            r = ENOMEM;
+    /* Compress, encrypt and checksum the block with a pooled cipher context (unless already done) */
+    if (src != NULL && !plain) {
+        job.block_num = block_num;
+        job.src = io.src;
+        job.len = io.buf_size;
+        job.raw = cas_ref;
+        r = http_io_cipher_run(priv, http_io_encode_block, &job);
+        encoded_buf = job.buf;
+        if (r != 0)
             goto fail;
-        }
-
-        /* Encrypt the block */
-        encrypt_len = http_io_crypt(priv, block_num, 1, io.src, io.buf_size, encrypt_buf);
-
-        /* Compute block signature */
-        http_io_authsig(priv, block_num, encrypt_buf, encrypt_len, hmac);
-        http_io_prhex(hmacbuf, hmac, SHA_DIGEST_LENGTH);
-
-        /* Update POST data */
-        io.src = encrypt_buf;
-        io.buf_size = encrypt_len;
-        free(encoded_buf);              /* OK if NULL */
-        encoded_buf = encrypt_buf;
-        encrypted = 1;
+        io.src = job.src;
+        io.buf_size = job.len;
     }
 
     /* Set Content-Encoding HTTP header */
-    if (compressed || encrypted) {
+    if (job.compressed || job.encrypted) {
         char ebuf[128];
 
         snprintf(ebuf, sizeof(ebuf), "%s: ", CONTENT_ENCODING_HEADER);
-        if (compressed)
-            snprintf(ebuf + strlen(ebuf), sizeof(ebuf) - strlen(ebuf), "%s", CONTENT_ENCODING_DEFLATE);
-        if (encrypted) {
-            snprintf(ebuf + strlen(ebuf), sizeof(ebuf) - strlen(ebuf), "%s%s-%s",
-              compressed ? ", " : "", CONTENT_ENCODING_ENCRYPT, config->encryption);
+        if (job.compressed)
+            snprintf(ebuf + strlen(ebuf), sizeof(ebuf) - strlen(ebuf), "%s", priv->codec);
+        if (job.encrypted) {
+            snprintf(ebuf + strlen(ebuf), sizeof(ebuf) - strlen(ebuf), "%s%s-%s", job.compressed ? ", " : "",
+              job.aead ? CONTENT_ENCODING_AEAD : CONTENT_ENCODING_ENCRYPT, job.aead ? priv->aead_name : config->encryption);
         }
         io.headers = http_io_add_header(io.headers, "%s", ebuf);
     }
 
-    /* Compute MD5 checksum */
-    if (src != NULL)
-        MD5(io.src, io.buf_size, md5);
-    else
-        memset(md5, 0, MD5_DIGEST_LENGTH);
+    /* Upload large blocks in parts */
+    multipart = src != NULL && priv->multipart && io.buf_size > config->multipart_size;
 
-    /* Report MD5 back to caller */
-    if (caller_md5 != NULL)
-        memcpy(caller_md5, md5, MD5_DIGEST_LENGTH);
+    /* Report MD5 back to caller (a multipart upload reports its own) */
+    if (caller_md5 != NULL && !multipart)
+        memcpy(caller_md5, job.md5, MD5_DIGEST_LENGTH);
 
     /* Construct URL for this block */
     http_io_get_block_url(urlbuf, sizeof(urlbuf), config, block_num);
@@ -1478,11 +2976,13 @@ http_io_write_block(struct s3backer_store *const s3b, s3b_block_t block_num, con
     if (src != NULL) {
 
         /* Add Content-Type header */
-        io.headers = http_io_add_header(io.headers, "%s: %s", CTYPE_HEADER, CONTENT_TYPE);
+        io.headers = http_io_add_header(io.headers, "%s: %s", CTYPE_HEADER, cas_ref ? CAS_REF_CONTENT_TYPE : CONTENT_TYPE);
 
-        /* Add Content-MD5 header */
-        http_io_base64_encode(md5buf, sizeof(md5buf), md5, MD5_DIGEST_LENGTH);
-        io.headers = http_io_add_header(io.headers, "%s: %s", MD5_HEADER, md5buf);
+        /* Add Content-MD5 header (each part of a multipart upload gets its own instead) */
+        if (!multipart) {
+            http_io_base64_encode(md5buf, sizeof(md5buf), job.md5, MD5_DIGEST_LENGTH);
+            io.headers = http_io_add_header(io.headers, "%s: %s", MD5_HEADER, md5buf);
+        }
     }
 
     /* Add ACL header (PUT only) */
@@ -1496,39 +2996,113 @@ http_io_write_block(struct s3backer_store *const s3b, s3b_block_t block_num, con
           FILE_SIZE_HEADER, (uintmax_t)(config->block_size * config->num_blocks));
     }
 
-    /* Add signature header (if encrypting) */
-    if (src != NULL && config->encryption != NULL)
+    /* Add signature header (if encrypting without AES-GCM) */
+    if (job.encrypted && !job.aead) {
+        http_io_prhex(hmacbuf, job.hmac, SHA_DIGEST_LENGTH);
         io.headers = http_io_add_header(io.headers, "%s: \"%s\"", HMAC_HEADER, hmacbuf);
+    }
 
     /* Add storage class header (if needed) */
     if (config->rrs)
         io.headers = http_io_add_header(io.headers, "%s: %s", STORAGE_CLASS_HEADER, SCLASS_REDUCED_REDUNDANCY);
 
-    /* Add Authorization header */
-    if ((r = http_io_add_auth(priv, &io, now, io.src, io.buf_size)) != 0)
-        goto fail;
+    /* Perform operation, uploading large blocks in parts */
+    if (multipart)
+        r = http_io_put_multipart(priv, &io, now, caller_md5);
+    else {
 
-    /* Perform operation */
-    r = http_io_perform_io(priv, &io, http_io_write_prepper);
+        /* Add Authorization header, using the payload hash computed along with the MD5 */
+        if (src != NULL)
+            io.payload_sha256 = http_io_payload_hash(priv, job.sha256);
+        if ((r = http_io_add_auth(priv, &io, now, io.src, io.buf_size)) != 0)
+            goto fail;
+
+        /* Perform operation */
+        r = http_io_perform_io(priv, &io, http_io_write_prepper);
+    }
 
     /* Update stats */
     if (r == 0) {
-        pthread_mutex_lock(&priv->mutex);
         if (src == NULL)
-            priv->stats.zero_blocks_written++;
+            STATS_INC(priv, zero_blocks_written);
         else
-            priv->stats.normal_blocks_written++;
-        pthread_mutex_unlock(&priv->mutex);
+            STATS_INC(priv, normal_blocks_written);
     }
 
 fail:
     /*  Clean up */
     curl_slist_free_all(io.headers);
-    if (encoded_buf != NULL)
-        free(encoded_buf);
+    http_io_put_buf(priv, encoded_buf);
     return r;
 }
 
+/*
+ * Encode (i.e., compress and encrypt, as configured) a block to be written and compute its MD5 checksum
+ * (and SHA-256 payload hash, if needed for authentication).
+ * If job->buf is set on return, the encoded data lives there and the caller must return it to the pool.
+ * This runs with a context borrowed from the cipher context pool.
+ */
+static int
+http_io_encode_block(struct cipher_ctx *cctx, void *arg)
+{
+    struct http_io_private *const priv = cctx->priv;
+    struct http_io_conf *const config = priv->config;
+    struct encode_job *const job = arg;
+    int r;
+
+    /* Compress data if desired (and it turns out to be compressible) */
+    if (!job->raw && config->compress != Z_NO_COMPRESSION) {
+        u_int compress_len;
+        void *buf;
+
+        if ((r = http_io_compress(priv, job->block_num, job->src, job->len, &buf, &compress_len)) != 0)
+            return r;
+        if (buf != NULL) {
+            job->buf = buf;
+            job->src = buf;
+            job->len = compress_len;
+            job->compressed = 1;
+        }
+    }
+
+    /* Encrypt data if desired */
+    if (!job->raw && config->encryption != NULL) {
+        void *encrypt_buf;
+
+        /* Get buffer */
+        assert(job->len + ENCRYPT_OVERHEAD <= priv->io_buf_size);
+        if ((encrypt_buf = http_io_get_buf(priv)) == NULL)
+            return ENOMEM;
+
+        /* Encrypt the block and compute its signature, or do both at once with AES-GCM */
+#if HAVE_OPENSSL_GCM
+        if (priv->use_aead) {
+            if ((r = http_io_aead_crypt(cctx, job->block_num, 1, job->src, job->len, encrypt_buf, &job->len)) != 0) {
+                (*config->log)(LOG_ERR, "%s encryption of block %0*jx failed",
+                  priv->aead_name, S3B_BLOCK_NUM_DIGITS, (uintmax_t)job->block_num);
+                http_io_put_buf(priv, encrypt_buf);
+                return r;
+            }
+            job->aead = 1;
+        } else
+#endif
+        {
+            job->len = http_io_crypt(cctx, job->block_num, 1, job->src, job->len, encrypt_buf);
+            http_io_authsig(cctx, job->block_num, encrypt_buf, job->len, job->hmac);
+        }
+
+        /* Replace compressed data, if any */
+        http_io_put_buf(priv, job->buf);
+        job->buf = encrypt_buf;
+        job->src = encrypt_buf;
+        job->encrypted = 1;
+    }
+
+    /* Compute digests, and check for zeroes if desired, in one pass */
+    job->zero = http_io_digest(priv, job->src, job->len, job->check_zero, job->md5, job->sha256);
+    return 0;
+}
+
 static void
 http_io_write_prepper(CURL *curl, struct http_io *io)
 {
@@ -1545,26 +3119,2524 @@ http_io_write_prepper(CURL *curl, struct http_io *io)
         curl_easy_setopt(curl, CURLOPT_UPLOAD, 1);
         curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)io->buf_size);
     }
-    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, io->method);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, io->headers);
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, io->method);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, io->headers);
+}
+
+/*
+ * Delete a zero block, batching it with any other blocks being deleted at the same time.
+ *
+ * A deletion that finds no other deletions in progress is sent right away as a plain DELETE. Otherwise,
+ * it starts a batch (or joins the one already started) which is sent as one multi-object delete as soon
+ * as a deletion in progress completes, the batch fills up, or DELETE_LINGER_MS passes. Each block gets
+ * its own result, and blocks the batch can't account for are deleted individually.
+ */
+static int
+http_io_delete_batched(struct http_io_private *priv, s3b_block_t block_num)
+{
+    struct http_io_conf *const config = priv->config;
+    struct timespec wake_time;
+    struct delete_batch *db;
+    u_int deletes_done;
+    u_int index;
+    int r;
+
+    /* Join the batch being collected, if any */
+    pthread_mutex_lock(&priv->mutex);
+    if ((db = priv->delete_batch) != NULL) {
+        index = db->num_blocks++;
+        db->blocks[index] = block_num;
+        db->refs++;
+        if (db->num_blocks == config->delete_batch) {
+            priv->delete_batch = NULL;
+            pthread_cond_broadcast(&priv->delete_wakeup);
+        }
+        while (!db->done)
+            pthread_cond_wait(&db->cond, &priv->mutex);
+        r = db->results[index];
+        http_io_delete_release(db);
+        if (r != EAGAIN)
+            goto done;
+        goto alone;
+    }
+
+    /* If no other deletions are in progress, there's nothing to wait for */
+    if (priv->deletes_active == 0)
+        goto alone;
+
+    /* Start a new batch */
+    if ((db = calloc(1, sizeof(*db))) == NULL)
+        goto oom0;
+    if ((db->blocks = calloc(config->delete_batch, sizeof(*db->blocks))) == NULL)
+        goto oom1;
+    if ((db->results = calloc(config->delete_batch, sizeof(*db->results))) == NULL)
+        goto oom2;
+    if (pthread_cond_init(&db->cond, NULL) != 0)
+        goto oom3;
+    db->blocks[0] = block_num;
+    db->num_blocks = 1;
+    db->refs = 1;
+    priv->delete_batch = db;
+
+    /* Let other deletions join until one in progress completes, the batch fills up, or we've waited long enough */
+    clock_gettime(CLOCK_REALTIME, &wake_time);
+    wake_time.tv_nsec += DELETE_LINGER_MS * 1000000;
+    if (wake_time.tv_nsec >= 1000000000) {
+        wake_time.tv_sec++;
+        wake_time.tv_nsec -= 1000000000;
+    }
+    deletes_done = priv->deletes_done;
+    while (priv->delete_batch == db && priv->deletes_done == deletes_done) {
+        if (pthread_cond_timedwait(&priv->delete_wakeup, &priv->mutex, &wake_time) == ETIMEDOUT)
+            break;
+    }
+    if (priv->delete_batch == db)
+        priv->delete_batch = NULL;
+    priv->deletes_active++;
+    pthread_mutex_unlock(&priv->mutex);
+
+    /* Send the batch, or a plain DELETE if nobody joined */
+    if (db->num_blocks > 1)
+        http_io_delete_multi(priv, db->blocks, db->num_blocks, db->results);
+    else
+        db->results[0] = http_io_delete_object(priv, block_num);
+
+    /* Wake up the other deleters in this batch */
+    pthread_mutex_lock(&priv->mutex);
+    priv->deletes_active--;
+    priv->deletes_done++;
+    pthread_cond_broadcast(&priv->delete_wakeup);
+    r = db->results[0];
+    db->done = 1;
+    pthread_cond_broadcast(&db->cond);
+    http_io_delete_release(db);
+    if (r != EAGAIN)
+        goto done;
+
+alone:
+    /* Delete the block by itself */
+    priv->deletes_active++;
+    pthread_mutex_unlock(&priv->mutex);
+    r = http_io_delete_object(priv, block_num);
+    pthread_mutex_lock(&priv->mutex);
+    priv->deletes_active--;
+    priv->deletes_done++;
+    pthread_cond_broadcast(&priv->delete_wakeup);
+
+done:
+    pthread_mutex_unlock(&priv->mutex);
+    return r;
+
+oom3:
+    free(db->results);
+oom2:
+    free(db->blocks);
+oom1:
+    free(db);
+oom0:
+    priv->stats.out_of_memory_errors++;
+    goto alone;
+}
+
+/*
+ * Release a reference to a batch of block deletions. Caller must hold the mutex.
+ */
+static void
+http_io_delete_release(struct delete_batch *db)
+{
+    assert(db->refs > 0);
+    if (--db->refs > 0)
+        return;
+    assert(db->done);
+    pthread_cond_destroy(&db->cond);
+    free(db->results);
+    free(db->blocks);
+    free(db);
+}
+
+/*
+ * Delete several blocks using multi-object deletes (if enabled), storing the result for each block in results[].
+ */
+void
+http_io_delete_blocks(struct s3backer_store *s3b, const s3b_block_t *blocks, u_int num_blocks, int *results)
+{
+    struct http_io_private *const priv = s3b->data;
+    struct http_io_conf *const config = priv->config;
+    u_int num;
+    u_int i;
+
+    for (i = 0; i < num_blocks; i += num) {
+        num = num_blocks - i;
+        if (num > config->delete_batch)
+            num = config->delete_batch;
+        if (num > 1 && !__atomic_load_n(&priv->no_delete_multi, __ATOMIC_RELAXED))
+            http_io_delete_multi(priv, blocks + i, num, results + i);
+        else
+            results[i] = EAGAIN;
+    }
+    for (i = 0; i < num_blocks; i++) {
+        if (results[i] == EAGAIN)
+            results[i] = http_io_delete_object(priv, blocks[i]);
+        if (results[i] == 0)
+            STATS_INC(priv, zero_blocks_written);
+    }
+}
+
+/*
+ * Delete a block's object with a plain DELETE.
+ */
+static int
+http_io_delete_object(struct http_io_private *priv, s3b_block_t block_num)
+{
+    struct http_io_conf *const config = priv->config;
+    char urlbuf[URL_BUF_SIZE(config)];
+    const time_t now = time(NULL);
+    struct http_io io;
+    int r;
+
+    /* Initialize I/O info */
+    memset(&io, 0, sizeof(io));
+    io.url = urlbuf;
+    io.method = HTTP_DELETE;
+    io.block_num = block_num;
+
+    /* Construct URL for this block */
+    http_io_get_block_url(urlbuf, sizeof(urlbuf), config, block_num);
+
+    /* Add Date header */
+    http_io_add_date(priv, &io, now);
+
+    /* Add Authorization header */
+    if ((r = http_io_add_auth(priv, &io, now, NULL, 0)) != 0)
+        goto done;
+
+    /* Perform operation */
+    r = http_io_perform_io(priv, &io, http_io_write_prepper);
+
+done:
+    /*  Clean up */
+    curl_slist_free_all(io.headers);
+    return r;
+}
+
+/*
+ * Delete up to DELETE_BATCH_MAX blocks with one multi-object delete, storing the result for each block
+ * in results[]. Blocks that might not have been deleted get EAGAIN, meaning they should be deleted
+ * individually; that covers both a failure of the whole request and keys S3 reports errors for,
+ * which a plain DELETE will either succeed for or report an accurate error for.
+ */
+static int
+http_io_delete_multi(struct http_io_private *priv, const s3b_block_t *blocks, u_int num_blocks, int *results)
+{
+    struct http_io_conf *const config = priv->config;
+    const size_t key_max = 6 * strlen(config->prefix) + config->hash_prefix + S3B_BLOCK_NUM_DIGITS;
+    char urlbuf[URL_BUF_SIZE(config) + sizeof(DELETE_SUBRESOURCE) + 2];
+    char keybuf[URL_BUF_SIZE(config)];
+    char md5buf[(MD5_DIGEST_LENGTH * 4) / 3 + 4];
+    u_char md5[MD5_DIGEST_LENGTH];
+    const time_t now = time(NULL);
+    char *response = NULL;
+    char *body = NULL;
+    size_t response_max;
+    size_t body_max;
+    size_t body_len;
+    s3b_block_t block_num;
+    struct http_io io;
+    const char *error;
+    u_int num_errors;
+    char code[64];
+    u_int i;
+    int r;
+
+    /* Initialize I/O info */
+    assert(num_blocks > 0 && num_blocks <= DELETE_BATCH_MAX);
+    memset(&io, 0, sizeof(io));
+    io.url = urlbuf;
+    io.method = HTTP_POST;
+
+    /* Allocate request and response buffers */
+    body_max = 128 + num_blocks * (key_max + 32);
+    response_max = DELETE_RESPONSE_MIN + num_blocks * DELETE_RESPONSE_PER_ERROR;
+    if ((body = malloc(body_max)) == NULL || (response = malloc(response_max + 1)) == NULL) {
+        r = errno;
+        (*config->log)(LOG_ERR, "malloc: %s", strerror(r));
+        STATS_INC(priv, out_of_memory_errors);
+        goto fail;
+    }
+
+    /* Build request, in quiet mode so only errors are reported */
+    body_len = snprintf(body, body_max, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<Delete><Quiet>true</Quiet>");
+    for (i = 0; i < num_blocks; i++) {
+        http_io_get_block_name(keybuf, sizeof(keybuf), config, blocks[i]);
+        body_len += snprintf(body + body_len, body_max - body_len, "<Object><Key>");
+        body_len += http_io_xml_escape(body + body_len, keybuf);
+        body_len += snprintf(body + body_len, body_max - body_len, "</Key></Object>");
+    }
+    body_len += snprintf(body + body_len, body_max - body_len, "</Delete>");
+    assert(body_len < body_max);
+    io.src = body;
+    io.buf_size = body_len;
+    io.dest = response;
+    io.dest_size = response_max;
+    io.evst = &priv->stats.http_delete_batches;
+    io.no_retry = 1;
+
+    /* Construct URL for the bucket */
+    snprintf(urlbuf, sizeof(urlbuf), "%s%s?%s=", config->baseURL, config->vhost ? "" : config->bucket, DELETE_SUBRESOURCE);
+
+    /* Add Date header */
+    http_io_add_date(priv, &io, now);
+
+    /* Add Content-Type and Content-MD5 headers (S3 requires the latter for multi-object deletes) */
+    io.headers = http_io_add_header(io.headers, "%s: %s", CTYPE_HEADER, XML_CONTENT_TYPE);
+    MD5((u_char *)body, body_len, md5);
+    http_io_base64_encode(md5buf, sizeof(md5buf), md5, MD5_DIGEST_LENGTH);
+    io.headers = http_io_add_header(io.headers, "%s: %s", MD5_HEADER, md5buf);
+
+    /* Add Authorization header */
+    if ((r = http_io_add_auth(priv, &io, now, body, body_len)) != 0)
+        goto fail;
+
+    /*
+     * Perform operation. Don't retry: the blocks will be deleted individually anyway, and servers that
+     * don't support multi-object deletes would otherwise cost a full retry sequence for every batch.
+     */
+    if ((r = http_io_perform_io(priv, &io, http_io_post_prepper)) != 0) {
+        switch (io.http_code) {
+        case HTTP_BAD_REQUEST:
+        case HTTP_METHOD_NOT_ALLOWED:
+        case HTTP_NOT_IMPLEMENTED:
+            if (!__atomic_exchange_n(&priv->no_delete_multi, 1, __ATOMIC_RELAXED)) {
+                (*config->log)(LOG_WARNING, "multi-object delete not supported (HTTP %ld response);"
+                  " deleting blocks individually from now on", io.http_code);
+            }
+            break;
+        default:
+            (*config->log)(LOG_NOTICE, "multi-object delete of %u blocks failed: %s; deleting them individually",
+              num_blocks, strerror(r));
+            break;
+        }
+        goto fail;
+    }
+
+    /* Check we got a complete result */
+    response[io.dest_size - io.bufs.rdremain] = '\0';
+    if (io.bufs.rdremain == 0 || strstr(response, DELETE_ELEM_RESULT) == NULL) {
+        (*config->log)(LOG_ERR, "invalid multi-object delete response; deleting %u blocks individually", num_blocks);
+        r = EIO;
+        goto fail;
+    }
+
+    /* Retry blocks with errors individually */
+    for (i = 0; i < num_blocks; i++)
+        results[i] = 0;
+    num_errors = 0;
+    for (error = response; (error = strstr(error, DELETE_ELEM_ERROR)) != NULL; error += sizeof(DELETE_ELEM_ERROR) - 1) {
+        const char *const error_end = strstr(error, DELETE_ELEM_ERROR_END);
+
+        if (http_io_xml_field(error, error_end, DELETE_ELEM_KEY, keybuf, sizeof(keybuf)) != 0
+          || http_io_parse_block(config, keybuf, &block_num) != 0) {
+            (*config->log)(LOG_ERR, "unrecognized key in multi-object delete response; deleting %u blocks individually",
+              num_blocks);
+            r = EIO;
+            goto fail;
+        }
+        if (http_io_xml_field(error, error_end, DELETE_ELEM_CODE, code, sizeof(code)) != 0)
+            snprintf(code, sizeof(code), "unknown error");
+        (*config->log)(LOG_NOTICE, "multi-object delete of block %0*jx failed: %s",
+          S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num, code);
+        for (i = 0; i < num_blocks; i++) {
+            if (blocks[i] == block_num)
+                results[i] = EAGAIN;
+        }
+        num_errors++;
+    }
+
+    /* Update stats */
+    STATS_ADD(priv, batched_deletes, num_blocks - num_errors);
+
+    /* Done */
+    r = 0;
+    goto done;
+
+fail:
+    for (i = 0; i < num_blocks; i++)
+        results[i] = EAGAIN;
+done:
+    /*  Clean up */
+    curl_slist_free_all(io.headers);
+    free(response);
+    free(body);
+    return r;
+}
+
+static void
+http_io_post_prepper(CURL *curl, struct http_io *io)
+{
+    memset(&io->bufs, 0, sizeof(io->bufs));
+    io->bufs.wrremain = io->buf_size;
+    io->bufs.wrdata = io->src;
+    io->bufs.rdremain = io->dest_size;
+    io->bufs.rddata = io->dest;
+    curl_easy_setopt(curl, CURLOPT_READFUNCTION, http_io_curl_writer);
+    curl_easy_setopt(curl, CURLOPT_READDATA, io);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, http_io_curl_reader);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, io);
+    curl_easy_setopt(curl, CURLOPT_UPLOAD, 1);
+    curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)io->buf_size);
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, io->method);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, io->headers);
+}
+
+/*
+ * Get the text of the first `name' element in an XML response, looking no further than `end' (if not NULL).
+ * This is only used for simple responses, whose elements of interest contain plain text.
+ */
+static int
+http_io_xml_field(const char *xml, const char *end, const char *name, char *buf, size_t bufsiz)
+{
+    const char *start;
+    const char *stop;
+    char tag[32];
+
+    snprintf(tag, sizeof(tag), "<%s>", name);
+    if ((start = strstr(xml, tag)) == NULL || (end != NULL && start > end))
+        return -1;
+    start += strlen(tag);
+    snprintf(tag, sizeof(tag), "</%s>", name);
+    if ((stop = strstr(start, tag)) == NULL || stop - start >= bufsiz)
+        return -1;
+    memcpy(buf, start, stop - start);
+    buf[stop - start] = '\0';
+    return 0;
+}
+
+/*
+ * Copy a string into an XML document, escaping special characters. Returns the number of characters written,
+ * which is at most six times the length of the string; buf is not NUL-terminated.
+ */
+static size_t
+http_io_xml_escape(char *buf, const char *s)
+{
+    size_t len = 0;
+
+    for ( ; *s != '\0'; s++) {
+        const char *esc;
+
+        switch (*s) {
+        case '&':
+            esc = "&amp;";
+            break;
+        case '<':
+            esc = "&lt;";
+            break;
+        case '>':
+            esc = "&gt;";
+            break;
+        case '"':
+            esc = "&quot;";
+            break;
+        case '\'':
+            esc = "&apos;";
+            break;
+        default:
+            buf[len++] = *s;
+            continue;
+        }
+        memcpy(buf + len, esc, strlen(esc));
+        len += strlen(esc);
+    }
+    return len;
+}
+
+/*
+ * Copy a string into a URL, percent-encoding everything except unreserved characters and those in `keep'.
+ * Returns the number of characters written, which is at most three times the length of the string;
+ * buf is not NUL-terminated.
+ */
+static size_t
+http_io_url_escape(char *buf, const char *s, const char *keep)
+{
+    size_t len = 0;
+
+    for ( ; *s != '\0'; s++) {
+        if (isalnum((u_char)*s) || strchr("-._~", *s) != NULL || strchr(keep, *s) != NULL)
+            buf[len++] = *s;
+        else
+            len += sprintf(buf + len, "%%%02X", (u_char)*s);
+    }
+    return len;
+}
+
+/*
+ * Determine whether a URL query string is an S3 sub-resource, which (unlike other parameters) is signed.
+ */
+static int
+http_io_is_subresource(const char *query)
+{
+    static const char *const subresources[] = {
+        DELETE_SUBRESOURCE,
+        MULTIPART_PART_NUMBER,
+        MULTIPART_UPLOAD_ID,
+        MULTIPART_UPLOADS,
+    };
+    size_t len;
+    int i;
+
+    for (i = 0; i < sizeof(subresources) / sizeof(*subresources); i++) {
+        len = strlen(subresources[i]);
+        if (strncmp(query, subresources[i], len) == 0 && (query[len] == '=' || query[len] == '\0'))
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * Upload a large block using a multipart upload: initiate the upload with the block's headers,
+ * upload its parts in parallel (each with its own Content-MD5 and retries), then complete it.
+ * An upload that fails after being initiated is aborted, so its parts don't linger in the bucket.
+ *
+ * On entry, io contains the block's URL, data and headers (except Authorization). S3 gives the
+ * completed object an ETag which is the MD5 of its parts' MD5s, plus a suffix; that MD5 is reported in md5.
+ */
+static int
+http_io_put_multipart(struct http_io_private *priv, struct http_io *io, time_t now, u_char *md5)
+{
+    struct http_io_conf *const config = priv->config;
+    const char *const url = io->url;
+    char urlbuf[strlen(url) + MULTIPART_QUERY_MAX];
+    char raw_upload_id[MULTIPART_UPLOAD_ID_MAX];
+    char upload_id[3 * MULTIPART_UPLOAD_ID_MAX];
+    char response[MULTIPART_RESPONSE_MAX + 1];
+    char md5hex[MD5_DIGEST_LENGTH * 2 + 1];
+    char md5buf[(MD5_DIGEST_LENGTH * 4) / 3 + 4];
+    u_char body_md5[MD5_DIGEST_LENGTH];
+    struct multipart mp;
+    struct http_io cio;
+    char *body = NULL;
+    size_t body_max;
+    size_t body_len;
+    u_int i;
+    int r;
+
+    /* Initialize multipart info */
+    memset(&mp, 0, sizeof(mp));
+    memset(&cio, 0, sizeof(cio));
+    mp.priv = priv;
+    mp.io = io;
+    mp.url = url;
+    mp.src = io->src;
+    mp.size = io->buf_size;
+    mp.part_size = config->multipart_size;
+    mp.num_parts = (mp.size + mp.part_size - 1) / mp.part_size;
+    mp.xfer = http_io_put_part;
+    if ((mp.md5s = calloc(mp.num_parts, sizeof(*mp.md5s))) == NULL) {
+        r = errno;
+        (*config->log)(LOG_ERR, "calloc: %s", strerror(r));
+        STATS_INC(priv, out_of_memory_errors);
+        goto done;
+    }
+
+    /* Initiate the upload, sending the block's headers */
+    snprintf(urlbuf, sizeof(urlbuf), "%s?%s=", url, MULTIPART_UPLOADS);
+    io->url = urlbuf;
+    io->method = HTTP_POST;
+    io->src = "";
+    io->buf_size = 0;
+    io->dest = response;
+    io->dest_size = MULTIPART_RESPONSE_MAX;
+    io->payload_sha256 = NULL;
+    if ((r = http_io_add_auth(priv, io, now, NULL, 0)) != 0)
+        goto done;
+    if ((r = http_io_perform_io(priv, io, http_io_post_prepper)) != 0)
+        goto done;
+
+    /* Get the upload ID, URL-encoded since it's used as a query parameter in all further requests */
+    response[io->dest_size - io->bufs.rdremain] = '\0';
+    if (http_io_xml_field(response, NULL, MULTIPART_ELEM_UPLOAD_ID, raw_upload_id, sizeof(raw_upload_id)) != 0
+      || *raw_upload_id == '\0') {
+        (*config->log)(LOG_ERR, "invalid multipart upload response for block %0*jx",
+          S3B_BLOCK_NUM_DIGITS, (uintmax_t)io->block_num);
+        r = EIO;
+        goto done;
+    }
+    upload_id[http_io_url_escape(upload_id, raw_upload_id, "")] = '\0';
+    mp.upload_id = upload_id;
+
+    /* Upload the parts */
+    if ((r = http_io_multipart_run(&mp)) != 0)
+        goto abort_upload;
+
+    /* Build the completion request */
+    body_max = 128 + mp.num_parts * (64 + sizeof(md5hex));
+    if ((body = malloc(body_max)) == NULL) {
+        r = errno;
+        (*config->log)(LOG_ERR, "malloc: %s", strerror(r));
+        STATS_INC(priv, out_of_memory_errors);
+        goto abort_upload;
+    }
+    body_len = snprintf(body, body_max, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<CompleteMultipartUpload>");
+    for (i = 0; i < mp.num_parts; i++) {
+        http_io_prhex(md5hex, mp.md5s[i], MD5_DIGEST_LENGTH);
+        body_len += snprintf(body + body_len, body_max - body_len,
+          "<Part><PartNumber>%u</PartNumber><ETag>\"%s\"</ETag></Part>", i + 1, md5hex);
+    }
+    body_len += snprintf(body + body_len, body_max - body_len, "</CompleteMultipartUpload>");
+    assert(body_len < body_max);
+
+    /* Complete the upload */
+    snprintf(urlbuf, sizeof(urlbuf), "%s?%s=%s", url, MULTIPART_UPLOAD_ID, upload_id);
+    cio.url = urlbuf;
+    cio.method = HTTP_POST;
+    cio.block_num = io->block_num;
+    cio.src = body;
+    cio.buf_size = body_len;
+    cio.dest = response;
+    cio.dest_size = MULTIPART_RESPONSE_MAX;
+    http_io_add_date(priv, &cio, now);
+    cio.headers = http_io_add_header(cio.headers, "%s: %s", CTYPE_HEADER, XML_CONTENT_TYPE);
+    MD5((u_char *)body, body_len, body_md5);
+    http_io_base64_encode(md5buf, sizeof(md5buf), body_md5, MD5_DIGEST_LENGTH);
+    cio.headers = http_io_add_header(cio.headers, "%s: %s", MD5_HEADER, md5buf);
+    if ((r = http_io_add_auth(priv, &cio, now, body, body_len)) != 0)
+        goto abort_upload;
+    if ((r = http_io_perform_io(priv, &cio, http_io_post_prepper)) != 0)
+        goto abort_upload;
+
+    /* S3 can report a failure to complete after sending a successful response code */
+    response[cio.dest_size - cio.bufs.rdremain] = '\0';
+    if (strstr(response, MULTIPART_ELEM_COMPLETE) == NULL) {
+        (*config->log)(LOG_ERR, "multipart upload of block %0*jx failed to complete",
+          S3B_BLOCK_NUM_DIGITS, (uintmax_t)io->block_num);
+        r = EIO;
+        goto abort_upload;
+    }
+
+    /* Report MD5 back to caller */
+    if (md5 != NULL)
+        MD5((u_char *)mp.md5s, mp.num_parts * MD5_DIGEST_LENGTH, md5);
+
+    /* Update stats */
+    STATS_INC(priv, multipart_uploads);
+    STATS_ADD(priv, multipart_parts, mp.num_parts);
+    goto done;
+
+abort_upload:
+    http_io_abort_multipart(&mp, upload_id);
+done:
+    /*  Clean up */
+    curl_slist_free_all(cio.headers);
+    io->url = url;
+    free(body);
+    free(mp.md5s);
+    return r;
+}
+
+/*
+ * Abort a multipart upload, discarding any parts already uploaded.
+ */
+static void
+http_io_abort_multipart(struct multipart *mp, const char *upload_id)
+{
+    struct http_io_private *const priv = mp->priv;
+    struct http_io_conf *const config = priv->config;
+    char urlbuf[strlen(mp->url) + MULTIPART_QUERY_MAX];
+    const time_t now = time(NULL);
+    struct http_io io;
+    int r;
+
+    /* Initialize I/O info */
+    memset(&io, 0, sizeof(io));
+    io.url = urlbuf;
+    io.method = HTTP_DELETE;
+    io.block_num = mp->io->block_num;
+    snprintf(urlbuf, sizeof(urlbuf), "%s?%s=%s", mp->url, MULTIPART_UPLOAD_ID, upload_id);
+
+    /* Add Date and Authorization headers */
+    http_io_add_date(priv, &io, now);
+    if ((r = http_io_add_auth(priv, &io, now, NULL, 0)) != 0)
+        goto done;
+
+    /* Perform operation */
+    if ((r = http_io_perform_io(priv, &io, http_io_write_prepper)) != 0) {
+        (*config->log)(LOG_WARNING, "failed to abort multipart upload of block %0*jx: %s",
+          S3B_BLOCK_NUM_DIGITS, (uintmax_t)io.block_num, strerror(r));
+    }
+
+done:
+    /*  Clean up */
+    curl_slist_free_all(io.headers);
+}
+
+/*
+ * Upload one part of a multipart upload.
+ */
+static int
+http_io_put_part(struct multipart *mp, u_int part)
+{
+    struct http_io_private *const priv = mp->priv;
+    const u_int off = part * mp->part_size;
+    const u_int len = mp->size - off < mp->part_size ? mp->size - off : mp->part_size;
+    char urlbuf[strlen(mp->url) + MULTIPART_QUERY_MAX];
+    char md5buf[(MD5_DIGEST_LENGTH * 4) / 3 + 4];
+    char sha256buf[SHA256_DIGEST_LENGTH * 2 + 1];
+    const time_t now = time(NULL);
+    struct http_io io;
+    int r;
+
+    /* Initialize I/O info */
+    memset(&io, 0, sizeof(io));
+    io.url = urlbuf;
+    io.method = HTTP_PUT;
+    io.src = mp->src + off;
+    io.buf_size = len;
+    io.block_num = mp->io->block_num;
+    io.check_cancel = mp->io->check_cancel;
+    io.check_cancel_arg = mp->io->check_cancel_arg;
+
+    /* Construct URL for this part (part numbers start at one) */
+    snprintf(urlbuf, sizeof(urlbuf), "%s?%s=%u&%s=%s",
+      mp->url, MULTIPART_PART_NUMBER, part + 1, MULTIPART_UPLOAD_ID, mp->upload_id);
+
+    /* Compute the part's digests */
+    (void)http_io_digest(priv, io.src, len, 0, mp->md5s[part], sha256buf);
+
+    /* Add Date and Content-MD5 headers */
+    http_io_add_date(priv, &io, now);
+    http_io_base64_encode(md5buf, sizeof(md5buf), mp->md5s[part], MD5_DIGEST_LENGTH);
+    io.headers = http_io_add_header(io.headers, "%s: %s", MD5_HEADER, md5buf);
+
+    /* Add Authorization header */
+    io.payload_sha256 = http_io_payload_hash(priv, sha256buf);
+    if ((r = http_io_add_auth(priv, &io, now, io.src, len)) != 0)
+        goto done;
+
+    /* Perform operation */
+    r = http_io_perform_io(priv, &io, http_io_write_prepper);
+
+done:
+    /*  Clean up */
+    curl_slist_free_all(io.headers);
+    return r;
+}
+
+/*
+ * Read the rest of a large block whose first part has been read into io->dest, using parallel ranged GETs.
+ * These are conditional on the ETag of the first part's response, so all parts come from the same object.
+ */
+static int
+http_io_get_multipart(struct http_io_private *priv, struct http_io *io, u_int *did_readp)
+{
+    struct http_io_conf *const config = priv->config;
+    struct multipart mp;
+    int r;
+
+    /* Is there more to read? */
+    if (io->object_size <= *did_readp)
+        return 0;
+    if (*did_readp != config->multipart_size || io->object_size > priv->io_buf_size || *io->etag == '\0') {
+        (*config->log)(LOG_ERR, "read of block %0*jx returned an invalid partial object (%ju bytes total)",
+          S3B_BLOCK_NUM_DIGITS, (uintmax_t)io->block_num, io->object_size);
+        return EIO;
+    }
+
+    /* Initialize multipart info; the first part has already been read */
+    memset(&mp, 0, sizeof(mp));
+    mp.priv = priv;
+    mp.io = io;
+    mp.url = io->url;
+    mp.dest = io->dest;
+    mp.size = io->object_size;
+    mp.part_size = config->multipart_size;
+    mp.num_parts = (mp.size + mp.part_size - 1) / mp.part_size;
+    mp.next_part = 1;
+    mp.xfer = http_io_get_part;
+
+    /* Read the remaining parts */
+    if ((r = http_io_multipart_run(&mp)) != 0)
+        return r;
+
+    /* Update stats */
+    STATS_INC(priv, multipart_reads);
+    STATS_ADD(priv, multipart_parts, mp.num_parts);
+
+    /* Done */
+    *did_readp = mp.size;
+    return 0;
+}
+
+/*
+ * Read one part of a large block.
+ */
+static int
+http_io_get_part(struct multipart *mp, u_int part)
+{
+    struct http_io_private *const priv = mp->priv;
+    struct http_io_conf *const config = priv->config;
+    const u_int off = part * mp->part_size;
+    const u_int len = mp->size - off < mp->part_size ? mp->size - off : mp->part_size;
+    const time_t now = time(NULL);
+    struct http_io io;
+    u_int did_read;
+    int r;
+
+    /* Initialize I/O info */
+    memset(&io, 0, sizeof(io));
+    io.url = mp->url;
+    io.method = HTTP_GET;
+    io.block_num = mp->io->block_num;
+    io.dest = mp->dest + off;
+    io.buf_size = len;
+
+    /* Add Date, Range and If-Match headers */
+    http_io_add_date(priv, &io, now);
+    io.headers = http_io_add_header(io.headers, "%s: bytes=%u-%u", RANGE_HEADER, off, off + len - 1);
+    io.headers = http_io_add_header(io.headers, "%s: %s", IF_MATCH_HEADER, mp->io->etag);
+
+    /* Add Authorization header */
+    if ((r = http_io_add_auth(priv, &io, now, NULL, 0)) != 0)
+        goto done;
+
+    /* Perform operation */
+    if ((r = http_io_perform_io(priv, &io, http_io_read_prepper)) != 0)
+        goto done;
+
+    /* Check for wrong length read */
+    if ((did_read = io.buf_size - io.bufs.rdremain) != len) {
+        (*config->log)(LOG_ERR, "read of block %0*jx part %u returned %u != %u bytes",
+          S3B_BLOCK_NUM_DIGITS, (uintmax_t)io.block_num, part + 1, did_read, len);
+        r = EIO;
+    }
+
+done:
+    /*  Clean up */
+    curl_slist_free_all(io.headers);
+    return r;
+}
+
+/*
+ * Transfer the parts of a multipart object, from mp->next_part on, using up to config->multipart_threads threads
+ * (including this one). Returns the first error encountered, after which no more parts are started.
+ */
+static int
+http_io_multipart_run(struct multipart *mp)
+{
+    struct http_io_private *const priv = mp->priv;
+    struct http_io_conf *const config = priv->config;
+    u_int num_threads = config->multipart_threads;
+    pthread_t *threads = NULL;
+    u_int i;
+    int r;
+
+    /* Don't start more threads than there are parts */
+    if (num_threads > mp->num_parts - mp->next_part)
+        num_threads = mp->num_parts - mp->next_part;
+
+    /* Start helper threads; if we can't, the parts just get transferred by fewer threads */
+    i = 0;
+    if (num_threads > 1 && (threads = calloc(num_threads - 1, sizeof(*threads))) != NULL) {
+        for ( ; i < num_threads - 1; i++) {
+            if ((r = pthread_create(&threads[i], NULL, http_io_multipart_main, mp)) != 0) {
+                (*config->log)(LOG_ERR, "pthread_create: %s", strerror(r));
+                break;
+            }
+        }
+    }
+
+    /* Transfer parts in this thread too */
+    (void)http_io_multipart_main(mp);
+
+    /* Wait for helper threads */
+    while (i > 0)
+        pthread_join(threads[--i], NULL);
+    free(threads);
+    return mp->r;
+}
+
+static void *
+http_io_multipart_main(void *arg)
+{
+    struct multipart *const mp = arg;
+    struct http_io_private *const priv = mp->priv;
+    u_int part;
+    int r;
+
+    while (1) {
+
+        /* Get the next part to transfer, unless done or something failed */
+        pthread_mutex_lock(&priv->mutex);
+        if (mp->r != 0 || mp->next_part >= mp->num_parts) {
+            pthread_mutex_unlock(&priv->mutex);
+            break;
+        }
+        part = mp->next_part++;
+        pthread_mutex_unlock(&priv->mutex);
+
+        /* Transfer it */
+        if ((r = (*mp->xfer)(mp, part)) != 0) {
+            pthread_mutex_lock(&priv->mutex);
+            if (mp->r == 0)
+                mp->r = r;
+            pthread_mutex_unlock(&priv->mutex);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Move a block from its plain key to its hashed key (see `--hashPrefix'), using a server-side copy
+ * followed by deleting the original. Content, encoding and metadata are all copied unchanged.
+ *
+ * If the hashed key already exists, it was either moved by an earlier, interrupted migration or written
+ * by a later mount, so it's at least as new as the plain key; in that case the plain key is just deleted.
+ */
+int
+http_io_migrate_block(struct s3backer_store *s3b, s3b_block_t block_num)
+{
+    struct http_io_private *const priv = s3b->data;
+    struct http_io_conf *const config = priv->config;
+    char urlbuf[URL_BUF_SIZE(config)];
+    char keybuf[URL_BUF_SIZE(config)];
+    char srcbuf[3 * URL_BUF_SIZE(config)];
+    char response[COPY_RESPONSE_MAX + 1];
+    const time_t now = time(NULL);
+    struct http_io io;
+    int exists;
+    int r;
+
+    /* Sanity check */
+    if (config->hash_prefix == 0 || block_num >= config->num_blocks)
+        return EINVAL;
+
+    /* Initialize I/O info */
+    memset(&io, 0, sizeof(io));
+    io.url = urlbuf;
+    io.method = HTTP_PUT;
+    io.block_num = block_num;
+    io.dest = response;
+    io.buf_size = COPY_RESPONSE_MAX;
+
+    /* Construct URL for the hashed key; don't overwrite it if it's already there */
+    http_io_get_block_url(urlbuf, sizeof(urlbuf), config, block_num);
+    if ((r = http_io_object_exists(priv, urlbuf, &exists)) != 0)
+        return r;
+    if (exists)
+        goto delete_plain;
+
+    /* Construct the copy source for the plain key, which S3 requires to be URL-encoded */
+    snprintf(keybuf, sizeof(keybuf), "/%s/%s%0*jx", config->bucket, config->prefix, S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num);
+    srcbuf[http_io_url_escape(srcbuf, keybuf, "/")] = '\0';
+
+    /* Add Date header */
+    http_io_add_date(priv, &io, now);
+
+    /* Add copy headers */
+    io.headers = http_io_add_header(io.headers, "%s: %s", COPY_SOURCE_HEADER, srcbuf);
+    io.headers = http_io_add_header(io.headers, "%s: COPY", METADATA_DIRECTIVE_HEADER);
+
+    /* Add Authorization header */
+    if ((r = http_io_add_auth(priv, &io, now, NULL, 0)) != 0)
+        goto done;
+
+    /* Perform operation */
+    if ((r = http_io_perform_io(priv, &io, http_io_copy_prepper)) != 0)
+        goto done;
+
+    /* A copy can fail even after a `200 OK' response, so check we got a result */
+    response[io.buf_size - io.bufs.rdremain] = '\0';
+    if (strstr(response, COPY_RESULT_ELEM) == NULL) {
+        (*config->log)(LOG_ERR, "copy of block %0*jx to its hashed key failed: %s",
+          S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num, response);
+        r = EIO;
+        goto done;
+    }
+
+    /* Delete the plain key */
+delete_plain:
+    curl_slist_free_all(io.headers);
+    memset(&io, 0, sizeof(io));
+    io.url = urlbuf;
+    io.method = HTTP_DELETE;
+    io.block_num = block_num;
+    http_io_get_plain_block_url(urlbuf, sizeof(urlbuf), config, block_num);
+    http_io_add_date(priv, &io, now);
+    if ((r = http_io_add_auth(priv, &io, now, NULL, 0)) != 0)
+        goto done;
+    r = http_io_perform_io(priv, &io, http_io_write_prepper);
+
+done:
+    /*  Clean up */
+    curl_slist_free_all(io.headers);
+    return r;
+}
+
+static void
+http_io_copy_prepper(CURL *curl, struct http_io *io)
+{
+    memset(&io->bufs, 0, sizeof(io->bufs));
+    io->bufs.rdremain = io->buf_size;
+    io->bufs.rddata = io->dest;
+    curl_easy_setopt(curl, CURLOPT_READFUNCTION, http_io_curl_writer);
+    curl_easy_setopt(curl, CURLOPT_READDATA, io);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, http_io_curl_reader);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, io);
+    curl_easy_setopt(curl, CURLOPT_UPLOAD, 1);
+    curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)0);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, io->headers);
+}
+
+/*
+ * Determine whether an object exists using a HEAD request.
+ */
+static int
+http_io_object_exists(struct http_io_private *priv, const char *url, int *existsp)
+{
+    const time_t now = time(NULL);
+    struct http_io io;
+    int r;
+
+    /* Initialize I/O info */
+    memset(&io, 0, sizeof(io));
+    io.url = url;
+    io.method = HTTP_HEAD;
+
+    /* Add Date and Authorization headers */
+    http_io_add_date(priv, &io, now);
+    if ((r = http_io_add_auth(priv, &io, now, NULL, 0)) != 0)
+        goto done;
+
+    /* Perform operation */
+    switch ((r = http_io_perform_io(priv, &io, http_io_head_prepper))) {
+    case ENOENT:
+        *existsp = 0;
+        r = 0;
+        break;
+    case 0:
+        *existsp = 1;
+        break;
+    default:
+        break;
+    }
+
+done:
+    /*  Clean up */
+    curl_slist_free_all(io.headers);
+    return r;
+}
+
+/*
+ * Get an object's raw ETag and the MD5 at its start (which for a multipart upload is the MD5 of its parts' MD5s).
+ *
+ * Returns ENOENT if the object does not exist.
+ */
+static int
+http_io_head_etag(struct http_io_private *priv, const char *url, u_char *md5, char *etag, size_t etag_size)
+{
+    const time_t now = time(NULL);
+    struct http_io io;
+    int r;
+
+    /* Initialize I/O info */
+    memset(&io, 0, sizeof(io));
+    io.url = url;
+    io.method = HTTP_HEAD;
+
+    /* Add Date and Authorization headers */
+    http_io_add_date(priv, &io, now);
+    if ((r = http_io_add_auth(priv, &io, now, NULL, 0)) != 0)
+        goto done;
+
+    /* Perform operation */
+    if ((r = http_io_perform_io(priv, &io, http_io_head_prepper)) != 0)
+        goto done;
+
+    /* Return ETag */
+    memcpy(md5, io.md5, MD5_DIGEST_LENGTH);
+    snprintf(etag, etag_size, "%s", io.etag);
+
+done:
+    /*  Clean up */
+    curl_slist_free_all(io.headers);
+    return r;
+}
+
+/*
+ * Write the packed layout marker, whose metadata records the pack factor.
+ */
+static int
+http_io_set_packed(struct http_io_private *priv)
+{
+    struct http_io_conf *const config = priv->config;
+    char urlbuf[URL_BUF_SIZE(config) + sizeof(PACKED_FLAG)];
+    const time_t now = time(NULL);
+    struct http_io io;
+    int r;
+
+    /* Initialize I/O info; the marker has no content */
+    memset(&io, 0, sizeof(io));
+    io.url = urlbuf;
+    io.method = HTTP_PUT;
+    io.src = "";
+    http_io_get_packed_flag_url(urlbuf, sizeof(urlbuf), config);
+    http_io_add_date(priv, &io, now);
+    io.headers = http_io_add_header(io.headers, "%s: %s", CTYPE_HEADER, MOUNTED_FLAG_CONTENT_TYPE);
+    io.headers = http_io_add_header(io.headers, "%s: %s", ACL_HEADER, config->accessType);
+    io.headers = http_io_add_header(io.headers, "%s: %u", PACK_FACTOR_HEADER, config->pack_factor);
+    if ((r = http_io_add_auth(priv, &io, now, NULL, 0)) != 0)
+        goto done;
+
+    /* Perform operation */
+    r = http_io_perform_io(priv, &io, http_io_write_prepper);
+
+done:
+    /*  Clean up */
+    curl_slist_free_all(io.headers);
+    return r;
+}
+
+/*
+ * Set or clear the unfinished key migration marker, optionally returning whether it was set.
+ *
+ * The marker is set before `--migrateKeys' moves any blocks, and cleared only once every block has moved,
+ * so a filesystem whose blocks are split between plain and hashed keys can't be mounted.
+ */
+int
+http_io_set_migrating(struct s3backer_store *s3b, int *old_valuep, int new_value)
+{
+    struct http_io_private *const priv = s3b->data;
+    struct http_io_conf *const config = priv->config;
+    char urlbuf[URL_BUF_SIZE(config) + sizeof(MIGRATING_FLAG)];
+
+    http_io_get_migrating_flag_url(urlbuf, sizeof(urlbuf), config);
+    return http_io_set_flag(priv, urlbuf, old_valuep, new_value);
+}
+
+/*
+ * Set or clear the hashed key layout marker, optionally returning whether it was set.
+ *
+ * The marker is set once `--migrateKeys' has moved every block to its hashed key (or found none to move,
+ * as for a new filesystem), and is required to mount with `--hashPrefix'. Unlike the first block's object,
+ * it doesn't disappear when that block is zeroed, so it reliably records the layout.
+ */
+int
+http_io_set_hashed(struct s3backer_store *s3b, int *old_valuep, int new_value)
+{
+    struct http_io_private *const priv = s3b->data;
+    struct http_io_conf *const config = priv->config;
+    char urlbuf[URL_BUF_SIZE(config) + sizeof(HASHED_FLAG)];
+
+    http_io_get_hashed_flag_url(urlbuf, sizeof(urlbuf), config);
+    return http_io_set_flag(priv, urlbuf, old_valuep, new_value);
+}
+
+/*
+ * Create or delete an empty marker object, optionally returning whether it existed.
+ */
+static int
+http_io_set_flag(struct http_io_private *priv, const char *url, int *old_valuep, int new_value)
+{
+    struct http_io_conf *const config = priv->config;
+    const time_t now = time(NULL);
+    struct http_io io;
+    int r;
+
+    /* Get old value */
+    if (old_valuep != NULL && (r = http_io_object_exists(priv, url, old_valuep)) != 0)
+        return r;
+    if (new_value == -1)
+        return 0;
+
+    /* Initialize I/O info; the marker has no content */
+    memset(&io, 0, sizeof(io));
+    io.url = url;
+    io.method = new_value ? HTTP_PUT : HTTP_DELETE;
+    http_io_add_date(priv, &io, now);
+    if (new_value) {
+        io.src = "";
+        io.headers = http_io_add_header(io.headers, "%s: %s", CTYPE_HEADER, MOUNTED_FLAG_CONTENT_TYPE);
+        io.headers = http_io_add_header(io.headers, "%s: %s", ACL_HEADER, config->accessType);
+    }
+    if ((r = http_io_add_auth(priv, &io, now, NULL, 0)) != 0)
+        goto done;
+
+    /* Perform operation; deleting a marker that's not there is fine */
+    if ((r = http_io_perform_io(priv, &io, http_io_write_prepper)) == ENOENT && !new_value)
+        r = 0;
+
+done:
+    /*  Clean up */
+    curl_slist_free_all(io.headers);
+    return r;
+}
+
+/*
+ * Verify a filesystem using hashed keys can be mounted: refuse if a key migration was not finished,
+ * or if the hashed key layout marker is missing (i.e., `--migrateKeys' has never been run).
+ */
+int
+http_io_check_key_layout(struct s3backer_store *s3b)
+{
+    struct http_io_private *const priv = s3b->data;
+    struct http_io_conf *const config = priv->config;
+    int exists;
+    int r;
+
+    /* Anything to check? */
+    if (config->hash_prefix == 0)
+        return 0;
+
+    /* Check for an unfinished migration */
+    if ((r = http_io_set_migrating(s3b, &exists, -1)) != 0)
+        return r;
+    if (exists) {
+        (*config->log)(LOG_ERR, "a key migration was not finished; run `--migrateKeys' again to complete it");
+        return EBUSY;
+    }
+
+    /* Check the layout was recorded */
+    if ((r = http_io_set_hashed(s3b, &exists, -1)) != 0)
+        return r;
+    if (!exists) {
+        (*config->log)(LOG_ERR, "no hashed key layout marker found; run `--migrateKeys' once to move any blocks"
+          " stored under plain keys (or, for a new filesystem, just to record the layout)");
+        return EBUSY;
+    }
+
+    /* OK */
+    return 0;
+}
+
+/*
+ * Get a buffer from the I/O buffer pool, allocating a new one if the pool is empty.
+ *
+ * The pool is a fixed array of slots that are taken and filled with atomic operations, so it needs no lock.
+ * Only as many slots are used as keep the pool's total size under IO_BUF_POOL_BYTES.
+ * Each thread starts looking at the slot it last used, so threads mostly keep to their own slots (and buffers).
+ */
+static void *
+http_io_get_buf(struct http_io_private *priv)
+{
+    struct http_io_conf *const config = priv->config;
+    void *buf;
+    u_int i;
+
+    if (io_buf_hint == UINT_MAX)
+        io_buf_hint = __atomic_fetch_add(&io_buf_threads, 1, __ATOMIC_RELAXED) % IO_BUF_SLOTS;
+    for (i = 0; i < priv->io_buf_slots; i++) {
+        const u_int slot = (io_buf_hint + i) % priv->io_buf_slots;
+
+        if (__atomic_load_n(&priv->io_bufs[slot], __ATOMIC_RELAXED) != NULL
+          && (buf = __atomic_exchange_n(&priv->io_bufs[slot], NULL, __ATOMIC_ACQUIRE)) != NULL) {
+            io_buf_hint = slot;
+            STATS_INC(priv, io_buffers_reused);
+            return buf;
+        }
+    }
+    if ((buf = malloc(priv->io_buf_size)) == NULL) {
+        (*config->log)(LOG_ERR, "malloc: %s", strerror(errno));
+        STATS_INC(priv, out_of_memory_errors);
+        return NULL;
+    }
+    STATS_INC(priv, io_buffers_created);
+    return buf;
+}
+
+/*
+ * Return a buffer to the I/O buffer pool, or free it if the pool is full. It's OK if buf is NULL.
+ */
+static void
+http_io_put_buf(struct http_io_private *priv, void *buf)
+{
+    void *empty;
+    u_int i;
+
+    if (buf == NULL)
+        return;
+    if (io_buf_hint == UINT_MAX)
+        io_buf_hint = __atomic_fetch_add(&io_buf_threads, 1, __ATOMIC_RELAXED) % IO_BUF_SLOTS;
+    for (i = 0; i < priv->io_buf_slots; i++) {
+        const u_int slot = (io_buf_hint + i) % priv->io_buf_slots;
+
+        empty = NULL;
+        if (__atomic_load_n(&priv->io_bufs[slot], __ATOMIC_RELAXED) == NULL
+          && __atomic_compare_exchange_n(&priv->io_bufs[slot], &empty, buf, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            io_buf_hint = slot;
+            return;
+        }
+    }
+    free(buf);
+}
+
+/*
+ * Compress data using the configured codec into a buffer from the I/O buffer pool, which the caller must return.
+ *
+ * If the data appears incompressible, or compressing it does not make it smaller, *bufp is set to NULL
+ * and the data should be stored as-is.
+ */
+static int
+http_io_compress(struct http_io_private *priv, s3b_block_t block_num,
+  const void *src, u_int len, void **bufp, u_int *lenp)
+{
+    struct http_io_conf *const config = priv->config;
+    u_long compress_len;
+    void *buf;
+    int r;
+
+    /* Don't bother if the data looks incompressible */
+    *bufp = NULL;
+    if (!http_io_compress_probe(priv, block_num, src, len))
+        return 0;
+
+    /* Get buffer */
+    compress_len = COMPRESS_BOUND(len);
+    assert(compress_len <= priv->io_buf_size);
+    if ((buf = http_io_get_buf(priv)) == NULL)
+        return ENOMEM;
+
+#if HAVE_LIBZSTD
+    /* Compress data using zstd */
+    if (strcmp(priv->codec, COMPRESS_ZSTD) == 0) {
+        struct zstd_ctx *ctx;
+        size_t zlen;
+
+        if ((ctx = http_io_get_zstd(priv)) == NULL) {
+            http_io_put_buf(priv, buf);
+            return ENOMEM;
+        }
+        if (priv->zstd_cdict != NULL)
+            zlen = ZSTD_compress_usingCDict(ctx->cctx, buf, compress_len, src, len, priv->zstd_cdict);
+        else {
+            zlen = ZSTD_compressCCtx(ctx->cctx, buf, compress_len, src, len,
+              config->compress == Z_DEFAULT_COMPRESSION ? ZSTD_DEFAULT_LEVEL : config->compress);
+        }
+        http_io_put_zstd(priv, ctx);
+        if (ZSTD_isError(zlen)) {
+            (*config->log)(LOG_ERR, "zstd compress: %s", ZSTD_getErrorName(zlen));
+            http_io_put_buf(priv, buf);
+            return EIO;
+        }
+        compress_len = zlen;
+        goto done;
+    }
+#endif
+
+#if HAVE_LIBLZ4
+    /* Compress data using LZ4; higher levels map to lower acceleration */
+    if (strcmp(priv->codec, COMPRESS_LZ4) == 0) {
+        const int level = config->compress == Z_DEFAULT_COMPRESSION ? LZ4_DEFAULT_LEVEL : config->compress;
+
+        if ((r = LZ4_compress_fast(src, buf, len, compress_len, LZ4_DEFAULT_LEVEL + 1 - level)) <= 0) {
+            (*config->log)(LOG_ERR, "LZ4 compress failed");
+            http_io_put_buf(priv, buf);
+            return EIO;
+        }
+        compress_len = r;
+        goto done;
+    }
+#endif
+
+    /* Compress data using zlib */
+    assert(strcmp(priv->codec, COMPRESS_DEFLATE) == 0);
+    r = compress2(buf, &compress_len, src, len, config->compress);
+    switch (r) {
+    case Z_OK:
+        break;
+    case Z_MEM_ERROR:
+        (*config->log)(LOG_ERR, "zlib compress: %s", strerror(ENOMEM));
+        STATS_INC(priv, out_of_memory_errors);
+        http_io_put_buf(priv, buf);
+        return ENOMEM;
+    default:
+        (*config->log)(LOG_ERR, "unknown zlib compress2() error %d", r);
+        http_io_put_buf(priv, buf);
+        return EIO;
+    }
+
+#if HAVE_LIBZSTD || HAVE_LIBLZ4
+done:
+#endif
+    /* If compression didn't help, remember that and store the data as-is */
+    if (compress_len >= len) {
+        http_io_put_buf(priv, buf);
+        http_io_compress_outcome(priv, block_num, 0);
+        STATS_INC(priv, compress_no_gain);
+        return 0;
+    }
+    http_io_compress_outcome(priv, block_num, 1);
+
+    /* Done */
+    *bufp = buf;
+    *lenp = compress_len;
+    return 0;
+}
+
+/*
+ * Determine whether data is worth compressing. Blocks in regions that have recently proven incompressible
+ * are skipped outright; otherwise, large blocks are probed by quickly compressing evenly spaced samples.
+ * A region's score decays as its blocks are skipped, so eventually we look again.
+ *
+ * Region scores and stats are updated atomically, so this doesn't take the mutex.
+ */
+static int
+http_io_compress_probe(struct http_io_private *priv, s3b_block_t block_num, const void *src, u_int len)
+{
+    u_char *const score = &priv->compress_scores[block_num / COMPRESS_REGION_BLOCKS];
+    u_char sample[COMPRESS_PROBE_SIZE];
+    u_char probe[COMPRESS_BOUND(COMPRESS_PROBE_SIZE)];
+    u_long probe_len = sizeof(probe);
+    u_char value;
+    u_int stride;
+    int i;
+
+    /* Check what we remember about this region */
+    value = __atomic_load_n(score, __ATOMIC_RELAXED);
+    while (value >= COMPRESS_REGION_SKIP) {
+        if (__atomic_compare_exchange_n(score, &value, value - 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            STATS_INC(priv, compress_region_skips);
+            STATS_ADD(priv, compress_bytes_skipped, len);
+            return 0;
+        }
+    }
+
+    /* Small blocks are cheap enough to just compress */
+    if (len < COMPRESS_PROBE_MIN_BLOCK)
+        return 1;
+
+    /* Compress a sample of the block as fast as possible */
+    stride = len / COMPRESS_PROBE_CHUNKS;
+    for (i = 0; i < COMPRESS_PROBE_CHUNKS; i++)
+        memcpy(sample + i * COMPRESS_PROBE_CHUNK_SIZE, (const u_char *)src + i * stride, COMPRESS_PROBE_CHUNK_SIZE);
+    if (compress2(probe, &probe_len, sample, sizeof(sample), Z_BEST_SPEED) != Z_OK)
+        return 1;
+    STATS_INC(priv, compress_probes);
+    if (probe_len * 100 < sizeof(sample) * COMPRESS_PROBE_PERCENT)
+        return 1;
+
+    /* It's incompressible */
+    http_io_compress_outcome(priv, block_num, 0);
+    STATS_INC(priv, compress_probe_skips);
+    STATS_ADD(priv, compress_bytes_skipped, len);
+    return 0;
+}
+
+/*
+ * Remember whether a block in some region turned out to be compressible.
+ */
+static void
+http_io_compress_outcome(struct http_io_private *priv, s3b_block_t block_num, int compressible)
+{
+    u_char *const score = &priv->compress_scores[block_num / COMPRESS_REGION_BLOCKS];
+    u_char value;
+
+    if (compressible) {
+        __atomic_store_n(score, 0, __ATOMIC_RELAXED);
+        return;
+    }
+    value = __atomic_load_n(score, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(score, &value,
+      value + COMPRESS_REGION_PENALTY > COMPRESS_REGION_MAX ? COMPRESS_REGION_MAX : value + COMPRESS_REGION_PENALTY,
+      0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+/*
+ * Decompress a block that was compressed with zstd or LZ4 into `dest', which has room for one block.
+ * Blocks compressed with zlib are handled inline by http_io_read_block().
+ */
+static int
+http_io_decompress(struct http_io_private *priv, s3b_block_t block_num, const char *codec,
+  const void *src, u_int len, void *dest, u_int *lenp)
+{
+    struct http_io_conf *const config = priv->config;
+
+#if HAVE_LIBZSTD
+    if (strcasecmp(codec, COMPRESS_ZSTD) == 0) {
+        const u_int dict_id = ZSTD_getDictID_fromFrame(src, len);
+        struct zstd_ctx *ctx;
+        size_t zlen;
+
+        /* Verify we have the dictionary the block was compressed with */
+        if (dict_id != 0 && (priv->zstd_ddict == NULL || dict_id != ZSTD_getDictID_fromDDict(priv->zstd_ddict))) {
+            (*config->log)(LOG_ERR, "block %0*jx was compressed using zstd dictionary %u which is not configured",
+              S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num, dict_id);
+            return EIO;
+        }
+
+        /* Decompress */
+        if ((ctx = http_io_get_zstd(priv)) == NULL)
+            return ENOMEM;
+        if (dict_id != 0)
+            zlen = ZSTD_decompress_usingDDict(ctx->dctx, dest, config->block_size, src, len, priv->zstd_ddict);
+        else
+            zlen = ZSTD_decompressDCtx(ctx->dctx, dest, config->block_size, src, len);
+        http_io_put_zstd(priv, ctx);
+        if (ZSTD_isError(zlen)) {
+            (*config->log)(LOG_ERR, "zstd decompress: %s", ZSTD_getErrorName(zlen));
+            return EIO;
+        }
+        *lenp = zlen;
+        return 0;
+    }
+#endif
+
+#if HAVE_LIBLZ4
+    if (strcasecmp(codec, COMPRESS_LZ4) == 0) {
+        int r;
+
+        if ((r = LZ4_decompress_safe(src, dest, len, config->block_size)) < 0) {
+            (*config->log)(LOG_ERR, "LZ4 decompress: %s", "data is corrupted or decompressed block is oversize");
+            return EIO;
+        }
+        *lenp = r;
+        return 0;
+    }
+#endif
+
+    /* Support for this codec was not compiled in */
+    (*config->log)(LOG_ERR, "block %0*jx is compressed with `%s' but s3backer was built without %s support",
+      S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num, codec, codec);
+    return EIO;
+}
+
+#if HAVE_LIBZSTD
+/*
+ * Load a trained zstd dictionary from config->compress_dict.
+ */
+static int
+http_io_zstd_load_dict(struct http_io_private *priv)
+{
+    struct http_io_conf *const config = priv->config;
+    struct stat sb;
+    void *dict;
+    FILE *fp;
+    int r;
+
+    /* Read dictionary file */
+    if ((fp = fopen(config->compress_dict, "r")) == NULL) {
+        r = errno;
+        (*config->log)(LOG_ERR, "can't open zstd dictionary `%s': %s", config->compress_dict, strerror(r));
+        return r;
+    }
+    if (fstat(fileno(fp), &sb) == -1) {
+        r = errno;
+        (*config->log)(LOG_ERR, "can't stat zstd dictionary `%s': %s", config->compress_dict, strerror(r));
+        fclose(fp);
+        return r;
+    }
+    if ((dict = malloc(sb.st_size > 0 ? sb.st_size : 1)) == NULL) {
+        r = errno;
+        (*config->log)(LOG_ERR, "malloc: %s", strerror(r));
+        fclose(fp);
+        return r;
+    }
+    if (fread(dict, 1, sb.st_size, fp) != (size_t)sb.st_size) {
+        (*config->log)(LOG_ERR, "can't read zstd dictionary `%s'", config->compress_dict);
+        free(dict);
+        fclose(fp);
+        return EIO;
+    }
+    fclose(fp);
+
+    /* Digest it for compression and decompression (both make their own copies) */
+    priv->zstd_cdict = ZSTD_createCDict(dict, sb.st_size,
+      config->compress == Z_DEFAULT_COMPRESSION ? ZSTD_DEFAULT_LEVEL : config->compress);
+    priv->zstd_ddict = ZSTD_createDDict(dict, sb.st_size);
+    free(dict);
+    if (priv->zstd_cdict == NULL || priv->zstd_ddict == NULL) {
+        (*config->log)(LOG_ERR, "invalid zstd dictionary `%s'", config->compress_dict);
+        return EINVAL;
+    }
+    (*config->log)(LOG_INFO, "loaded zstd dictionary %u from `%s'",
+      ZSTD_getDictID_fromDDict(priv->zstd_ddict), config->compress_dict);
+    return 0;
+}
+
+/*
+ * Get a zstd context pair from the pool, creating a new one if the pool is empty.
+ */
+static struct zstd_ctx *
+http_io_get_zstd(struct http_io_private *priv)
+{
+    struct http_io_conf *const config = priv->config;
+    struct zstd_ctx *ctx;
+
+    pthread_mutex_lock(&priv->mutex);
+    if ((ctx = LIST_FIRST(&priv->zstd_ctxs)) != NULL)
+        LIST_REMOVE(ctx, link);
+    pthread_mutex_unlock(&priv->mutex);
+    if (ctx != NULL)
+        return ctx;
+    if ((ctx = calloc(1, sizeof(*ctx))) == NULL
+      || (ctx->cctx = ZSTD_createCCtx()) == NULL
+      || (ctx->dctx = ZSTD_createDCtx()) == NULL) {
+        (*config->log)(LOG_ERR, "can't create zstd context: %s", strerror(ENOMEM));
+        pthread_mutex_lock(&priv->mutex);
+        priv->stats.out_of_memory_errors++;
+        pthread_mutex_unlock(&priv->mutex);
+        if (ctx != NULL) {
+            ZSTD_freeCCtx(ctx->cctx);
+            free(ctx);
+        }
+        return NULL;
+    }
+    return ctx;
+}
+
+/*
+ * Return a zstd context pair to the pool.
+ */
+static void
+http_io_put_zstd(struct http_io_private *priv, struct zstd_ctx *ctx)
+{
+    pthread_mutex_lock(&priv->mutex);
+    LIST_INSERT_HEAD(&priv->zstd_ctxs, ctx, link);
+    pthread_mutex_unlock(&priv->mutex);
+}
+#endif
+
+/*
+ * Store a block's content as a content object named by its SHA-256 hash, unless an
+ * identical content object already exists, and format a reference to it into `refbuf'.
+ *
+ * Content objects are never deleted, so a HEAD that finds the object is sufficient.
+ */
+static int
+http_io_cas_store(struct http_io_private *priv, s3b_block_t block_num, const void *src, char *refbuf, size_t refbufsiz)
+{
+    struct http_io_conf *const config = priv->config;
+    char urlbuf[CAS_URL_BUF_SIZE(config)];
+    char md5buf[(MD5_DIGEST_LENGTH * 4) / 3 + 4];
+    char hashbuf[SHA256_DIGEST_LENGTH * 2 + 1];
+    u_char hash[SHA256_DIGEST_LENGTH];
+    const time_t now = time(NULL);
+    void *encoded_buf = NULL;
+    struct encode_job job;
+    struct http_io io;
+    int r;
+
+    /* Hash content and format reference */
+    SHA256(src, config->block_size, hash);
+    http_io_prhex(hashbuf, hash, SHA256_DIGEST_LENGTH);
+    snprintf(refbuf, refbufsiz, "%s%s\n", CAS_REF_SIGNATURE, hashbuf);
+    assert(strlen(refbuf) == CAS_REF_LENGTH);
+
+    /* Construct URL for the content object */
+    http_io_get_cas_url(urlbuf, sizeof(urlbuf), config, hashbuf);
+
+    /* Initialize I/O info */
+    memset(&io, 0, sizeof(io));
+    io.url = urlbuf;
+    io.method = HTTP_HEAD;
+    io.block_num = block_num;
+
+    /* See if the content is already there */
+    http_io_add_date(priv, &io, now);
+    if ((r = http_io_add_auth(priv, &io, now, NULL, 0)) != 0)
+        goto done;
+    switch ((r = http_io_perform_io(priv, &io, http_io_head_prepper))) {
+    case 0:
+        pthread_mutex_lock(&priv->mutex);
+        priv->stats.cas_blocks_deduped++;
+        pthread_mutex_unlock(&priv->mutex);
+        goto done;
+    case ENOENT:
+        break;
+    default:
+        goto done;
+    }
+
+    /* Reset I/O info */
+    curl_slist_free_all(io.headers);
+    memset(&io, 0, sizeof(io));
+    io.url = urlbuf;
+    io.method = HTTP_PUT;
+    io.src = src;
+    io.buf_size = config->block_size;
+    io.block_num = block_num;
+
+    /* Compress (if desired) and checksum content with a pooled cipher context (content is never encrypted) */
+    assert(config->encryption == NULL);
+    memset(&job, 0, sizeof(job));
+    job.block_num = block_num;
+    job.src = io.src;
+    job.len = io.buf_size;
+    r = http_io_cipher_run(priv, http_io_encode_block, &job);
+    encoded_buf = job.buf;
+    if (r != 0)
+        goto done;
+    io.src = job.src;
+    io.buf_size = job.len;
+    if (job.compressed)
+        io.headers = http_io_add_header(io.headers, "%s: %s", CONTENT_ENCODING_HEADER, priv->codec);
+
+    /* Add Date header */
+    http_io_add_date(priv, &io, now);
+
+    /* Add Content-Type and Content-MD5 headers */
+    io.headers = http_io_add_header(io.headers, "%s: %s", CTYPE_HEADER, CONTENT_TYPE);
+    http_io_base64_encode(md5buf, sizeof(md5buf), job.md5, MD5_DIGEST_LENGTH);
+    io.payload_sha256 = http_io_payload_hash(priv, job.sha256);
+    io.headers = http_io_add_header(io.headers, "%s: %s", MD5_HEADER, md5buf);
+
+    /* Add ACL and storage class headers */
+    io.headers = http_io_add_header(io.headers, "%s: %s", ACL_HEADER, config->accessType);
+    if (config->rrs)
+        io.headers = http_io_add_header(io.headers, "%s: %s", STORAGE_CLASS_HEADER, SCLASS_REDUCED_REDUNDANCY);
+
+    /* Add Authorization header */
+    if ((r = http_io_add_auth(priv, &io, now, io.src, io.buf_size)) != 0)
+        goto done;
+
+    /* Upload content */
+    if ((r = http_io_perform_io(priv, &io, http_io_write_prepper)) == 0) {
+        pthread_mutex_lock(&priv->mutex);
+        priv->stats.cas_blocks_uploaded++;
+        pthread_mutex_unlock(&priv->mutex);
+    }
+
+done:
+    /*  Clean up */
+    curl_slist_free_all(io.headers);
+    http_io_put_buf(priv, encoded_buf);
+    return r;
+}
+
+/*
+ * If a block object just read contains a content reference, read the referenced content object
+ * in its place. Plain blocks are always exactly one block long, so they can't be mistaken for one.
+ * The content's hash is recorded in "io" so the caller can verify it once the content is decoded.
+ */
+static int
+http_io_cas_follow(struct http_io_private *priv, struct http_io *io, u_int *did_readp)
+{
+    struct http_io_conf *const config = priv->config;
+    const char *const ref = io->dest;
+    char urlbuf[CAS_URL_BUF_SIZE(config)];
+    char hashbuf[SHA256_DIGEST_LENGTH * 2 + 1];
+    u_char hash[SHA256_DIGEST_LENGTH];
+    const time_t now = time(NULL);
+    struct http_io cio;
+    int r;
+
+    /* Is this a content reference? */
+    if (*io->content_encoding != '\0'
+      || *did_readp != CAS_REF_LENGTH
+      || *did_readp == config->block_size
+      || memcmp(ref, CAS_REF_SIGNATURE, sizeof(CAS_REF_SIGNATURE) - 1) != 0)
+        return 0;
+
+    /* Parse content hash */
+    memcpy(hashbuf, ref + sizeof(CAS_REF_SIGNATURE) - 1, SHA256_DIGEST_LENGTH * 2);
+    hashbuf[SHA256_DIGEST_LENGTH * 2] = '\0';
+    if (http_io_parse_hex(hashbuf, hash, SHA256_DIGEST_LENGTH) != 0) {
+        (*config->log)(LOG_ERR, "block %0*jx contains an invalid content reference",
+          S3B_BLOCK_NUM_DIGITS, (uintmax_t)io->block_num);
+        return EIO;
+    }
+
+    /* Initialize I/O info; read content into the same buffer */
+    memset(&cio, 0, sizeof(cio));
+    cio.url = urlbuf;
+    cio.method = HTTP_GET;
+    cio.block_num = io->block_num;
+    cio.dest = io->dest;
+    cio.buf_size = io->buf_size;
+
+    /* Construct URL for the content object */
+    http_io_get_cas_url(urlbuf, sizeof(urlbuf), config, hashbuf);
+
+    /* Add Date and Authorization headers */
+    http_io_add_date(priv, &cio, now);
+    if ((r = http_io_add_auth(priv, &cio, now, NULL, 0)) != 0)
+        goto done;
+
+    /* Perform operation */
+    switch ((r = http_io_perform_io(priv, &cio, http_io_read_prepper))) {
+    case 0:
+        break;
+    case ENOENT:
+        (*config->log)(LOG_ERR, "block %0*jx refers to missing content %s",
+          S3B_BLOCK_NUM_DIGITS, (uintmax_t)io->block_num, hashbuf);
+        r = EIO;
+        goto done;
+    default:
+        goto done;
+    }
+
+    /* Return the content in place of the reference */
+    *did_readp = cio.buf_size - cio.bufs.rdremain;
+    memcpy(io->content_encoding, cio.content_encoding, sizeof(io->content_encoding));
+    memcpy(io->cas_hash, hash, SHA256_DIGEST_LENGTH);
+    io->cas_followed = 1;
+
+done:
+    /*  Clean up */
+    curl_slist_free_all(cio.headers);
+    return r;
+}
+
+/*
+ * Read a block from within its packed object using a Range request.
+ *
+ * The object's ETag covers the whole object, so the block's MD5 is computed locally
+ * and compared against any expected MD5 here instead of via If-Match/If-None-Match.
+ */
+static int
+http_io_read_packed(struct http_io_private *priv, s3b_block_t block_num, void *dest,
+  u_char *actual_md5, const u_char *expect_md5, int strict)
+{
+    struct http_io_conf *const config = priv->config;
+    const s3b_block_t base = block_num - block_num % config->pack_factor;
+    u_char md5[MD5_DIGEST_LENGTH];
+    int r;
+
+    /* Read block */
+    r = http_io_get_range(priv, base, (size_t)http_io_pack_blocks(config, base) * config->block_size,
+      (size_t)(block_num - base) * config->block_size, config->block_size, dest, NULL);
+    if (r == ERANGE) {
+        (*config->log)(LOG_ERR, "object for block %0*jx is not a packed object", S3B_BLOCK_NUM_DIGITS, (uintmax_t)base);
+        r = EIO;
+    }
+
+    /* Update stats */
+    switch (r) {
+    case 0:
+        STATS_INC(priv, normal_blocks_read);
+        break;
+    case ENOENT:
+        STATS_INC(priv, zero_blocks_read);
+        break;
+    default:
+        break;
+    }
+
+    /* Treat `404 Not Found' all zeroes */
+    if (r == ENOENT) {
+        memset(dest, 0, config->block_size);
+        r = 0;
+    }
+    if (r != 0)
+        return r;
+
+    /* Compute MD5; zero blocks always have a zero MD5 */
+    if (http_io_is_zero_block(dest, config->block_size))
+        memset(md5, 0, MD5_DIGEST_LENGTH);
+    else
+        MD5(dest, config->block_size, md5);
+    if (actual_md5 != NULL)
+        memcpy(actual_md5, md5, MD5_DIGEST_LENGTH);
+
+    /* Check expected MD5 */
+    if (expect_md5 != NULL) {
+        const int match = memcmp(md5, expect_md5, MD5_DIGEST_LENGTH) == 0;
+
+        if (strict) {
+            if (!match) {
+                (*config->log)(LOG_ERR, "rec'd stale content for block %0*jx",
+                  S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num);
+                STATS_INC(priv, http_stale);
+                r = EIO;
+            }
+        } else if (match) {
+            STATS_INC(priv, http_verified);
+            r = EEXIST;
+        } else
+            STATS_INC(priv, http_mismatch);
+    }
+
+    /* Done */
+    return r;
+}
+
+/*
+ * Write a block by rewriting its packed object.
+ *
+ * Writers of other blocks in the same object that arrive before the PUT starts join the
+ * current round, so dirty neighbours written back together share a single PUT. Blocks not
+ * written in the round are filled in from the existing object, unless the non-zero block
+ * bitmap shows they are all empty. An object whose blocks are all zero is deleted.
+ *
+ * This sits below the MD5 cache, which only protects the blocks actually being written, so
+ * the fill read checks the object against the MD5 of our own last write of it (if recent).
+ */
+static int
+http_io_write_packed(struct http_io_private *priv, s3b_block_t block_num, const void *src, u_char *caller_md5)
+{
+    struct http_io_conf *const config = priv->config;
+    const s3b_block_t base = block_num - block_num % config->pack_factor;
+    const u_int index = block_num - base;
+    struct pack_write *pw;
+    struct pack_md5 *pm;
+    u_char expect_md5[MD5_DIGEST_LENGTH];
+    u_char md5[MD5_DIGEST_LENGTH];
+    u_char *fill = NULL;
+    size_t obj_size;
+    int need_fill;
+    int expect;
+    u_int i;
+    int r;
+
+    /* Report MD5 back to caller; zero blocks always have a zero MD5 */
+    if (caller_md5 != NULL) {
+        if (src != NULL)
+            MD5(src, config->block_size, caller_md5);
+        else
+            memset(caller_md5, 0, MD5_DIGEST_LENGTH);
+    }
+
+    /* Join the collecting round for this object, if any, or wait for one that is already sending */
+    pthread_mutex_lock(&priv->mutex);
+    while (1) {
+        LIST_FOREACH(pw, &priv->pack_writes, link) {
+            if (pw->base == base)
+                break;
+        }
+        if (pw == NULL)
+            break;
+        pw->refs++;
+        if (!pw->sending) {
+            if (src != NULL)
+                memcpy(pw->data + (size_t)index * config->block_size, src, config->block_size);
+            else
+                memset(pw->data + (size_t)index * config->block_size, 0, config->block_size);
+            if (!pw->dirty[index]) {
+                pw->dirty[index] = 1;
+                pw->num_dirty++;
+            }
+            priv->stats.pack_blocks_coalesced++;
+            while (!pw->done)
+                pthread_cond_wait(&pw->cond, &priv->mutex);
+            r = pw->result;
+            http_io_pack_release(pw);
+            goto done;
+        }
+        while (!pw->done)
+            pthread_cond_wait(&pw->cond, &priv->mutex);
+        http_io_pack_release(pw);
+    }
+
+    /* Start a new round */
+    if ((pw = calloc(1, sizeof(*pw))) == NULL) {
+        r = errno;
+        goto fail0;
+    }
+    pw->base = base;
+    pw->num_blocks = http_io_pack_blocks(config, base);
+    obj_size = (size_t)pw->num_blocks * config->block_size;
+    if ((pw->data = calloc(1, obj_size)) == NULL) {
+        r = errno;
+        goto fail1;
+    }
+    if ((pw->dirty = calloc(pw->num_blocks, sizeof(*pw->dirty))) == NULL) {
+        r = errno;
+        goto fail2;
+    }
+    if ((r = pthread_cond_init(&pw->cond, NULL)) != 0)
+        goto fail3;
+    if (src != NULL)
+        memcpy(pw->data + (size_t)index * config->block_size, src, config->block_size);
+    pw->dirty[index] = 1;
+    pw->num_dirty = 1;
+    pw->refs = 1;
+    LIST_INSERT_HEAD(&priv->pack_writes, pw, link);
+
+    /* See whether any other block in the object might be non-zero */
+    need_fill = pw->num_blocks > 1;
+    if (need_fill && priv->non_zero != NULL) {
+        for (need_fill = 0, i = 0; i < pw->num_blocks && !need_fill; i++) {
+            if (i != index)
+                need_fill = http_io_nonzero_test(priv, base + i);
+        }
+    }
+
+    /* If we wrote this object recently, the fill must read back what we wrote; if we deleted it, it's all zeroes */
+    expect = 0;
+    if (need_fill && (pm = http_io_pack_md5_get(priv, base)) != NULL) {
+        if (memcmp(pm->md5, zero_md5, MD5_DIGEST_LENGTH) == 0)
+            need_fill = 0;
+        else {
+            memcpy(expect_md5, pm->md5, MD5_DIGEST_LENGTH);
+            expect = 1;
+        }
+    }
+    pthread_mutex_unlock(&priv->mutex);
+
+    /* Read existing object while other writers join */
+    r = 0;
+    if (need_fill) {
+        if ((fill = malloc(obj_size)) == NULL) {
+            (*config->log)(LOG_ERR, "malloc: %s", strerror(errno));
+            pthread_mutex_lock(&priv->mutex);
+            priv->stats.out_of_memory_errors++;
+            pthread_mutex_unlock(&priv->mutex);
+            r = ENOMEM;
+        } else {
+            r = http_io_get_range(priv, base, obj_size, 0, obj_size, fill, expect ? expect_md5 : NULL);
+            pthread_mutex_lock(&priv->mutex);
+            priv->stats.pack_read_fills++;
+            pthread_mutex_unlock(&priv->mutex);
+            switch (r) {
+            case ENOENT:
+                if (expect) {
+                    (*config->log)(LOG_ERR, "rec'd stale content for block %0*jx", S3B_BLOCK_NUM_DIGITS, (uintmax_t)base);
+                    STATS_INC(priv, http_stale);
+                    r = EIO;
+                    break;
+                }
+                free(fill);
+                fill = NULL;
+                r = 0;
+                break;
+            case ERANGE:
+                (*config->log)(LOG_ERR, "object for block %0*jx is not a packed object",
+                  S3B_BLOCK_NUM_DIGITS, (uintmax_t)base);
+                r = EIO;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    /* Close the round and fill in blocks nobody wrote */
+    pthread_mutex_lock(&priv->mutex);
+    pw->sending = 1;
+    if (fill != NULL) {
+        for (i = 0; i < pw->num_blocks; i++) {
+            if (!pw->dirty[i])
+                memcpy(pw->data + (size_t)i * config->block_size, fill + (size_t)i * config->block_size, config->block_size);
+        }
+    }
+    pthread_mutex_unlock(&priv->mutex);
+    free(fill);
+
+    /* Write (or delete) the object */
+    if (r == 0)
+        r = http_io_pack_put(priv, base, pw->num_blocks, http_io_is_zero_block(pw->data, obj_size) ? NULL : pw->data, md5);
+
+    /* Remember what we wrote and wake up the other writers in this round */
+    pthread_mutex_lock(&priv->mutex);
+    if (r == 0)
+        http_io_pack_md5_put(priv, base, md5);
+    LIST_REMOVE(pw, link);
+    pw->result = r;
+    pw->done = 1;
+    pthread_cond_broadcast(&pw->cond);
+    http_io_pack_release(pw);
+
+done:
+    /* Update stats */
+    pthread_mutex_unlock(&priv->mutex);
+    if (r == 0) {
+        if (src == NULL)
+            STATS_INC(priv, zero_blocks_written);
+        else
+            STATS_INC(priv, normal_blocks_written);
+    }
+    return r;
+
+fail3:
+    free(pw->dirty);
+fail2:
+    free(pw->data);
+fail1:
+    free(pw);
+fail0:
+    (*config->log)(LOG_ERR, "can't write block %0*jx: %s", S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num, strerror(r));
+    if (r == ENOMEM)
+        priv->stats.out_of_memory_errors++;
+    pthread_mutex_unlock(&priv->mutex);
+    return r;
+}
+
+/*
+ * Release a reference to a packed object write round. Caller must hold the mutex.
+ */
+static void
+http_io_pack_release(struct pack_write *pw)
+{
+    assert(pw->refs > 0);
+    if (--pw->refs > 0)
+        return;
+    assert(pw->done);
+    pthread_cond_destroy(&pw->cond);
+    free(pw->dirty);
+    free(pw->data);
+    free(pw);
+}
+
+/*
+ * Find the MD5 of a packed object we wrote recently, if any, first forgetting expired ones.
+ * Caller must hold the mutex.
+ */
+static struct pack_md5 *
+http_io_pack_md5_get(struct http_io_private *priv, s3b_block_t base)
+{
+    struct http_io_conf *const config = priv->config;
+    const double expiry = http_io_now() - config->md5_cache_time / 1000.0;
+    struct pack_md5 *pm;
+
+    if (priv->pack_md5s == NULL)
+        return NULL;
+    while ((pm = TAILQ_FIRST(&priv->pack_md5_list)) != NULL && pm->timestamp < expiry) {
+        TAILQ_REMOVE(&priv->pack_md5_list, pm, link);
+        s3b_hash_remove(priv->pack_md5s, pm->base);
+        free(pm);
+    }
+    return s3b_hash_get(priv->pack_md5s, base);
+}
+
+/*
+ * Remember the MD5 of a packed object we just wrote, forgetting the oldest one if there are too many.
+ * Caller must hold the mutex.
+ */
+static void
+http_io_pack_md5_put(struct http_io_private *priv, s3b_block_t base, const u_char *md5)
+{
+    struct http_io_conf *const config = priv->config;
+    struct pack_md5 *pm;
+
+    if (priv->pack_md5s == NULL)
+        return;
+    if ((pm = http_io_pack_md5_get(priv, base)) != NULL)
+        TAILQ_REMOVE(&priv->pack_md5_list, pm, link);
+    else {
+        if (s3b_hash_size(priv->pack_md5s) >= config->md5_cache_size) {
+            struct pack_md5 *const oldest = TAILQ_FIRST(&priv->pack_md5_list);
+
+            TAILQ_REMOVE(&priv->pack_md5_list, oldest, link);
+            s3b_hash_remove(priv->pack_md5s, oldest->base);
+            free(oldest);
+        }
+        if ((pm = malloc(sizeof(*pm))) == NULL) {
+            (*config->log)(LOG_ERR, "malloc: %s", strerror(errno));
+            priv->stats.out_of_memory_errors++;
+            return;
+        }
+        pm->base = base;
+        s3b_hash_put_new(priv->pack_md5s, pm);
+    }
+    memcpy(pm->md5, md5, MD5_DIGEST_LENGTH);
+    pm->timestamp = http_io_now();
+    TAILQ_INSERT_TAIL(&priv->pack_md5_list, pm, link);
+}
+
+/*
+ * Forget all remembered packed object MD5s.
+ */
+static void
+http_io_pack_md5_free(struct http_io_private *priv)
+{
+    struct pack_md5 *pm;
+
+    while ((pm = TAILQ_FIRST(&priv->pack_md5_list)) != NULL) {
+        TAILQ_REMOVE(&priv->pack_md5_list, pm, link);
+        free(pm);
+    }
+    if (priv->pack_md5s != NULL)
+        s3b_hash_destroy(priv->pack_md5s);
+}
+
+/*
+ * Get the number of blocks in the packed object starting with block `base'.
+ */
+static u_int
+http_io_pack_blocks(struct http_io_conf *config, s3b_block_t base)
+{
+    return config->num_blocks - base < config->pack_factor ? config->num_blocks - base : config->pack_factor;
+}
+
+/*
+ * Read `len' bytes at offset `off' from the object for block `block_num' using a Range request.
+ * If `expect_md5' is not NULL, stale content is retried until the object's MD5 matches.
+ *
+ * Returns ENOENT if the object does not exist, or ERANGE if the object is not `obj_size'
+ * bytes of data stored as-is (e.g., it is compressed, encrypted, or a content reference).
+ */
+static int
+http_io_get_range(struct http_io_private *priv, s3b_block_t block_num, size_t obj_size, size_t off, size_t len, void *dest,
+  const u_char *expect_md5)
+{
+    struct http_io_conf *const config = priv->config;
+    char urlbuf[URL_BUF_SIZE(config)];
+    const time_t now = time(NULL);
+    struct http_io io;
+    int r;
+
+    /* Sanity check */
+    assert(len > 0);
+    assert(off + len <= obj_size);
+    assert(len <= UINT_MAX);                    /* s3b_config.c limits the size of packed objects */
+
+    /* Initialize I/O info */
+    memset(&io, 0, sizeof(io));
+    io.url = urlbuf;
+    io.method = HTTP_GET;
+    io.block_num = block_num;
+    io.dest = dest;
+    io.buf_size = len;
+
+    /* Construct URL for the object */
+    http_io_get_block_url(urlbuf, sizeof(urlbuf), config, block_num);
+
+    /* Add Date and Range headers */
+    http_io_add_date(priv, &io, now);
+    io.headers = http_io_add_header(io.headers, "%s: bytes=%ju-%ju",
+      RANGE_HEADER, (uintmax_t)off, (uintmax_t)(off + len - 1));
+
+    /* Add If-Match header if required */
+    if (expect_md5 != NULL) {
+        char md5buf[MD5_DIGEST_LENGTH * 2 + 1];
+
+        http_io_prhex(md5buf, expect_md5, MD5_DIGEST_LENGTH);
+        io.headers = http_io_add_header(io.headers, "%s: \"%s\"", IF_MATCH_HEADER, md5buf);
+    }
+
+    /* Add Authorization header */
+    if ((r = http_io_add_auth(priv, &io, now, NULL, 0)) != 0)
+        goto done;
+
+    /* Perform operation */
+    if ((r = http_io_perform_io(priv, &io, http_io_read_prepper)) != 0)
+        goto done;
+
+    /* Verify we got the requested bytes of an unencoded object of the expected size */
+    if (*io.content_encoding != '\0' || io.object_size != obj_size || io.bufs.rdremain != 0)
+        r = ERANGE;
+
+done:
+    /*  Clean up */
+    curl_slist_free_all(io.headers);
+    return r;
+}
+
+/*
+ * Write the packed object starting with block `base', or delete it if src == NULL.
+ * The object's MD5 (zero if deleted) is returned in `md5'.
+ */
+static int
+http_io_pack_put(struct http_io_private *priv, s3b_block_t base, u_int num_blocks, const void *src, u_char *md5)
+{
+    struct http_io_conf *const config = priv->config;
+    char urlbuf[URL_BUF_SIZE(config)];
+    char md5buf[(MD5_DIGEST_LENGTH * 4) / 3 + 4];
+    char sha256buf[SHA256_DIGEST_LENGTH * 2 + 1];
+    const time_t now = time(NULL);
+    struct http_io io;
+    int r;
+
+    /* Initialize I/O info */
+    memset(&io, 0, sizeof(io));
+    io.url = urlbuf;
+    io.method = src != NULL ? HTTP_PUT : HTTP_DELETE;
+    io.src = src;
+    io.buf_size = num_blocks * config->block_size;
+    io.block_num = base;
+
+    /* Construct URL for the object */
+    http_io_get_block_url(urlbuf, sizeof(urlbuf), config, base);
+
+    /* Add Date header */
+    http_io_add_date(priv, &io, now);
+
+    /* Add PUT-only headers */
+    memset(md5, 0, MD5_DIGEST_LENGTH);
+    if (src != NULL) {
+
+        /* Add Content-Type and Content-MD5 headers, hashing the payload for authentication at the same time */
+        http_io_digest(priv, src, io.buf_size, 0, md5, sha256buf);
+        io.payload_sha256 = http_io_payload_hash(priv, sha256buf);
+        io.headers = http_io_add_header(io.headers, "%s: %s", CTYPE_HEADER, CONTENT_TYPE);
+        http_io_base64_encode(md5buf, sizeof(md5buf), md5, MD5_DIGEST_LENGTH);
+        io.headers = http_io_add_header(io.headers, "%s: %s", MD5_HEADER, md5buf);
+
+        /* Add ACL and storage class headers */
+        io.headers = http_io_add_header(io.headers, "%s: %s", ACL_HEADER, config->accessType);
+        if (config->rrs)
+            io.headers = http_io_add_header(io.headers, "%s: %s", STORAGE_CLASS_HEADER, SCLASS_REDUCED_REDUNDANCY);
+
+        /* Add file size meta-data and pack factor to zero'th object (the packed layout marker has them too) */
+        if (base == 0) {
+            io.headers = http_io_add_header(io.headers, "%s: %u", BLOCK_SIZE_HEADER, config->block_size);
+            io.headers = http_io_add_header(io.headers, "%s: %ju",
+              FILE_SIZE_HEADER, (uintmax_t)(config->block_size * config->num_blocks));
+            io.headers = http_io_add_header(io.headers, "%s: %u", PACK_FACTOR_HEADER, config->pack_factor);
+        }
+    }
+
+    /* Add Authorization header */
+    if ((r = http_io_add_auth(priv, &io, now, io.src, io.buf_size)) != 0)
+        goto done;
+
+    /* Perform operation */
+    r = http_io_perform_io(priv, &io, http_io_write_prepper);
+
+done:
+    /*  Clean up */
+    curl_slist_free_all(io.headers);
+    return r;
+}
+
+/*
+ * Read part of a block with a Range request when blocks are stored as-is, rather than
+ * downloading the whole block. Falls back to reading the whole block if the block's
+ * object turns out to be encoded (e.g., written by an earlier mount with `--compress').
+ */
+static int
+http_io_read_block_part(struct s3backer_store *s3b, s3b_block_t block_num, u_int off, u_int len, void *dest)
+{
+    struct http_io_private *const priv = s3b->data;
+    struct http_io_conf *const config = priv->config;
+    s3b_block_t base = block_num;
+    size_t obj_size = config->block_size;
+    size_t obj_off = off;
+    int r;
+
+    /* Sanity check */
+    if (config->block_size == 0 || block_num >= config->num_blocks)
+        return EINVAL;
+    assert(off + len <= config->block_size);
+
+    /* Encoded blocks must be read whole; so must whole blocks, to get the usual MD5 handling */
+    if (config->compress != Z_NO_COMPRESSION || config->encryption != NULL || config->cas
+      || len == 0 || len == config->block_size)
+        return block_part_read_block_part(s3b, block_num, config->block_size, off, len, dest);
+
+    /* Read zero blocks when bitmap indicates empty until non-zero content is written */
+    if (priv->non_zero != NULL && !http_io_nonzero_test(priv, block_num)) {
+        STATS_INC(priv, empty_blocks_read);
+        memset(dest, 0, len);
+        return 0;
+    }
+
+    /* Find the block within its object */
+    if (config->pack_factor > 1) {
+        base = block_num - block_num % config->pack_factor;
+        obj_size = (size_t)http_io_pack_blocks(config, base) * config->block_size;
+        obj_off += (size_t)(block_num - base) * config->block_size;
+    }
+
+    /* Read the requested range */
+    r = http_io_get_range(priv, base, obj_size, obj_off, len, dest, NULL);
+
+    /* Update stats */
+    switch (r) {
+    case 0:
+        STATS_INC(priv, partial_blocks_read);
+        break;
+    case ENOENT:
+        STATS_INC(priv, zero_blocks_read);
+        break;
+    default:
+        break;
+    }
+
+    /* Handle result */
+    switch (r) {
+    case ENOENT:
+        memset(dest, 0, len);
+        return 0;
+    case ERANGE:
+        if (config->pack_factor > 1) {
+            (*config->log)(LOG_ERR, "object for block %0*jx is not a packed object", S3B_BLOCK_NUM_DIGITS, (uintmax_t)base);
+            return EIO;
+        }
+        return block_part_read_block_part(s3b, block_num, config->block_size, off, len, dest);
+    default:
+        return r;
+    }
+}
+
+static int
+http_io_write_block_part(struct s3backer_store *s3b, s3b_block_t block_num, u_int off, u_int len, const void *src)
+{
+    struct http_io_private *const priv = s3b->data;
+    struct http_io_conf *const config = priv->config;
+
+    return block_part_write_block_part(s3b, block_num, config->block_size, off, len, src);
+}
+
+#if HAVE_CURL_HTTP2
+/*
+ * HTTP/2 multiplexing thread.
+ *
+ * All transfers are run on a single multi handle, which lets cURL multiplex them as streams
+ * over a few shared connections instead of giving each transfer its own connection.
+ */
+static void *
+http_io_multi_main(void *arg)
+{
+    struct http_io_private *const priv = arg;
+    struct http_io_conf *const config = priv->config;
+    struct curl_waitfd waitfd;
+    struct multi_xfer *xfer;
+    CURLMcode mcode;
+    CURLcode result;
+    CURLMsg *msg;
+    char buf[64];
+    long version;
+    long conns;
+    int running;
+    int nmsgs;
+
+    pthread_mutex_lock(&priv->mutex);
+    while (!priv->shutting_down) {
+
+        /* Add newly submitted transfers */
+        while ((xfer = TAILQ_FIRST(&priv->multi_queue)) != NULL) {
+            TAILQ_REMOVE(&priv->multi_queue, xfer, link);
+            if ((mcode = curl_multi_add_handle(priv->multi, xfer->curl)) != CURLM_OK) {
+                (*config->log)(LOG_ERR, "curl_multi_add_handle: %s", curl_multi_strerror(mcode));
+                xfer->result = CURLE_FAILED_INIT;
+                xfer->done = 1;
+                pthread_cond_signal(&xfer->cond);
+                continue;
+            }
+            if (++priv->multi_active > priv->stats.http2_max_streams)
+                priv->stats.http2_max_streams = priv->multi_active;
+        }
+        pthread_mutex_unlock(&priv->mutex);
+
+        /* Make progress on all transfers */
+        if ((mcode = curl_multi_perform(priv->multi, &running)) != CURLM_OK)
+            (*config->log)(LOG_ERR, "curl_multi_perform: %s", curl_multi_strerror(mcode));
+
+        /* Reap completed transfers */
+        while ((msg = curl_multi_info_read(priv->multi, &nmsgs)) != NULL) {
+            CURL *const curl = msg->easy_handle;
+
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+            result = msg->data.result;
+            curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&xfer);
+            if (curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &conns) != CURLE_OK)
+                conns = 0;
+            if (curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION, &version) != CURLE_OK)
+                version = 0;
+            curl_multi_remove_handle(priv->multi, curl);
+            pthread_mutex_lock(&priv->mutex);
+            priv->multi_active--;
+            priv->stats.http2_streams++;
+            priv->stats.http2_connections += conns;
+            if (version != CURL_HTTP_VERSION_2_0)
+                priv->stats.http2_fallbacks++;
+            xfer->result = result;
+            xfer->done = 1;
+            pthread_cond_signal(&xfer->cond);
+            pthread_mutex_unlock(&priv->mutex);
+        }
+
+        /* Wait for network activity or a newly submitted transfer */
+        waitfd.fd = priv->multi_pipe[0];
+        waitfd.events = CURL_WAIT_POLLIN;
+        waitfd.revents = 0;
+        if ((mcode = curl_multi_wait(priv->multi, &waitfd, 1, 1000, NULL)) != CURLM_OK)
+            (*config->log)(LOG_ERR, "curl_multi_wait: %s", curl_multi_strerror(mcode));
+        while (read(priv->multi_pipe[0], buf, sizeof(buf)) > 0)
+            ;
+        pthread_mutex_lock(&priv->mutex);
+    }
+    pthread_mutex_unlock(&priv->mutex);
+    return NULL;
 }
+#endif  /* HAVE_CURL_HTTP2 */
 
-static int
-http_io_read_block_part(struct s3backer_store *s3b, s3b_block_t block_num, u_int off, u_int len, void *dest)
+/*
+ * Perform a transfer, either directly or (with HTTP/2) via the multiplexing thread.
+ */
+static CURLcode
+http_io_perform_curl(struct http_io_private *priv, CURL *curl)
 {
-    struct http_io_private *const priv = s3b->data;
-    struct http_io_conf *const config = priv->config;
+    struct multi_xfer xfer;
+    CURLcode result;
+
+    /* Track network stage depth */
+    http_io_net_start(priv);
+
+    /* Not multiplexing? */
+    if (priv->multi == NULL) {
+        result = curl_easy_perform(curl);
+        goto done;
+    }
+
+    /* Hand transfer to the multiplexing thread */
+    memset(&xfer, 0, sizeof(xfer));
+    xfer.curl = curl;
+    if (pthread_cond_init(&xfer.cond, NULL) != 0) {
+        result = CURLE_OUT_OF_MEMORY;
+        goto done;
+    }
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, (char *)&xfer);
+    pthread_mutex_lock(&priv->mutex);
+    TAILQ_INSERT_TAIL(&priv->multi_queue, &xfer, link);
+    pthread_mutex_unlock(&priv->mutex);
+    (void)write(priv->multi_pipe[1], "", 1);
+
+    /* Wait for it to complete */
+    pthread_mutex_lock(&priv->mutex);
+    while (!xfer.done)
+        pthread_cond_wait(&xfer.cond, &priv->mutex);
+    pthread_mutex_unlock(&priv->mutex);
+    pthread_cond_destroy(&xfer.cond);
+    result = xfer.result;
+
+done:
+    ATOMIC_SUB(&priv->stats.net_active_transfers, 1);
+    return result;
+}
 
-    return block_part_read_block_part(s3b, block_num, config->block_size, off, len, dest);
+/*
+ * Count a transfer starting, for the network stage depth stats.
+ */
+static void
+http_io_net_start(struct http_io_private *priv)
+{
+    u_int active;
+    u_int max;
+
+    active = __atomic_add_fetch(&priv->stats.net_active_transfers, 1, __ATOMIC_RELAXED);
+    max = ATOMIC_LOAD(&priv->stats.net_max_active_transfers);
+    while (active > max && !__atomic_compare_exchange_n(&priv->stats.net_max_active_transfers,
+      &max, active, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
 }
 
+/*
+ * Encode or decode a block in the calling thread, using a context borrowed from the cipher context pool.
+ *
+ * Each thread moves its own block from the CPU stage straight on to the network stage, so one thread's
+ * encoding overlaps with other threads' transfers without any hand-off between threads. The pool bounds
+ * the number of blocks being encoded or decoded at once to the number of cores, rather than the number
+ * of threads doing I/O; when every context is busy, we wait for one to become idle.
+ */
 static int
-http_io_write_block_part(struct s3backer_store *s3b, s3b_block_t block_num, u_int off, u_int len, const void *src)
+http_io_cipher_run(struct http_io_private *priv, http_io_cipher_t *func, void *arg)
 {
-    struct http_io_private *const priv = s3b->data;
-    struct http_io_conf *const config = priv->config;
+    struct cipher_ctx *cctx;
+    int r;
 
-    return block_part_write_block_part(s3b, block_num, config->block_size, off, len, src);
+    /* Borrow a context */
+    pthread_mutex_lock(&priv->cipher_mutex);
+    if ((cctx = SLIST_FIRST(&priv->cipher_idle)) == NULL) {
+        if (++priv->stats.crypto_queue_depth > priv->stats.crypto_max_queue_depth)
+            priv->stats.crypto_max_queue_depth = priv->stats.crypto_queue_depth;
+        while ((cctx = SLIST_FIRST(&priv->cipher_idle)) == NULL)
+            pthread_cond_wait(&priv->cipher_wakeup, &priv->cipher_mutex);
+        priv->stats.crypto_queue_depth--;
+    }
+    SLIST_REMOVE_HEAD(&priv->cipher_idle, link);
+    pthread_mutex_unlock(&priv->cipher_mutex);
+
+    /* Do the work */
+    r = (*func)(cctx, arg);
+
+    /* Return the context */
+    pthread_mutex_lock(&priv->cipher_mutex);
+    SLIST_INSERT_HEAD(&priv->cipher_idle, cctx, link);
+    priv->stats.crypto_jobs++;
+    pthread_cond_signal(&priv->cipher_wakeup);
+    pthread_mutex_unlock(&priv->cipher_mutex);
+    return r;
 }
 
 /*
@@ -1574,10 +5646,13 @@ static int
 http_io_perform_io(struct http_io_private *priv, struct http_io *io, http_io_curl_prepper_t *prepper)
 {
     struct http_io_conf *const config = priv->config;
+    struct rate_gov *const gov = http_io_get_gov(priv, io);
     struct timespec delay;
     CURLcode curl_code;
     u_int retry_pause = 0;
     u_int total_pause;
+    u_int jittered;
+    u_int seed = 0;
     long http_code;
     double clen;
     int attempt;
@@ -1590,15 +5665,27 @@ http_io_perform_io(struct http_io_private *priv, struct http_io *io, http_io_cur
     /* Make attempts */
     for (attempt = 0, total_pause = 0; 1; attempt++, total_pause += retry_pause) {
 
+        /* Wait for the rate governor (if any); do this first, so we don't sit on a CURL instance while waiting */
+        if (gov != NULL)
+            http_io_gov_acquire(priv, gov);
+
         /* Acquire and initialize CURL instance */
         if ((curl = http_io_acquire_curl(priv, io)) == NULL)
             return EIO;
         (*prepper)(curl, io);
 
+        /* Route the request to the best endpoint (if any) */
+        io->endpoint = http_io_endpoint_pick(priv, io, curl);
+
         /* Perform HTTP operation and check result */
         if (attempt > 0)
             (*config->log)(LOG_INFO, "retrying query (attempt #%d): %s %s", attempt + 1, io->method, io->url);
-        curl_code = curl_easy_perform(curl);
+#if HAVE_CURL_MULTI_WAIT
+        if (io->hedge)
+            curl_code = http_io_perform_hedged(priv, io, prepper, &curl);
+        else
+#endif
+            curl_code = http_io_perform_curl(priv, curl);
 
         /* Find out what the HTTP result code was (if any) */
         switch (curl_code) {
@@ -1611,6 +5698,19 @@ http_io_perform_io(struct http_io_private *priv, struct http_io *io, http_io_cur
             http_code = -1;
             break;
         }
+        io->http_code = http_code;
+
+        /* Update endpoint latency and health */
+        http_io_endpoint_done(priv, io->endpoint, curl, curl_code);
+        io->endpoint = NULL;
+
+        /* Slow down on `503 Slow Down' or timeout, and speed up again on responses showing S3 is keeping up */
+        if (gov != NULL) {
+            if (http_code == HTTP_SERVICE_UNAVAILABLE || curl_code == CURLE_OPERATION_TIMEDOUT)
+                http_io_gov_feedback(priv, gov, 0);
+            else if (http_code > 0 && http_code < 500)
+                http_io_gov_feedback(priv, gov, 1);
+        }
 
         /* Work around the fact that libcurl converts a 304 HTTP code as success */
         if (curl_code == 0 && http_code == HTTP_NOT_MODIFIED)
@@ -1648,21 +5748,16 @@ http_io_perform_io(struct http_io_private *priv, struct http_io *io, http_io_cur
             }
 
             /* Update stats */
-            pthread_mutex_lock(&priv->mutex);
-            if (strcmp(io->method, HTTP_GET) == 0) {
-                priv->stats.http_gets.count++;
-                priv->stats.http_gets.time += curl_time;
-            } else if (strcmp(io->method, HTTP_PUT) == 0) {
-                priv->stats.http_puts.count++;
-                priv->stats.http_puts.time += curl_time;
-            } else if (strcmp(io->method, HTTP_DELETE) == 0) {
-                priv->stats.http_deletes.count++;
-                priv->stats.http_deletes.time += curl_time;
-            } else if (strcmp(io->method, HTTP_HEAD) == 0) {
-                priv->stats.http_heads.count++;
-                priv->stats.http_heads.time += curl_time;
-            }
-            pthread_mutex_unlock(&priv->mutex);
+            if (io->evst != NULL)
+                http_io_count_evst(io->evst, curl_time);
+            else if (strcmp(io->method, HTTP_GET) == 0)
+                http_io_count_evst(&priv->stats.http_gets, curl_time);
+            else if (strcmp(io->method, HTTP_PUT) == 0)
+                http_io_count_evst(&priv->stats.http_puts, curl_time);
+            else if (strcmp(io->method, HTTP_DELETE) == 0)
+                http_io_count_evst(&priv->stats.http_deletes, curl_time);
+            else if (strcmp(io->method, HTTP_HEAD) == 0)
+                http_io_count_evst(&priv->stats.http_heads, curl_time);
 
             /* Done */
             http_io_release_curl(priv, &curl, r == 0);
@@ -1677,15 +5772,11 @@ http_io_perform_io(struct http_io_private *priv, struct http_io *io, http_io_cur
         case CURLE_ABORTED_BY_CALLBACK:
             if (config->debug)
                 (*config->log)(LOG_DEBUG, "write aborted: %s %s", io->method, io->url);
-            pthread_mutex_lock(&priv->mutex);
-            priv->stats.http_canceled_writes++;
-            pthread_mutex_unlock(&priv->mutex);
+            STATS_INC(priv, http_canceled_writes);
             return ECONNABORTED;
         case CURLE_OPERATION_TIMEDOUT:
             (*config->log)(LOG_NOTICE, "operation timeout: %s %s", io->method, io->url);
-            pthread_mutex_lock(&priv->mutex);
-            priv->stats.curl_timeouts++;
-            pthread_mutex_unlock(&priv->mutex);
+            STATS_INC(priv, curl_timeouts);
             break;
         case CURLE_HTTP_RETURNED_ERROR:                 /* special handling for some specific HTTP codes */
             switch (http_code) {
@@ -1693,23 +5784,21 @@ http_io_perform_io(struct http_io_private *priv, struct http_io *io, http_io_cur
                 if (config->debug)
                     (*config->log)(LOG_DEBUG, "rec'd %ld response: %s %s", http_code, io->method, io->url);
                 return ENOENT;
+            case HTTP_RANGE_NOT_SATISFIABLE:
+                if (config->debug)
+                    (*config->log)(LOG_DEBUG, "rec'd %ld response: %s %s", http_code, io->method, io->url);
+                return ERANGE;
             case HTTP_UNAUTHORIZED:
                 (*config->log)(LOG_ERR, "rec'd %ld response: %s %s", http_code, io->method, io->url);
-                pthread_mutex_lock(&priv->mutex);
-                priv->stats.http_unauthorized++;
-                pthread_mutex_unlock(&priv->mutex);
+                STATS_INC(priv, http_unauthorized);
                 return EACCES;
             case HTTP_FORBIDDEN:
                 (*config->log)(LOG_ERR, "rec'd %ld response: %s %s", http_code, io->method, io->url);
-                pthread_mutex_lock(&priv->mutex);
-                priv->stats.http_forbidden++;
-                pthread_mutex_unlock(&priv->mutex);
+                STATS_INC(priv, http_forbidden);
                 return EPERM;
             case HTTP_PRECONDITION_FAILED:
                 (*config->log)(LOG_INFO, "rec'd stale content: %s %s", io->method, io->url);
-                pthread_mutex_lock(&priv->mutex);
-                priv->stats.http_stale++;
-                pthread_mutex_unlock(&priv->mutex);
+                STATS_INC(priv, http_stale);
                 break;
             case HTTP_NOT_MODIFIED:
                 if (io->expect_304) {
@@ -1720,59 +5809,60 @@ http_io_perform_io(struct http_io_private *priv, struct http_io *io, http_io_cur
                 /* FALLTHROUGH */
             default:
                 (*config->log)(LOG_ERR, "rec'd %ld response: %s %s", http_code, io->method, io->url);
-                pthread_mutex_lock(&priv->mutex);
                 switch (http_code / 100) {
                 case 4:
-                    priv->stats.http_4xx_error++;
+                    STATS_INC(priv, http_4xx_error);
                     break;
                 case 5:
-                    priv->stats.http_5xx_error++;
+                    STATS_INC(priv, http_5xx_error);
+                    if (http_code == HTTP_SERVICE_UNAVAILABLE)
+                        STATS_INC(priv, http_slowdowns);
                     break;
                 default:
-                    priv->stats.http_other_error++;
+                    STATS_INC(priv, http_other_error);
                     break;
                 }
-                pthread_mutex_unlock(&priv->mutex);
                 break;
             }
             break;
         default:
             (*config->log)(LOG_ERR, "operation failed: %s (%s)", curl_easy_strerror(curl_code),
               total_pause >= config->max_retry_pause ? "final attempt" : "will retry");
-            pthread_mutex_lock(&priv->mutex);
             switch (curl_code) {
             case CURLE_OUT_OF_MEMORY:
-                priv->stats.curl_out_of_memory++;
+                STATS_INC(priv, curl_out_of_memory);
                 break;
             case CURLE_COULDNT_CONNECT:
-                priv->stats.curl_connect_failed++;
+                STATS_INC(priv, curl_connect_failed);
                 break;
             case CURLE_COULDNT_RESOLVE_HOST:
-                priv->stats.curl_host_unknown++;
+                STATS_INC(priv, curl_host_unknown);
                 break;
             default:
-                priv->stats.curl_other_error++;
+                STATS_INC(priv, curl_other_error);
                 break;
             }
-            pthread_mutex_unlock(&priv->mutex);
             break;
         }
 
         /* Retry with exponential backoff up to max total pause limit */
-        if (total_pause >= config->max_retry_pause)
+        if (io->no_retry || total_pause >= config->max_retry_pause)
             break;
         retry_pause = retry_pause > 0 ? retry_pause * 2 : config->initial_retry_pause;
         if (total_pause + retry_pause > config->max_retry_pause)
             retry_pause = config->max_retry_pause - total_pause;
-        delay.tv_sec = retry_pause / 1000;
-        delay.tv_nsec = (retry_pause % 1000) * 1000000;
+
+        /* Add jitter so threads that failed together don't all retry together */
+        if (seed == 0)
+            seed = (u_int)(http_io_now() * 1000000.0) ^ (u_int)(uintptr_t)io;
+        jittered = retry_pause / 2 + rand_r(&seed) % (retry_pause / 2 + 1);
+        delay.tv_sec = jittered / 1000;
+        delay.tv_nsec = (jittered % 1000) * 1000000;
         nanosleep(&delay, NULL);            // TODO: check for EINTR
 
         /* Update retry stats */
-        pthread_mutex_lock(&priv->mutex);
-        priv->stats.num_retries++;
-        priv->stats.retry_delay += retry_pause;
-        pthread_mutex_unlock(&priv->mutex);
+        STATS_INC(priv, num_retries);
+        STATS_ADD(priv, retry_delay, jittered);
     }
 
     /* Give up */
@@ -1780,6 +5870,167 @@ http_io_perform_io(struct http_io_private *priv, struct http_io *io, http_io_cur
     return EIO;
 }
 
+#if HAVE_CURL_MULTI_WAIT
+/*
+ * Perform a block GET, sending a duplicate request if no response has started to arrive by the time
+ * most recent GETs had received their first byte, and taking whichever copy finishes first.
+ *
+ * On return, *curlp is the handle that finished and io contains its results.
+ */
+static CURLcode
+http_io_perform_hedged(struct http_io_private *priv, struct http_io *io, http_io_curl_prepper_t *prepper, CURL **curlp)
+{
+    struct http_io_conf *const config = priv->config;
+    struct rate_gov *const gov = http_io_get_gov(priv, io);
+    CURL *curls[2] = { *curlp, NULL };
+    int running[2] = { 0, 0 };
+    CURLcode result = CURLE_OK;
+    struct http_io hedge;
+    double hedge_start = 0.0;
+    double threshold;
+    double start;
+    double ttfb;
+    int hedge_tried = 0;
+    int winner = -1;
+    CURLMcode mcode;
+    CURLMsg *msg;
+    CURLM *multi;
+    int timeout;
+    int nrunning;
+    int nmsgs;
+    int i;
+
+    /* If we don't know how long GETs usually take yet, just do a normal transfer */
+    if ((threshold = http_io_hedge_threshold(priv)) == 0.0 || (multi = http_io_acquire_multi(priv)) == NULL) {
+        result = http_io_perform_curl(priv, *curlp);
+        if (result == CURLE_OK && curl_easy_getinfo(*curlp, CURLINFO_STARTTRANSFER_TIME, &ttfb) == CURLE_OK)
+            http_io_hedge_sample(priv, ttfb);
+        return result;
+    }
+
+    /* Start the original request */
+    memset(&hedge, 0, sizeof(hedge));
+    if ((mcode = curl_multi_add_handle(multi, curls[0])) != CURLM_OK) {
+        (*config->log)(LOG_ERR, "curl_multi_add_handle: %s", curl_multi_strerror(mcode));
+        http_io_release_multi(priv, multi);
+        return CURLE_FAILED_INIT;
+    }
+    running[0] = 1;
+    http_io_net_start(priv);
+    start = http_io_now();
+
+    /* Run transfers until one of them settles the request */
+    while (1) {
+
+        /* Make progress on all transfers */
+        if ((mcode = curl_multi_perform(multi, &nrunning)) != CURLM_OK) {
+            (*config->log)(LOG_ERR, "curl_multi_perform: %s", curl_multi_strerror(mcode));
+            result = CURLE_FAILED_INIT;
+            winner = 0;
+            break;
+        }
+
+        /* Reap completed transfers */
+        while ((msg = curl_multi_info_read(multi, &nmsgs)) != NULL) {
+            CURLcode done_result;
+
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+            i = msg->easy_handle == curls[0] ? 0 : 1;
+            done_result = msg->data.result;
+            curl_multi_remove_handle(multi, curls[i]);
+            ATOMIC_SUB(&priv->stats.net_active_transfers, 1);
+            running[i] = 0;
+
+            /* Any response from S3 settles it, but a network failure doesn't while the other copy is still going */
+            if (winner == -1 && (done_result == CURLE_OK || done_result == CURLE_HTTP_RETURNED_ERROR || !running[!i])) {
+                result = done_result;
+                winner = i;
+            }
+        }
+        if (winner != -1)
+            break;
+
+        /* Send a duplicate request if the response hasn't started to arrive in time, budget permitting */
+        if (!hedge_tried && http_io_now() - start >= threshold) {
+            hedge_tried = 1;
+            if (curl_easy_getinfo(curls[0], CURLINFO_STARTTRANSFER_TIME, &ttfb) == CURLE_OK
+              && ttfb == 0.0 && http_io_hedge_permit(priv)) {
+                hedge = *io;
+
+                /* Hedges are GETs too, so they take a token from the GET rate governor */
+                if (gov != NULL)
+                    http_io_gov_acquire(priv, gov);
+                if ((hedge.dest = http_io_get_buf(priv)) != NULL
+                  && (curls[1] = http_io_acquire_curl(priv, &hedge)) != NULL) {
+                    (*prepper)(curls[1], &hedge);
+                    hedge.endpoint = http_io_endpoint_pick(priv, &hedge, curls[1]);
+                    if ((mcode = curl_multi_add_handle(multi, curls[1])) == CURLM_OK) {
+                        if (config->debug)
+                            (*config->log)(LOG_DEBUG, "hedging after %.3f sec: %s %s", threshold, io->method, io->url);
+                        running[1] = 1;
+                        http_io_net_start(priv);
+                        hedge_start = http_io_now();
+                        STATS_INC(priv, http_hedged_gets);
+                    } else {
+                        (*config->log)(LOG_ERR, "curl_multi_add_handle: %s", curl_multi_strerror(mcode));
+                        http_io_endpoint_done(priv, hedge.endpoint, NULL, CURLE_OK);
+                        http_io_release_curl(priv, &curls[1], 0);
+                    }
+                }
+            }
+        }
+
+        /* Wait for network activity, or until it's time to hedge */
+        timeout = HEDGE_POLL_MS;
+        if (!hedge_tried) {
+            const double remain = start + threshold - http_io_now();
+
+            if (remain * 1000.0 < timeout)
+                timeout = remain > 0.0 ? (int)(remain * 1000.0) + 1 : 0;
+        }
+        if ((mcode = curl_multi_wait(multi, NULL, 0, timeout, NULL)) != CURLM_OK) {
+            (*config->log)(LOG_ERR, "curl_multi_wait: %s", curl_multi_strerror(mcode));
+            result = CURLE_FAILED_INIT;
+            winner = 0;
+            break;
+        }
+    }
+
+    /* Abandon the other copy (if any) */
+    for (i = 0; i < 2; i++) {
+        if (running[i]) {
+            curl_multi_remove_handle(multi, curls[i]);
+            ATOMIC_SUB(&priv->stats.net_active_transfers, 1);
+        }
+        if (i != winner && curls[i] != NULL) {
+            http_io_endpoint_done(priv, i == 0 ? io->endpoint : hedge.endpoint, NULL, CURLE_OK);
+            http_io_release_curl(priv, &curls[i], 0);
+        }
+    }
+    http_io_release_multi(priv, multi);
+
+    /* If the duplicate won, its results become ours */
+    if (winner == 1) {
+        void *const dest = io->dest;
+
+        *io = hedge;
+        hedge.dest = dest;
+        STATS_INC(priv, http_hedge_wins);
+    }
+    if (hedge.dest != NULL)
+        http_io_put_buf(priv, hedge.dest);
+
+    /* Record how long it took for the response to start arriving */
+    if (result == CURLE_OK && curl_easy_getinfo(curls[winner], CURLINFO_STARTTRANSFER_TIME, &ttfb) == CURLE_OK)
+        http_io_hedge_sample(priv, ttfb + (winner == 1 ? hedge_start - start : 0.0));
+
+    /* Done */
+    *curlp = curls[winner];
+    return result;
+}
+#endif
+
 /*
  * Compute S3 authorization hash using secret access key and add Authorization and SHA256 hash headers.
  *
@@ -1789,34 +6040,39 @@ static int
 http_io_add_auth(struct http_io_private *priv, struct http_io *const io, time_t now, const void *payload, size_t plen)
 {
     const struct http_io_conf *const config = priv->config;
+    struct credentials *creds;
+    int slot;
+    int r;
 
     /* Anything to do? */
-    if (config->accessId == NULL)
+    if ((creds = http_io_creds_acquire(priv, &slot)) == NULL)
         return 0;
 
     /* Which auth version? */
     if (strcmp(config->authVersion, AUTH_VERSION_AWS2) == 0)
-        return http_io_add_auth2(priv, io, now, payload, plen);
-    if (strcmp(config->authVersion, AUTH_VERSION_AWS4) == 0)
-        return http_io_add_auth4(priv, io, now, payload, plen);
+        r = http_io_add_auth2(priv, creds, io, now, payload, plen);
+    else if (strcmp(config->authVersion, AUTH_VERSION_AWS4) == 0)
+        r = http_io_add_auth4(priv, creds, io, now, payload, plen);
+    else
+        r = EINVAL;
 
-    /* Oops */
-    return EINVAL;
+    /* Done */
+    http_io_creds_release(priv, creds, slot);
+    return r;
 }
 
 /**
  * AWS verison 2 authentication
  */
 static int
-http_io_add_auth2(struct http_io_private *priv, struct http_io *const io, time_t now, const void *payload, size_t plen)
+http_io_add_auth2(struct http_io_private *priv, const struct credentials *creds, struct http_io *const io,
+  time_t now, const void *payload, size_t plen)
 {
     const struct http_io_conf *const config = priv->config;
     const struct curl_slist *header;
     u_char hmac[SHA_DIGEST_LENGTH];
     const char *resource;
     char **amz_hdrs = NULL;
-    char access_id[128];
-    char access_key[128];
     char authbuf[200];
 #if DEBUG_AUTHENTICATION
     char sigbuf[1024];
@@ -1832,15 +6088,9 @@ http_io_add_auth2(struct http_io_private *priv, struct http_io *const io, time_t
     int i;
     int r;
 
-    /* Snapshot current credentials */
-    pthread_mutex_lock(&priv->mutex);
-    snprintf(access_id, sizeof(access_id), "%s", config->accessId);
-    snprintf(access_key, sizeof(access_key), "%s", config->accessKey);
-    pthread_mutex_unlock(&priv->mutex);
-
     /* Initialize HMAC */
     HMAC_CTX_init(&hmac_ctx);
-    HMAC_Init_ex(&hmac_ctx, access_key, strlen(access_key), EVP_sha1(), NULL);
+    HMAC_Init_ex(&hmac_ctx, creds->access_key, strlen(creds->access_key), EVP_sha1(), NULL);
 
 #if DEBUG_AUTHENTICATION
     *sigbuf = '\0';
@@ -1888,6 +6138,20 @@ http_io_add_auth2(struct http_io_private *priv, struct http_io *const io, time_t
     snprintf(sigbuf + strlen(sigbuf), sizeof(sigbuf) - strlen(sigbuf), "/%s%.*s", config->bucket, resource_len, resource);
 #endif
 
+    /* Sign sub-resources (unlike listing parameters, these are signed); one without a value is signed without the `=' */
+    if (qmark != NULL && http_io_is_subresource(qmark + 1)) {
+        const char *const query = qmark + 1;
+        size_t query_len = strlen(query);
+
+        if (query_len > 0 && query[query_len - 1] == '=')
+            query_len--;
+        HMAC_Update(&hmac_ctx, (const u_char *)"?", 1);
+        HMAC_Update(&hmac_ctx, (const u_char *)query, query_len);
+#if DEBUG_AUTHENTICATION
+        snprintf(sigbuf + strlen(sigbuf), sizeof(sigbuf) - strlen(sigbuf), "?%.*s", (int)query_len, query);
+#endif
+    }
+
     /* Finish up */
     HMAC_Final(&hmac_ctx, hmac, &hmac_len);
     assert(hmac_len == SHA_DIGEST_LENGTH);
@@ -1904,7 +6168,7 @@ http_io_add_auth2(struct http_io_private *priv, struct http_io *const io, time_t
 #endif
 
     /* Add auth header */
-    io->headers = http_io_add_header(io->headers, "%s: AWS %s:%s", AUTH_HEADER, access_id, authbuf);
+    io->headers = http_io_add_header(io->headers, "%s: AWS %s:%s", AUTH_HEADER, creds->access_id, authbuf);
 
     /* Done */
     r = 0;
@@ -1921,21 +6185,27 @@ fail:
  * AWS verison 4 authentication
  */
 static int
-http_io_add_auth4(struct http_io_private *priv, struct http_io *const io, time_t now, const void *payload, size_t plen)
+http_io_add_auth4(struct http_io_private *priv, struct credentials *creds, struct http_io *const io,
+  time_t now, const void *payload, size_t plen)
 {
+#if DEBUG_AUTHENTICATION
     const struct http_io_conf *const config = priv->config;
+#endif
     u_char payload_hash[EVP_MAX_MD_SIZE];
     u_char creq_hash[EVP_MAX_MD_SIZE];
+    u_char sigkey[EVP_MAX_MD_SIZE];
     u_char hmac[EVP_MAX_MD_SIZE];
     u_int payload_hash_len;
     u_int creq_hash_len;
+    u_int sigkey_len;
     u_int hmac_len;
     char payload_hash_buf[EVP_MAX_MD_SIZE * 2 + 1];
     char creq_hash_buf[EVP_MAX_MD_SIZE * 2 + 1];
     char hmac_buf[EVP_MAX_MD_SIZE * 2 + 1];
     const struct curl_slist *hdr;
-    char **sorted_hdrs = NULL;
-    char *header_names = NULL;
+    const char *sorted_hdrs[AUTH4_MAX_HEADERS];
+    char header_names[AUTH4_HEADER_NAMES_SIZE];
+    char scope[AUTH4_SCOPE_SIZE];
     const char *host;
     size_t host_len;
     const char *uripath;
@@ -1951,27 +6221,15 @@ http_io_add_auth4(struct http_io_private *priv, struct http_io *const io, time_t
 #endif
     char hosthdr[128];
     char datebuf[DATE_BUF_SIZE];
-    char access_id[128];
-    char access_key[128];
-    char iam_token[1024];
     struct tm tm;
     char *p;
     int r;
     int i;
 
-    /* Snapshot current credentials */
-    pthread_mutex_lock(&priv->mutex);
-    snprintf(access_id, sizeof(access_id), "%s", config->accessId);
-    snprintf(access_key, sizeof(access_key), "%s%s", ACCESS_KEY_PREFIX, config->accessKey);
-    snprintf(iam_token, sizeof(iam_token), "%s", config->iam_token != NULL ? config->iam_token : "");
-    pthread_mutex_unlock(&priv->mutex);
-
     /* Extract host, URI path, and query parameters from URL */
     if ((p = strchr(io->url, ':')) == NULL || *++p != '/' || *++p != '/'
-      || (host = p + 1) == NULL || (uripath = strchr(host, '/')) == NULL) {
-        r = EINVAL;
-        goto fail;
-    }
+      || (host = p + 1) == NULL || (uripath = strchr(host, '/')) == NULL)
+        return EINVAL;
     host_len = uripath - host;
     if ((p = strchr(uripath, '?')) != NULL) {
         uripath_len = p - uripath;
@@ -1983,27 +6241,34 @@ http_io_add_auth4(struct http_io_private *priv, struct http_io *const io, time_t
         query_params_len = 0;
     }
 
+    /* Format date */
+    strftime(datebuf, sizeof(datebuf), AWS_DATE_BUF_FMT, gmtime_r(&now, &tm));
+
+    /* Get signing key and credential scope for today (these only change once a day, or when the credentials do) */
+    http_io_auth4_sigkey(priv, creds, datebuf, sigkey, &sigkey_len, scope);
+
     /* Initialize */
     EVP_MD_CTX_init(&hash_ctx);
     HMAC_CTX_init(&hmac_ctx);
 
-    /* Format date */
-    strftime(datebuf, sizeof(datebuf), AWS_DATE_BUF_FMT, gmtime_r(&now, &tm));
-
 /****** Hash Payload and Add Header ******/
 
-    EVP_DigestInit_ex(&hash_ctx, EVP_sha256(), NULL);
-    if (payload != NULL)
-        EVP_DigestUpdate(&hash_ctx, payload, plen);
-    EVP_DigestFinal_ex(&hash_ctx, payload_hash, &payload_hash_len);
-    http_io_prhex(payload_hash_buf, payload_hash, payload_hash_len);
+    if (io->payload_sha256 != NULL)
+        snprintf(payload_hash_buf, sizeof(payload_hash_buf), "%s", io->payload_sha256);
+    else {
+        EVP_DigestInit_ex(&hash_ctx, EVP_sha256(), NULL);
+        if (payload != NULL)
+            EVP_DigestUpdate(&hash_ctx, payload, plen);
+        EVP_DigestFinal_ex(&hash_ctx, payload_hash, &payload_hash_len);
+        http_io_prhex(payload_hash_buf, payload_hash, payload_hash_len);
+    }
 
     io->headers = http_io_add_header(io->headers, "%s: %s", CONTENT_SHA256_HEADER, payload_hash_buf);
 
 /****** Add IAM security token header (if any) ******/
 
-    if (*iam_token != '\0')
-        io->headers = http_io_add_header(io->headers, "%s: %s", SECURITY_TOKEN_HEADER, iam_token);
+    if (creds->iam_token != NULL)
+        io->headers = http_io_add_header(io->headers, "%s: %s", SECURITY_TOKEN_HEADER, creds->iam_token);
 
 /****** Create Hashed Canonical Request ******/
 
@@ -2016,16 +6281,14 @@ http_io_add_auth4(struct http_io_private *priv, struct http_io *const io, time_t
 
     /* Sort headers by (lowercase) name; add "Host" header manually - special case because cURL adds it, not us */
     snprintf(hosthdr, sizeof(hosthdr), "host:%.*s", (int)host_len, host);
-    for (num_sorted_hdrs = 1, hdr = io->headers; hdr != NULL; hdr = hdr->next)
-        num_sorted_hdrs++;
-    if ((sorted_hdrs = malloc(num_sorted_hdrs * sizeof(*sorted_hdrs))) == NULL) {
-        r = errno;
-        goto fail;
-    }
     sorted_hdrs[0] = hosthdr;
-    for (i = 1, hdr = io->headers; hdr != NULL; hdr = hdr->next)
-        sorted_hdrs[i++] = hdr->data;
-    assert(i == num_sorted_hdrs);
+    for (num_sorted_hdrs = 1, hdr = io->headers; hdr != NULL; hdr = hdr->next) {
+        if (num_sorted_hdrs == AUTH4_MAX_HEADERS) {
+            r = E2BIG;
+            goto fail;
+        }
+        sorted_hdrs[num_sorted_hdrs++] = hdr->data;
+    }
     qsort(sorted_hdrs, num_sorted_hdrs, sizeof(*sorted_hdrs), http_io_strcasecmp_ptr);
 
     /* Request method */
@@ -2049,57 +6312,41 @@ http_io_add_auth4(struct http_io_private *priv, struct http_io *const io, time_t
     snprintf(sigbuf + strlen(sigbuf), sizeof(sigbuf) - strlen(sigbuf), "%.*s\n", (int)query_params_len, query_params);
 #endif
 
-    /* Canonical headers */
+    /* Canonical headers; build the lowercase signed header name list at the same time */
     header_names_length = 0;
     for (i = 0; i < num_sorted_hdrs; i++) {
-        const char *value = sorted_hdrs[i];
+        const char *const name = header_names + header_names_length;
         const char *s;
-        char lcase;
 
-        s = value;
-        do {
-            if (*s == '\0') {
+        if (i > 0)
+            header_names[header_names_length++] = ';';
+        for (s = sorted_hdrs[i]; *s != ':'; s++) {
+            if (*s == '\0' || header_names_length >= sizeof(header_names) - 1) {
                 r = EINVAL;
                 goto fail;
             }
-            lcase = tolower(*s);
-            EVP_DigestUpdate(&hash_ctx, (const u_char *)&lcase, 1);
-#if DEBUG_AUTHENTICATION
-            snprintf(sigbuf + strlen(sigbuf), sizeof(sigbuf) - strlen(sigbuf), "%c", lcase);
-#endif
-            header_names_length++;
-        } while (*s++ != ':');
+            header_names[header_names_length++] = tolower(*s);
+        }
+        EVP_DigestUpdate(&hash_ctx, (const u_char *)name, (header_names + header_names_length) - name);
+        EVP_DigestUpdate(&hash_ctx, (const u_char *)":", 1);
+        s++;
         while (isspace(*s))
             s++;
         EVP_DigestUpdate(&hash_ctx, (const u_char *)s, strlen(s));
         EVP_DigestUpdate(&hash_ctx, (const u_char *)"\n", 1);
 #if DEBUG_AUTHENTICATION
-        snprintf(sigbuf + strlen(sigbuf), sizeof(sigbuf) - strlen(sigbuf), "%s\n", s);
+        snprintf(sigbuf + strlen(sigbuf), sizeof(sigbuf) - strlen(sigbuf), "%.*s:%s\n",
+          (int)((header_names + header_names_length) - name), name, s);
 #endif
     }
+    header_names[header_names_length] = '\0';
     EVP_DigestUpdate(&hash_ctx, (const u_char *)"\n", 1);
 #if DEBUG_AUTHENTICATION
     snprintf(sigbuf + strlen(sigbuf), sizeof(sigbuf) - strlen(sigbuf), "\n");
 #endif
 
     /* Signed headers */
-    if ((header_names = malloc(header_names_length)) == NULL) {
-        r = errno;
-        goto fail;
-    }
-    p = header_names;
-    for (i = 0; i < num_sorted_hdrs; i++) {
-        const char *value = sorted_hdrs[i];
-        const char *s;
-
-        if (p > header_names)
-            *p++ = ';';
-        for (s = value; *s != '\0' && *s != ':'; s++)
-            *p++ = tolower(*s);
-    }
-    *p++ = '\0';
-    assert(p <= header_names + header_names_length);
-    EVP_DigestUpdate(&hash_ctx, (const u_char *)header_names, strlen(header_names));
+    EVP_DigestUpdate(&hash_ctx, (const u_char *)header_names, header_names_length);
     EVP_DigestUpdate(&hash_ctx, (const u_char *)"\n", 1);
 #if DEBUG_AUTHENTICATION
     snprintf(sigbuf + strlen(sigbuf), sizeof(sigbuf) - strlen(sigbuf), "%s\n", header_names);
@@ -2120,9 +6367,86 @@ http_io_add_auth4(struct http_io_private *priv, struct http_io *const io, time_t
     (*config->log)(LOG_DEBUG, "auth: canonical request hash = %s", creq_hash_buf);
 #endif
 
-/****** Derive Signing Key ******/
+/****** Sign the String To Sign ******/
+
+#if DEBUG_AUTHENTICATION
+    *sigbuf = '\0';
+#endif
+    HMAC_Init_ex(&hmac_ctx, sigkey, sigkey_len, EVP_sha256(), NULL);
+    HMAC_Update(&hmac_ctx, (const u_char *)SIGNATURE_ALGORITHM, strlen(SIGNATURE_ALGORITHM));
+    HMAC_Update(&hmac_ctx, (const u_char *)"\n", 1);
+#if DEBUG_AUTHENTICATION
+    snprintf(sigbuf + strlen(sigbuf), sizeof(sigbuf) - strlen(sigbuf), "%s\n", SIGNATURE_ALGORITHM);
+#endif
+    HMAC_Update(&hmac_ctx, (const u_char *)datebuf, strlen(datebuf));
+    HMAC_Update(&hmac_ctx, (const u_char *)"\n", 1);
+#if DEBUG_AUTHENTICATION
+    snprintf(sigbuf + strlen(sigbuf), sizeof(sigbuf) - strlen(sigbuf), "%s\n", datebuf);
+#endif
+    HMAC_Update(&hmac_ctx, (const u_char *)scope, strlen(scope));
+    HMAC_Update(&hmac_ctx, (const u_char *)"\n", 1);
+#if DEBUG_AUTHENTICATION
+    snprintf(sigbuf + strlen(sigbuf), sizeof(sigbuf) - strlen(sigbuf), "%s\n", scope);
+#endif
+    HMAC_Update(&hmac_ctx, (const u_char *)creq_hash_buf, strlen(creq_hash_buf));
+#if DEBUG_AUTHENTICATION
+    snprintf(sigbuf + strlen(sigbuf), sizeof(sigbuf) - strlen(sigbuf), "%s", creq_hash_buf);
+#endif
+    HMAC_Final(&hmac_ctx, hmac, &hmac_len);
+    http_io_prhex(hmac_buf, hmac, hmac_len);
+
+#if DEBUG_AUTHENTICATION
+    (*config->log)(LOG_DEBUG, "auth: key to sign:\n%s", sigbuf);
+    (*config->log)(LOG_DEBUG, "auth: signature hmac = %s", hmac_buf);
+#endif
+
+/****** Add Authorization Header ******/
+
+    io->headers = http_io_add_header(io->headers, "%s: %s Credential=%s/%s, SignedHeaders=%s, Signature=%s",
+      AUTH_HEADER, SIGNATURE_ALGORITHM, creds->access_id, scope, header_names, hmac_buf);
+
+    /* Done */
+    r = 0;
+
+fail:
+    /* Clean up */
+    EVP_MD_CTX_cleanup(&hash_ctx);
+    HMAC_CTX_cleanup(&hmac_ctx);
+    return r;
+}
+
+/*
+ * Get the AWS version 4 signing key and credential scope for the given date and secret key.
+ *
+ * The key is derived from the secret key, date, region and service with four chained HMAC's, so we cache
+ * the result and only derive it again when the date or credentials change.
+ */
+static void
+http_io_auth4_sigkey(struct http_io_private *priv, struct credentials *creds, const char *datebuf,
+  u_char *sigkey, u_int *sigkey_lenp, char *scope)
+{
+    const struct http_io_conf *const config = priv->config;
+    const struct auth4_sigkey *const cache = &creds->sigkey;
+    const char *const access_key = creds->access_key4;
+    struct credentials *update;
+    struct auth4_sigkey derived;
+    HMAC_CTX hmac_ctx;
+    u_char hmac[EVP_MAX_MD_SIZE];
+    u_int hmac_len;
+#if DEBUG_AUTHENTICATION
+    char hmac_buf[EVP_MAX_MD_SIZE * 2 + 1];
+#endif
+
+    /* Check cache (it's part of the snapshot, so it never changes underneath us) */
+    if (cache->key_len > 0 && strncmp(cache->scope, datebuf, 8) == 0) {
+        memcpy(sigkey, cache->key, cache->key_len);
+        *sigkey_lenp = cache->key_len;
+        strcpy(scope, cache->scope);
+        return;
+    }
 
     /* Do nested HMAC's */
+    HMAC_CTX_init(&hmac_ctx);
     HMAC_Init_ex(&hmac_ctx, access_key, strlen(access_key), EVP_sha256(), NULL);
 #if DEBUG_AUTHENTICATION
     (*config->log)(LOG_DEBUG, "auth: access_key = \"%s\"", access_key);
@@ -2146,7 +6470,7 @@ http_io_add_auth4(struct http_io_private *priv, struct http_io *const io, time_t
     HMAC_Final(&hmac_ctx, hmac, &hmac_len);
 #if DEBUG_AUTHENTICATION
     http_io_prhex(hmac_buf, hmac, hmac_len);
-    (*config->log)(LOG_DEBUG, "auth: HMAC[%s] = %sn", S3_SERVICE_NAME, hmac_buf);
+    (*config->log)(LOG_DEBUG, "auth: HMAC[%s] = %s", S3_SERVICE_NAME, hmac_buf);
 #endif
     HMAC_Init_ex(&hmac_ctx, hmac, hmac_len, EVP_sha256(), NULL);
     HMAC_Update(&hmac_ctx, (const u_char *)SIGNATURE_TERMINATOR, strlen(SIGNATURE_TERMINATOR));
@@ -2155,64 +6479,191 @@ http_io_add_auth4(struct http_io_private *priv, struct http_io *const io, time_t
     http_io_prhex(hmac_buf, hmac, hmac_len);
     (*config->log)(LOG_DEBUG, "auth: HMAC[%s] = %s", SIGNATURE_TERMINATOR, hmac_buf);
 #endif
+    HMAC_CTX_cleanup(&hmac_ctx);
 
-/****** Sign the String To Sign ******/
+    /* Format credential scope */
+    snprintf(scope, AUTH4_SCOPE_SIZE, "%.8s/%s/%s/%s", datebuf, config->region, S3_SERVICE_NAME, SIGNATURE_TERMINATOR);
+    memcpy(sigkey, hmac, hmac_len);
+    *sigkey_lenp = hmac_len;
+
+    STATS_INC(priv, auth4_key_derivations);
+
+    /* Update cache by publishing a copy of the snapshot with the new key; if the credentials changed meanwhile, don't bother */
+    snprintf(derived.scope, sizeof(derived.scope), "%s", scope);
+    memcpy(derived.key, hmac, hmac_len);
+    derived.key_len = hmac_len;
+    if ((update = http_io_creds_new(creds->access_id, creds->access_key, creds->iam_token, &derived)) != NULL
+      && !http_io_creds_publish(priv, creds, update))
+        free(update);
+}
+
+/*
+ * Create a new credentials snapshot, or return NULL and set errno.
+ */
+static struct credentials *
+http_io_creds_new(const char *access_id, const char *access_key, const char *iam_token, const struct auth4_sigkey *sigkey)
+{
+    const size_t id_len = strlen(access_id) + 1;
+    const size_t key_len = strlen(ACCESS_KEY_PREFIX) + strlen(access_key) + 1;
+    const size_t token_len = iam_token != NULL ? strlen(iam_token) + 1 : 0;
+    struct credentials *creds;
+    char *p;
+
+    /* Allocate snapshot and strings together */
+    if ((creds = calloc(1, sizeof(*creds) + id_len + key_len + token_len)) == NULL)
+        return NULL;
+    p = (char *)(creds + 1);
+
+    /* Initialize */
+    memcpy(p, access_id, id_len);
+    creds->access_id = p;
+    p += id_len;
+    snprintf(p, key_len, "%s%s", ACCESS_KEY_PREFIX, access_key);
+    creds->access_key4 = p;
+    creds->access_key = p + strlen(ACCESS_KEY_PREFIX);
+    p += key_len;
+    if (iam_token != NULL) {
+        memcpy(p, iam_token, token_len);
+        creds->iam_token = p;
+    }
+    if (sigkey != NULL)
+        creds->sigkey = *sigkey;
+    return creds;
+}
+
+/*
+ * Get the current credentials snapshot, or NULL if there are no credentials, protecting it from being freed
+ * until it's released with http_io_creds_release().
+ *
+ * A signer stores the snapshot in a free hazard pointer slot and then checks it is still current; a publisher
+ * that replaced it must then see the slot (see http_io_creds_reclaim()). This costs one atomic operation on a
+ * slot that is usually the one this thread used last. If every slot is busy, we take a reference under the mutex.
+ */
+static struct credentials *
+http_io_creds_acquire(struct http_io_private *priv, int *slotp)
+{
+    struct credentials *creds;
+    struct credentials *empty;
+    u_int i;
+
+    if (creds_hint == UINT_MAX)
+        creds_hint = __atomic_fetch_add(&creds_threads, 1, __ATOMIC_RELAXED) % CREDS_HAZARDS;
+    for (i = 0; i < CREDS_HAZARDS; i++) {
+        const u_int slot = (creds_hint + i) % CREDS_HAZARDS;
+        struct credentials **const hazard = &priv->creds_hazards[slot];
+
+        if (__atomic_load_n(hazard, __ATOMIC_RELAXED) != NULL)
+            continue;
+        while (1) {
+            if ((creds = __atomic_load_n(&priv->creds, __ATOMIC_ACQUIRE)) == NULL) {
+                *slotp = -1;
+                return NULL;
+            }
+            empty = NULL;
+            if (!__atomic_compare_exchange_n(hazard, &empty, creds, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+                break;                                  // another thread took the slot; try the next one
+            if (__atomic_load_n(&priv->creds, __ATOMIC_SEQ_CST) == creds) {
+                creds_hint = slot;
+                *slotp = slot;
+                return creds;
+            }
+            __atomic_store_n(hazard, NULL, __ATOMIC_RELEASE);   // replaced meanwhile; try again
+        }
+    }
+
+    /* All slots are busy */
+    pthread_mutex_lock(&priv->mutex);
+    if ((creds = priv->creds) != NULL)
+        creds->refs++;
+    pthread_mutex_unlock(&priv->mutex);
+    *slotp = -1;
+    return creds;
+}
+
+/*
+ * Release a credentials snapshot obtained from http_io_creds_acquire().
+ *
+ * If we held the last reference to a snapshot that has since been retired, free it now rather than
+ * leaving it for the next publish.
+ */
+static void
+http_io_creds_release(struct http_io_private *priv, struct credentials *creds, int slot)
+{
+    int retired;
+
+    if (slot >= 0) {
+        __atomic_store_n(&priv->creds_hazards[slot], NULL, __ATOMIC_RELEASE);
+        return;
+    }
+    pthread_mutex_lock(&priv->mutex);
+    assert(creds->refs > 0);
+    retired = --creds->refs == 0 && creds != priv->creds;
+    pthread_mutex_unlock(&priv->mutex);
+    if (retired)
+        http_io_creds_reclaim(priv);
+}
 
-#if DEBUG_AUTHENTICATION
-    *sigbuf = '\0';
-#endif
-    HMAC_Init_ex(&hmac_ctx, hmac, hmac_len, EVP_sha256(), NULL);
-    HMAC_Update(&hmac_ctx, (const u_char *)SIGNATURE_ALGORITHM, strlen(SIGNATURE_ALGORITHM));
-    HMAC_Update(&hmac_ctx, (const u_char *)"\n", 1);
-#if DEBUG_AUTHENTICATION
-    snprintf(sigbuf + strlen(sigbuf), sizeof(sigbuf) - strlen(sigbuf), "%s\n", SIGNATURE_ALGORITHM);
-#endif
-    HMAC_Update(&hmac_ctx, (const u_char *)datebuf, strlen(datebuf));
-    HMAC_Update(&hmac_ctx, (const u_char *)"\n", 1);
-#if DEBUG_AUTHENTICATION
-    snprintf(sigbuf + strlen(sigbuf), sizeof(sigbuf) - strlen(sigbuf), "%s\n", datebuf);
-#endif
-    HMAC_Update(&hmac_ctx, (const u_char *)datebuf, 8);
-    HMAC_Update(&hmac_ctx, (const u_char *)"/", 1);
-    HMAC_Update(&hmac_ctx, (const u_char *)config->region, strlen(config->region));
-    HMAC_Update(&hmac_ctx, (const u_char *)"/", 1);
-    HMAC_Update(&hmac_ctx, (const u_char *)S3_SERVICE_NAME, strlen(S3_SERVICE_NAME));
-    HMAC_Update(&hmac_ctx, (const u_char *)"/", 1);
-    HMAC_Update(&hmac_ctx, (const u_char *)SIGNATURE_TERMINATOR, strlen(SIGNATURE_TERMINATOR));
-    HMAC_Update(&hmac_ctx, (const u_char *)"\n", 1);
-#if DEBUG_AUTHENTICATION
-    snprintf(sigbuf + strlen(sigbuf), sizeof(sigbuf) - strlen(sigbuf), "%.8s/%s/%s/%s\n",
-      datebuf, config->region, S3_SERVICE_NAME, SIGNATURE_TERMINATOR);
-#endif
-    HMAC_Update(&hmac_ctx, (const u_char *)creq_hash_buf, strlen(creq_hash_buf));
-#if DEBUG_AUTHENTICATION
-    snprintf(sigbuf + strlen(sigbuf), sizeof(sigbuf) - strlen(sigbuf), "%s", creq_hash_buf);
-#endif
-    HMAC_Final(&hmac_ctx, hmac, &hmac_len);
-    http_io_prhex(hmac_buf, hmac, hmac_len);
+/*
+ * Replace the current credentials snapshot with the given one, which the caller must have created.
+ *
+ * If "expect" is not NULL, only replace it if it's still current, and return zero (leaving the new snapshot
+ * to the caller) if not. Otherwise, replace whatever is current. Returns non-zero if published.
+ *
+ * The replaced snapshot is retired, and freed by this or a later call once no signer is using it.
+ */
+static int
+http_io_creds_publish(struct http_io_private *priv, struct credentials *expect, struct credentials *creds)
+{
+    struct credentials *old;
 
-#if DEBUG_AUTHENTICATION
-    (*config->log)(LOG_DEBUG, "auth: key to sign:\n%s", sigbuf);
-    (*config->log)(LOG_DEBUG, "auth: signature hmac = %s", hmac_buf);
-#endif
+    /* Swap in new snapshot; hold the mutex so signers taking a reference see either the old one or the new one */
+    pthread_mutex_lock(&priv->mutex);
+    if (expect == NULL)
+        old = __atomic_exchange_n(&priv->creds, creds, __ATOMIC_SEQ_CST);
+    else {
+        old = expect;
+        if (!__atomic_compare_exchange_n(&priv->creds, &old, creds, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            pthread_mutex_unlock(&priv->mutex);
+            return 0;
+        }
+    }
 
-/****** Add Authorization Header ******/
+    /* Retire the old snapshot */
+    if (old != NULL) {
+        old->next = priv->creds_retired;
+        priv->creds_retired = old;
+    }
+    pthread_mutex_unlock(&priv->mutex);
 
-    io->headers = http_io_add_header(io->headers, "%s: %s Credential=%s/%.8s/%s/%s/%s, SignedHeaders=%s, Signature=%s",
-      AUTH_HEADER, SIGNATURE_ALGORITHM, access_id, datebuf, config->region, S3_SERVICE_NAME, SIGNATURE_TERMINATOR,
-      header_names, hmac_buf);
+    /* Free whatever retired snapshots are no longer in use */
+    http_io_creds_reclaim(priv);
+    return 1;
+}
 
-    /* Done */
-    r = 0;
+/*
+ * Free retired credentials snapshots that no signer is using.
+ */
+static void
+http_io_creds_reclaim(struct http_io_private *priv)
+{
+    struct credentials **credsp;
+    struct credentials *creds;
+    int in_use;
+    u_int i;
 
-fail:
-    /* Clean up */
-    if (sorted_hdrs != NULL)
-        free(sorted_hdrs);
-    free(header_names);
-    EVP_MD_CTX_cleanup(&hash_ctx);
-    HMAC_CTX_cleanup(&hmac_ctx);
-    return r;
+    pthread_mutex_lock(&priv->mutex);
+    for (credsp = &priv->creds_retired; (creds = *credsp) != NULL; ) {
+        in_use = creds->refs > 0;
+        for (i = 0; i < CREDS_HAZARDS && !in_use; i++)
+            in_use = __atomic_load_n(&priv->creds_hazards[i], __ATOMIC_SEQ_CST) == creds;
+        if (in_use) {
+            credsp = &creds->next;
+            continue;
+        }
+        *credsp = creds->next;
+        free(creds);
+    }
+    pthread_mutex_unlock(&priv->mutex);
 }
 
 /*
@@ -2223,6 +6674,26 @@ http_io_get_block_url(char *buf, size_t bufsiz, struct http_io_conf *config, s3b
 {
     int len;
 
+    if (config->hash_prefix == 0) {
+        http_io_get_plain_block_url(buf, bufsiz, config, block_num);
+        return;
+    }
+    if (config->vhost)
+        len = snprintf(buf, bufsiz, "%s", config->baseURL);
+    else
+        len = snprintf(buf, bufsiz, "%s%s/", config->baseURL, config->bucket);
+    assert(len < bufsiz);
+    http_io_get_block_name(buf + len, bufsiz - len, config, block_num);
+}
+
+/*
+ * Create URL for a block using the plain (not hashed) key layout.
+ */
+static void
+http_io_get_plain_block_url(char *buf, size_t bufsiz, struct http_io_conf *config, s3b_block_t block_num)
+{
+    int len;
+
     if (config->vhost)
         len = snprintf(buf, bufsiz, "%s%s%0*jx", config->baseURL, config->prefix, S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num);
     else {
@@ -2233,6 +6704,61 @@ http_io_get_block_url(char *buf, size_t bufsiz, struct http_io_conf *config, s3b
     assert(len < bufsiz);
 }
 
+/*
+ * Get the name of a block's object (including prefix).
+ *
+ * With hashed keys, the block number is preceded by a few hex digits of its hash, so consecutive
+ * blocks are spread evenly across the keyspace (and therefore across S3's index partitions).
+ */
+void
+http_io_get_block_name(char *buf, size_t bufsiz, struct http_io_conf *config, s3b_block_t block_num)
+{
+    int len;
+
+    if (config->hash_prefix > 0) {
+        len = snprintf(buf, bufsiz, "%s%0*jx%0*jx", config->prefix, (int)config->hash_prefix,
+          http_io_block_hash(config, block_num), S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num);
+    } else
+        len = snprintf(buf, bufsiz, "%s%0*jx", config->prefix, S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num);
+    (void)len;                  /* avoid compiler warning when NDEBUG defined */
+    assert(len < bufsiz);
+}
+
+/*
+ * Get a block's hash prefix, which is the top config->hash_prefix hex digits of MurmurHash3's
+ * 64-bit finalizer applied to the block number. This determines object names, so it must never change.
+ */
+static uintmax_t
+http_io_block_hash(struct http_io_conf *config, s3b_block_t block_num)
+{
+    uint64_t hash = (uint64_t)block_num;
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return (uintmax_t)(hash >> (64 - config->hash_prefix * 4));
+}
+
+/*
+ * Get the URL of the content object having the given (hex) SHA-256 hash.
+ */
+static void
+http_io_get_cas_url(char *buf, size_t bufsiz, struct http_io_conf *config, const char *hash)
+{
+    int len;
+
+    if (config->vhost)
+        len = snprintf(buf, bufsiz, "%s%s%s%s", config->baseURL, config->prefix, CAS_KEY_INFIX, hash);
+    else {
+        len = snprintf(buf, bufsiz, "%s%s/%s%s%s", config->baseURL,
+          config->bucket, config->prefix, CAS_KEY_INFIX, hash);
+    }
+    (void)len;                  /* avoid compiler warning when NDEBUG defined */
+    assert(len < bufsiz);
+}
+
 /*
  * Create URL for the mounted flag, and return pointer to the URL's path not including any "/bucket" prefix.
  */
@@ -2249,6 +6775,70 @@ http_io_get_mounted_flag_url(char *buf, size_t bufsiz, struct http_io_conf *conf
     assert(len < bufsiz);
 }
 
+/*
+ * Create URL for the saved non-zero block bitmap.
+ */
+static void
+http_io_get_nonzero_url(char *buf, size_t bufsiz, struct http_io_conf *config)
+{
+    int len;
+
+    if (config->vhost)
+        len = snprintf(buf, bufsiz, "%s%s%s", config->baseURL, config->prefix, NONZERO_BITMAP);
+    else
+        len = snprintf(buf, bufsiz, "%s%s/%s%s", config->baseURL, config->bucket, config->prefix, NONZERO_BITMAP);
+    (void)len;                  /* avoid compiler warning when NDEBUG defined */
+    assert(len < bufsiz);
+}
+
+/*
+ * Create URL for the unfinished key migration marker.
+ */
+static void
+http_io_get_migrating_flag_url(char *buf, size_t bufsiz, struct http_io_conf *config)
+{
+    int len;
+
+    if (config->vhost)
+        len = snprintf(buf, bufsiz, "%s%s%s", config->baseURL, config->prefix, MIGRATING_FLAG);
+    else
+        len = snprintf(buf, bufsiz, "%s%s/%s%s", config->baseURL, config->bucket, config->prefix, MIGRATING_FLAG);
+    (void)len;                  /* avoid compiler warning when NDEBUG defined */
+    assert(len < bufsiz);
+}
+
+/*
+ * Create URL for the hashed key layout marker.
+ */
+static void
+http_io_get_hashed_flag_url(char *buf, size_t bufsiz, struct http_io_conf *config)
+{
+    int len;
+
+    if (config->vhost)
+        len = snprintf(buf, bufsiz, "%s%s%s", config->baseURL, config->prefix, HASHED_FLAG);
+    else
+        len = snprintf(buf, bufsiz, "%s%s/%s%s", config->baseURL, config->bucket, config->prefix, HASHED_FLAG);
+    (void)len;                  /* avoid compiler warning when NDEBUG defined */
+    assert(len < bufsiz);
+}
+
+/*
+ * Create URL for the packed layout marker.
+ */
+static void
+http_io_get_packed_flag_url(char *buf, size_t bufsiz, struct http_io_conf *config)
+{
+    int len;
+
+    if (config->vhost)
+        len = snprintf(buf, bufsiz, "%s%s%s", config->baseURL, config->prefix, PACKED_FLAG);
+    else
+        len = snprintf(buf, bufsiz, "%s%s/%s%s", config->baseURL, config->bucket, config->prefix, PACKED_FLAG);
+    (void)len;                  /* avoid compiler warning when NDEBUG defined */
+    assert(len < bufsiz);
+}
+
 /*
  * Add date header based on supplied time.
  */
@@ -2302,12 +6892,13 @@ http_io_acquire_curl(struct http_io_private *priv, struct http_io *io)
         if ((curl = curl_easy_init()) == NULL) {
             pthread_mutex_lock(&priv->mutex);
             priv->stats.curl_handles_created--;         // undo optimistic
-            priv->stats.curl_other_error++;
+            STATS_INC(priv, curl_other_error);
             pthread_mutex_unlock(&priv->mutex);
             (*config->log)(LOG_ERR, "curl_easy_init() failed");
             return NULL;
         }
     }
+    curl_easy_setopt(curl, CURLOPT_SHARE, priv->share);
     curl_easy_setopt(curl, CURLOPT_URL, io->url);
     curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1);
     curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
@@ -2325,6 +6916,12 @@ http_io_acquire_curl(struct http_io_private *priv, struct http_io *io)
         if (config->cacert != NULL)
             curl_easy_setopt(curl, CURLOPT_CAINFO, config->cacert);
     }
+#if HAVE_CURL_HTTP2
+    if (config->http2 > 0) {
+        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+        curl_easy_setopt(curl, CURLOPT_PIPEWAIT, (long)1);
+    }
+#endif
     if (config->debug_http)
         curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
     return curl;
@@ -2382,6 +6979,11 @@ http_io_curl_header(void *ptr, size_t size, size_t nmemb, void *stream)
     /* Check for interesting headers */
     (void)sscanf(buf, FILE_SIZE_HEADER ": %ju", &io->file_size);
     (void)sscanf(buf, BLOCK_SIZE_HEADER ": %u", &io->block_size);
+    (void)sscanf(buf, PACK_FACTOR_HEADER ": %u", &io->pack_factor);
+
+    /* Content-Range header gives the total object size */
+    if (strncasecmp(buf, CONTENT_RANGE_HEADER ":", sizeof(CONTENT_RANGE_HEADER)) == 0)
+        (void)sscanf(buf + sizeof(CONTENT_RANGE_HEADER), " bytes %*u-%*u/%ju", &io->object_size);
 
     /* ETag header requires parsing */
     if (strncasecmp(buf, ETAG_HEADER ":", sizeof(ETAG_HEADER)) == 0) {
@@ -2390,6 +6992,8 @@ http_io_curl_header(void *ptr, size_t size, size_t nmemb, void *stream)
         snprintf(fmtbuf, sizeof(fmtbuf), " \"%%%uc\"", MD5_DIGEST_LENGTH * 2);
         if (sscanf(buf + sizeof(ETAG_HEADER), fmtbuf, md5buf) == 1)
             http_io_parse_hex(md5buf, io->md5, MD5_DIGEST_LENGTH);
+        snprintf(fmtbuf, sizeof(fmtbuf), " %%%us", (u_int)sizeof(io->etag) - 1);
+        (void)sscanf(buf + sizeof(ETAG_HEADER), fmtbuf, io->etag);
     }
 
     /* "x-amz-meta-s3backer-hmac" header requires parsing */
@@ -2444,6 +7048,63 @@ http_io_release_curl(struct http_io_private *priv, CURL **curlp, int may_cache)
     pthread_mutex_unlock(&priv->mutex);
 }
 
+#if HAVE_CURL_MULTI_WAIT
+static CURLM *
+http_io_acquire_multi(struct http_io_private *priv)
+{
+    struct http_io_conf *const config = priv->config;
+    struct multi_holder *holder;
+    CURLM *multi;
+
+    pthread_mutex_lock(&priv->mutex);
+    if ((holder = LIST_FIRST(&priv->multis)) != NULL) {
+        LIST_REMOVE(holder, link);
+        pthread_mutex_unlock(&priv->mutex);
+        multi = holder->multi;
+        free(holder);
+        return multi;
+    }
+    pthread_mutex_unlock(&priv->mutex);
+    if ((multi = curl_multi_init()) == NULL)
+        (*config->log)(LOG_ERR, "curl_multi_init() failed");
+    return multi;
+}
+
+static void
+http_io_release_multi(struct http_io_private *priv, CURLM *multi)
+{
+    struct multi_holder *holder;
+
+    if ((holder = calloc(1, sizeof(*holder))) == NULL) {
+        curl_multi_cleanup(multi);
+        pthread_mutex_lock(&priv->mutex);
+        priv->stats.out_of_memory_errors++;
+        pthread_mutex_unlock(&priv->mutex);
+        return;
+    }
+    holder->multi = multi;
+    pthread_mutex_lock(&priv->mutex);
+    LIST_INSERT_HEAD(&priv->multis, holder, link);
+    pthread_mutex_unlock(&priv->mutex);
+}
+#endif
+
+static void
+http_io_share_lock(CURL *curl, curl_lock_data data, curl_lock_access access, void *arg)
+{
+    struct http_io_private *const priv = arg;
+
+    pthread_mutex_lock(&priv->share_locks[data]);
+}
+
+static void
+http_io_share_unlock(CURL *curl, curl_lock_data data, void *arg)
+{
+    struct http_io_private *const priv = arg;
+
+    pthread_mutex_unlock(&priv->share_locks[data]);
+}
+
 static void
 http_io_openssl_locker(int mode, int i, const char *file, int line)
 {
@@ -2466,43 +7127,162 @@ http_io_base64_encode(char *buf, size_t bufsiz, const void *data, size_t len)
     BIO* bmem;
     BIO* b64;
 
-    b64 = BIO_new(BIO_f_base64());
-    bmem = BIO_new(BIO_s_mem());
-    b64 = BIO_push(b64, bmem);
-    BIO_write(b64, data, len);
-    (void)BIO_flush(b64);
-    BIO_get_mem_ptr(b64, &bptr);
-    snprintf(buf, bufsiz, "%.*s", (int)bptr->length - 1, (char *)bptr->data);
-    BIO_free_all(b64);
+    b64 = BIO_new(BIO_f_base64());
+    bmem = BIO_new(BIO_s_mem());
+    b64 = BIO_push(b64, bmem);
+    BIO_write(b64, data, len);
+    (void)BIO_flush(b64);
+    BIO_get_mem_ptr(b64, &bptr);
+    snprintf(buf, bufsiz, "%.*s", (int)bptr->length - 1, (char *)bptr->data);
+    BIO_free_all(b64);
+}
+
+static int
+http_io_is_zero_block(const void *data, u_int block_size)
+{
+    static const u_long zero;
+    const u_int *ptr;
+    int i;
+
+    if (block_size <= sizeof(zero))
+        return memcmp(data, &zero, block_size) == 0;
+    ptr = (const u_int *)data;
+    for (i = 0; i < block_size / sizeof(*ptr); i++) {
+        if (*ptr++ != 0)
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * Compute the MD5 and (if needed for authentication) SHA-256 digests of outgoing data in a single pass,
+ * a chunk at a time, optionally checking whether the data is all zeroes along the way.
+ * The SHA-256 digest is formatted into `sha256buf' in hex, or set to the empty string if not needed.
+ *
+ * Returns true if check_zero was given and the data is all zeroes.
+ */
+static int
+http_io_digest(struct http_io_private *priv, const void *data, u_int len, int check_zero,
+  u_char *md5, char *sha256buf)
+{
+    struct http_io_conf *const config = priv->config;
+    const int want_sha256 = strcmp(config->authVersion, AUTH_VERSION_AWS4) == 0 && !config->unsigned_payload;
+    const u_char *const ptr = data;
+    u_char sha256[SHA256_DIGEST_LENGTH];
+    SHA256_CTX sha256_ctx;
+    MD5_CTX md5_ctx;
+    int zero = check_zero;
+    u_int chunk;
+    u_int off;
+
+    /* Digest one chunk at a time */
+    MD5_Init(&md5_ctx);
+    if (want_sha256)
+        SHA256_Init(&sha256_ctx);
+    for (off = 0; off < len; off += chunk) {
+        if ((chunk = len - off) > DIGEST_CHUNK_SIZE)
+            chunk = DIGEST_CHUNK_SIZE;
+        if (zero)
+            zero = http_io_is_zero_block(ptr + off, chunk);
+        MD5_Update(&md5_ctx, ptr + off, chunk);
+        if (want_sha256)
+            SHA256_Update(&sha256_ctx, ptr + off, chunk);
+    }
+    MD5_Final(md5, &md5_ctx);
+    *sha256buf = '\0';
+    if (want_sha256) {
+        SHA256_Final(sha256, &sha256_ctx);
+        http_io_prhex(sha256buf, sha256, SHA256_DIGEST_LENGTH);
+    }
+    return zero;
+}
+
+/*
+ * Get the payload hash to use when authenticating an upload, given its precomputed SHA-256 (if any).
+ */
+static const char *
+http_io_payload_hash(struct http_io_private *priv, const char *sha256buf)
+{
+    if (priv->config->unsigned_payload)
+        return UNSIGNED_PAYLOAD;
+    return *sha256buf != '\0' ? sha256buf : NULL;
+}
+
+/*
+ * Initialize a pooled context's cipher and HMAC contexts, keying them once up front.
+ */
+static void
+http_io_key_ctx(struct cipher_ctx *cctx)
+{
+    struct http_io_private *const priv = cctx->priv;
+    int r;
+
+#ifdef NDEBUG
+    /* Avoid unused variable warning */
+    (void)r;
+#endif
+
+    /* Context for generating IVs by encrypting the block number */
+    EVP_CIPHER_CTX_init(&cctx->iv_ctx);
+    r = EVP_EncryptInit_ex(&cctx->iv_ctx, priv->cipher, NULL, priv->ivkey, priv->ivkey);
+    assert(r == 1);
+    EVP_CIPHER_CTX_set_padding(&cctx->iv_ctx, 0);
+    assert(EVP_CIPHER_CTX_block_size(&cctx->iv_ctx) == EVP_CIPHER_CTX_iv_length(&cctx->iv_ctx));
+
+    /* Contexts for bulk data encryption and decryption */
+    EVP_CIPHER_CTX_init(&cctx->enc_ctx);
+    r = EVP_EncryptInit_ex(&cctx->enc_ctx, priv->cipher, NULL, priv->key, NULL);
+    assert(r == 1);
+    EVP_CIPHER_CTX_set_padding(&cctx->enc_ctx, 1);
+    EVP_CIPHER_CTX_init(&cctx->dec_ctx);
+    r = EVP_DecryptInit_ex(&cctx->dec_ctx, priv->cipher, NULL, priv->key, NULL);
+    assert(r == 1);
+    EVP_CIPHER_CTX_set_padding(&cctx->dec_ctx, 1);
+
+    /* Context for signing blocks */
+    HMAC_CTX_init(&cctx->hmac_ctx);
+    HMAC_Init_ex(&cctx->hmac_ctx, (const u_char *)priv->key, priv->keylen, EVP_sha1(), NULL);
+
+    /* Context for authenticated encryption and decryption */
+    EVP_CIPHER_CTX_init(&cctx->aead_ctx);
+    if (priv->aead_cipher != NULL) {
+        r = EVP_EncryptInit_ex(&cctx->aead_ctx, priv->aead_cipher, NULL, priv->aead_key, NULL);
+        assert(r == 1);
+    }
+
+    /* Done */
+    cctx->keyed = 1;
 }
 
-static int
-http_io_is_zero_block(const void *data, u_int block_size)
+/*
+ * Free a pooled context's cipher and HMAC contexts, if any.
+ */
+static void
+http_io_unkey_ctx(struct cipher_ctx *cctx)
 {
-    static const u_long zero;
-    const u_int *ptr;
-    int i;
-
-    if (block_size <= sizeof(zero))
-        return memcmp(data, &zero, block_size) == 0;
-    ptr = (const u_int *)data;
-    for (i = 0; i < block_size / sizeof(*ptr); i++) {
-        if (*ptr++ != 0)
-            return 0;
-    }
-    return 1;
+    if (!cctx->keyed)
+        return;
+    EVP_CIPHER_CTX_cleanup(&cctx->iv_ctx);
+    EVP_CIPHER_CTX_cleanup(&cctx->enc_ctx);
+    EVP_CIPHER_CTX_cleanup(&cctx->dec_ctx);
+    HMAC_CTX_cleanup(&cctx->hmac_ctx);
+    EVP_CIPHER_CTX_cleanup(&cctx->aead_ctx);
+    cctx->keyed = 0;
 }
 
 /*
- * Encrypt or decrypt one block
+ * Encrypt or decrypt one block.
+ *
+ * The cctx's contexts are already keyed, so we only need to reset the IV for each operation.
  */
 static u_int
-http_io_crypt(struct http_io_private *priv, s3b_block_t block_num, int enc, const u_char *src, u_int len, u_char *dest)
+http_io_crypt(struct cipher_ctx *cctx, s3b_block_t block_num, int enc, const u_char *src, u_int len, u_char *dest)
 {
+    struct http_io_private *const priv = cctx->priv;
+    EVP_CIPHER_CTX *const ctx = enc ? &cctx->enc_ctx : &cctx->dec_ctx;
     u_char ivec[EVP_MAX_IV_LENGTH];
-    EVP_CIPHER_CTX ctx;
+    u_char blockbuf[EVP_MAX_IV_LENGTH];
     u_int total_len;
-    char blockbuf[EVP_MAX_IV_LENGTH];
     int clen;
     int r;
 
@@ -2513,36 +7293,27 @@ http_io_crypt(struct http_io_private *priv, s3b_block_t block_num, int enc, cons
 
     /* Sanity check */
     assert(EVP_MAX_IV_LENGTH >= MD5_DIGEST_LENGTH);
-
-    /* Initialize cipher context */
-    EVP_CIPHER_CTX_init(&ctx);
+    assert(cctx->keyed);
 
     /* Generate initialization vector by encrypting the block number using previously generated IV */
     memset(blockbuf, 0, sizeof(blockbuf));
-    snprintf(blockbuf, sizeof(blockbuf), "%0*jx", S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num);
-
-    /* Initialize cipher for IV generation */
-    r = EVP_EncryptInit_ex(&ctx, priv->cipher, NULL, priv->ivkey, priv->ivkey);
+    snprintf((char *)blockbuf, sizeof(blockbuf), "%0*jx", S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num);
+    r = EVP_EncryptInit_ex(&cctx->iv_ctx, NULL, NULL, NULL, priv->ivkey);
     assert(r == 1);
-    EVP_CIPHER_CTX_set_padding(&ctx, 0);
-
-    /* Encrypt block number to get IV for bulk encryption */
-    r = EVP_EncryptUpdate(&ctx, ivec, &clen, (const u_char *)blockbuf, EVP_CIPHER_CTX_block_size(&ctx));
-    assert(r == 1 && clen == EVP_CIPHER_CTX_block_size(&ctx));
-    r = EVP_EncryptFinal_ex(&ctx, NULL, &clen);
+    r = EVP_EncryptUpdate(&cctx->iv_ctx, ivec, &clen, blockbuf, EVP_CIPHER_CTX_block_size(&cctx->iv_ctx));
+    assert(r == 1 && clen == EVP_CIPHER_CTX_block_size(&cctx->iv_ctx));
+    r = EVP_EncryptFinal_ex(&cctx->iv_ctx, NULL, &clen);
     assert(r == 1 && clen == 0);
 
-    /* Re-initialize cipher for bulk data encryption */
-    assert(EVP_CIPHER_CTX_block_size(&ctx) == EVP_CIPHER_CTX_iv_length(&ctx));
-    r = EVP_CipherInit_ex(&ctx, priv->cipher, NULL, priv->key, ivec, enc);
+    /* Reset the bulk data context with the new IV */
+    r = EVP_CipherInit_ex(ctx, NULL, NULL, NULL, ivec, enc);
     assert(r == 1);
-    EVP_CIPHER_CTX_set_padding(&ctx, 1);
 
     /* Encrypt/decrypt */
-    r = EVP_CipherUpdate(&ctx, dest, &clen, src, (int)len);
+    r = EVP_CipherUpdate(ctx, dest, &clen, src, (int)len);
     assert(r == 1 && clen >= 0);
     total_len = (u_int)clen;
-    r = EVP_CipherFinal_ex(&ctx, dest + total_len, &clen);
+    r = EVP_CipherFinal_ex(ctx, dest + total_len, &clen);
     assert(r == 1 && clen >= 0);
     total_len += (u_int)clen;
 
@@ -2552,35 +7323,107 @@ http_io_crypt(struct http_io_private *priv, s3b_block_t block_num, int enc, cons
     struct http_io_conf *const config = priv->config;
     char ivecbuf[sizeof(ivec) * 2 + 1];
     http_io_prhex(ivecbuf, ivec, sizeof(ivec));
-    (*config->log)(LOG_DEBUG, "%sCRYPT: block=%s ivec=0x%s len: %d -> %d", (enc ? "EN" : "DE"), blockbuf, ivecbuf, len, total_len);
+    (*config->log)(LOG_DEBUG, "%sCRYPT: block=%s ivec=0x%s len: %d -> %d", (enc ? "EN" : "DE"), (char *)blockbuf, ivecbuf, len, total_len);
 }
 #endif
 
     /* Done */
-    EVP_CIPHER_CTX_cleanup(&ctx);
     return total_len;
 }
 
 static void
-http_io_authsig(struct http_io_private *priv, s3b_block_t block_num, const u_char *src, u_int len, u_char *hmac)
+http_io_authsig(struct cipher_ctx *cctx, s3b_block_t block_num, const u_char *src, u_int len, u_char *hmac)
 {
+    struct http_io_private *const priv = cctx->priv;
     const char *const ciphername = EVP_CIPHER_name(priv->cipher);
     char blockbuf[64];
     u_int hmac_len;
-    HMAC_CTX ctx;
 
-    /* Sign the block number, the name of the encryption algorithm, and the block data */
+    /* Sign the block number, the name of the encryption algorithm, and the block data (reusing the key) */
+    assert(cctx->keyed);
     snprintf(blockbuf, sizeof(blockbuf), "%0*jx", S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num);
-    HMAC_CTX_init(&ctx);
-    HMAC_Init_ex(&ctx, (const u_char *)priv->key, priv->keylen, EVP_sha1(), NULL);
-    HMAC_Update(&ctx, (const u_char *)blockbuf, strlen(blockbuf));
-    HMAC_Update(&ctx, (const u_char *)ciphername, strlen(ciphername));
-    HMAC_Update(&ctx, (const u_char *)src, len);
-    HMAC_Final(&ctx, (u_char *)hmac, &hmac_len);
+    HMAC_Init_ex(&cctx->hmac_ctx, NULL, 0, NULL, NULL);
+    HMAC_Update(&cctx->hmac_ctx, (const u_char *)blockbuf, strlen(blockbuf));
+    HMAC_Update(&cctx->hmac_ctx, (const u_char *)ciphername, strlen(ciphername));
+    HMAC_Update(&cctx->hmac_ctx, (const u_char *)src, len);
+    HMAC_Final(&cctx->hmac_ctx, (u_char *)hmac, &hmac_len);
     assert(hmac_len == SHA_DIGEST_LENGTH);
-    HMAC_CTX_cleanup(&ctx);
 }
 
+#if HAVE_OPENSSL_GCM
+/*
+ * Encrypt and authenticate, or authenticate and decrypt, one block using AES-GCM in a single pass.
+ *
+ * Encrypted blocks consist of a random nonce, the ciphertext, and the authentication tag. The block number
+ * and cipher name are authenticated as additional data, so blocks can't be swapped or relabeled.
+ * Returns EIO if the block fails authentication.
+ *
+ * Nonces are random because nothing persistent records how many times a block has been written, so a
+ * counter could repeat after a crash or when two mounts race. Random 96-bit nonces are safe for up to
+ * 2^32 encryptions under one key (NIST SP 800-38D); the man page tells users to change the password
+ * before writing that many blocks.
+ */
+static int
+http_io_aead_crypt(struct cipher_ctx *cctx, s3b_block_t block_num, int enc,
+  const u_char *src, u_int len, u_char *dest, u_int *lenp)
+{
+    struct http_io_private *const priv = cctx->priv;
+    EVP_CIPHER_CTX *const ctx = &cctx->aead_ctx;
+    u_char nonce[GCM_NONCE_LENGTH];
+    u_char tag[GCM_TAG_LENGTH];
+    char aad[64];
+    u_int total_len;
+    int clen;
+
+    /* Sanity check */
+    assert(cctx->keyed && priv->aead_cipher != NULL);
+
+    /* Get nonce */
+    if (enc) {
+        if (RAND_bytes(nonce, sizeof(nonce)) != 1)
+            return EIO;
+    } else {
+        if (len < GCM_NONCE_LENGTH + GCM_TAG_LENGTH)
+            return EIO;
+        memcpy(nonce, src, sizeof(nonce));
+        memcpy(tag, src + len - sizeof(tag), sizeof(tag));
+        src += sizeof(nonce);
+        len -= sizeof(nonce) + sizeof(tag);
+    }
+
+    /* Reset context with the nonce and add the additional authenticated data */
+    snprintf(aad, sizeof(aad), "%0*jx%s", S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num, priv->aead_name);
+    if (EVP_CipherInit_ex(ctx, NULL, NULL, NULL, nonce, enc) != 1
+      || EVP_CipherUpdate(ctx, NULL, &clen, (const u_char *)aad, strlen(aad)) != 1)
+        return EIO;
+
+    /* Encrypt/decrypt */
+    if (enc) {
+        memcpy(dest, nonce, sizeof(nonce));
+        dest += sizeof(nonce);
+    }
+    if (EVP_CipherUpdate(ctx, dest, &clen, src, (int)len) != 1)
+        return EIO;
+    total_len = (u_int)clen;
+
+    /* Verify or generate tag */
+    if (!enc && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, sizeof(tag), tag) != 1)
+        return EIO;
+    if (EVP_CipherFinal_ex(ctx, dest + total_len, &clen) != 1)
+        return EIO;                                 /* authentication failed */
+    total_len += (u_int)clen;
+    if (enc) {
+        if (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, sizeof(tag), dest + total_len) != 1)
+            return EIO;
+        total_len += sizeof(nonce) + sizeof(tag);
+    }
+
+    /* Done */
+    *lenp = total_len;
+    return 0;
+}
+#endif
+
 static void
 update_hmac_from_header(HMAC_CTX *const ctx, struct http_io *const io,
   const char *name, int value_only, char *sigbuf, size_t sigbuflen)
@@ -2648,6 +7491,524 @@ http_io_parse_hex(const char *str, u_char *buf, u_int nbytes)
     return 0;
 }
 
+/*
+ * Test and set bits in the non-zero block bitmap. These are atomic, so no lock is needed.
+ */
+static int
+http_io_nonzero_test(struct http_io_private *priv, s3b_block_t block_num)
+{
+    const int bits_per_word = sizeof(*priv->non_zero) * 8;
+
+    return (ATOMIC_LOAD(&priv->non_zero[block_num / bits_per_word]) & (1 << (block_num % bits_per_word))) != 0;
+}
+
+static void
+http_io_nonzero_set(struct http_io_private *priv, s3b_block_t block_num)
+{
+    const int bits_per_word = sizeof(*priv->non_zero) * 8;
+
+    ATOMIC_OR(&priv->non_zero[block_num / bits_per_word], 1 << (block_num % bits_per_word));
+}
+
+/*
+ * Count a successful HTTP operation taking the given time.
+ */
+static void
+http_io_count_evst(struct http_io_evst *evst, double secs)
+{
+    ATOMIC_ADD(&evst->count, 1);
+    ATOMIC_ADD(&evst->time_usec, (uint64_t)(secs * 1000000.0));
+}
+
+/*
+ * Get the rate governor for a request, if any.
+ */
+static struct rate_gov *
+http_io_get_gov(struct http_io_private *priv, struct http_io *io)
+{
+    if (!priv->config->rate_governor)
+        return NULL;
+    if (strcmp(io->method, HTTP_GET) == 0 || strcmp(io->method, HTTP_HEAD) == 0)
+        return &priv->govs[GOV_GET];
+    if (strcmp(io->method, HTTP_PUT) == 0)
+        return &priv->govs[GOV_PUT];
+    if (strcmp(io->method, HTTP_DELETE) == 0 || strcmp(io->method, HTTP_POST) == 0)
+        return &priv->govs[GOV_DELETE];
+    return NULL;
+}
+
+/*
+ * Take a token from a rate governor's bucket, sleeping until it would have been refilled if necessary.
+ *
+ * Tokens are reserved even when none are available, so waiting requests are spaced out rather
+ * than all retrying at once when the bucket refills.
+ */
+static void
+http_io_gov_acquire(struct http_io_private *priv, struct rate_gov *gov)
+{
+    struct timespec delay;
+    double wait = 0.0;
+    double now;
+
+    /* Measure request rate, so a limit can start from the rate at which we were actually throttled */
+    pthread_mutex_lock(&priv->gov_mutex);
+    now = http_io_now();
+    if (now - gov->interval_start >= GOV_MEASURE_INTERVAL) {
+        gov->measured = gov->count / (now - gov->interval_start);
+        gov->interval_start = now;
+        gov->count = 0;
+    }
+    gov->count++;
+
+    /* Anything to limit? */
+    if (gov->rate == 0.0) {
+        pthread_mutex_unlock(&priv->gov_mutex);
+        return;
+    }
+
+    /* Refill bucket and take a token */
+    gov->tokens += (now - gov->last_refill) * gov->rate;
+    if (gov->tokens > gov->rate * GOV_BURST + 1.0)
+        gov->tokens = gov->rate * GOV_BURST + 1.0;
+    gov->last_refill = now;
+    if (--gov->tokens < 0.0)
+        wait = -gov->tokens / gov->rate;
+    pthread_mutex_unlock(&priv->gov_mutex);
+
+    /* Wait our turn */
+    if (wait > 0.0) {
+        STATS_INC(priv, gov_throttled);
+        STATS_ADD(priv, gov_delay, (uint64_t)(wait * 1000.0));
+        delay.tv_sec = (time_t)wait;
+        delay.tv_nsec = (long)((wait - delay.tv_sec) * 1000000000.0);
+        nanosleep(&delay, NULL);
+    }
+}
+
+/*
+ * Adjust a rate governor's rate: additive increase when S3 is keeping up, multiplicative decrease when it's not.
+ *
+ * There is no limit until the first time S3 throttles us; the limit then starts from the rate we were sending at,
+ * and is lifted again once it has climbed back up to that rate.
+ */
+static void
+http_io_gov_feedback(struct http_io_private *priv, struct rate_gov *gov, int ok)
+{
+    struct http_io_conf *const config = priv->config;
+    double elapsed;
+    double now;
+
+    pthread_mutex_lock(&priv->gov_mutex);
+    if (ok) {
+        if (gov->rate > 0.0) {
+            gov->rate += GOV_INCREASE / gov->rate;
+            if (gov->rate >= gov->max_rate)
+                gov->rate = 0.0;
+        }
+    } else if ((now = http_io_now()) - gov->last_decrease >= GOV_DECREASE_INTERVAL) {
+        if (gov->rate == 0.0) {
+            elapsed = now - gov->interval_start;
+            gov->max_rate = gov->measured;
+            if (elapsed > 0.0 && gov->count / elapsed > gov->max_rate)
+                gov->max_rate = gov->count / elapsed;
+            if (gov->max_rate < GOV_MIN_RATE)
+                gov->max_rate = GOV_MIN_RATE;
+            gov->rate = gov->max_rate;
+            gov->last_refill = now;
+        }
+        gov->rate *= GOV_DECREASE;
+        if (gov->rate < GOV_MIN_RATE)
+            gov->rate = GOV_MIN_RATE;
+        if (gov->tokens > 0.0)
+            gov->tokens = 0.0;
+        gov->last_decrease = now;
+        (*config->log)(LOG_NOTICE, "S3 is throttling requests; reducing %s request rate to %.1f/sec",
+          gov == &priv->govs[GOV_GET] ? "GET" : gov == &priv->govs[GOV_PUT] ? "PUT" : "DELETE", gov->rate);
+    }
+    pthread_mutex_unlock(&priv->gov_mutex);
+}
+
+#if HAVE_CURL_MULTI_WAIT
+/*
+ * Get the time after which a block GET that hasn't started to receive its response is hedged (zero = don't hedge yet).
+ */
+static double
+http_io_hedge_threshold(struct http_io_private *priv)
+{
+    double threshold;
+
+    pthread_mutex_lock(&priv->gov_mutex);
+    threshold = priv->hedge_threshold;
+    pthread_mutex_unlock(&priv->gov_mutex);
+    return threshold;
+}
+
+/*
+ * Determine whether we can afford to hedge a request. Hedges are limited by the budget, and are not sent
+ * at all while the rate governor is backing off, because then S3 is slow due to too many requests.
+ */
+static int
+http_io_hedge_permit(struct http_io_private *priv)
+{
+    struct rate_gov *const gov = &priv->govs[GOV_GET];
+    int permit = 0;
+
+    pthread_mutex_lock(&priv->gov_mutex);
+    if (priv->hedge_tokens >= 1.0 && gov->rate == 0.0) {
+        priv->hedge_tokens -= 1.0;
+        permit = 1;
+    }
+    pthread_mutex_unlock(&priv->gov_mutex);
+    return permit;
+}
+
+/*
+ * Record a block GET's time to first byte and earn hedging budget for it.
+ * Every so often, recompute the hedging threshold from the recent samples.
+ */
+static void
+http_io_hedge_sample(struct http_io_private *priv, double ttfb)
+{
+    struct http_io_conf *const config = priv->config;
+    double samples[HEDGE_SAMPLES];
+    u_int num_samples;
+    double threshold;
+    u_int index;
+
+    /* Record sample and earn budget */
+    pthread_mutex_lock(&priv->gov_mutex);
+    priv->hedge_samples[priv->hedge_num_samples++ % HEDGE_SAMPLES] = ttfb;
+    priv->hedge_tokens += config->hedge_budget / 100.0;
+    if (priv->hedge_tokens > HEDGE_MAX_TOKENS)
+        priv->hedge_tokens = HEDGE_MAX_TOKENS;
+    num_samples = priv->hedge_num_samples;
+    if (num_samples < HEDGE_MIN_SAMPLES || num_samples % HEDGE_RECOMPUTE != 0) {
+        pthread_mutex_unlock(&priv->gov_mutex);
+        return;
+    }
+    if (num_samples > HEDGE_SAMPLES)
+        num_samples = HEDGE_SAMPLES;
+    memcpy(samples, priv->hedge_samples, num_samples * sizeof(*samples));
+    pthread_mutex_unlock(&priv->gov_mutex);
+
+    /* Find the configured percentile */
+    qsort(samples, num_samples, sizeof(*samples), http_io_double_cmp);
+    if ((index = num_samples * config->hedge_percentile / 100) >= num_samples)
+        index = num_samples - 1;
+    if ((threshold = samples[index]) < HEDGE_MIN_DELAY)
+        threshold = HEDGE_MIN_DELAY;
+
+    /* Update threshold */
+    pthread_mutex_lock(&priv->gov_mutex);
+    priv->hedge_threshold = threshold;
+    pthread_mutex_unlock(&priv->gov_mutex);
+}
+#endif
+
+
+/*
+ * Build the list of endpoints from config->endpoints and, if config->resolve_endpoints,
+ * every address the base URL's host resolves to. Endpoints only change where requests are sent;
+ * URLs (and so the Host header, signatures and TLS certificate checks) stay the same.
+ */
+static int
+http_io_init_endpoints(struct http_io_private *priv)
+{
+    struct http_io_conf *const config = priv->config;
+    struct addrinfo hints;
+    struct addrinfo *res;
+    struct addrinfo *ai;
+    char basehost[256];
+    const char *host;
+    char *list;
+    char *state;
+    char *s;
+    int r = 0;
+
+    /* Anything to do? */
+    if (config->endpoints == NULL && !config->resolve_endpoints)
+        return 0;
+#if !HAVE_CURL_CONNECT_TO
+    (*config->log)(LOG_ERR, "multiple endpoints are not supported by this version of cURL");
+    return ENOTSUP;
+#endif
+    if ((priv->endpoints = calloc(ENDPOINTS_MAX, sizeof(*priv->endpoints))) == NULL)
+        return errno;
+
+    /* Get the base URL's host; only requests to it are routed to endpoints */
+    if ((host = strstr(config->baseURL, "://")) == NULL) {
+        (*config->log)(LOG_ERR, "can't find host in base URL `%s'", config->baseURL);
+        r = EINVAL;
+        goto fail;
+    }
+    host += 3;
+    snprintf(basehost, sizeof(basehost), "%.*s", (int)(*host == '[' ? strcspn(host, "]") + 1 : strcspn(host, ":/")), host);
+
+    /* Add configured endpoints */
+    if (config->endpoints != NULL) {
+        if ((list = strdup(config->endpoints)) == NULL) {
+            r = errno;
+            goto fail;
+        }
+        for (s = strtok_r(list, WHITESPACE ",", &state); s != NULL; s = strtok_r(NULL, WHITESPACE ",", &state)) {
+            if ((r = http_io_add_endpoint(priv, basehost, s)) != 0)
+                break;
+        }
+        free(list);
+        if (r != 0)
+            goto fail;
+    }
+
+    /* Add every address of the base URL's host */
+    if (config->resolve_endpoints) {
+        char hostbuf[256];
+        char addrbuf[INET6_ADDRSTRLEN];
+        char namebuf[INET6_ADDRSTRLEN + 2];
+
+        snprintf(hostbuf, sizeof(hostbuf), "%.*s", (int)strcspn(basehost + (*basehost == '['), "]"),
+          basehost + (*basehost == '['));
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if ((r = getaddrinfo(hostbuf, NULL, &hints, &res)) != 0) {
+            (*config->log)(LOG_ERR, "can't resolve `%s': %s", hostbuf, gai_strerror(r));
+            r = EHOSTUNREACH;
+            goto fail;
+        }
+        for (ai = res; ai != NULL; ai = ai->ai_next) {
+            const void *const addr = ai->ai_family == AF_INET6 ?
+              (const void *)&((struct sockaddr_in6 *)ai->ai_addr)->sin6_addr :
+              (const void *)&((struct sockaddr_in *)ai->ai_addr)->sin_addr;
+
+            if (inet_ntop(ai->ai_family, addr, addrbuf, sizeof(addrbuf)) == NULL)
+                continue;
+            snprintf(namebuf, sizeof(namebuf), ai->ai_family == AF_INET6 ? "[%s]" : "%s", addrbuf);
+            if ((r = http_io_add_endpoint(priv, basehost, namebuf)) != 0)
+                break;
+        }
+        freeaddrinfo(res);
+        if (r != 0)
+            goto fail;
+    }
+
+    /* Sanity check */
+    if (priv->num_endpoints == 0) {
+        (*config->log)(LOG_ERR, "no endpoints found");
+        r = EINVAL;
+        goto fail;
+    }
+    if (config->debug) {
+        u_int i;
+
+        for (i = 0; i < priv->num_endpoints; i++)
+            (*config->log)(LOG_DEBUG, "endpoint: %s", priv->endpoints[i].stats.name);
+    }
+    return 0;
+
+fail:
+    while (priv->num_endpoints > 0)
+        curl_slist_free_all(priv->endpoints[--priv->num_endpoints].connect_to);
+    free(priv->endpoints);
+    priv->endpoints = NULL;
+    return r;
+}
+
+/*
+ * Add an endpoint given as "host[:port]" (where host may be a bracketed IPv6 address), ignoring duplicates.
+ */
+static int
+http_io_add_endpoint(struct http_io_private *priv, const char *basehost, const char *name)
+{
+    struct http_io_conf *const config = priv->config;
+    struct endpoint *ep;
+    char buf[256 + ENDPOINT_NAME_MAX + 4];
+    const char *port;
+    size_t hostlen;
+    u_int i;
+
+    /* Parse host and optional port */
+    if (*name == '[')
+        hostlen = (port = strchr(name, ']')) != NULL ? port - name + 1 : 0;
+    else
+        hostlen = strcspn(name, ":");
+    port = name + hostlen;
+    if (hostlen == 0 || strlen(name) >= ENDPOINT_NAME_MAX
+      || (*port != '\0' && (*port != ':' || port[1] == '\0' || port[strspn(port + 1, "0123456789") + 1] != '\0'))) {
+        (*config->log)(LOG_ERR, "invalid endpoint `%s'", name);
+        return EINVAL;
+    }
+
+    /* Ignore duplicates */
+    for (i = 0; i < priv->num_endpoints; i++) {
+        if (strcmp(priv->endpoints[i].stats.name, name) == 0)
+            return 0;
+    }
+    if (priv->num_endpoints >= ENDPOINTS_MAX) {
+        (*config->log)(LOG_ERR, "too many endpoints (max is %u)", ENDPOINTS_MAX);
+        return EINVAL;
+    }
+
+    /* Route requests for the base URL's host (any port) here; an empty port means the URL's port */
+    ep = &priv->endpoints[priv->num_endpoints];
+    snprintf(buf, sizeof(buf), "%s::%.*s:%s", basehost, (int)hostlen, name, *port != '\0' ? port + 1 : "");
+    if ((ep->connect_to = curl_slist_append(NULL, buf)) == NULL)
+        return ENOMEM;
+    snprintf(ep->stats.name, sizeof(ep->stats.name), "%s", name);
+    priv->num_endpoints++;
+    return 0;
+}
+
+/*
+ * Choose an endpoint for a request and route it there (if using endpoints).
+ *
+ * The best endpoint has the lowest average time to first byte, weighted by the number of requests it has
+ * in progress; endpoints without any samples yet are assumed to be average. Ejected endpoints are skipped
+ * until their ejection expires, unless they all are, in which case the one due back soonest is used.
+ */
+static struct endpoint *
+http_io_endpoint_pick(struct http_io_private *priv, struct http_io *io, CURL *curl)
+{
+    struct http_io_conf *const config = priv->config;
+    struct endpoint *ejected = NULL;
+    struct endpoint *best = NULL;
+    double best_score = 0.0;
+    double prior = 0.0;
+    double score;
+    double now;
+    u_int samples;
+    u_int i;
+
+    /* Anything to do? Requests for other hosts (e.g., EC2 IAM meta-data) go where their URL says */
+    if (priv->num_endpoints == 0 || strncmp(io->url, config->baseURL, strlen(config->baseURL)) != 0)
+        return NULL;
+
+    /* Find the best endpoint, starting the search in a different place each time to spread ties around */
+    now = http_io_now();
+    pthread_mutex_lock(&priv->endpoint_mutex);
+    for (i = samples = 0; i < priv->num_endpoints; i++) {
+        if (priv->endpoints[i].ewma > 0.0) {
+            prior += priv->endpoints[i].ewma;
+            samples++;
+        }
+    }
+    prior = samples > 0 ? prior / samples : 1.0;
+    for (i = 0; i < priv->num_endpoints; i++) {
+        struct endpoint *const ep = &priv->endpoints[(priv->endpoint_next + i) % priv->num_endpoints];
+
+        if (ep->ejected_until > now) {
+            if (ejected == NULL || ep->ejected_until < ejected->ejected_until)
+                ejected = ep;
+            continue;
+        }
+        score = (ep->ewma > 0.0 ? ep->ewma : prior) * (ep->stats.in_flight + 1);
+        if (best == NULL || score < best_score) {
+            best = ep;
+            best_score = score;
+        }
+    }
+    if (best == NULL)
+        best = ejected;
+    priv->endpoint_next++;
+    best->stats.in_flight++;
+    best->stats.requests++;
+    pthread_mutex_unlock(&priv->endpoint_mutex);
+
+    /* Route the request there */
+#if HAVE_CURL_CONNECT_TO
+    curl_easy_setopt(curl, CURLOPT_CONNECT_TO, best->connect_to);
+#endif
+    return best;
+}
+
+/*
+ * Record the outcome of a request sent to an endpoint (if any); curl is NULL if the request was abandoned.
+ *
+ * Responses update the endpoint's average time to first byte. Connect failures in a row eject the endpoint
+ * for a while, and each ejection that follows without an intervening response lasts twice as long.
+ */
+static void
+http_io_endpoint_done(struct http_io_private *priv, struct endpoint *ep, CURL *curl, CURLcode curl_code)
+{
+    struct http_io_conf *const config = priv->config;
+    const int responded = curl != NULL && (curl_code == CURLE_OK || curl_code == CURLE_HTTP_RETURNED_ERROR);
+    const int failed = curl != NULL && http_io_endpoint_failed(curl_code);
+    double eject_time = 0.0;
+    double ttfb = 0.0;
+    u_int failures = 0;
+    double now;
+
+    /* Anything to do? */
+    if (ep == NULL)
+        return;
+
+    /* Get time to first byte */
+    if (responded && curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &ttfb) != CURLE_OK)
+        ttfb = 0.0;
+
+    /* Update endpoint */
+    now = http_io_now();
+    pthread_mutex_lock(&priv->endpoint_mutex);
+    ep->stats.in_flight--;
+    if (responded) {
+        if (ttfb > 0.0)
+            ep->ewma = ep->ewma > 0.0 ? ep->ewma + ENDPOINT_EWMA_WEIGHT * (ttfb - ep->ewma) : ttfb;
+        ep->failures = 0;
+        ep->eject_time = 0.0;
+    } else if (failed) {
+        ep->stats.failures++;
+        if (++ep->failures >= ENDPOINT_EJECT_FAILURES && ep->ejected_until <= now) {
+            ep->eject_time = ep->eject_time > 0.0 ? ep->eject_time * 2 : ENDPOINT_EJECT_MIN;
+            if (ep->eject_time > ENDPOINT_EJECT_MAX)
+                ep->eject_time = ENDPOINT_EJECT_MAX;
+            ep->ejected_until = now + ep->eject_time;
+            ep->stats.ejections++;
+            eject_time = ep->eject_time;
+            failures = ep->failures;
+        }
+    }
+    pthread_mutex_unlock(&priv->endpoint_mutex);
+
+    /* Log ejections */
+    if (eject_time > 0.0) {
+        (*config->log)(LOG_WARNING, "endpoint %s failed %u times in a row; not using it for %.0f seconds",
+          ep->stats.name, failures, eject_time);
+    }
+}
+
+/*
+ * Determine whether a request failure reflects on the endpoint it was sent to: it couldn't be reached,
+ * or it timed out or dropped the connection. A server that silently drops packets only ever times out.
+ */
+static int
+http_io_endpoint_failed(CURLcode curl_code)
+{
+    switch (curl_code) {
+    case CURLE_COULDNT_RESOLVE_HOST:
+    case CURLE_COULDNT_CONNECT:
+    case CURLE_OPERATION_TIMEDOUT:
+    case CURLE_SSL_CONNECT_ERROR:
+    case CURLE_GOT_NOTHING:
+    case CURLE_SEND_ERROR:
+    case CURLE_RECV_ERROR:
+    case CURLE_PARTIAL_FILE:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Get the current monotonic time in seconds.
+ */
+static double
+http_io_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
 static void
 http_io_prhex(char *buf, const u_char *data, size_t len)
 {
@@ -2670,3 +8031,14 @@ http_io_strcasecmp_ptr(const void *const ptr1, const void *const ptr2)
     return strcasecmp(str1, str2);
 }
 
+#if HAVE_CURL_MULTI_WAIT
+static int
+http_io_double_cmp(const void *const ptr1, const void *const ptr2)
+{
+    const double val1 = *(const double *)ptr1;
+    const double val2 = *(const double *)ptr2;
+
+    return val1 < val2 ? -1 : val1 > val2 ? 1 : 0;
+}
+#endif
+
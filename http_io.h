@@ -30,11 +30,34 @@
 #define AUTH_VERSION_AWS2   "aws2"
 #define AUTH_VERSION_AWS4   "aws4"
 
+/* Hashed key layout */
+#define HASH_PREFIX_MAX     8                       // max hex digits of block number hash prefixed to keys
+
+/* Multi-object deletes */
+#define DELETE_BATCH_MAX    1000                    // S3 maximum keys per multi-object delete
+
+/* Multiple endpoints */
+#define ENDPOINTS_MAX       32                      // max endpoints requests are spread across
+#define ENDPOINT_NAME_MAX   64                      // max length of "host[:port]" endpoint names
+
+/* Saved non-zero block bitmap encodings */
+#define NONZERO_ENCODING_RAW    0                   // one bit per block
+#define NONZERO_ENCODING_RLE    1                   // alternating zero/non-zero run lengths as varints
+
+/* Multipart uploads */
+#define MULTIPART_MIN_SIZE  (5 * 1024 * 1024)       // S3 minimum size of all but the last part
+#define MULTIPART_MAX_PARTS 10000                   // S3 maximum number of parts
+#define MULTIPART_THREADS_MAX 64                    // max threads transferring the parts of one block
+
+/* Compression codecs (also used as the Content-Encoding token) */
+#define COMPRESS_DEFLATE    "deflate"
+#define COMPRESS_ZSTD       "zstd"
+#define COMPRESS_LZ4        "lz4"
+
 /* Configuration info structure for http_io store */
 struct http_io_conf {
     char                *accessId;
     char                *accessKey;
-    char                *iam_token;
     const char          *accessType;
     const char          *ec2iam_role;
     const char          *authVersion;
@@ -51,10 +74,30 @@ struct http_io_conf {
     int                 debug_http;
     int                 quiet;
     int                 rrs;                        // reduced redundancy storage
-    int                 compress;                   // zlib compression level
+    int                 compress;                   // compression level
+    const char          *compress_codec;            // compression codec (NULL = deflate)
+    const char          *compress_dict;             // zstd compression dictionary file
     int                 vhost;                      // use virtual host style URL
+    int                 cas;                        // content addressed layout
+    u_int               hash_prefix;                // hex digits of block number hash prefixed to keys (zero = none)
+    u_int               http2;                      // max HTTP/2 connections (zero = don't multiplex)
+    u_int               pack_factor;                // number of consecutive blocks per object
+    u_int               md5_cache_size;             // max packed object MD5s remembered after writing
+    u_int               md5_cache_time;             // how long to remember them (milliseconds)
+    u_int               crypto_contexts;            // max blocks encoded/decoded at once (zero = one per core)
+    u_int               list_threads;               // threads listing ranges of the bucket concurrently
+    int                 rate_governor;              // adapt request rates when S3 throttles us
+    u_int               hedge_percentile;           // hedge block GETs slower than this percentile (zero = never)
+    u_int               hedge_budget;               // max hedged GETs as a percentage of all block GETs
+    u_int               delete_batch;               // max blocks per multi-object delete (0 or 1 = don't batch)
+    u_int               multipart_size;             // transfer larger blocks in parts of this size (zero = never)
+    u_int               multipart_threads;          // max parts of one block transferred at once
+    const char          *endpoints;                 // comma-separated "host[:port]" addresses serving baseURL
+    int                 resolve_endpoints;          // also use every address baseURL's host resolves to
     u_int               *nonzero_bitmap;            // is set to NULL by http_io_create()
+    uint64_t            nonzero_generation;         // generation of saved nonzero_bitmap (if any)
     int                 insecure;
+    int                 unsigned_payload;           // don't sign payload hash with authVersion aws4 (requires SSL)
     u_int               block_size;
     off_t               num_blocks;
     u_int               timeout;
@@ -64,10 +107,21 @@ struct http_io_conf {
     log_func_t          *log;
 };
 
+/* Statistics for one endpoint */
+struct http_io_endpoint_stats {
+    char                name[ENDPOINT_NAME_MAX];    // "host[:port]"
+    u_int               requests;                   // requests sent
+    u_int               in_flight;                  // requests in progress
+    u_int               latency;                    // average time to first byte (milliseconds)
+    u_int               failures;                   // requests that failed to connect, timed out, or were cut off
+    u_int               ejections;                  // times taken out of rotation after failing repeatedly
+    int                 ejected;                    // currently out of rotation
+};
+
 /* Statistics structure for http_io store */
 struct http_io_evst {
     u_int               count;                      // number of occurrences
-    double              time;                       // total time taken
+    uint64_t            time_usec;                  // total time taken in microseconds
 };
 
 struct http_io_stats {
@@ -75,16 +129,33 @@ struct http_io_stats {
     /* Block stats */
     u_int               normal_blocks_read;
     u_int               normal_blocks_written;
+    u_int               partial_blocks_read;        // block fragments read with a Range request
     u_int               zero_blocks_read;
     u_int               zero_blocks_written;
     u_int               empty_blocks_read;          // only when nonzero_bitmap != NULL
     u_int               empty_blocks_written;       // only when nonzero_bitmap != NULL
+    u_int               cas_blocks_uploaded;        // content objects uploaded
+    u_int               cas_blocks_deduped;         // content objects already present
+    u_int               pack_blocks_coalesced;      // block writes merged into another block's PUT
+    u_int               pack_read_fills;            // object reads required to fill in unwritten blocks
+
+    /* Compression stats */
+    u_int               compress_probes;            // blocks sampled to see if they are compressible
+    u_int               compress_probe_skips;       // blocks not compressed because the sample was incompressible
+    u_int               compress_region_skips;      // blocks not compressed because their region was incompressible
+    u_int               compress_no_gain;           // blocks compressed that did not get any smaller
+    uint64_t            compress_bytes_skipped;     // bytes we avoided compressing
 
     /* HTTP transfer stats */
     struct http_io_evst http_heads;                 // total successful
     struct http_io_evst http_gets;                  // total successful
     struct http_io_evst http_puts;                  // total successful
     struct http_io_evst http_deletes;               // total successful
+    struct http_io_evst http_delete_batches;        // total successful multi-object deletes
+    u_int               batched_deletes;            // blocks deleted by multi-object deletes
+    u_int               multipart_uploads;          // blocks written by multipart uploads
+    u_int               multipart_reads;            // blocks read using parallel ranged GETs
+    u_int               multipart_parts;            // parts uploaded or read by the above
     u_int               http_unauthorized;
     u_int               http_forbidden;
     u_int               http_stale;
@@ -95,6 +166,12 @@ struct http_io_stats {
     u_int               http_other_error;
     u_int               http_canceled_writes;
 
+    /* HTTP/2 multiplexing stats */
+    u_int               http2_streams;              // transfers completed on the multi handle
+    u_int               http2_connections;          // connections opened by those transfers
+    u_int               http2_max_streams;          // most transfers in progress at once
+    u_int               http2_fallbacks;            // transfers that did not use HTTP/2
+
     /* CURL stats */
     u_int               curl_handles_created;
     u_int               curl_handles_reused;
@@ -104,10 +181,41 @@ struct http_io_stats {
     u_int               curl_out_of_memory;
     u_int               curl_other_error;
 
+    /* Buffer pool stats */
+    u_int               io_buffers_created;
+    u_int               io_buffers_reused;
+
+    /* Pipeline stats */
+    u_int               crypto_jobs;                // blocks encoded or decoded using a pooled cipher context
+    u_int               crypto_queue_depth;         // threads currently waiting for a cipher context
+    u_int               crypto_max_queue_depth;     // most threads ever waiting for a cipher context
+    u_int               net_active_transfers;       // transfers currently in progress
+    u_int               net_max_active_transfers;   // most transfers ever in progress at once
+
+    /* Authentication stats */
+    u_int               auth4_key_derivations;      // aws4 signing keys derived (i.e., not found in the cache)
+
     /* Retry stats */
     u_int               num_retries;
     uint64_t            retry_delay;
 
+    /* Rate governor stats */
+    u_int               http_slowdowns;             // `503 Slow Down' responses
+    u_int               gov_throttled;              // requests delayed by the rate governor
+    uint64_t            gov_delay;                  // total delay imposed by the rate governor (milliseconds)
+    u_int               gov_get_rate;               // current GET/HEAD rate limit (requests/sec, zero = none)
+    u_int               gov_put_rate;               // current PUT rate limit (requests/sec, zero = none)
+    u_int               gov_delete_rate;            // current DELETE rate limit (requests/sec, zero = none)
+
+    /* Hedged read stats */
+    u_int               http_hedged_gets;           // duplicate GETs sent for slow block reads
+    u_int               http_hedge_wins;            // duplicate GETs that finished first
+    u_int               hedge_threshold;            // current hedging threshold (milliseconds)
+
+    /* Endpoint stats */
+    u_int               num_endpoints;              // zero unless requests are spread across endpoints
+    struct http_io_endpoint_stats endpoints[ENDPOINTS_MAX];
+
     /* Misc */
     u_int               out_of_memory_errors;
 };
@@ -116,4 +224,15 @@ struct http_io_stats {
 extern struct s3backer_store *http_io_create(struct http_io_conf *config);
 extern void http_io_get_stats(struct s3backer_store *s3b, struct http_io_stats *stats);
 extern int http_io_parse_block(struct http_io_conf *config, const char *name, s3b_block_t *block_num);
+extern void http_io_get_block_name(char *buf, size_t bufsiz, struct http_io_conf *config, s3b_block_t block_num);
+extern int http_io_migrate_block(struct s3backer_store *s3b, s3b_block_t block_num);
+extern int http_io_set_migrating(struct s3backer_store *s3b, int *old_valuep, int new_value);
+extern int http_io_set_hashed(struct s3backer_store *s3b, int *old_valuep, int new_value);
+extern int http_io_check_key_layout(struct s3backer_store *s3b);
+extern void http_io_delete_blocks(struct s3backer_store *s3b, const s3b_block_t *blocks, u_int num_blocks, int *results);
+extern int http_io_load_nonzero_bitmap(struct s3backer_store *s3b, u_int **bitmapp, uintmax_t *countp);
+extern uint64_t http_io_encode_nonzero(struct http_io_conf *config, const u_int *bitmap, u_char *buf,
+  size_t raw_size, size_t *lenp, u_int *encodingp);
+extern uint64_t http_io_decode_nonzero(struct http_io_conf *config, u_int encoding, const u_char *buf,
+  size_t len, u_int *bitmap);
 
@@ -30,6 +30,7 @@
 #include "s3b_config.h"
 #include "erase.h"
 #include "reset.h"
+#include "migrate.h"
 
 int
 main(int argc, char **argv)
@@ -55,6 +56,13 @@ main(int argc, char **argv)
         return 0;
     }
 
+    /* Handle `--migrateKeys' flag */
+    if (config->migrate) {
+        if (s3backer_migrate(config) != 0)
+            return 1;
+        return 0;
+    }
+
     /* Get FUSE operation hooks */
     fuse_ops = fuse_ops_create(&config->fuse_ops);
 
@@ -0,0 +1,321 @@
+
+/*
+ * s3backer - FUSE-based single file backing store via Amazon S3
+ * 
+ * Copyright 2008-2011 Archie L. Cobbs <archie@dellroad.org>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * $Id$
+ */
+
+#include "s3backer.h"
+#include "block_cache.h"
+#include "ec_protect.h"
+#include "fuse_ops.h"
+#include "http_io.h"
+#include "s3b_config.h"
+#include "migrate.h"
+
+#define BLOCKS_PER_DOT          0x100
+#define MAX_QUEUE_LENGTH        1000
+#define NUM_MIGRATION_THREADS   25
+
+/* Migration state */
+struct migrate_state {
+    struct s3backer_store       *s3b;
+    u_int                       pack_factor;
+    u_int                       *bitmap;        // blocks found under their plain keys
+    uintmax_t                   found;
+    s3b_block_t                 queue[MAX_QUEUE_LENGTH];
+    u_int                       qlen;
+    pthread_t                   threads[NUM_MIGRATION_THREADS];
+    int                         quiet;
+    int                         stopping;
+    uintmax_t                   count;
+    uintmax_t                   errors;
+    pthread_mutex_t             mutex;
+    pthread_cond_t              thread_wakeup;
+    pthread_cond_t              queue_not_full;
+};
+
+/* Internal functions */
+static void migrate_list_callback(void *arg, s3b_block_t block_num);
+static void *migrate_thread_main(void *arg);
+
+/*
+ * Move all blocks stored under plain keys to their hashed keys (see `--hashPrefix').
+ *
+ * Only one store can exist at a time, so we first find the blocks using a store configured
+ * for the plain key layout, then move them using a store configured for the hashed layout.
+ */
+int
+s3backer_migrate(struct s3b_config *config)
+{
+    struct migrate_state state;
+    struct migrate_state *const priv = &state;
+    struct http_io_conf plain_config;
+    const int bits_per_word = sizeof(*priv->bitmap) * 8;
+    s3b_block_t block_num;
+    char response[10];
+    size_t nwords;
+    int flag_set = 0;
+    int mounted;
+    int ok = 0;
+    int i;
+    int r;
+
+    /* Double check with user */
+    if (!config->force) {
+        warnx("`--migrateKeys' flag given: moving all blocks in %s to %u digit hashed keys",
+          config->description, config->http_io.hash_prefix);
+        fprintf(stderr, "s3backer: is this correct? [y/N] ");
+        *response = '\0';
+        if (fgets(response, sizeof(response), stdin) != NULL) {
+            while (*response && isspace(response[strlen(response) - 1]))
+                response[strlen(response) - 1] = '\0';
+        }
+        if (strcasecmp(response, "y") != 0 && strcasecmp(response, "yes") != 0) {
+            warnx("not confirmed");
+            goto fail0;
+        }
+    }
+
+    /* Initialize state */
+    memset(priv, 0, sizeof(*priv));
+    priv->quiet = config->quiet;
+    priv->pack_factor = config->http_io.pack_factor;
+    nwords = (config->num_blocks + bits_per_word - 1) / bits_per_word;
+    if ((priv->bitmap = calloc(nwords, sizeof(*priv->bitmap))) == NULL) {
+        warn("calloc");
+        goto fail0;
+    }
+    if ((r = pthread_mutex_init(&priv->mutex, NULL)) != 0) {
+        warnx("pthread_mutex_init: %s", strerror(r));
+        goto fail1;
+    }
+    if ((r = pthread_cond_init(&priv->thread_wakeup, NULL)) != 0) {
+        warnx("pthread_cond_init: %s", strerror(r));
+        goto fail2;
+    }
+    if ((r = pthread_cond_init(&priv->queue_not_full, NULL)) != 0) {
+        warnx("pthread_cond_init: %s", strerror(r));
+        goto fail3;
+    }
+
+    /* Logging */
+    if (!config->quiet) {
+        fprintf(stderr, "s3backer: listing blocks stored under plain keys...");
+        fflush(stderr);
+    }
+
+    /* Create temporary lower layer using the plain key layout */
+    plain_config = config->http_io;
+    plain_config.hash_prefix = 0;
+    if ((priv->s3b = http_io_create(&plain_config)) == NULL) {
+        warnx("http_io_create");
+        goto fail4;
+    }
+
+    /* Set mounted flag so nothing mounts the filesystem while blocks are moving; refuse if it's already mounted */
+    if ((r = (*priv->s3b->set_mounted)(priv->s3b, &mounted, -1)) != 0) {
+        warnx("error reading mounted flag: %s", strerror(r));
+        goto fail5;
+    }
+    if (mounted) {
+        if (!config->force) {
+            warnx("%s appears to be already mounted", config->description);
+            goto fail5;
+        }
+        if (!config->quiet)
+            warnx("warning: filesystem appears already mounted but you said `--force', so I'll proceed anyway");
+    }
+    if ((r = (*priv->s3b->set_mounted)(priv->s3b, NULL, 1)) != 0) {
+        warnx("can't set mounted flag: %s", strerror(r));
+        goto fail5;
+    }
+    flag_set = 1;
+
+    /* Mark the migration unfinished; only a migration that moves every block clears this */
+    if ((r = http_io_set_migrating(priv->s3b, NULL, 1)) != 0) {
+        warnx("can't set migration marker: %s", strerror(r));
+        goto fail5;
+    }
+
+    /* Find blocks stored under plain keys */
+    if ((r = (*priv->s3b->list_blocks)(priv->s3b, migrate_list_callback, priv)) != 0) {
+        warnx("can't list blocks: %s", strerror(r));
+        goto fail5;
+    }
+    (*priv->s3b->destroy)(priv->s3b);
+    priv->s3b = NULL;
+    if (!config->quiet) {
+        fprintf(stderr, "done\n");
+        warnx("found %ju blocks to move", priv->found);
+    }
+
+    /* Create temporary lower layer using the hashed key layout */
+    if ((priv->s3b = http_io_create(&config->http_io)) == NULL) {
+        warnx("http_io_create");
+        warnx("the mounted flag is still set; use `--reset-mounted-flag' to clear it");
+        goto fail4;
+    }
+
+    /* Start threads */
+    for (i = 0; i < NUM_MIGRATION_THREADS; i++) {
+        if ((r = pthread_create(&priv->threads[i], NULL, migrate_thread_main, priv)) != 0)
+            goto fail6;
+    }
+
+    /* Logging */
+    if (!config->quiet) {
+        fprintf(stderr, "s3backer: moving blocks to hashed keys...");
+        fflush(stderr);
+    }
+
+    /* Queue blocks */
+    for (block_num = 0; block_num < config->num_blocks; block_num++) {
+        if ((priv->bitmap[block_num / bits_per_word] & (1 << (block_num % bits_per_word))) == 0)
+            continue;
+        pthread_mutex_lock(&priv->mutex);
+        while (priv->qlen == MAX_QUEUE_LENGTH)
+            pthread_cond_wait(&priv->queue_not_full, &priv->mutex);
+        priv->queue[priv->qlen++] = block_num;
+        pthread_cond_signal(&priv->thread_wakeup);
+        pthread_mutex_unlock(&priv->mutex);
+    }
+
+    /* Success (so far) */
+    ok = 1;
+
+    /* Clean up */
+fail6:
+    pthread_mutex_lock(&priv->mutex);
+    priv->stopping = 1;
+    pthread_cond_broadcast(&priv->thread_wakeup);
+    pthread_mutex_unlock(&priv->mutex);
+    for (i = 0; i < NUM_MIGRATION_THREADS; i++) {
+        if (priv->threads[i] == (pthread_t)0)
+            continue;
+        if ((r = pthread_join(priv->threads[i], NULL)) != 0)
+            warnx("pthread_join: %s", strerror(r));
+    }
+    if (ok && !config->quiet) {
+        fprintf(stderr, "done\n");
+        warnx("moved %ju blocks", priv->count);
+    }
+    if (priv->errors > 0) {
+        warnx("%ju blocks could not be moved; run `--migrateKeys' again to retry", priv->errors);
+        ok = 0;
+    }
+
+    /* The filesystem can be mounted with hashed keys only if every block was moved */
+    if (ok && (r = http_io_set_hashed(priv->s3b, NULL, 1)) != 0) {
+        warnx("can't write hashed key layout marker: %s", strerror(r));
+        ok = 0;
+    }
+    if (ok && (r = http_io_set_migrating(priv->s3b, NULL, 0)) != 0) {
+        warnx("can't clear migration marker: %s", strerror(r));
+        ok = 0;
+    }
+fail5:
+    if (flag_set && (r = (*priv->s3b->set_mounted)(priv->s3b, NULL, 0)) != 0) {
+        warnx("can't clear mounted flag: %s", strerror(r));
+        ok = 0;
+    }
+    (*priv->s3b->destroy)(priv->s3b);
+fail4:
+    pthread_cond_destroy(&priv->queue_not_full);
+fail3:
+    pthread_cond_destroy(&priv->thread_wakeup);
+fail2:
+    pthread_mutex_destroy(&priv->mutex);
+fail1:
+    free(priv->bitmap);
+fail0:
+    return ok ? 0 : -1;
+}
+
+static void
+migrate_list_callback(void *arg, s3b_block_t block_num)
+{
+    struct migrate_state *const priv = arg;
+    const int bits_per_word = sizeof(*priv->bitmap) * 8;
+
+    /* With packed objects, only the first block in each object has a key */
+    if (block_num % priv->pack_factor != 0)
+        return;
+    priv->bitmap[block_num / bits_per_word] |= 1 << (block_num % bits_per_word);
+    priv->found++;
+}
+
+static void *
+migrate_thread_main(void *arg)
+{
+    struct migrate_state *const priv = arg;
+    s3b_block_t block_num;
+    int r;
+
+    /* Acquire lock */
+    pthread_mutex_lock(&priv->mutex);
+
+    /* Move blocks until there are no more */
+    while (1) {
+
+        /* Is there a block to move? */
+        if (priv->qlen > 0) {
+
+            /* Grab next block */
+            if (priv->qlen == MAX_QUEUE_LENGTH)
+                pthread_cond_signal(&priv->queue_not_full);
+            block_num = priv->queue[--priv->qlen];
+
+            /* Move block; if it's not there anymore, someone else moved it */
+            pthread_mutex_unlock(&priv->mutex);
+            if ((r = http_io_migrate_block(priv->s3b, block_num)) == ENOENT)
+                r = 0;
+            pthread_mutex_lock(&priv->mutex);
+
+            /* Check for error */
+            if (r != 0) {
+                warnx("can't move block %0*jx: %s", S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num, strerror(r));
+                priv->errors++;
+                continue;
+            }
+
+            /* Update count and output a dot */
+            if ((++priv->count % BLOCKS_PER_DOT) == 0 && !priv->quiet) {
+                fprintf(stderr, ".");
+                fflush(stderr);
+            }
+
+            /* Spin again */
+            continue;
+        }
+
+        /* Are we done? */
+        if (priv->stopping)
+            break;
+
+        /* Wait for something to do */
+        pthread_cond_wait(&priv->thread_wakeup, &priv->mutex);
+    }
+
+    /* Done */
+    pthread_mutex_unlock(&priv->mutex);
+    return NULL;
+}
+
@@ -68,6 +68,16 @@
 #define S3BACKER_DEFAULT_READ_AHEAD                 4
 #define S3BACKER_DEFAULT_READ_AHEAD_TRIGGER         2
 #define S3BACKER_DEFAULT_COMPRESSION                Z_NO_COMPRESSION
+#define S3BACKER_DEFAULT_PACK_FACTOR                1
+#define S3BACKER_DEFAULT_HTTP2_CONNECTIONS          4
+#define S3BACKER_DEFAULT_LIST_BLOCKS_THREADS        16
+#define S3BACKER_DEFAULT_HEDGE_PERCENTILE           95
+#define S3BACKER_DEFAULT_HEDGE_BUDGET               5               // 5%
+#define S3BACKER_DEFAULT_HASH_PREFIX                0
+#define S3BACKER_HASH_PREFIX_DIGITS                 4               // `--hashPrefix' without a value
+#define S3BACKER_DEFAULT_DELETE_BATCH               DELETE_BATCH_MAX
+#define S3BACKER_DEFAULT_MULTIPART_SIZE             (16 * 1024 * 1024)  // 16MB
+#define S3BACKER_DEFAULT_MULTIPART_THREADS          4
 #define S3BACKER_DEFAULT_ENCRYPTION                 "AES-128-CBC"
 
 /* MacFUSE setting for kernel daemon timeout */
@@ -93,6 +103,7 @@ struct list_blocks {
  ****************************************************************************/
 
 static print_stats_t s3b_config_print_stats;
+static void s3b_config_print_rate(void *prarg, printer_t *printer, const char *name, u_int rate);
 
 static int parse_size_string(const char *s, uintmax_t *valp);
 static void unparse_size_string(char *buf, size_t bmax, uintmax_t value);
@@ -142,6 +153,15 @@ static struct s3b_config config = {
         .authVersion=           S3BACKER_DEFAULT_AUTH_VERSION,
         .user_agent=            user_agent_buf,
         .compress=              S3BACKER_DEFAULT_COMPRESSION,
+        .pack_factor=           S3BACKER_DEFAULT_PACK_FACTOR,
+        .list_threads=          S3BACKER_DEFAULT_LIST_BLOCKS_THREADS,
+        .rate_governor=         1,
+        .hedge_percentile=      S3BACKER_DEFAULT_HEDGE_PERCENTILE,
+        .hedge_budget=          S3BACKER_DEFAULT_HEDGE_BUDGET,
+        .hash_prefix=           S3BACKER_DEFAULT_HASH_PREFIX,
+        .delete_batch=          S3BACKER_DEFAULT_DELETE_BATCH,
+        .multipart_size=        S3BACKER_DEFAULT_MULTIPART_SIZE,
+        .multipart_threads=     S3BACKER_DEFAULT_MULTIPART_THREADS,
         .timeout=               S3BACKER_DEFAULT_TIMEOUT,
         .initial_retry_pause=   S3BACKER_DEFAULT_INITIAL_RETRY_PAUSE,
         .max_retry_pause=       S3BACKER_DEFAULT_MAX_RETRY_PAUSE,
@@ -179,6 +199,7 @@ static struct s3b_config config = {
     .erase=                 0,
     .no_auto_detect=        0,
     .reset=                 0,
+    .migrate=               0,
     .log=                   syslog_logger
 };
 
@@ -268,6 +289,19 @@ static const struct fuse_opt option_list[] = {
         .offset=    offsetof(struct s3b_config, block_cache.no_verify),
         .value=     1
     },
+    {
+        .templ=     "--blockCacheDedup",
+        .offset=    offsetof(struct s3b_config, block_cache.dedup),
+        .value=     1
+    },
+    {
+        .templ=     "--blockCacheHotFile=%s",
+        .offset=    offsetof(struct s3b_config, block_cache.hot_file),
+    },
+    {
+        .templ=     "--blockCacheHotBlocks=%u",
+        .offset=    offsetof(struct s3b_config, block_cache.hot_blocks),
+    },
     {
         .templ=     "--blockSize=%s",
         .offset=    offsetof(struct s3b_config, block_size_str),
@@ -313,11 +347,67 @@ static const struct fuse_opt option_list[] = {
         .offset=    offsetof(struct s3b_config, reset),
         .value=     1
     },
+    {
+        .templ=     "--migrateKeys",
+        .offset=    offsetof(struct s3b_config, migrate),
+        .value=     1
+    },
     {
         .templ=     "--vhost",
         .offset=    offsetof(struct s3b_config, http_io.vhost),
         .value=     1
     },
+    {
+        .templ=     "--endpoints=%s",
+        .offset=    offsetof(struct s3b_config, http_io.endpoints),
+    },
+    {
+        .templ=     "--resolveEndpoints",
+        .offset=    offsetof(struct s3b_config, http_io.resolve_endpoints),
+        .value=     1
+    },
+    {
+        .templ=     "--http2",
+        .offset=    offsetof(struct s3b_config, http_io.http2),
+        .value=     S3BACKER_DEFAULT_HTTP2_CONNECTIONS
+    },
+    {
+        .templ=     "--http2=%u",
+        .offset=    offsetof(struct s3b_config, http_io.http2),
+    },
+    {
+        .templ=     "--cryptoContexts=%u",
+        .offset=    offsetof(struct s3b_config, http_io.crypto_contexts),
+    },
+    {
+        .templ=     "--noRateGovernor",
+        .offset=    offsetof(struct s3b_config, http_io.rate_governor),
+        .value=     0
+    },
+    {
+        .templ=     "--hedgePercentile=%u",
+        .offset=    offsetof(struct s3b_config, http_io.hedge_percentile),
+    },
+    {
+        .templ=     "--hedgeBudget=%u",
+        .offset=    offsetof(struct s3b_config, http_io.hedge_budget),
+    },
+    {
+        .templ=     "--deleteBatch=%u",
+        .offset=    offsetof(struct s3b_config, http_io.delete_batch),
+    },
+    {
+        .templ=     "--multipartSize=%s",
+        .offset=    offsetof(struct s3b_config, multipart_size_str),
+    },
+    {
+        .templ=     "--multipartThreads=%u",
+        .offset=    offsetof(struct s3b_config, http_io.multipart_threads),
+    },
+    {
+        .templ=     "--listBlocksThreads=%u",
+        .offset=    offsetof(struct s3b_config, http_io.list_threads),
+    },
     {
         .templ=     "--fileMode=%o",
         .offset=    offsetof(struct s3b_config, fuse_ops.file_mode),
@@ -348,6 +438,10 @@ static const struct fuse_opt option_list[] = {
         .templ=     "--minWriteDelay=%u",
         .offset=    offsetof(struct s3b_config, ec_protect.min_write_delay),
     },
+    {
+        .templ=     "--packFactor=%u",
+        .offset=    offsetof(struct s3b_config, http_io.pack_factor),
+    },
     {
         .templ=     "--prefix=%s",
         .offset=    offsetof(struct s3b_config, http_io.prefix),
@@ -384,6 +478,11 @@ static const struct fuse_opt option_list[] = {
         .offset=    offsetof(struct s3b_config, http_io.insecure),
         .value=     1
     },
+    {
+        .templ=     "--unsignedPayload",
+        .offset=    offsetof(struct s3b_config, http_io.unsigned_payload),
+        .value=     1
+    },
     {
         .templ=     "--compress",
         .offset=    offsetof(struct s3b_config, http_io.compress),
@@ -393,6 +492,28 @@ static const struct fuse_opt option_list[] = {
         .templ=     "--compress=%d",
         .offset=    offsetof(struct s3b_config, http_io.compress),
     },
+    {
+        .templ=     "--compressCodec=%s",
+        .offset=    offsetof(struct s3b_config, http_io.compress_codec),
+    },
+    {
+        .templ=     "--compressDict=%s",
+        .offset=    offsetof(struct s3b_config, http_io.compress_dict),
+    },
+    {
+        .templ=     "--contentAddressed",
+        .offset=    offsetof(struct s3b_config, http_io.cas),
+        .value=     1
+    },
+    {
+        .templ=     "--hashPrefix",
+        .offset=    offsetof(struct s3b_config, http_io.hash_prefix),
+        .value=     S3BACKER_HASH_PREFIX_DIGITS
+    },
+    {
+        .templ=     "--hashPrefix=%u",
+        .offset=    offsetof(struct s3b_config, http_io.hash_prefix),
+    },
     {
         .templ=     "--encrypt",
         .offset=    offsetof(struct s3b_config, encrypt),
@@ -645,6 +766,7 @@ s3b_config_print_stats(void *prarg, printer_t *printer)
     double curl_reuse_ratio = 0.0;
     u_int total_oom = 0;
     u_int total_curls;
+    u_int i;
 
     /* Get HTTP stats */
     if (http_io_store != NULL)
@@ -662,21 +784,65 @@ s3b_config_print_stats(void *prarg, printer_t *printer)
     if (http_io_store != NULL) {
         (*printer)(prarg, "%-28s %u\n", "http_normal_blocks_read", http_io_stats.normal_blocks_read);
         (*printer)(prarg, "%-28s %u\n", "http_normal_blocks_written", http_io_stats.normal_blocks_written);
+        (*printer)(prarg, "%-28s %u\n", "http_partial_blocks_read", http_io_stats.partial_blocks_read);
         (*printer)(prarg, "%-28s %u\n", "http_zero_blocks_read", http_io_stats.zero_blocks_read);
         (*printer)(prarg, "%-28s %u\n", "http_zero_blocks_written", http_io_stats.zero_blocks_written);
         if (config.list_blocks) {
             (*printer)(prarg, "%-28s %u\n", "http_empty_blocks_read", http_io_stats.empty_blocks_read);
             (*printer)(prarg, "%-28s %u\n", "http_empty_blocks_written", http_io_stats.empty_blocks_written);
         }
+        if (config.http_io.cas) {
+            (*printer)(prarg, "%-28s %u\n", "http_cas_blocks_uploaded", http_io_stats.cas_blocks_uploaded);
+            (*printer)(prarg, "%-28s %u\n", "http_cas_blocks_deduped", http_io_stats.cas_blocks_deduped);
+        }
+        if (config.http_io.compress != Z_NO_COMPRESSION) {
+            (*printer)(prarg, "%-28s %u\n", "http_compress_probes", http_io_stats.compress_probes);
+            (*printer)(prarg, "%-28s %u\n", "http_compress_probe_skips", http_io_stats.compress_probe_skips);
+            (*printer)(prarg, "%-28s %u\n", "http_compress_region_skips", http_io_stats.compress_region_skips);
+            (*printer)(prarg, "%-28s %u\n", "http_compress_no_gain", http_io_stats.compress_no_gain);
+            (*printer)(prarg, "%-28s %ju\n", "http_compress_bytes_skipped", (uintmax_t)http_io_stats.compress_bytes_skipped);
+        }
+        if (config.http_io.pack_factor > 1) {
+            (*printer)(prarg, "%-28s %u\n", "http_pack_blocks_coalesced", http_io_stats.pack_blocks_coalesced);
+            (*printer)(prarg, "%-28s %u\n", "http_pack_read_fills", http_io_stats.pack_read_fills);
+        }
+        if (config.http_io.http2 > 0) {
+            (*printer)(prarg, "%-28s %u\n", "http2_streams", http_io_stats.http2_streams);
+            (*printer)(prarg, "%-28s %u\n", "http2_connections", http_io_stats.http2_connections);
+            (*printer)(prarg, "%-28s %.1f\n", "http2_streams_per_connection", http_io_stats.http2_connections > 0 ?
+              (double)http_io_stats.http2_streams / http_io_stats.http2_connections : 0.0);
+            (*printer)(prarg, "%-28s %u\n", "http2_max_streams", http_io_stats.http2_max_streams);
+            (*printer)(prarg, "%-28s %u\n", "http2_fallbacks", http_io_stats.http2_fallbacks);
+        }
+        for (i = 0; i < http_io_stats.num_endpoints; i++) {
+            const struct http_io_endpoint_stats *const ep = &http_io_stats.endpoints[i];
+            char namebuf[ENDPOINT_NAME_MAX + 16];
+
+            snprintf(namebuf, sizeof(namebuf), "endpoint %s", ep->name);
+            (*printer)(prarg, "%-28s %u requests, %u in flight, %u ms, %u failures, %u ejections%s\n",
+              namebuf, ep->requests, ep->in_flight, ep->latency, ep->failures, ep->ejections,
+              ep->ejected ? " (ejected)" : "");
+        }
         (*printer)(prarg, "%-28s %u\n", "http_gets", http_io_stats.http_gets.count);
         (*printer)(prarg, "%-28s %u\n", "http_puts", http_io_stats.http_puts.count);
         (*printer)(prarg, "%-28s %u\n", "http_deletes", http_io_stats.http_deletes.count);
         (*printer)(prarg, "%-28s %.3f sec\n", "http_avg_get_time", http_io_stats.http_gets.count > 0 ?
-          http_io_stats.http_gets.time / http_io_stats.http_gets.count : 0.0);
+          http_io_stats.http_gets.time_usec / 1000000.0 / http_io_stats.http_gets.count : 0.0);
         (*printer)(prarg, "%-28s %.3f sec\n", "http_avg_put_time", http_io_stats.http_puts.count > 0 ?
-          http_io_stats.http_puts.time / http_io_stats.http_puts.count : 0.0);
+          http_io_stats.http_puts.time_usec / 1000000.0 / http_io_stats.http_puts.count : 0.0);
         (*printer)(prarg, "%-28s %.3f sec\n", "http_avg_delete_time", http_io_stats.http_deletes.count > 0 ?
-          http_io_stats.http_deletes.time / http_io_stats.http_deletes.count : 0.0);
+          http_io_stats.http_deletes.time_usec / 1000000.0 / http_io_stats.http_deletes.count : 0.0);
+        if (config.http_io.multipart_size > 0 && config.block_size > config.http_io.multipart_size) {
+            (*printer)(prarg, "%-28s %u\n", "http_multipart_uploads", http_io_stats.multipart_uploads);
+            (*printer)(prarg, "%-28s %u\n", "http_multipart_reads", http_io_stats.multipart_reads);
+            (*printer)(prarg, "%-28s %u\n", "http_multipart_parts", http_io_stats.multipart_parts);
+        }
+        if (config.http_io.delete_batch > 1) {
+            (*printer)(prarg, "%-28s %u\n", "http_delete_batches", http_io_stats.http_delete_batches.count);
+            (*printer)(prarg, "%-28s %u\n", "http_batched_deletes", http_io_stats.batched_deletes);
+            (*printer)(prarg, "%-28s %.3f sec\n", "http_avg_delete_batch_time", http_io_stats.http_delete_batches.count > 0 ?
+              http_io_stats.http_delete_batches.time_usec / 1000000.0 / http_io_stats.http_delete_batches.count : 0.0);
+        }
         (*printer)(prarg, "%-28s %u\n", "http_unauthorized", http_io_stats.http_unauthorized);
         (*printer)(prarg, "%-28s %u\n", "http_forbidden", http_io_stats.http_forbidden);
         (*printer)(prarg, "%-28s %u\n", "http_stale", http_io_stats.http_stale);
@@ -689,6 +855,21 @@ s3b_config_print_stats(void *prarg, printer_t *printer)
         (*printer)(prarg, "%-28s %u\n", "http_num_retries", http_io_stats.num_retries);
         (*printer)(prarg, "%-28s %ju.%03u sec\n", "http_total_retry_delay",
           (uintmax_t)(http_io_stats.retry_delay / 1000), (u_int)(http_io_stats.retry_delay % 1000));
+        if (config.http_io.rate_governor) {
+            (*printer)(prarg, "%-28s %u\n", "http_slowdowns", http_io_stats.http_slowdowns);
+            s3b_config_print_rate(prarg, printer, "http_rate_limit_get", http_io_stats.gov_get_rate);
+            s3b_config_print_rate(prarg, printer, "http_rate_limit_put", http_io_stats.gov_put_rate);
+            s3b_config_print_rate(prarg, printer, "http_rate_limit_delete", http_io_stats.gov_delete_rate);
+            (*printer)(prarg, "%-28s %u\n", "http_rate_throttled", http_io_stats.gov_throttled);
+            (*printer)(prarg, "%-28s %ju.%03u sec\n", "http_rate_throttle_delay",
+              (uintmax_t)(http_io_stats.gov_delay / 1000), (u_int)(http_io_stats.gov_delay % 1000));
+        }
+        if (config.http_io.hedge_percentile > 0 && config.http_io.http2 == 0) {
+            (*printer)(prarg, "%-28s %u\n", "http_hedged_gets", http_io_stats.http_hedged_gets);
+            (*printer)(prarg, "%-28s %u\n", "http_hedge_wins", http_io_stats.http_hedge_wins);
+            (*printer)(prarg, "%-28s %u.%03u sec\n", "http_hedge_threshold",
+              http_io_stats.hedge_threshold / 1000, http_io_stats.hedge_threshold % 1000);
+        }
         total_curls = http_io_stats.curl_handles_created + http_io_stats.curl_handles_reused;
         if (total_curls > 0)
             curl_reuse_ratio = (double)http_io_stats.curl_handles_reused / (double)total_curls;
@@ -698,6 +879,14 @@ s3b_config_print_stats(void *prarg, printer_t *printer)
         (*printer)(prarg, "%-28s %u\n", "curl_host_unknown", http_io_stats.curl_host_unknown);
         (*printer)(prarg, "%-28s %u\n", "curl_out_of_memory", http_io_stats.curl_out_of_memory);
         (*printer)(prarg, "%-28s %u\n", "curl_other_error", http_io_stats.curl_other_error);
+        (*printer)(prarg, "%-28s %u\n", "http_io_buffers_created", http_io_stats.io_buffers_created);
+        (*printer)(prarg, "%-28s %u\n", "http_io_buffers_reused", http_io_stats.io_buffers_reused);
+        (*printer)(prarg, "%-28s %u\n", "http_crypto_jobs", http_io_stats.crypto_jobs);
+        (*printer)(prarg, "%-28s %u\n", "http_crypto_queue_depth", http_io_stats.crypto_queue_depth);
+        (*printer)(prarg, "%-28s %u\n", "http_crypto_max_queue_depth", http_io_stats.crypto_max_queue_depth);
+        (*printer)(prarg, "%-28s %u\n", "http_net_active", http_io_stats.net_active_transfers);
+        (*printer)(prarg, "%-28s %u\n", "http_net_max_active", http_io_stats.net_max_active_transfers);
+        (*printer)(prarg, "%-28s %u\n", "http_auth4_key_derivations", http_io_stats.auth4_key_derivations);
         total_oom += http_io_stats.out_of_memory_errors;
     }
     if (block_cache_store != NULL) {
@@ -723,6 +912,8 @@ s3b_config_print_stats(void *prarg, printer_t *printer)
         (*printer)(prarg, "%-28s %.4f\n", "block_cache_write_hit_ratio", write_hit_ratio);
         (*printer)(prarg, "%-28s %u\n", "block_cache_verified", block_cache_stats.verified);
         (*printer)(prarg, "%-28s %u\n", "block_cache_mismatch", block_cache_stats.mismatch);
+        (*printer)(prarg, "%-28s %u blocks\n", "block_cache_hot_prefetched", block_cache_stats.hot_prefetched);
+        (*printer)(prarg, "%-28s %u blocks\n", "block_cache_dedup_saved", block_cache_stats.dedup_saved);
         total_oom += block_cache_stats.out_of_memory_errors;
     }
     if (ec_protect_store != NULL) {
@@ -737,6 +928,15 @@ s3b_config_print_stats(void *prarg, printer_t *printer)
     (*printer)(prarg, "%-28s %u\n", "out_of_memory_errors", total_oom);
 }
 
+static void
+s3b_config_print_rate(void *prarg, printer_t *printer, const char *name, u_int rate)
+{
+    if (rate == 0)
+        (*printer)(prarg, "%-28s %s\n", name, "unlimited");
+    else
+        (*printer)(prarg, "%-28s %u/sec\n", name, rate);
+}
+
 static int
 parse_size_string(const char *s, uintmax_t *valp)
 {
@@ -890,6 +1090,7 @@ validate_config(void)
     char fileSizeBuf[64];
     struct stat sb;
     char urlbuf[512];
+    int max_level;
     int i;
     int r;
 
@@ -1019,6 +1220,18 @@ validate_config(void)
         return -1;
     }
 
+    /* Unsigned payloads are only safe when SSL protects the content */
+    if (config.http_io.unsigned_payload) {
+        if (strcmp(config.http_io.authVersion, AUTH_VERSION_AWS4) != 0) {
+            warnx("`--unsignedPayload' requires `--authVersion=%s'", AUTH_VERSION_AWS4);
+            return -1;
+        }
+        if (strncmp(config.http_io.baseURL, "https", 5) != 0) {
+            warnx("`--unsignedPayload' requires SSL");
+            return -1;
+        }
+    }
+
     /* Handle virtual host style URL (prefix hostname with bucket name) */
     if (config.http_io.vhost) {
         size_t buflen;
@@ -1113,17 +1326,134 @@ validate_config(void)
             warnx("unexpected flag `%s' (`--encrypt' was not specified)", "--keyLength");
     }
 
+    /* Check compression codec; choosing one implies `--compress' */
+    if (config.http_io.compress_codec != NULL) {
+        const char *const codec = config.http_io.compress_codec;
+
+        if (strcmp(codec, COMPRESS_DEFLATE) != 0 && strcmp(codec, COMPRESS_ZSTD) != 0 && strcmp(codec, COMPRESS_LZ4) != 0) {
+            warnx("unknown compression codec `%s'", codec);
+            return -1;
+        }
+#if !HAVE_LIBZSTD
+        if (strcmp(codec, COMPRESS_ZSTD) == 0) {
+            warnx("compression codec `%s' is not supported by this build", codec);
+            return -1;
+        }
+#endif
+#if !HAVE_LIBLZ4
+        if (strcmp(codec, COMPRESS_LZ4) == 0) {
+            warnx("compression codec `%s' is not supported by this build", codec);
+            return -1;
+        }
+#endif
+        if (config.http_io.compress == Z_NO_COMPRESSION)
+            config.http_io.compress = Z_DEFAULT_COMPRESSION;
+    }
+    if (config.http_io.compress_dict != NULL
+      && (config.http_io.compress_codec == NULL || strcmp(config.http_io.compress_codec, COMPRESS_ZSTD) != 0)) {
+        warnx("`--compressDict' requires `--compressCodec=%s'", COMPRESS_ZSTD);
+        return -1;
+    }
+
     /* We always want to compress if we are encrypting */
     if (config.http_io.encryption != NULL && config.http_io.compress == Z_NO_COMPRESSION)
         config.http_io.compress = Z_DEFAULT_COMPRESSION;
 
+    /* Content addressed layout is incompatible with encryption, which is keyed by block number */
+    if (config.http_io.cas && config.http_io.encryption != NULL) {
+        warnx("`--contentAddressed' is incompatible with `--encrypt'");
+        return -1;
+    }
+
+    /* Check listing threads */
+    if (config.http_io.list_threads == 0) {
+        warnx("invalid number of listing threads %u", config.http_io.list_threads);
+        return -1;
+    }
+
+    /* Check hedging parameters */
+    if (config.http_io.hedge_percentile >= 100) {
+        warnx("invalid hedge percentile %u", config.http_io.hedge_percentile);
+        return -1;
+    }
+    if (config.http_io.hedge_budget > 100) {
+        warnx("invalid hedge budget %u%%", config.http_io.hedge_budget);
+        return -1;
+    }
+#if !HAVE_CURL_MULTI_WAIT
+    config.http_io.hedge_percentile = 0;                /* hedging requires cURL version 7.28.0 or later */
+#endif
+
+    /* Check multi-object delete batch size */
+    if (config.http_io.delete_batch > DELETE_BATCH_MAX) {
+        warnx("invalid delete batch size %u (max is %u)", config.http_io.delete_batch, DELETE_BATCH_MAX);
+        return -1;
+    }
+
+    /* Check multipart transfer threads */
+    if (config.http_io.multipart_threads == 0 || config.http_io.multipart_threads > MULTIPART_THREADS_MAX) {
+        warnx("invalid multipart threads %u (max is %u)", config.http_io.multipart_threads, MULTIPART_THREADS_MAX);
+        return -1;
+    }
+
+    /* Check hashed key layout */
+    if (config.http_io.hash_prefix > HASH_PREFIX_MAX) {
+        warnx("invalid hash prefix length %u (max is %u)", config.http_io.hash_prefix, HASH_PREFIX_MAX);
+        return -1;
+    }
+    if (config.migrate && config.http_io.hash_prefix == 0) {
+        warnx("`--migrateKeys' requires `--hashPrefix'");
+        return -1;
+    }
+    if (config.migrate && config.test) {
+        warnx("`--migrateKeys' is not supported in test mode");
+        return -1;
+    }
+
+    /* Packed objects are read with byte ranges, so they must be stored as-is */
+    if (config.http_io.pack_factor == 0) {
+        warnx("invalid pack factor %u", config.http_io.pack_factor);
+        return -1;
+    }
+    if (config.http_io.pack_factor > 1) {
+        if (config.http_io.compress != Z_NO_COMPRESSION || config.http_io.encryption != NULL) {
+            warnx("`--packFactor' is incompatible with `--compress' and `--encrypt'");
+            return -1;
+        }
+        if (config.http_io.cas) {
+            warnx("`--packFactor' is incompatible with `--contentAddressed'");
+            return -1;
+        }
+    }
+
+    /* Check multiple endpoint support */
+#if !HAVE_CURL_CONNECT_TO
+    if (config.http_io.endpoints != NULL || config.http_io.resolve_endpoints) {
+        warnx("`--endpoints' and `--resolveEndpoints' require cURL version 7.49.0 or later");
+        return -1;
+    }
+#endif
+
+    /* Check HTTP/2 support */
+#if !HAVE_CURL_HTTP2
+    if (config.http_io.http2 > 0) {
+        warnx("`--http2' requires cURL version 7.50.0 or later with HTTP/2 support");
+        return -1;
+    }
+#endif
+
     /* Check compression level */
     switch (config.http_io.compress) {
     case Z_DEFAULT_COMPRESSION:
     case Z_NO_COMPRESSION:
         break;
     default:
-        if (config.http_io.compress < Z_BEST_SPEED || config.http_io.compress > Z_BEST_COMPRESSION) {
+        max_level = Z_BEST_COMPRESSION;
+#if HAVE_LIBZSTD
+        if (config.http_io.compress_codec != NULL && strcmp(config.http_io.compress_codec, COMPRESS_ZSTD) == 0)
+            max_level = ZSTD_maxCLevel();
+#endif
+        if (config.http_io.compress < Z_BEST_SPEED || config.http_io.compress > max_level) {
             warnx("illegal compression level `%d'", config.http_io.compress);
             return -1;
         }
@@ -1156,6 +1486,10 @@ validate_config(void)
         return -1;
     }
 
+    /* Packed objects written recently are read back with the same consistency guarantee as individual blocks */
+    config.http_io.md5_cache_size = config.ec_protect.cache_size;
+    config.http_io.md5_cache_time = config.ec_protect.cache_time;
+
     /* Parse block and file sizes */
     if (config.block_size_str != NULL) {
         if (parse_size_string(config.block_size_str, &value) == -1 || value == 0) {
@@ -1168,6 +1502,21 @@ validate_config(void)
         }
         config.block_size = value;
     }
+    if (config.multipart_size_str != NULL) {
+        if (parse_size_string(config.multipart_size_str, &value) == -1) {
+            warnx("invalid multipart size `%s'", config.multipart_size_str);
+            return -1;
+        }
+        if ((u_int)value != value) {
+            warnx("multipart size `%s' is too big", config.multipart_size_str);
+            return -1;
+        }
+        config.http_io.multipart_size = value;
+    }
+    if (config.http_io.multipart_size != 0 && config.http_io.multipart_size < MULTIPART_MIN_SIZE) {
+        warnx("multipart size must be zero or at least %u", MULTIPART_MIN_SIZE);
+        return -1;
+    }
     if (config.file_size_str != NULL) {
         if (parse_size_string(config.file_size_str, &value) == -1 || value == 0) {
             warnx("invalid file size `%s'", config.block_size_str);
@@ -1205,6 +1554,14 @@ validate_config(void)
         warnx("`--blockCacheSync' requires setting `--blockCacheWriteDelay=0'");
         return -1;
     }
+    if (config.block_cache.dedup && config.block_cache.cache_file != NULL) {
+        warnx("`--blockCacheDedup' is incompatible with `--blockCacheFile'");
+        return -1;
+    }
+    if (config.block_cache.cache_size == 0 && config.block_cache.hot_file != NULL) {
+        warnx("`--blockCacheHotFile' requires the block cache to be enabled");
+        return -1;
+    }
     if (config.block_cache.cache_size > 0 && config.block_cache.cache_file != NULL) {
         int bs_bits = ffs(config.block_size) - 1;
         int cs_bits = ffs(config.block_cache.cache_size);
@@ -1217,9 +1574,9 @@ validate_config(void)
     }
 
     /* Check mount point */
-    if (config.erase || config.reset) {
+    if (config.erase || config.reset || config.migrate) {
         if (config.mount != NULL) {
-            warnx("no mount point should be specified with `--erase' or `--reset-mounted-flag'");
+            warnx("no mount point should be specified with `--erase', `--reset-mounted-flag' or `--migrateKeys'");
             return -1;
         }
     } else {
@@ -1331,7 +1688,11 @@ validate_config(void)
         if ((s3b = http_io_create(&config.http_io)) == NULL)
             err(1, "http_io_create");
         r = (*s3b->set_mounted)(s3b, &mounted, -1);
+        if (r == 0 && !config.migrate)
+            r = http_io_check_key_layout(s3b);
         (*s3b->destroy)(s3b);
+        if (r == EBUSY)
+            errx(1, "error: %s can't be mounted with `--hashPrefix' until `--migrateKeys' completes", config.description);
         if (r != 0) {
             errno = r;
             err(1, "error reading mounted flag");
@@ -1362,6 +1723,12 @@ validate_config(void)
         return -1;
     }
 
+    /* Check packed object size */
+    if ((uintmax_t)config.block_size * config.http_io.pack_factor > UINT_MAX) {
+        warnx("pack factor %u is too big for block size %u", config.http_io.pack_factor, config.block_size);
+        return -1;
+    }
+
     /* Check block size vs. encryption block size */
     if (config.http_io.encryption != NULL && config.block_size % EVP_MAX_IV_LENGTH != 0) {
         warnx("block size must be at least %u when encryption is enabled", EVP_MAX_IV_LENGTH);
@@ -1435,7 +1802,7 @@ validate_config(void)
     config.fuse_ops.log = config.log;
 
     /* If `--listBlocks' was given, build non-empty block bitmap */
-    if (config.erase || config.reset)
+    if (config.erase || config.reset || config.migrate)
         config.list_blocks = 0;
     if (config.list_blocks) {
         struct s3backer_store *temp_store;
@@ -1451,18 +1818,23 @@ validate_config(void)
         /* Create temporary lower layer */
         if ((temp_store = config.test ? test_io_create(&config.http_io) : http_io_create(&config.http_io)) == NULL)
             err(1, config.test ? "test_io_create" : "http_io_create");
+        assert(config.http_io.nonzero_bitmap == NULL);
 
-        /* Initialize bitmap */
-        nwords = (config.num_blocks + (sizeof(*lb.bitmap) * 8) - 1) / (sizeof(*lb.bitmap) * 8);
-        if ((lb.bitmap = calloc(nwords, sizeof(*lb.bitmap))) == NULL)
-            err(1, "calloc");
-        lb.print_dots = !config.quiet;
-        lb.count = 0;
+        /* Use the bitmap saved by the last clean unmount, if any */
+        r = ENOENT;
+        if (!config.test && (r = http_io_load_nonzero_bitmap(temp_store, &lb.bitmap, &lb.count)) != 0 && r != ENOENT)
+            warnx("can't load saved non-zero block bitmap: %s", strerror(r));
 
-        /* Generate non-zero block bitmap */
-        assert(config.http_io.nonzero_bitmap == NULL);
-        if ((r = (*temp_store->list_blocks)(temp_store, list_blocks_callback, &lb)) != 0)
-            errx(1, "can't list blocks: %s", strerror(r));
+        /* Otherwise, generate non-zero block bitmap by listing the bucket */
+        if (r != 0) {
+            nwords = (config.num_blocks + (sizeof(*lb.bitmap) * 8) - 1) / (sizeof(*lb.bitmap) * 8);
+            if ((lb.bitmap = calloc(nwords, sizeof(*lb.bitmap))) == NULL)
+                err(1, "calloc");
+            lb.print_dots = !config.quiet;
+            lb.count = 0;
+            if ((r = (*temp_store->list_blocks)(temp_store, list_blocks_callback, &lb)) != 0)
+                errx(1, "can't list blocks: %s", strerror(r));
+        }
 
         /* Close temporary store */
         (*temp_store->destroy)(temp_store);
@@ -1509,7 +1881,10 @@ dump_config(void)
     (*config.log)(LOG_DEBUG, "%24s: %s", "accessType", config.http_io.accessType);
     (*config.log)(LOG_DEBUG, "%24s: \"%s\"", "ec2iam_role", config.http_io.ec2iam_role != NULL ? config.http_io.ec2iam_role : "");
     (*config.log)(LOG_DEBUG, "%24s: %s", "authVersion", config.http_io.authVersion);
+    (*config.log)(LOG_DEBUG, "%24s: %s", "unsigned_payload", config.http_io.unsigned_payload ? "true" : "false");
     (*config.log)(LOG_DEBUG, "%24s: \"%s\"", "baseURL", config.http_io.baseURL);
+    (*config.log)(LOG_DEBUG, "%24s: %s", "endpoints", config.http_io.endpoints != NULL ? config.http_io.endpoints : "(none)");
+    (*config.log)(LOG_DEBUG, "%24s: %s", "resolve_endpoints", config.http_io.resolve_endpoints ? "true" : "false");
     (*config.log)(LOG_DEBUG, "%24s: \"%s\"", "region", config.http_io.region);
     (*config.log)(LOG_DEBUG, "%24s: \"%s\"", config.test ? "testdir" : "bucket", config.http_io.bucket);
     (*config.log)(LOG_DEBUG, "%24s: \"%s\"", "prefix", config.http_io.prefix);
@@ -1525,6 +1900,22 @@ dump_config(void)
     (*config.log)(LOG_DEBUG, "%24s: 0%o", "file_mode", config.fuse_ops.file_mode);
     (*config.log)(LOG_DEBUG, "%24s: %s", "read_only", config.fuse_ops.read_only ? "true" : "false");
     (*config.log)(LOG_DEBUG, "%24s: %d", "compress", config.http_io.compress);
+    (*config.log)(LOG_DEBUG, "%24s: %s", "compress_codec",
+      config.http_io.compress_codec != NULL ? config.http_io.compress_codec : COMPRESS_DEFLATE);
+    (*config.log)(LOG_DEBUG, "%24s: %s", "compress_dict",
+      config.http_io.compress_dict != NULL ? config.http_io.compress_dict : "(none)");
+    (*config.log)(LOG_DEBUG, "%24s: %s", "content_addressed", config.http_io.cas ? "true" : "false");
+    (*config.log)(LOG_DEBUG, "%24s: %u", "hash_prefix", config.http_io.hash_prefix);
+    (*config.log)(LOG_DEBUG, "%24s: %u", "pack_factor", config.http_io.pack_factor);
+    (*config.log)(LOG_DEBUG, "%24s: %u", "http2_connections", config.http_io.http2);
+    (*config.log)(LOG_DEBUG, "%24s: %u", "crypto_contexts", config.http_io.crypto_contexts);
+    (*config.log)(LOG_DEBUG, "%24s: %u", "list_threads", config.http_io.list_threads);
+    (*config.log)(LOG_DEBUG, "%24s: %s", "rate_governor", config.http_io.rate_governor ? "true" : "false");
+    (*config.log)(LOG_DEBUG, "%24s: %u", "hedge_percentile", config.http_io.hedge_percentile);
+    (*config.log)(LOG_DEBUG, "%24s: %u%%", "hedge_budget", config.http_io.hedge_budget);
+    (*config.log)(LOG_DEBUG, "%24s: %u", "delete_batch", config.http_io.delete_batch);
+    (*config.log)(LOG_DEBUG, "%24s: %u", "multipart_size", config.http_io.multipart_size);
+    (*config.log)(LOG_DEBUG, "%24s: %u", "multipart_threads", config.http_io.multipart_threads);
     (*config.log)(LOG_DEBUG, "%24s: %s", "encryption", config.http_io.encryption != NULL ? config.http_io.encryption : "(none)");
     (*config.log)(LOG_DEBUG, "%24s: %u", "key_length", config.http_io.key_length);
     (*config.log)(LOG_DEBUG, "%24s: \"%s\"", "password", config.http_io.password != NULL ? "****" : "");
@@ -1551,6 +1942,10 @@ dump_config(void)
     (*config.log)(LOG_DEBUG, "%24s: \"%s\"", "block_cache_cache_file",
       config.block_cache.cache_file != NULL ? config.block_cache.cache_file : "");
     (*config.log)(LOG_DEBUG, "%24s: %s", "block_cache_no_verify", config.block_cache.no_verify ? "true" : "false");
+    (*config.log)(LOG_DEBUG, "%24s: %s", "block_cache_dedup", config.block_cache.dedup ? "true" : "false");
+    (*config.log)(LOG_DEBUG, "%24s: \"%s\"", "block_cache_hot_file",
+      config.block_cache.hot_file != NULL ? config.block_cache.hot_file : "");
+    (*config.log)(LOG_DEBUG, "%24s: %u blocks", "block_cache_hot_blocks", config.block_cache.hot_blocks);
     (*config.log)(LOG_DEBUG, "fuse_main arguments:");
     for (i = 0; i < config.fuse_args.argc; i++)
         (*config.log)(LOG_DEBUG, "  [%d] = \"%s\"", i, config.fuse_args.argv[i]);
@@ -1626,6 +2021,7 @@ usage(void)
     fprintf(stderr, "\ts3backer --test [options] directory /mount/point\n");
     fprintf(stderr, "\ts3backer --erase [options] bucket\n");
     fprintf(stderr, "\ts3backer --reset-mounted-flag [options] bucket\n");
+    fprintf(stderr, "\ts3backer --migrateKeys --hashPrefix[=NUM] [options] bucket\n");
     fprintf(stderr, "Options:\n");
     fprintf(stderr, "\t--%-27s %s\n", "accessFile=FILE", "File containing `accessID:accessKey' pairs");
     fprintf(stderr, "\t--%-27s %s\n", "accessId=ID", "S3 access key ID");
@@ -1642,7 +2038,10 @@ usage(void)
     fprintf(stderr, "\n");
     fprintf(stderr, "\t--%-27s %s\n", "accessEC2IAM=ROLE", "Acquire S3 credentials from EC2 machine via IAM role");
     fprintf(stderr, "\t--%-27s %s\n", "baseURL=URL", "Base URL for all requests");
+    fprintf(stderr, "\t--%-27s %s\n", "blockCacheDedup", "Share memory between identical cached blocks");
     fprintf(stderr, "\t--%-27s %s\n", "blockCacheFile=FILE", "Block cache persistent file");
+    fprintf(stderr, "\t--%-27s %s\n", "blockCacheHotBlocks=NUM", "Max hot blocks to remember (zero = cache size)");
+    fprintf(stderr, "\t--%-27s %s\n", "blockCacheHotFile=FILE", "Save/prefetch hot blocks across restarts");
     fprintf(stderr, "\t--%-27s %s\n", "blockCacheMaxDirty=NUM", "Block cache maximum number of dirty blocks");
     fprintf(stderr, "\t--%-27s %s\n", "blockCacheNoVerify", "Disable verification of data loaded from cache file");
     fprintf(stderr, "\t--%-27s %s\n", "blockCacheSize=NUM", "Block cache size (in number of blocks)");
@@ -1653,25 +2052,42 @@ usage(void)
     fprintf(stderr, "\t--%-27s %s\n", "blockSize=SIZE", "Block size (with optional suffix 'K', 'M', 'G', etc.)");
     fprintf(stderr, "\t--%-27s %s\n", "cacert=FILE", "Specify SSL certificate authority file");
     fprintf(stderr, "\t--%-27s %s\n", "compress[=LEVEL]", "Enable block compression, with 1=fast up to 9=small");
+    fprintf(stderr, "\t--%-27s %s\n", "compressCodec=CODEC", "Compress blocks using `deflate', `zstd' or `lz4'");
+    fprintf(stderr, "\t--%-27s %s\n", "compressDict=FILE", "Use trained zstd dictionary from FILE");
+    fprintf(stderr, "\t--%-27s %s\n", "contentAddressed", "Store block content by hash; skip uploading duplicates");
+    fprintf(stderr, "\t--%-27s %s\n", "cryptoContexts=NUM", "Pre-keyed cipher contexts (max blocks encoded at once)");
     fprintf(stderr, "\t--%-27s %s\n", "debug", "Enable logging of debug messages");
     fprintf(stderr, "\t--%-27s %s\n", "debug-http", "Print HTTP headers to standard output");
+    fprintf(stderr, "\t--%-27s %s\n", "deleteBatch=NUM", "Max blocks deleted per request (0 = one at a time)");
     fprintf(stderr, "\t--%-27s %s\n", "directIO", "Disable kernel caching of the backed file");
     fprintf(stderr, "\t--%-27s %s\n", "encrypt[=CIPHER]", "Enable encryption (implies `--compress')");
+    fprintf(stderr, "\t--%-27s %s\n", "endpoints=HOST[:PORT],...", "Spread requests across these servers");
     fprintf(stderr, "\t--%-27s %s\n", "erase", "Erase all blocks in the filesystem");
     fprintf(stderr, "\t--%-27s %s\n", "fileMode=MODE", "Permissions of backed file in filesystem");
     fprintf(stderr, "\t--%-27s %s\n", "filename=NAME", "Name of backed file in filesystem");
     fprintf(stderr, "\t--%-27s %s\n", "force", "Ignore different auto-detected block and file sizes");
+    fprintf(stderr, "\t--%-27s %s\n", "hashPrefix[=NUM]", "Prefix block keys with NUM hex digits of a hash");
+    fprintf(stderr, "\t--%-27s %s\n", "hedgeBudget=PERCENT", "Max duplicate reads as a percentage of all reads");
+    fprintf(stderr, "\t--%-27s %s\n", "hedgePercentile=NUM", "Duplicate reads slower than this percentile (0 = never)");
     fprintf(stderr, "\t--%-27s %s\n", "help", "Show this information and exit");
+    fprintf(stderr, "\t--%-27s %s\n", "http2[=NUM]", "Multiplex requests over NUM shared HTTP/2 connections");
     fprintf(stderr, "\t--%-27s %s\n", "initialRetryPause=MILLIS", "Inital retry pause after stale data or server error");
     fprintf(stderr, "\t--%-27s %s\n", "insecure", "Don't verify SSL server identity");
     fprintf(stderr, "\t--%-27s %s\n", "keyLength", "Override generated cipher key length");
     fprintf(stderr, "\t--%-27s %s\n", "listBlocks", "Auto-detect non-empty blocks at startup");
+    fprintf(stderr, "\t--%-27s %s\n", "listBlocksThreads=NUM", "Number of threads listing the bucket concurrently");
     fprintf(stderr, "\t--%-27s %s\n", "maxDownloadSpeed=BITSPERSEC", "Max download bandwith for a single read");
     fprintf(stderr, "\t--%-27s %s\n", "maxRetryPause=MILLIS", "Max total pause after stale data or server error");
     fprintf(stderr, "\t--%-27s %s\n", "maxUploadSpeed=BITSPERSEC", "Max upload bandwith for a single write");
     fprintf(stderr, "\t--%-27s %s\n", "md5CacheSize=NUM", "Max size of MD5 cache (zero = disabled)");
     fprintf(stderr, "\t--%-27s %s\n", "md5CacheTime=MILLIS", "Expire time for MD5 cache (zero = infinite)");
+    fprintf(stderr, "\t--%-27s %s\n", "migrateKeys", "Move blocks from plain keys to hashed keys");
     fprintf(stderr, "\t--%-27s %s\n", "minWriteDelay=MILLIS", "Minimum time between same block writes");
+    fprintf(stderr, "\t--%-27s %s\n", "multipartSize=SIZE", "Transfer larger blocks in parts of SIZE (0 = never)");
+    fprintf(stderr, "\t--%-27s %s\n", "multipartThreads=NUM", "Max parts of one block transferred at once"
+      " (per block cache thread)");
+    fprintf(stderr, "\t--%-27s %s\n", "noRateGovernor", "Don't adapt request rates when S3 throttles requests");
+    fprintf(stderr, "\t--%-27s %s\n", "packFactor=NUM", "Number of consecutive blocks stored in each object");
     fprintf(stderr, "\t--%-27s %s\n", "password=PASSWORD", "Encrypt using PASSWORD");
     fprintf(stderr, "\t--%-27s %s\n", "passwordFile=FILE", "Encrypt using password read from FILE");
     fprintf(stderr, "\t--%-27s %s\n", "prefix=STRING", "Prefix for resource names within bucket");
@@ -1681,6 +2097,7 @@ usage(void)
     fprintf(stderr, "\t--%-27s %s\n", "readOnly", "Return `Read-only file system' error for write attempts");
     fprintf(stderr, "\t--%-27s %s\n", "region=region", "Specify AWS region");
     fprintf(stderr, "\t--%-27s %s\n", "reset-mounted-flag", "Reset `already mounted' flag in the filesystem");
+    fprintf(stderr, "\t--%-27s %s\n", "resolveEndpoints", "Spread requests across all addresses of the host");
     fprintf(stderr, "\t--%-27s %s\n", "rrs", "Target written blocks for Reduced Redundancy Storage");
     fprintf(stderr, "\t--%-27s %s\n", "size=SIZE", "File size (with optional suffix 'K', 'M', 'G', etc.)");
     fprintf(stderr, "\t--%-27s %s\n", "ssl", "Enable SSL");
@@ -1688,6 +2105,7 @@ usage(void)
     fprintf(stderr, "\t--%-27s %s\n", "test", "Run in local test mode (bucket is a directory)");
     fprintf(stderr, "\t--%-27s %s\n", "timeout=SECONDS", "Max time allowed for one HTTP operation");
     fprintf(stderr, "\t--%-27s %s\n", "timeout=SECONDS", "Specify HTTP operation timeout");
+    fprintf(stderr, "\t--%-27s %s\n", "unsignedPayload", "Don't include payload hash in aws4 signatures (requires SSL)");
     fprintf(stderr, "\t--%-27s %s\n", "version", "Show version information and exit");
     fprintf(stderr, "\t--%-27s %s\n", "vhost", "Use virtual host bucket style URL for all requests");
     fprintf(stderr, "Default values:\n");
@@ -1701,14 +2119,24 @@ usage(void)
     fprintf(stderr, "\t--%-27s %u\n", "blockCacheTimeout", S3BACKER_DEFAULT_BLOCK_CACHE_TIMEOUT);
     fprintf(stderr, "\t--%-27s %u\n", "blockCacheWriteDelay", S3BACKER_DEFAULT_BLOCK_CACHE_WRITE_DELAY);
     fprintf(stderr, "\t--%-27s %d\n", "blockSize", S3BACKER_DEFAULT_BLOCKSIZE);
+    fprintf(stderr, "\t--%-27s %s\n", "cryptoContexts", "Number of CPU cores");
+    fprintf(stderr, "\t--%-27s %u\n", "deleteBatch", S3BACKER_DEFAULT_DELETE_BATCH);
     fprintf(stderr, "\t--%-27s \"%s\"\n", "filename", S3BACKER_DEFAULT_FILENAME);
+    fprintf(stderr, "\t--%-27s %u\n", "hashPrefix", S3BACKER_DEFAULT_HASH_PREFIX);
+    fprintf(stderr, "\t--%-27s %u\n", "hedgeBudget", S3BACKER_DEFAULT_HEDGE_BUDGET);
+    fprintf(stderr, "\t--%-27s %u\n", "hedgePercentile", S3BACKER_DEFAULT_HEDGE_PERCENTILE);
+    fprintf(stderr, "\t--%-27s %u\n", "http2", S3BACKER_DEFAULT_HTTP2_CONNECTIONS);
     fprintf(stderr, "\t--%-27s %u\n", "initialRetryPause", S3BACKER_DEFAULT_INITIAL_RETRY_PAUSE);
+    fprintf(stderr, "\t--%-27s %u\n", "listBlocksThreads", S3BACKER_DEFAULT_LIST_BLOCKS_THREADS);
     fprintf(stderr, "\t--%-27s %u\n", "md5CacheSize", S3BACKER_DEFAULT_MD5_CACHE_SIZE);
     fprintf(stderr, "\t--%-27s %u\n", "md5CacheTime", S3BACKER_DEFAULT_MD5_CACHE_TIME);
     fprintf(stderr, "\t--%-27s 0%03o (0%03o if `--readOnly')\n", "fileMode",
       S3BACKER_DEFAULT_FILE_MODE, S3BACKER_DEFAULT_FILE_MODE_READ_ONLY);
     fprintf(stderr, "\t--%-27s %u\n", "maxRetryPause", S3BACKER_DEFAULT_MAX_RETRY_PAUSE);
     fprintf(stderr, "\t--%-27s %u\n", "minWriteDelay", S3BACKER_DEFAULT_MIN_WRITE_DELAY);
+    fprintf(stderr, "\t--%-27s %u\n", "multipartSize", S3BACKER_DEFAULT_MULTIPART_SIZE);
+    fprintf(stderr, "\t--%-27s %u\n", "multipartThreads", S3BACKER_DEFAULT_MULTIPART_THREADS);
+    fprintf(stderr, "\t--%-27s %u\n", "packFactor", S3BACKER_DEFAULT_PACK_FACTOR);
     fprintf(stderr, "\t--%-27s \"%s\"\n", "prefix", S3BACKER_DEFAULT_PREFIX);
     fprintf(stderr, "\t--%-27s %u\n", "readAhead", S3BACKER_DEFAULT_READ_AHEAD);
     fprintf(stderr, "\t--%-27s %u\n", "readAheadTrigger", S3BACKER_DEFAULT_READ_AHEAD_TRIGGER);
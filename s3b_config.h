@@ -41,6 +41,7 @@ struct s3b_config {
     int                         debug;
     int                         erase;
     int                         reset;
+    int                         migrate;
     int                         quiet;
     int                         force;
     int                         test;
@@ -53,6 +54,7 @@ struct s3b_config {
     /* These are only used during command line parsing */
     const char                  *file_size_str;
     const char                  *block_size_str;
+    const char                  *multipart_size_str;
     const char                  *password_file;
     const char                  *max_speed_str[2];
     int                         encrypt;
@@ -27,6 +27,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/queue.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 /* Add some queue.h definitions missing on Linux */
 #ifndef LIST_FIRST
@@ -50,8 +53,10 @@
 #include <errno.h>
 #include <expat.h>
 #include <fcntl.h>
+#include <netdb.h>
 #include <pthread.h>
 #include <regex.h>
+#include <sched.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -68,9 +73,16 @@
 #include <openssl/evp.h>
 #include <openssl/hmac.h>
 #include <openssl/md5.h>
+#include <openssl/rand.h>
 #include <openssl/sha.h>
 
 #include <zlib.h>
+#if HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+#if HAVE_LIBLZ4
+#include <lz4.h>
+#endif
 #include <fuse.h>
 
 #ifndef FUSE_OPT_KEY_DISCARD
@@ -124,6 +124,7 @@ test_io_read_block(struct s3backer_store *const s3b, s3b_block_t block_num, void
     struct http_io_conf *const config = priv->config;
     u_char md5[MD5_DIGEST_LENGTH];
     char path[PATH_MAX];
+    char name[PATH_MAX];
     int zero_block;
     MD5_CTX ctx;
     int fd;
@@ -143,7 +144,8 @@ test_io_read_block(struct s3backer_store *const s3b, s3b_block_t block_num, void
     }
 
     /* Generate path */
-    snprintf(path, sizeof(path), "%s/%s%0*jx", config->bucket, config->prefix, S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num);
+    http_io_get_block_name(name, sizeof(name), config, block_num);
+    snprintf(path, sizeof(path), "%s/%s", config->bucket, name);
 
     /* Read block */
     if ((fd = open(path, O_RDONLY)) != -1) {
@@ -228,6 +230,7 @@ test_io_write_block(struct s3backer_store *const s3b, s3b_block_t block_num, con
     u_char md5[MD5_DIGEST_LENGTH];
     char temp[PATH_MAX];
     char path[PATH_MAX];
+    char name[PATH_MAX];
     MD5_CTX ctx;
     int total;
     int fd;
@@ -265,7 +268,8 @@ test_io_write_block(struct s3backer_store *const s3b, s3b_block_t block_num, con
     }
 
     /* Generate path */
-    snprintf(path, sizeof(path), "%s/%s%0*jx", config->bucket, config->prefix, S3B_BLOCK_NUM_DIGITS, (uintmax_t)block_num);
+    http_io_get_block_name(name, sizeof(name), config, block_num);
+    snprintf(path, sizeof(path), "%s/%s", config->bucket, name);
 
     /* Delete zero blocks */
     if (src == NULL) {
@@ -35,6 +35,9 @@
 #define DELAY_RANGE     50
 #define READ_FACTOR     2
 #define ZERO_FACTOR     3
+#define BITMAP_BLOCKS   1000            // not a multiple of the bitmap word size, so the last word is partial
+#define BENCH_BLOCKS    20000           // blocks encrypted and signed per `--benchCrypto' round
+#define BENCH_SIZE      4096            // `--benchCrypto' block size; small blocks are where key setup matters
 
 /* Block states */
 struct block_state {
@@ -44,6 +47,14 @@ struct block_state {
 };
 
 /* Internal functions */
+static void bench_crypto(void);
+static double bench_crypto_round(int prekeyed, const u_char *key, const u_char *ivkey, u_char *src, u_char *dest);
+static void check_nonzero_encoding(void);
+static void check_nonzero_pattern(const char *name, int (*pattern)(off_t), u_int expect_encoding);
+static int pattern_sparse(off_t block_num);
+static int pattern_alternate(off_t block_num);
+static int pattern_all(off_t block_num);
+static int pattern_none(off_t block_num);
 static void *thread_main(void *arg);
 static void logit(int id, const char *fmt, ...) __attribute__ ((__format__ (__printf__, 2, 3)));
 static uint64_t get_time(void);
@@ -63,6 +74,19 @@ main(int argc, char **argv)
     int i;
     int r;
 
+    /* Compare per-block key setup against pre-keyed contexts, then exit */
+    if (argc == 2 && strcmp(argv[1], "--benchCrypto") == 0) {
+        bench_crypto();
+        return 0;
+    }
+
+    /* Check the saved non-zero block bitmap encodings, then exit */
+    if (argc == 2 && strcmp(argv[1], "--checkNonzero") == 0) {
+        check_nonzero_encoding();
+        printf("non-zero block bitmap encodings OK\n");
+        return 0;
+    }
+
     /* Get configuration */
     if ((config = s3backer_get_config(argc, argv)) == NULL)
         exit(1);
@@ -102,6 +126,193 @@ main(int argc, char **argv)
     return 0;
 }
 
+/*
+ * Time encrypting and signing blocks the way http_io.c does with the default cipher, first keying new
+ * contexts for every block, then reusing contexts keyed once and resetting only the IV for each block.
+ */
+static void
+bench_crypto(void)
+{
+    u_char key[EVP_MAX_KEY_LENGTH];
+    u_char ivkey[EVP_MAX_KEY_LENGTH];
+    u_char *src;
+    u_char *dest;
+    double fresh;
+    double prekeyed;
+
+    /* Initialize */
+    if ((src = malloc(BENCH_SIZE)) == NULL || (dest = malloc(BENCH_SIZE + EVP_MAX_BLOCK_LENGTH)) == NULL)
+        err(1, "malloc");
+    if (RAND_bytes(key, sizeof(key)) != 1 || RAND_bytes(ivkey, sizeof(ivkey)) != 1 || RAND_bytes(src, BENCH_SIZE) != 1)
+        errx(1, "RAND_bytes() failed");
+
+    /* Warm up, then time both ways */
+    bench_crypto_round(0, key, ivkey, src, dest);
+    fresh = bench_crypto_round(0, key, ivkey, src, dest);
+    prekeyed = bench_crypto_round(1, key, ivkey, src, dest);
+    printf("%u %u byte blocks, AES-128-CBC + HMAC-SHA1\n", BENCH_BLOCKS, BENCH_SIZE);
+    printf("%-28s %.3f usec/block\n", "keyed per block", fresh * 1e6 / BENCH_BLOCKS);
+    printf("%-28s %.3f usec/block\n", "pre-keyed", prekeyed * 1e6 / BENCH_BLOCKS);
+    printf("%-28s %.2fx\n", "speedup", prekeyed > 0 ? fresh / prekeyed : 0.0);
+    free(dest);
+    free(src);
+}
+
+static double
+bench_crypto_round(int prekeyed, const u_char *key, const u_char *ivkey, u_char *src, u_char *dest)
+{
+    const EVP_CIPHER *const cipher = EVP_aes_128_cbc();
+    EVP_CIPHER_CTX iv_ctx;
+    EVP_CIPHER_CTX ctx;
+    HMAC_CTX hmac_ctx;
+    u_char ivec[EVP_MAX_IV_LENGTH];
+    u_char blockbuf[EVP_MAX_IV_LENGTH];
+    u_char hmac[EVP_MAX_MD_SIZE];
+    struct timespec start;
+    struct timespec stop;
+    u_int hmac_len;
+    int clen;
+    int i;
+
+    /* Key the contexts once up front, if reusing them */
+    EVP_CIPHER_CTX_init(&iv_ctx);
+    EVP_CIPHER_CTX_init(&ctx);
+    HMAC_CTX_init(&hmac_ctx);
+    if (prekeyed) {
+        EVP_EncryptInit_ex(&iv_ctx, cipher, NULL, ivkey, ivkey);
+        EVP_CIPHER_CTX_set_padding(&iv_ctx, 0);
+        EVP_EncryptInit_ex(&ctx, cipher, NULL, key, NULL);
+        HMAC_Init_ex(&hmac_ctx, key, EVP_CIPHER_key_length(cipher), EVP_sha1(), NULL);
+    }
+
+    /* Encrypt and sign each block */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < BENCH_BLOCKS; i++) {
+
+        /* Derive the IV from the block number */
+        memset(blockbuf, 0, sizeof(blockbuf));
+        snprintf((char *)blockbuf, sizeof(blockbuf), "%0*jx", S3B_BLOCK_NUM_DIGITS, (uintmax_t)i);
+        if (prekeyed)
+            EVP_EncryptInit_ex(&iv_ctx, NULL, NULL, NULL, ivkey);
+        else {
+            EVP_EncryptInit_ex(&iv_ctx, cipher, NULL, ivkey, ivkey);
+            EVP_CIPHER_CTX_set_padding(&iv_ctx, 0);
+        }
+        EVP_EncryptUpdate(&iv_ctx, ivec, &clen, blockbuf, EVP_CIPHER_CTX_block_size(&iv_ctx));
+        EVP_EncryptFinal_ex(&iv_ctx, NULL, &clen);
+
+        /* Encrypt */
+        EVP_EncryptInit_ex(&ctx, prekeyed ? NULL : cipher, NULL, prekeyed ? NULL : key, ivec);
+        EVP_EncryptUpdate(&ctx, dest, &clen, src, BENCH_SIZE);
+        EVP_EncryptFinal_ex(&ctx, dest + clen, &clen);
+
+        /* Sign */
+        if (prekeyed)
+            HMAC_Init_ex(&hmac_ctx, NULL, 0, NULL, NULL);
+        else
+            HMAC_Init_ex(&hmac_ctx, key, EVP_CIPHER_key_length(cipher), EVP_sha1(), NULL);
+        HMAC_Update(&hmac_ctx, blockbuf, strlen((char *)blockbuf));
+        HMAC_Update(&hmac_ctx, dest, BENCH_SIZE);
+        HMAC_Final(&hmac_ctx, hmac, &hmac_len);
+
+        /* Without pre-keying, every block gets new contexts */
+        if (!prekeyed) {
+            EVP_CIPHER_CTX_cleanup(&iv_ctx);
+            EVP_CIPHER_CTX_cleanup(&ctx);
+            HMAC_CTX_cleanup(&hmac_ctx);
+            EVP_CIPHER_CTX_init(&iv_ctx);
+            EVP_CIPHER_CTX_init(&ctx);
+            HMAC_CTX_init(&hmac_ctx);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    /* Clean up */
+    EVP_CIPHER_CTX_cleanup(&iv_ctx);
+    EVP_CIPHER_CTX_cleanup(&ctx);
+    HMAC_CTX_cleanup(&hmac_ctx);
+    return (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/*
+ * Verify that non-zero block bitmaps survive encoding and decoding, using both the run-length and raw encodings.
+ */
+static void
+check_nonzero_encoding(void)
+{
+    check_nonzero_pattern("sparse", pattern_sparse, NONZERO_ENCODING_RLE);
+    check_nonzero_pattern("alternate", pattern_alternate, NONZERO_ENCODING_RAW);
+    check_nonzero_pattern("all", pattern_all, NONZERO_ENCODING_RLE);
+    check_nonzero_pattern("none", pattern_none, NONZERO_ENCODING_RLE);
+}
+
+static void
+check_nonzero_pattern(const char *name, int (*pattern)(off_t), u_int expect_encoding)
+{
+    const int bits_per_word = sizeof(u_int) * 8;
+    const size_t num_words = (BITMAP_BLOCKS + bits_per_word - 1) / bits_per_word;
+    const size_t raw_size = (BITMAP_BLOCKS + 7) / 8;
+    u_int bitmap[num_words];
+    u_int decoded[num_words];
+    u_char buf[raw_size];
+    struct http_io_conf conf;
+    uint64_t expect_count;
+    uint64_t count;
+    u_int encoding;
+    size_t len;
+    off_t i;
+
+    /* Build bitmap */
+    memset(&conf, 0, sizeof(conf));
+    conf.num_blocks = BITMAP_BLOCKS;
+    memset(bitmap, 0, sizeof(bitmap));
+    for (expect_count = 0, i = 0; i < BITMAP_BLOCKS; i++) {
+        if ((*pattern)(i)) {
+            bitmap[i / bits_per_word] |= 1 << (i % bits_per_word);
+            expect_count++;
+        }
+    }
+
+    /* Encode it, and check the expected encoding was chosen */
+    if ((count = http_io_encode_nonzero(&conf, bitmap, buf, raw_size, &len, &encoding)) != expect_count)
+        errx(1, "non-zero bitmap \"%s\": encoded %ju bits != %ju", name, (uintmax_t)count, (uintmax_t)expect_count);
+    if (encoding != expect_encoding)
+        errx(1, "non-zero bitmap \"%s\": got encoding %u != %u", name, encoding, expect_encoding);
+
+    /* Decode it, and check we get back what we started with */
+    memset(decoded, 0, sizeof(decoded));
+    if ((count = http_io_decode_nonzero(&conf, encoding, buf, len, decoded)) != expect_count)
+        errx(1, "non-zero bitmap \"%s\": decoded %ju bits != %ju", name, (uintmax_t)count, (uintmax_t)expect_count);
+    if (memcmp(decoded, bitmap, sizeof(bitmap)) != 0)
+        errx(1, "non-zero bitmap \"%s\": decoded bitmap differs", name);
+}
+
+static int
+pattern_sparse(off_t block_num)
+{
+    return block_num < 10 || block_num == 500 || block_num == BITMAP_BLOCKS - 1;
+}
+
+static int
+pattern_alternate(off_t block_num)
+{
+    return block_num % 2 == 0;
+}
+
+static int
+pattern_all(off_t block_num)
+{
+    (void)block_num;
+    return 1;
+}
+
+static int
+pattern_none(off_t block_num)
+{
+    (void)block_num;
+    return 0;
+}
+
 static void *
 thread_main(void *arg)
 {